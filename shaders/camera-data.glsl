@@ -0,0 +1,10 @@
+// Camera uniform block, shared by every pass. Must match CameraData in vec.hpp.
+layout(std140) uniform CameraData
+{
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    mat4 invViewMatrix;
+    mat4 invProjectionMatrix;
+    mat4 shadowMatrix;
+    vec4 camPosition;
+};
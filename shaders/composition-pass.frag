@@ -60,15 +60,7 @@ layout(std140) uniform Material
     float shininess;
 } material;
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 uniform int       u_HasSolid;
 uniform sampler2D u_SolidDepthMap;
@@ -88,13 +80,15 @@ uniform sampler2D u_FluidShadowThickness[NUM_TOTAL_LIGHTS];
 
 uniform float u_ReflectionConstant;
 uniform float u_AttennuationConstant;
-uniform int   u_TransparentFluid;
 
 // fluidity
 uniform float uMinShadowBias;
 uniform float uMaxShadowBias;
 uniform float uRefractionModifier;
-uniform int uUseRefractionMask;
+
+// Fluid buffers are rendered at a lower resolution than this pass
+uniform int   u_UpsampleFluid;
+uniform float u_UpsampleDepthSigma;
 
 // in/out
 in vec2  f_TexCoord;
@@ -153,11 +147,87 @@ vec3 computeAttennuation(float thickness)
 }
 
 
+bool isBackgroundDepth(float eyeDepth)
+{
+    return eyeDepth > 0.0f || eyeDepth < -1000.0f;
+}
+
+// Joint bilateral upsampling of the low resolution fluid buffers.
+// The full resolution solid depth rejects samples hidden behind meshes at this pixel,
+// and the range weight keeps samples from different fluid layers from being averaged.
+void upsampleFluid(vec2 texCoord, float solidDepth, out float eyeDepth, out float thickness, out vec3 N)
+{
+    ivec2 lowResSize = textureSize(u_DepthTex, 0);
+    vec2  lowResPos  = texCoord * vec2(lowResSize) - 0.5;
+    ivec2 base       = ivec2(floor(lowResPos));
+    vec2  f          = lowResPos - vec2(base);
+
+    const ivec2 offsets[4] = ivec2[](ivec2(0, 0), ivec2(1, 0), ivec2(0, 1), ivec2(1, 1));
+    float bilinear[4] = float[](
+        (1.0 - f.x) * (1.0 - f.y), f.x * (1.0 - f.y),
+        (1.0 - f.x) * f.y,         f.x * f.y);
+
+    ivec2 coords[4];
+    float depths[4];
+    bool  valid[4];
+    float coverage  = 0.0;
+    float refDepth  = 0.0;
+    float refWeight = -1.0;
+    for(int i = 0; i < 4; ++i) {
+        coords[i] = clamp(base + offsets[i], ivec2(0), lowResSize - 1);
+        depths[i] = texelFetch(u_DepthTex, coords[i], 0).r;
+        valid[i]  = !isBackgroundDepth(depths[i]) && depths[i] >= solidDepth + DEPTH_BIAS;
+        if(valid[i]) {
+            coverage += bilinear[i];
+            if(bilinear[i] > refWeight) {
+                refWeight = bilinear[i];
+                refDepth  = depths[i];
+            }
+        }
+    }
+
+    // Most of the footprint is background (or behind a mesh): keep the silhouette sharp
+    if(coverage < 0.5) {
+        eyeDepth  = -1e6;
+        thickness = 0.0;
+        N         = vec3(0, 0, 1);
+        return;
+    }
+
+    float twoSigma2 = 2.0 * u_UpsampleDepthSigma * u_UpsampleDepthSigma;
+    float wsum      = 0.0;
+    eyeDepth  = 0.0;
+    thickness = 0.0;
+    N         = vec3(0.0);
+    for(int i = 0; i < 4; ++i) {
+        if(!valid[i]) continue;
+        float dz = depths[i] - refDepth;
+        float w  = bilinear[i] * exp(-dz * dz / twoSigma2) + 1e-6;
+        eyeDepth  += w * depths[i];
+        thickness += w * texelFetch(u_ThicknessTex, coords[i], 0).r;
+        N         += w * texelFetch(u_NormalTex, coords[i], 0).xyz;
+        wsum      += w;
+    }
+
+    eyeDepth  /= wsum;
+    thickness /= wsum;
+    N          = length(N) > 0.0 ? normalize(N) : vec3(0, 0, 1);
+}
+
 const int lightID = 0;
 //-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
 void main()
 {
-    float eyeDepth  = texture(u_DepthTex, f_TexCoord).r;
+    float eyeDepth;
+    float thickness;
+    vec3  N;
+    if(u_UpsampleFluid == 1) {
+        upsampleFluid(f_TexCoord, texture(u_SolidDepthMap, f_TexCoord).r, eyeDepth, thickness, N);
+    } else {
+        eyeDepth  = texture(u_DepthTex, f_TexCoord).r;
+        thickness = texture(u_ThicknessTex, f_TexCoord).r;
+        N         = texture(u_NormalTex, f_TexCoord).xyz;
+    }
     vec3  backColor = texture(u_BackgroundTex, f_TexCoord).xyz;
     if(u_HasSolid == 1) {
 #ifdef FIXED_SPOT
@@ -184,9 +254,6 @@ void main()
         }
     }
 
-    vec3  N         = texture(u_NormalTex, f_TexCoord).xyz;
-    float thickness = texture(u_ThicknessTex, f_TexCoord).r;
-
     vec3 position = uvToEye(f_TexCoord, eyeDepth);
     vec3 viewer   = normalize(-position.xyz);
 
@@ -238,10 +305,9 @@ void main()
     }
 #endif
 
-    if(u_TransparentFluid == 0) {
-        fragColor = vec4(vec3(material.ambient + material.diffuse * diffuse + vec4(0, 0, 0.2, 0) + material.specular * specular) * shadowColor, 1.0);
-        return;
-    }
+#ifndef TRANSPARENT_FLUID
+    fragColor = vec4(vec3(material.ambient + material.diffuse * diffuse + vec4(0, 0, 0.2, 0) + material.specular * specular) * shadowColor, 1.0);
+#else
 
     //Fresnel Reflection
     float fresnelRatio    = clamp(F + (1.0 - F) * pow((1.0 - dot(viewer, N)), fresnelPower), 0, 1);
@@ -255,7 +321,7 @@ void main()
     vec2 refractionDisplacement = refractionDir.xy * uRefractionModifier * thickness * u_AttennuationConstant * 0.1f;
 
     // GPU Gems 2 - Refraction mask
-    if (uUseRefractionMask == 1)
+#ifdef USE_REFRACTION_MASK
     {
         bool validDisplacement = false;
         for (int i = 0; i < 5; i++)
@@ -276,6 +342,7 @@ void main()
             if (!validDisplacement) refractionDisplacement = vec2(0);
         }
     }
+#endif
 
     vec3 refractionColor = colorAttennuation * texture(u_BackgroundTex, f_TexCoord + refractionDisplacement).xyz;
 
@@ -283,4 +350,5 @@ void main()
     vec3 finalColor = (mix(refractionColor, reflectionColor, fresnelRatio) + specular * material.specular.xyz) * shadowColor;
 
     fragColor = vec4(finalColor, 1);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,109 @@
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//                                .--,       .--,
+//                               ( (  \.---./  ) )
+//                                '.__/o   o\__.'
+//                                   {=  ^  =}
+//                                    >  -  <
+//     ___________________________.""`-------`"".____________________________
+//    /                                                                      \
+//    \    This file is part of Banana - a graphics programming framework    /
+//    /                    Created: 2018 by Nghia Truong                     \
+//    \                      <nghiatruong.vn@gmail.com>                      /
+//    /                      https://ttnghia.github.io                       \
+//    \                        All rights reserved.                          /
+//    /                                                                      \
+//    \______________________________________________________________________/
+//                                  ___)( )(___
+//                                 (((__) (__)))
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// fragment shader, depth and thickness pass (depth-pass.frag and thickness-pass.frag in one draw)
+// Depth is resolved with GL_MAX blending (closest surface has the largest eye space z),
+// thickness is additive. Fragments outside one of the sprites write the identity of its blend.
+#version 410 core
+
+#include "camera-data.glsl"
+
+uniform float u_PointRadius;
+uniform float u_ThicknessRadius;
+uniform int   u_ScreenWidth;
+uniform int   u_ScreenHeight;
+
+in vec3        f_ViewCenter;
+flat in mat3   f_AnisotropyMatrix;
+flat in float  f_DepthSpriteScale;
+flat in float  f_ThicknessSpriteScale;
+
+layout(location = 0) out float outDepth;
+layout(location = 1) out float outThick;
+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// Returns false if the fragment is outside of the particle
+bool ComputeFragmentPosition(vec2 spriteCoord, out vec3 fragPos)
+{
+    vec3 normal;
+
+#ifndef USE_ANISOTROPY_KERNEL
+    {
+        normal.xy = spriteCoord;
+        float mag = dot(normal.xy, normal.xy);
+
+        if(mag > 1.0) {
+            return false;      // outside circle
+        }
+        normal.z = sqrt(1.0 - mag);
+        fragPos  = f_ViewCenter + normal * u_PointRadius;
+    }
+#else
+    {
+        vec3 fc = gl_FragCoord.xyz;
+        fc.xy /= vec2(u_ScreenWidth, u_ScreenHeight);
+        fc    *= 2.0;
+        fc    -= 1.0;
+
+        vec4 worldPos = invProjectionMatrix * vec4(fc, 1.0);
+        vec3 rayDir   = vec3(worldPos) / worldPos.w;
+
+        mat3 transMatrix    = mat3(viewMatrix) * f_AnisotropyMatrix * u_PointRadius;
+        mat3 transInvMatrix = inverse(transMatrix);
+
+        vec3 camT    = transInvMatrix * vec3(0, 0, 0);
+        vec3 centerT = transInvMatrix * f_ViewCenter;
+        vec3 rayDirT = normalize(transInvMatrix * rayDir);
+
+        // solve the ray-sphere intersection
+        float tmp   = dot(rayDirT, camT - centerT);
+        float delta = tmp * tmp - dot(camT - centerT, camT - centerT) + 1.0;
+        if(delta < 0.0) {
+            return false;      // outside circle in parameter space
+        }
+        float d                  = -tmp - sqrt(delta);
+        vec3  intersectionPointT = camT + rayDirT * d;
+        fragPos = transMatrix * intersectionPointT;
+    }
+#endif
+
+    return true;
+}
+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+void main()
+{
+    vec2 pointCoord = gl_PointCoord.xy * vec2(2.0, -2.0) + vec2(-1.0, 1.0);
+
+    vec3 fragPos;
+    bool insideDepth = ComputeFragmentPosition(pointCoord * f_DepthSpriteScale, fragPos);
+
+    vec2  N   = pointCoord * f_ThicknessSpriteScale;
+    float mag = dot(N, N);
+
+    if(!insideDepth && mag > 1.0) {
+        discard;
+    }
+
+    // Same as the clear value
+    float minusInfinity = uintBitsToFloat(0xff800000u);
+    outDepth = insideDepth ? fragPos.z : minusInfinity;
+    outThick = (mag > 1.0) ? 0.0 : 2.0 * u_ThicknessRadius * sqrt(1.0 - mag) / 8.0f;
+}
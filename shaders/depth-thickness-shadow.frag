@@ -0,0 +1,125 @@
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//                                .--,       .--,
+//                               ( (  \.---./  ) )
+//                                '.__/o   o\__.'
+//                                   {=  ^  =}
+//                                    >  -  <
+//     ___________________________.""`-------`"".____________________________
+//    /                                                                      \
+//    \    This file is part of Banana - a graphics programming framework    /
+//    /                    Created: 2018 by Nghia Truong                     \
+//    \                      <nghiatruong.vn@gmail.com>                      /
+//    /                      https://ttnghia.github.io                       \
+//    \                        All rights reserved.                          /
+//    /                                                                      \
+//    \______________________________________________________________________/
+//                                  ___)( )(___
+//                                 (((__) (__)))
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// fragment shader, fluid shadow and thickness shadow pass (fluid-shadow.fs and thickness-shadow.frag
+// in one draw)
+// Depth is resolved with GL_MIN blending (window space depth), thickness is additive.
+// Fragments outside one of the sprites write the identity of its blend.
+#version 410 core
+#define NUM_TOTAL_LIGHTS 8
+
+struct LightMatrix
+{
+    mat4 viewMatrix;
+    mat4 prjMatrix;
+};
+
+layout(std140) uniform LightMatrices
+{
+    LightMatrix lightMatrices[NUM_TOTAL_LIGHTS];
+};
+
+uniform int   u_LightID;
+uniform float u_PointRadius;
+uniform float u_ThicknessRadius;
+uniform int   u_ScreenWidth;
+uniform int   u_ScreenHeight;
+
+in vec3       f_ViewCenter;
+flat in mat3  f_AnisotropyMatrix;
+flat in mat4  invPrjMatrix;
+flat in float f_DepthSpriteScale;
+flat in float f_ThicknessSpriteScale;
+
+layout(location = 0) out float outDepth;
+layout(location = 1) out float outThick;
+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// Returns false if the fragment is outside of the particle
+bool ComputeFragmentPosition(vec2 spriteCoord, out vec3 fragPos)
+{
+    vec3 normal;
+
+#ifndef USE_ANISOTROPY_KERNEL
+    {
+        normal.xy = spriteCoord;
+        float mag = dot(normal.xy, normal.xy);
+
+        if(mag > 1.0) {
+            return false;      // outside circle
+        }
+        normal.z = sqrt(1.0 - mag);
+        fragPos  = f_ViewCenter + normal * u_PointRadius;
+    }
+#else
+    {
+        vec3 fc = gl_FragCoord.xyz;
+        fc.xy /= vec2(u_ScreenWidth, u_ScreenHeight);
+        fc    *= 2.0;
+        fc    -= 1.0;
+
+        vec4 worldPos = invPrjMatrix * vec4(fc, 1.0);
+        vec3 rayDir   = vec3(worldPos) / worldPos.w;
+
+        mat3 transMatrix    = mat3(lightMatrices[u_LightID].viewMatrix) * f_AnisotropyMatrix * u_PointRadius;
+        mat3 transInvMatrix = inverse(transMatrix);
+
+        vec3 camT    = transInvMatrix * vec3(0, 0, 0);
+        vec3 centerT = transInvMatrix * f_ViewCenter;
+        vec3 rayDirT = normalize(transInvMatrix * rayDir);
+
+        // solve the ray-sphere intersection
+        float tmp   = dot(rayDirT, camT - centerT);
+        float delta = tmp * tmp - dot(camT - centerT, camT - centerT) + 1.0;
+        if(delta < 0.0) {
+            return false;      // outside circle in parameter space
+        }
+        float d                  = -tmp - sqrt(delta);
+        vec3  intersectionPointT = camT + rayDirT * d;
+        fragPos = transMatrix * intersectionPointT;
+    }
+#endif
+
+    return true;
+}
+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+void main()
+{
+    vec2 pointCoord = gl_PointCoord.xy * vec2(2.0, -2.0) + vec2(-1.0, 1.0);
+
+    vec3 fragPos;
+    bool insideDepth = ComputeFragmentPosition(pointCoord * f_DepthSpriteScale, fragPos);
+
+    vec2  N   = pointCoord * f_ThicknessSpriteScale;
+    float mag = dot(N, N);
+
+    if(!insideDepth && mag > 1.0) {
+        discard;
+    }
+
+    if(insideDepth) {
+        vec4 clipSpacePos = lightMatrices[u_LightID].prjMatrix * vec4(fragPos, 1.0);
+        outDepth = (clipSpacePos.z / clipSpacePos.w) * 0.5 + 0.5;
+    } else {
+        outDepth = 1.0;
+    }
+    outThick = (mag > 1.0) ? 0.0 : 2.0 * u_ThicknessRadius * sqrt(1.0 - mag) / 2.0;
+}
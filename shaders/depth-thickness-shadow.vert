@@ -0,0 +1,121 @@
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//                                .--,       .--,
+//                               ( (  \.---./  ) )
+//                                '.__/o   o\__.'
+//                                   {=  ^  =}
+//                                    >  -  <
+//     ___________________________.""`-------`"".____________________________
+//    /                                                                      \
+//    \    This file is part of Banana - a graphics programming framework    /
+//    /                    Created: 2018 by Nghia Truong                     \
+//    \                      <nghiatruong.vn@gmail.com>                      /
+//    /                      https://ttnghia.github.io                       \
+//    \                        All rights reserved.                          /
+//    /                                                                      \
+//    \______________________________________________________________________/
+//                                  ___)( )(___
+//                                 (((__) (__)))
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+// vertex shader, fluid shadow and thickness shadow pass (fluid-shadow.vs and thickness-shadow.vert
+// in one draw)
+#version 410 core
+#define NUM_TOTAL_LIGHTS 8
+
+struct LightMatrix
+{
+    mat4 viewMatrix;
+    mat4 prjMatrix;
+};
+
+layout(std140) uniform LightMatrices
+{
+    LightMatrix lightMatrices[NUM_TOTAL_LIGHTS];
+};
+
+uniform int   u_LightID;
+uniform float u_PointRadius;
+uniform float u_ThicknessRadius;
+uniform float u_PointScale;
+uniform int   u_ScreenWidth;
+uniform int   u_ScreenHeight;
+
+in vec3 v_Position;
+in vec3 v_AnisotropyMatrix0;
+in vec3 v_AnisotropyMatrix1;
+in vec3 v_AnisotropyMatrix2;
+
+out vec3       f_ViewCenter;
+flat out mat3  f_AnisotropyMatrix;
+flat out mat4  invPrjMatrix;
+// Both sprites share gl_PointSize, which is the largest one. These map gl_PointCoord to each sprite.
+flat out float f_DepthSpriteScale;
+flat out float f_ThicknessSpriteScale;
+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+const mat4 D = mat4(1., 0., 0., 0.,
+                    0., 1., 0., 0.,
+                    0., 0., 1., 0.,
+                    0., 0., 0., -1.);
+
+float ComputePointSize(mat4 T)
+{
+    vec2 xbc;
+    vec2 ybc;
+
+    mat4  R = transpose(lightMatrices[u_LightID].prjMatrix * lightMatrices[u_LightID].viewMatrix * T);
+    float A = dot(R[ 3 ], D * R[ 3 ]);
+    float B = -2. * dot(R[ 0 ], D * R[ 3 ]);
+    float C = dot(R[ 0 ], D * R[ 0 ]);
+    xbc[ 0 ] = (-B - sqrt(B * B - 4. * A * C)) / (2.0 * A);
+    xbc[ 1 ] = (-B + sqrt(B * B - 4. * A * C)) / (2.0 * A);
+    float sx = abs(xbc[ 0 ] - xbc[ 1 ]) * .5 * u_ScreenWidth;
+
+    A        = dot(R[ 3 ], D * R[ 3 ]);
+    B        = -2. * dot(R[ 1 ], D * R[ 3 ]);
+    C        = dot(R[ 1 ], D * R[ 1 ]);
+    ybc[ 0 ] = (-B - sqrt(B * B - 4. * A * C)) / (2.0 * A);
+    ybc[ 1 ] = (-B + sqrt(B * B - 4. * A * C)) / (2.0 * A);
+    float sy = abs(ybc[ 0 ] - ybc[ 1 ]) * .5 * u_ScreenHeight;
+
+    return ceil(max(sx, sy));
+}
+
+//-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+-+
+void main()
+{
+    vec4  eyeCoord = lightMatrices[u_LightID].viewMatrix * vec4(v_Position, 1.0);
+    vec3  posEye   = vec3(eyeCoord);
+    float dist     = length(posEye);
+
+#ifndef USE_ANISOTROPY_KERNEL
+    mat4 T = mat4(u_PointRadius, 0, 0, 0,
+                  0, u_PointRadius, 0, 0,
+                  0, 0, u_PointRadius, 0,
+                  v_Position.x, v_Position.y, v_Position.z, 1.0);
+#else
+    mat4 T = mat4(v_AnisotropyMatrix0[0] * u_PointRadius, v_AnisotropyMatrix0[1] * u_PointRadius, v_AnisotropyMatrix0[2] * u_PointRadius, 0,
+                  v_AnisotropyMatrix1[0] * u_PointRadius, v_AnisotropyMatrix1[1] * u_PointRadius, v_AnisotropyMatrix1[2] * u_PointRadius, 0,
+                  v_AnisotropyMatrix2[0] * u_PointRadius, v_AnisotropyMatrix2[1] * u_PointRadius, v_AnisotropyMatrix2[2] * u_PointRadius, 0,
+                  v_Position.x, v_Position.y, v_Position.z, 1.0);
+#endif
+
+    float depthPointSize     = ComputePointSize(T);
+    float thicknessPointSize = u_ThicknessRadius * (u_PointScale / dist) * 4.0f;
+    gl_PointSize = max(depthPointSize, thicknessPointSize);
+
+    /////////////////////////////////////////////////////////////////
+    // output
+    f_ViewCenter           = eyeCoord.xyz;
+#ifndef USE_ANISOTROPY_KERNEL
+    f_AnisotropyMatrix     = mat3(0);
+#else
+    f_AnisotropyMatrix     = mat3(v_AnisotropyMatrix0, v_AnisotropyMatrix1, v_AnisotropyMatrix2);
+#endif
+    invPrjMatrix           = inverse(lightMatrices[u_LightID].prjMatrix);
+    f_DepthSpriteScale     = gl_PointSize / max(depthPointSize, 1e-6);
+    f_ThicknessSpriteScale = gl_PointSize / max(thicknessPointSize, 1e-6);
+
+    gl_Position = lightMatrices[u_LightID].prjMatrix * eyeCoord;
+}
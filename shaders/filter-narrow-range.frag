@@ -26,15 +26,7 @@
 
 #define PI_OVER_8 0.392699082f
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 uniform sampler2D u_DepthTex;
 uniform float     u_ParticleRadius;
@@ -43,8 +35,8 @@ uniform int       u_MaxFilterSize;
 uniform int       u_ScreenWidth;
 uniform int       u_ScreenHeight;
 
-// u_DoFilter1D = 1, 0, and -1 (-1 mean filter2D with fixed radius)
-uniform int u_DoFilter1D;
+// Filters in 1D when FILTER_1D is defined, otherwise in 2D. Defining FIXED_FILTER_RADIUS
+// filters in 2D with a fixed radius.
 uniform int u_FilterDirection;
 
 in vec2   f_TexCoord;
@@ -171,7 +163,11 @@ float filter2D(float pixelDepth)
     float threshold  = u_ParticleRadius * thresholdRatio;
     float ratio      = u_ScreenHeight / 2.0 / tan(PI_OVER_8);
     float K          = -u_FilterSize * ratio * u_ParticleRadius * 0.1f;
-    int   filterSize = (u_DoFilter1D < 0) ? fixedFilterRadius : min(u_MaxFilterSize, int(ceil(K / pixelDepth)));
+#ifdef FIXED_FILTER_RADIUS
+    int   filterSize = fixedFilterRadius;
+#else
+    int   filterSize = min(u_MaxFilterSize, int(ceil(K / pixelDepth)));
+#endif
 
     float upper       = pixelDepth + threshold;
     float lower       = pixelDepth - threshold;
@@ -233,6 +229,10 @@ void main()
     if(pixelDepth > 0.0 || pixelDepth < -1000.0f) {
         outDepth = pixelDepth;
     } else {
-        outDepth = (u_DoFilter1D == 1) ? filter1D(pixelDepth) : filter2D(pixelDepth);
+#ifdef FILTER_1D
+        outDepth = filter1D(pixelDepth);
+#else
+        outDepth = filter2D(pixelDepth);
+#endif
     }
 }
@@ -1,4 +1,5 @@
 #version 450
+#extension GL_ARB_shader_draw_parameters : enable
 
 in  vec3 vPos;
 out vec4 fFragPos;
@@ -15,11 +16,35 @@ layout(std140) uniform LightMatrices
     LightMatrix lightMatrices[NUM_TOTAL_LIGHTS];
 };
 
-uniform mat4 uLightMatrix;
-uniform mat4 model;
+// Per draw data, written by MeshBatch
+struct DrawData
+{
+    mat4  model;
+    vec4  diffuse;
+    vec4  specular; // w: shininess
+    float reflectiveness;
+    int   emissive;
+    int   invertNormals;
+    int   padding;
+};
+
+layout(std430, binding = 0) readonly buffer DrawDataBuffer
+{
+    DrawData draws[];
+};
+
+// Index of the first draw of the current (multi) draw call
+uniform int u_DrawOffset;
+
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID (u_DrawOffset + gl_DrawIDARB)
+#else
+#define DRAW_ID u_DrawOffset
+#endif
 
 void main()
 {
+    mat4 model = draws[DRAW_ID].model;
     fFragPos = lightMatrices[0].prjMatrix * lightMatrices[0].viewMatrix * model * vec4(vPos, 1.0);
     gl_Position = fFragPos;
 }
\ No newline at end of file
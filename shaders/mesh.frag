@@ -15,15 +15,7 @@ layout(std140) uniform Lights
     int        u_NumLights;
 };
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 in vec3 fNormal;
 in vec3 fFragPos;
@@ -39,20 +31,18 @@ uniform samplerCube uSkybox;
 uniform sampler2D uFluidShadowMap;
 uniform sampler2D uFluidShadowThicknessMap;
 
-uniform int uRenderShadows;
 uniform int uRenderFluidShadows;
 uniform float uMinShadowBias;
 uniform float uMaxShadowBias;
 uniform float uShadowIntensity;
 uniform float uFluidShadowIntensity;
-uniform int   uUsePcf;
 
 // Material
-uniform vec3  uDiffuse;
-uniform vec3  uSpecular;
-uniform float uShininess;
-uniform int   uEmissive;
-uniform float uReflectiveness;
+flat in vec3  fDiffuse;
+flat in vec3  fSpecular;
+flat in float fShininess;
+flat in int   fEmissive;
+flat in float fReflectiveness;
 
 float calculateAttenuation(vec3 fragPos, vec3 lightPos)
 {
@@ -186,16 +176,18 @@ void main()
 
     float specularStrength = 1;
     vec3 specReflectDir = reflect(lightDir, normal);
-    vec3 specular = pow(max(dot(viewDir, specReflectDir), 0), uShininess) * uSpecular * lights[0].diffuse.xyz;
+    vec3 specular = pow(max(dot(viewDir, specReflectDir), 0), fShininess) * fSpecular * lights[0].diffuse.xyz;
 
     float solidShadow = 1;
     vec3 fluidShadow = vec3(1);
 
     float lightSpaceDepth;
     float g;
-    if (uRenderShadows == 1 || uRenderFluidShadows == 1)
+#ifndef RENDER_SHADOWS
+    if (uRenderFluidShadows == 1)
+#endif
     {
-        if (uUsePcf == 1)
+#ifdef USE_PCF
         {
             SolidShadowData solidShadowData;
             solidShadowData.shadowLevel = 0;
@@ -206,7 +198,9 @@ void main()
             fluidShadowData.depth = 1;
             
             if (uRenderFluidShadows == 1) fluidShadowData = inFluidShadowPCF(fFragPosLightSpace, normal, lightDir);
-            if (uRenderShadows == 1) solidShadowData = inSolidShadowPCF(fFragPosLightSpace, normal, lightDir);
+#ifdef RENDER_SHADOWS
+            solidShadowData = inSolidShadowPCF(fFragPosLightSpace, normal, lightDir);
+#endif
 
             g = solidShadowData.depth;
 
@@ -224,17 +218,18 @@ void main()
                 solidShadow = 1 - (solidShadowData.shadowLevel * uShadowIntensity);
             }
         }
-        else
+#else
         {
             solidShadow = 1 - inShadow(fFragPosLightSpace, normal, lightDir);
         }
+#endif
     }
 
     vec3 reflectionDir = reflect(-viewDir, normal);
     vec4 reflectionColor = texture(uSkybox, reflectionDir);
 
-    vec3 diffuse = max(dot(normal, -lightDir), 0.0) * lights[0].diffuse.xyz * uDiffuse;
-    vec3 ambient = uDiffuse * lights[0].ambient.xyz;
+    vec3 diffuse = max(dot(normal, -lightDir), 0.0) * lights[0].diffuse.xyz * fDiffuse;
+    vec3 ambient = fDiffuse * lights[0].ambient.xyz;
     vec3 nonReflectiveColor = (diffuse + specular);
 
     const float refractiveIndex = 1.33;
@@ -242,13 +237,13 @@ void main()
     const float fresnelPower    = 5.0;
     const float F               = ((1.0 - eta) * (1.0 - eta)) / ((1.0 + eta) * (1.0 + eta));
     float fresnelRatio    = clamp(F + (1.0 - F) * pow((1.0 - dot(viewDir, normal)), fresnelPower), 0, 1);
-    fresnelRatio = uReflectiveness * fresnelRatio;
+    fresnelRatio = fReflectiveness * fresnelRatio;
     fragColor = (mix(nonReflectiveColor, reflectionColor.xyz, fresnelRatio) + ambient) * solidShadow * fluidShadow; 
 
     // If material is emissive, just show it's diffuse color.
     // Otherwise, use the normal lighting calculations
     // TODO: If material is emissive, the whole lighting calculation can be ignored.
-    fragColor = (-1 * uEmissive + 1) * fragColor + uEmissive * uDiffuse;
+    fragColor = (-1 * fEmissive + 1) * fragColor + fEmissive * fDiffuse;
     vec4 clipSpacePos = projectionMatrix * vec4(fFragEyePos, 1.0);
     fragDepth = vec4(fFragEyePos, 1.0).z;
     gl_FragDepth = clipSpacePos.z / clipSpacePos.w;
@@ -1,4 +1,5 @@
 #version 450 core
+#extension GL_ARB_shader_draw_parameters : enable
 
 layout (location = 0) in vec3 vPos;
 layout (location = 1) in vec3 vNormal;
@@ -18,15 +19,7 @@ layout(std140) uniform Lights
     int        u_NumLights;
 };
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 struct LightMatrix
 {
@@ -39,27 +32,64 @@ layout(std140) uniform LightMatrices
     LightMatrix lightMatrices[NUM_TOTAL_LIGHTS];
 };
 
-uniform mat4 projection;
-uniform mat4 model;
+// Per draw data, written by MeshBatch
+struct DrawData
+{
+    mat4  model;
+    vec4  diffuse;
+    vec4  specular; // w: shininess
+    float reflectiveness;
+    int   emissive;
+    int   invertNormals;
+    int   padding;
+};
+
+layout(std430, binding = 0) readonly buffer DrawDataBuffer
+{
+    DrawData draws[];
+};
+
+// Index of the first draw of the current (multi) draw call
+uniform int u_DrawOffset;
+
+#ifdef GL_ARB_shader_draw_parameters
+#define DRAW_ID (u_DrawOffset + gl_DrawIDARB)
+#else
+#define DRAW_ID u_DrawOffset
+#endif
 
 out vec3 fFragPos;
 out vec4 fFragPosLightSpace;
 out vec3 fFragEyePos;
 out vec3 fNormal;
 
-// Useful when rendering back faces only
-uniform int uInvertNormals;
+// Material
+flat out vec3  fDiffuse;
+flat out vec3  fSpecular;
+flat out float fShininess;
+flat out int   fEmissive;
+flat out float fReflectiveness;
 
 void main()
 {
+    DrawData draw = draws[DRAW_ID];
+    mat4 model    = draw.model;
+
     gl_Position = projectionMatrix * viewMatrix * model * vec4(vPos, 1.0);
 
-    // This 2x + 1 expression is just for optimization. It will return 1 when uInvertNormals is 0 
-    // (and keep the normals intact) or -1 when uInvertNormals is 1 (this inverting the)
+    // invertNormals is useful when rendering back faces only.
+    // This 2x + 1 expression is just for optimization. It will return 1 when invertNormals is 0 
+    // (and keep the normals intact) or -1 when invertNormals is 1 (this inverting the)
     // normals.
     // This avoids branching.
-    fNormal = (-2 * uInvertNormals + 1) * vNormal;  
+    fNormal = (-2 * draw.invertNormals + 1) * vNormal;  
     fFragPos = (model * vec4(vPos, 1.0)).xyz;
     fFragPosLightSpace = lightMatrices[0].prjMatrix * lightMatrices[0].viewMatrix * model * vec4(vPos, 1.0);
     fFragEyePos = (viewMatrix * model * vec4(vPos, 1.0)).xyz;
+
+    fDiffuse        = draw.diffuse.xyz;
+    fSpecular       = draw.specular.xyz;
+    fShininess      = draw.specular.w;
+    fEmissive       = draw.emissive;
+    fReflectiveness = draw.reflectiveness;
 }
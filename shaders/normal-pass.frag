@@ -21,15 +21,7 @@
 // fragment shader, normal pass
 #version 410 core
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 uniform sampler2D u_DepthTex;
 uniform int       u_ScreenWidth;
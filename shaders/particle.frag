@@ -40,15 +40,7 @@ layout(std140) uniform Lights
     int        u_NumLights;
 };
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 layout(std140) uniform Material
 {
@@ -60,7 +52,6 @@ layout(std140) uniform Material
 
 uniform int   u_ColorMode;
 uniform float u_PointRadius;
-uniform int   u_UseAnisotropyKernel;
 uniform int   u_ScreenWidth;
 uniform int   u_ScreenHeight;
 
@@ -94,7 +85,8 @@ void main()
     vec3 normal;
     vec3 fragPos;
 
-    if(u_UseAnisotropyKernel == 0) {
+#ifndef USE_ANISOTROPY_KERNEL
+    {
         normal.xy = gl_PointCoord.xy * vec2(2.0, -2.0) + vec2(-1.0, 1.0);
         float mag = dot(normal.xy, normal.xy);
 
@@ -103,7 +95,9 @@ void main()
         }
         normal.z = sqrt(1.0 - mag);
         fragPos  = f_ViewCenter + normal * u_PointRadius;
-    } else {
+    }
+#else
+    {
         vec3 fc = gl_FragCoord.xyz;
         fc.xy /= vec2(u_ScreenWidth, u_ScreenHeight);
         fc    *= 2.0;
@@ -133,6 +127,7 @@ void main()
         fragPos = transMatrix * intersectionPointT;;
         normal  = normalize(normalMatrix * normalT);
     }
+#endif
 
     // correct depth
     float z = dot(vec4(fragPos, 1.0), transpose(projectionMatrix)[2]);
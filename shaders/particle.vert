@@ -35,15 +35,7 @@ uniform vec3 colorRamp[] = vec3[] (vec3(1.0, 0.0, 0.0),
                                    vec3(0.0, 1.0, 1.0),
                                    vec3(0.0, 0.0, 1.0));
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 //uniform float u_PointScale;
 
@@ -51,7 +43,6 @@ uniform uint  u_nParticles;
 uniform int   u_ColorMode;
 uniform vec4  u_ClipPlane;
 uniform float u_PointRadius;
-uniform int   u_UseAnisotropyKernel;
 uniform int   u_ScreenWidth;
 uniform int   u_ScreenHeight;
 
@@ -133,21 +124,27 @@ void main()
     vec3  posEye   = vec3(eyeCoord);
     float dist     = length(posEye);
 
-    mat4 T = (u_UseAnisotropyKernel == 0) ?
-             mat4(u_PointRadius, 0, 0, 0,
+#ifndef USE_ANISOTROPY_KERNEL
+    mat4 T = mat4(u_PointRadius, 0, 0, 0,
                   0, u_PointRadius, 0, 0,
                   0, 0, u_PointRadius, 0,
-                  v_Position.x, v_Position.y, v_Position.z, 1.0) :
-             mat4(v_AnisotropyMatrix0[0] * u_PointRadius, v_AnisotropyMatrix0[1] * u_PointRadius, v_AnisotropyMatrix0[2] * u_PointRadius, 0,
+                  v_Position.x, v_Position.y, v_Position.z, 1.0);
+#else
+    mat4 T = mat4(v_AnisotropyMatrix0[0] * u_PointRadius, v_AnisotropyMatrix0[1] * u_PointRadius, v_AnisotropyMatrix0[2] * u_PointRadius, 0,
                   v_AnisotropyMatrix1[0] * u_PointRadius, v_AnisotropyMatrix1[1] * u_PointRadius, v_AnisotropyMatrix1[2] * u_PointRadius, 0,
                   v_AnisotropyMatrix2[0] * u_PointRadius, v_AnisotropyMatrix2[1] * u_PointRadius, v_AnisotropyMatrix2[2] * u_PointRadius, 0,
                   v_Position.x, v_Position.y, v_Position.z, 1.0);
+#endif
 
     /////////////////////////////////////////////////////////////////
     // output
     f_ViewCenter       = posEye;
     f_Color            = generateVertexColor();
-    f_AnisotropyMatrix = (u_UseAnisotropyKernel == 0) ? mat3(0) : mat3(v_AnisotropyMatrix0, v_AnisotropyMatrix1, v_AnisotropyMatrix2);
+#ifndef USE_ANISOTROPY_KERNEL
+    f_AnisotropyMatrix = mat3(0);
+#else
+    f_AnisotropyMatrix = mat3(v_AnisotropyMatrix0, v_AnisotropyMatrix1, v_AnisotropyMatrix2);
+#endif
 
 #ifdef UNIT_SPHERE_ISOLATED_PARTICLE
     float sx = length(v_AnisotropyMatrix0);
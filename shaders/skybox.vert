@@ -4,15 +4,7 @@ layout(location = 0) in vec3 vPos;
 
 out vec3 fTexCoords;
 
-layout(std140) uniform CameraData
-{
-    mat4 viewMatrix;
-    mat4 projectionMatrix;
-    mat4 invViewMatrix;
-    mat4 invProjectionMatrix;
-    mat4 shadowMatrix;
-    vec4 camPosition;
-};
+#include "camera-data.glsl"
 
 void main()
 {
@@ -1,5 +1,12 @@
 #include "Fluid.hpp"
 #include "utils/glcall.h"
+#include "utils/logger.h"
+#include "utils/parallel_for.hpp"
+#include "utils/profiler.hpp"
+#include <atomic>
+#include <algorithm>
+#include <cfloat>
+#include <cstdint>
 #include <sstream>
 #include <iomanip>
 #include <iostream>
@@ -14,36 +21,148 @@ bool Fluid::Load(const std::string& folder, const std::string& prefix, int start
         m_npzFileList.push_back(fileName);
     }
 
-    return Load();
+    return Load(m_npzFileList);
 }
 
 bool Fluid::Load(const std::vector<std::string>& npzFileList)
 {
-    m_npzFileList = npzFileList;
-    return Load();
+    if (!LoadFiles(npzFileList)) return false;
+    Init();
+    return true;
 }
 
-bool Fluid::Load()
+// Spreads the lower 10 bits of v, so that there are two zero bits between each of them
+static uint32_t ExpandBits(uint32_t v)
 {
-    CleanUp();
-    // TODO: Perform error checking
-    for (int i = 0; i < m_npzFileList.size(); i++)
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+}
+
+// Sorts the particles along a Morton curve and returns the bounds of every chunk of
+// PARTICLES_PER_CHUNK consecutive particles
+template<typename T>
+static std::vector<ParticleChunkBounds> SortParticlesIntoChunks(T* positions, int nParticles)
+{
+    std::vector<ParticleChunkBounds> chunkBounds;
+    if (nParticles <= 0) return chunkBounds;
+
+    float min[3] = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    float max[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (int i = 0; i < nParticles; i++)
+    {
+        float p[3] = { (float)positions[i].x, (float)positions[i].y, (float)positions[i].z };
+        for (int k = 0; k < 3; k++)
+        {
+            min[k] = std::min(min[k], p[k]);
+            max[k] = std::max(max[k], p[k]);
+        }
+    }
+
+    std::vector<std::pair<uint32_t, int>> codes(nParticles);
+    for (int i = 0; i < nParticles; i++)
+    {
+        float p[3] = { (float)positions[i].x, (float)positions[i].y, (float)positions[i].z };
+        uint32_t code = 0;
+        for (int k = 0; k < 3; k++)
+        {
+            float extent = max[k] - min[k];
+            uint32_t cell = extent > 0 ? (uint32_t)std::min(1023.f, (p[k] - min[k]) / extent * 1024.f) : 0;
+            code |= ExpandBits(cell) << (2 - k);
+        }
+        codes[i] = { code, i };
+    }
+    std::sort(codes.begin(), codes.end());
+
+    std::vector<T> sorted(nParticles);
+    for (int i = 0; i < nParticles; i++) sorted[i] = positions[codes[i].second];
+    std::copy(sorted.begin(), sorted.end(), positions);
+
+    for (int first = 0; first < nParticles; first += Fluid::PARTICLES_PER_CHUNK)
     {
-        cnpy::npz_t particleData = cnpy::npz_load(m_npzFileList[i]);
-        auto posParticleData = GetFramePosArray(particleData);
-        auto [ frameVao, frameVbo ] = LoadParticleDataToVao(posParticleData);
-        m_frameData.push_back({ CalcNumberOfParticles(posParticleData), frameVao, frameVbo });
+        ParticleChunkBounds bounds = { { FLT_MAX, FLT_MAX, FLT_MAX, 0.f }, 
+            { -FLT_MAX, -FLT_MAX, -FLT_MAX, 0.f } };
+        int last = std::min(nParticles, first + Fluid::PARTICLES_PER_CHUNK);
+        for (int i = first; i < last; i++)
+        {
+            bounds.min.x = std::min(bounds.min.x, (float)positions[i].x);
+            bounds.min.y = std::min(bounds.min.y, (float)positions[i].y);
+            bounds.min.z = std::min(bounds.min.z, (float)positions[i].z);
+            bounds.max.x = std::max(bounds.max.x, (float)positions[i].x);
+            bounds.max.y = std::max(bounds.max.y, (float)positions[i].y);
+            bounds.max.z = std::max(bounds.max.z, (float)positions[i].z);
+        }
+        chunkBounds.push_back(bounds);
     }
 
+    return chunkBounds;
+}
+
+bool Fluid::LoadFiles(const std::vector<std::string>& npzFileList)
+{
+    PROFILE_SCOPE("Fluid::LoadFiles");
+    std::vector<std::string> fileList = npzFileList;
+    std::vector<LoadedFrame> frames(fileList.size());
+    std::atomic<bool> failed(false);
+
+    fluidity::ParallelFor(frames.size(), [&](unsigned i) {
+        // cnpy reports errors with exceptions, which can't leave the worker
+        try
+        {
+            cnpy::npz_t particleData;
+            {
+                PROFILE_SCOPE("cnpy::npz_load");
+                particleData = cnpy::npz_load(fileList[i]);
+            }
+            LoadedFrame& frame = frames[i];
+            frame.positions  = GetFramePosArray(particleData);
+            frame.nParticles = CalcNumberOfParticles(frame.positions);
+
+            PROFILE_SCOPE("Fluid::SortParticlesIntoChunks");
+            if (frame.positions.word_size == 4) frame.chunkBounds = SortParticlesIntoChunks(
+                frame.positions.data<vec3>(), frame.nParticles);
+            else frame.chunkBounds = SortParticlesIntoChunks(frame.positions.data<dVec3>(),
+                frame.nParticles);
+        }
+        catch (const std::exception& e)
+        {
+            LOG_ERROR("Unable to load fluid frame: " + fileList[i] + " " + e.what());
+            failed = true;
+        }
+    });
+
+    if (failed) return false;
+
+    m_npzFileList  = std::move(fileList);
+    m_loadedFrames = std::move(frames);
     return true; 
 }
 
+void Fluid::Init()
+{
+    PROFILE_SCOPE("Fluid::Init");
+    CleanUp();
+    for (const auto& frame : m_loadedFrames)
+    {
+        PROFILE_SCOPE("Fluid::LoadParticleDataToVao");
+        auto [ frameVao, frameVbo ] = LoadParticleDataToVao(frame.positions);
+        GLuint chunkBoundsBuffer = LoadChunkBoundsToBuffer(frame.chunkBounds);
+        m_frameData.push_back({ frame.nParticles, frameVao, frameVbo, chunkBoundsBuffer, 
+            (int)frame.chunkBounds.size() });
+    }
+
+    m_loadedFrames.clear();
+}
+
 
 void Fluid::CleanUp()
 {
     for (auto& f : m_frameData)
     {
         GLCall(glDeleteBuffers(1, &f.vbo));
+        GLCall(glDeleteBuffers(1, &f.chunkBoundsBuffer));
         GLCall(glDeleteVertexArrays(1, &f.vao));
     }
 
@@ -87,6 +206,18 @@ std::tuple<GLuint, GLuint> Fluid::LoadParticleDataToVao(const cnpy::NpyArray& da
     return { vao, vbo };
 }
 
+GLuint Fluid::LoadChunkBoundsToBuffer(const std::vector<ParticleChunkBounds>& chunkBounds)
+{
+    GLuint buffer;
+    GLCall(glGenBuffers(1, &buffer));
+    GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer));
+    GLCall(glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(ParticleChunkBounds) * chunkBounds.size(),
+        chunkBounds.data(), GL_STATIC_DRAW));
+    GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+    return buffer;
+}
+
 GLenum Fluid::GetDataTypeFromWordSize(size_t wordSize)
 {
     // Only 32 and 64 bit floating-point types are allowed
@@ -101,6 +232,18 @@ cnpy::NpyArray& Fluid::GetFramePosArray(cnpy::npz_t& particleData)
     return particleData["pos"];
 }
 
+GLuint Fluid::GetFrameChunkBoundsBuffer(int frame)
+{
+    assert(frame < GetNumberOfFrames());
+    return m_frameData[frame].chunkBoundsBuffer;
+}
+
+int Fluid::GetNumberOfChunks(int frame)
+{
+    assert(frame < GetNumberOfFrames());
+    return m_frameData[frame].nChunks;
+}
+
 int Fluid::GetNumberOfParticles(int frame)
 {
     assert(frame < GetNumberOfFrames());
@@ -2,14 +2,25 @@
 #include <string>
 #include <cnpy.h>
 #include <vector>
+#include <tuple>
 #include <GL/glew.h>
 #include "vec.hpp"
 
+// std430 layout, must match ChunkBounds in hiz-cull.comp
+struct ParticleChunkBounds
+{
+    Vec4 min;
+    Vec4 max;
+};
+
 struct FrameData
 {
     int nParticles;
     GLuint vao;
     GLuint vbo;
+    // Shader storage buffer with the bounds of each chunk of PARTICLES_PER_CHUNK particles
+    GLuint chunkBoundsBuffer;
+    int nChunks;
 };
 
 class Fluid {
@@ -17,7 +28,14 @@ public:
     Fluid() = default;
 
     bool Load(const std::string& folder, const std::string& prefix, int start, int count);
+    // Same as LoadFiles followed by Init
     bool Load(const std::vector<std::string>& npzFileList);
+    // CPU side of Load: reads the frames and sorts their particles, in parallel. Doesn't use
+    // OpenGL, so it can run on another thread.
+    bool LoadFiles(const std::vector<std::string>& npzFileList);
+    // Replaces the uploaded frames with the ones read by LoadFiles. Requires an active OpenGL
+    // context.
+    void Init();
 
     void CleanUp();
 
@@ -27,16 +45,31 @@ public:
     const std::vector<std::string>& GetFileList() const { return m_npzFileList; }
 
     GLuint GetFrameVao(int frame);
+    GLuint GetFrameChunkBoundsBuffer(int frame);
+    int GetNumberOfChunks(int frame);
+
+    // Particles are sorted along a Morton curve when loaded, so consecutive particles
+    // are close to each other, and can be culled in chunks
+    static constexpr int PARTICLES_PER_CHUNK = 1024;
 
 private:
     int CalcNumberOfParticles(const cnpy::NpyArray& particleData);
     cnpy::NpyArray& GetFramePosArray(cnpy::npz_t& particleData);
     bool LoadFrameToVao(int frame);
     std::tuple<GLuint, GLuint> LoadParticleDataToVao(const cnpy::NpyArray& data);
+    GLuint LoadChunkBoundsToBuffer(const std::vector<ParticleChunkBounds>& chunkBounds);
 
     GLenum GetDataTypeFromWordSize(size_t wordSize);
 
-    bool Load();
+    // Read by LoadFiles, waiting to be uploaded by Init
+    struct LoadedFrame
+    {
+        cnpy::NpyArray positions;
+        std::vector<ParticleChunkBounds> chunkBounds;
+        int nParticles = 0;
+    };
+
     std::vector<std::string> m_npzFileList;
     std::vector<FrameData> m_frameData;
+    std::vector<LoadedFrame> m_loadedFrames;
 };
\ No newline at end of file
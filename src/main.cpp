@@ -1,28 +1,187 @@
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
 #include <iostream>
+#include <limits>
+#include <sstream>
 #include <stdio.h>
 #include <cnpy.h>
 #include "Fluid.hpp"
+#include "renderer/batch_renderer.hpp"
 #include "renderer/fluid_renderer.hpp"
+#include "renderer/headless_context.hpp"
+#include "renderer/shard_driver.hpp"
 #include "renderer/window.h"
 #include "utils/logger.h"
 #include "utils/gui_layer.hpp"
+#include "utils/profiler.hpp"
 
 struct CommandLineArgs 
 {
     std::string scenePath;
     std::string npzPath;
-    int frameCount;
-    int firstFrame;
+    int frameCount = 0;
+    int firstFrame = 0;
+    // Each entry is target=FORMAT
+    std::vector<std::string> renderTargetFormats;
+    bool validateRenderTargetFormats = false;
+    bool benchmarkFilters = false;
+    bool benchmarkProfiler = false;
+    bool headless = false;
+    unsigned width  = 1366;
+    unsigned height = 768;
+    // Headless frames are written here when set
+    std::string outputDirectory;
+    fluidity::ImageFormat outputFormat = fluidity::ImageFormat::PNG;
+    // Headless frames are streamed here when set. "-" is stdout.
+    std::string streamPath;
+    fluidity::StreamFormat streamFormat = fluidity::StreamFormat::Y4M;
+    int fps = 30;
+    // Headless renders are split among this many worker processes
+    int numWorkers = 1;
+    size_t workerMemoryMegabytes = 0;
+    bool pinCores = false;
+    // Only frames [shardFirst, shardFirst + shardCount) of the scene are loaded and rendered
+    int shardFirst = 0;
+    int shardCount = 0;
+    std::string manifestPath;
+    // Options workers are started with as well
+    std::vector<std::string> workerArgs;
+    // Set when an option value can't be parsed
+    bool invalidArgs = false;
 };
 
+// Parses WIDTHxHEIGHT
+bool parseResolution(const std::string& resolution, unsigned& width, unsigned& height)
+{
+    unsigned parsedWidth, parsedHeight;
+    char separator;
+    std::stringstream stream(resolution);
+    if (!(stream >> parsedWidth >> separator >> parsedHeight) || separator != 'x' ||
+        parsedWidth == 0 || parsedHeight == 0)
+    {
+        return false;
+    }
+
+    width  = parsedWidth;
+    height = parsedHeight;
+    return true;
+}
+
+// Parses a whole decimal number in [minValue, max of T]. minValue can't be negative.
+template <typename T>
+bool parseNumber(const std::string& text, T minValue, T& value)
+{
+    long long parsed;
+    std::stringstream stream(text);
+    if (!(stream >> parsed) || !stream.eof() || parsed < (long long)minValue ||
+        (unsigned long long)parsed > (unsigned long long)std::numeric_limits<T>::max())
+    {
+        return false;
+    }
+
+    value = (T)parsed;
+    return true;
+}
+
 CommandLineArgs parseCommandArgs(int argc, char* args[])
 {
-    CommandLineArgs output = { "", "", 0, 0 };
+    CommandLineArgs output;
+
+    int positional = 0;
+    for (int i = 1; i < argc; i++)
+    {
+        std::string arg = args[i];
+        int optionStart = i;
+        bool workerOption = true;
+        if (arg == "--format" && i + 1 < argc) output.renderTargetFormats.push_back(args[++i]);
+        else if (arg == "--validate-formats") output.validateRenderTargetFormats = true;
+        else if (arg == "--benchmark-filters") output.benchmarkFilters = true;
+        else if (arg == "--benchmark-profiler") output.benchmarkProfiler = true;
+        else if (arg == "--headless") output.headless = true;
+        else if (arg == "--output" && i + 1 < argc) output.outputDirectory = args[++i];
+        else if (arg == "--output-format" && i + 1 < argc)
+        {
+            if (!fluidity::ParseImageFormat(args[++i], output.outputFormat))
+            {
+                std::cerr << "Error: Invalid output format: " << args[i] << "\n";
+                output.invalidArgs = true;
+            }
+        }
+        else if (arg == "--stream" && i + 1 < argc) output.streamPath = args[++i];
+        else if (arg == "--stream-format" && i + 1 < argc)
+        {
+            if (!fluidity::ParseStreamFormat(args[++i], output.streamFormat))
+            {
+                std::cerr << "Error: Invalid stream format: " << args[i] << "\n";
+                output.invalidArgs = true;
+            }
+        }
+        else if (arg == "--fps" && i + 1 < argc)
+        {
+            if (!parseNumber(args[++i], 1, output.fps))
+            {
+                std::cerr << "Error: Invalid frame rate: " << args[i] << "\n";
+                output.invalidArgs = true;
+            }
+        }
+        else if (arg == "--resolution" && i + 1 < argc)
+        {
+            if (!parseResolution(args[++i], output.width, output.height))
+            {
+                std::cerr << "Error: Invalid resolution: " << args[i] << "\n";
+                output.invalidArgs = true;
+            }
+        }
+        else
+        {
+            // The driver hands each worker its own frames and manifest
+            workerOption = false;
+            if (arg == "--workers" && i + 1 < argc)
+            {
+                if (!parseNumber(args[++i], 1, output.numWorkers))
+                {
+                    std::cerr << "Error: Invalid number of workers: " << args[i] << "\n";
+                    output.invalidArgs = true;
+                }
+            }
+            else if (arg == "--worker-memory" && i + 1 < argc) 
+            {
+                // Megabytes, so that the limit in bytes can't overflow
+                if (!parseNumber(args[++i], (size_t)1, output.workerMemoryMegabytes) ||
+                    output.workerMemoryMegabytes > std::numeric_limits<size_t>::max() >> 20)
+                {
+                    std::cerr << "Error: Invalid worker memory: " << args[i] << "\n";
+                    output.invalidArgs = true;
+                }
+            }
+            else if (arg == "--pin-cores") output.pinCores = true;
+            else if (arg == "--manifest" && i + 1 < argc) output.manifestPath = args[++i];
+            else if (arg == "--shard" && i + 2 < argc)
+            {
+                if (!parseNumber(args[i + 1], 0, output.shardFirst) || 
+                    !parseNumber(args[i + 2], 1, output.shardCount))
+                {
+                    std::cerr << "Error: Invalid shard: " << args[i + 1] << " " << args[i + 2] << "\n";
+                    output.invalidArgs = true;
+                }
+                i += 2;
+            }
+            else
+            {
+                if (positional == 0) output.scenePath = arg;
+                if (positional == 1) output.npzPath = arg;
+                if (positional == 2) output.frameCount = std::stoi(arg);
+                if (positional == 3) output.firstFrame = std::stoi(arg);
+                positional++;
+            }
+        }
 
-    if (argc > 1) output.scenePath = args[1];
-    if (argc > 2) output.npzPath = args[2];
-    if (argc > 3) output.frameCount = std::stoi(args[3]);
-    if (argc > 4) output.firstFrame = std::stoi(args[4]);
+        if (workerOption)
+        {
+            output.workerArgs.insert(output.workerArgs.end(), args + optionStart, args + i + 1);
+        }
+    }
 
     return output;
 }
@@ -30,6 +189,55 @@ CommandLineArgs parseCommandArgs(int argc, char* args[])
 void printUsage()
 {
     std::cout << "Usage: $ npz-rendering scene_path npz_path frame_count [first_frame]\n";
+    std::cout << "Options:\n";
+    std::cout << "  --format target=FORMAT  Render target format. Targets: depth, thickness, normal,\n"
+                 "                          composition, meshColor, meshDepth. Formats: R32F, RGB32F,\n"
+                 "                          RGBA32F, R16F, RG16F, RGBA16F, R11G11B10F\n";
+    std::cout << "  --validate-formats      Print the maximum error of each target against FP32\n";
+    std::cout << "  --benchmark-filters     Print the GPU time of every filter backend\n";
+    std::cout << "  --benchmark-profiler    Print the CPU cost of a profiler zone, and exit\n";
+    std::cout << "  --headless              Render without a window (EGL or OSMesa), frame_count\n"
+                 "                          frames from first_frame, and print the frame rate\n";
+    std::cout << "  --resolution WxH        Window or headless resolution. Default: 1366x768\n";
+    std::cout << "  --output DIR            Headless only: write every frame, and the scene's AOVs,\n"
+                 "                          to DIR\n";
+    std::cout << "  --output-format FORMAT  Format of the written frames: png (default), exr (linear,\n"
+                 "                          float) or raw (rgb24)\n";
+    std::cout << "  --stream PATH           Headless only: stream every frame to PATH, usually a\n"
+                 "                          named pipe, or to stdout with -\n";
+    std::cout << "  --stream-format FORMAT  y4m (default, 4:2:0) or rgb24\n";
+    std::cout << "  --fps N                 Frame rate in the y4m header. Default: 30\n";
+    std::cout << "  --workers N             Split a headless render with --output among N worker\n"
+                 "                          processes, each loading only its frames\n";
+    std::cout << "  --worker-memory MB      Memory limit of each worker. Resident memory with a\n"
+                 "                          delegated cgroup v2 memory controller, otherwise address\n"
+                 "                          space, which needs generous headroom\n";
+    std::cout << "  --pin-cores             Pin each worker to its share of the cores\n";
+    std::cout << "  --manifest PATH         List the written files and timings in PATH (YAML).\n"
+                 "                          Default with workers: DIR/manifest.yml\n";
+}
+
+bool applyRenderTargetFormats(const std::vector<std::string>& formatArgs, 
+    fluidity::RenderTargetFormats& formats)
+{
+    for (const auto& formatArg : formatArgs)
+    {
+        size_t separator = formatArg.find('=');
+        fluidity::RenderTarget target;
+        fluidity::RenderTargetFormat format;
+
+        if (separator == std::string::npos || 
+            !fluidity::ParseRenderTarget(formatArg.substr(0, separator), target) ||
+            !fluidity::ParseRenderTargetFormat(formatArg.substr(separator + 1), format))
+        {
+            std::cerr << "Error: Invalid render target format: " << formatArg << "\n";
+            printUsage();
+            return false;
+        }
+        formats[target] = format;
+    }
+
+    return true;
 }
 
 int validateCommandLineArguments(const CommandLineArgs& cmdArgs)
@@ -56,12 +264,198 @@ int validateCommandLineArguments(const CommandLineArgs& cmdArgs)
     return 0;
 }
 
+// Loads the scene at cmdArgs.scenePath, if any, with the formats given in the command line
+bool loadScene(const CommandLineArgs& cmdArgs, fluidity::SceneSerializer& serializer, 
+    fluidity::Scene& scene)
+{
+    scene = fluidity::Scene::CreateEmptyScene();
+    if (!cmdArgs.scenePath.empty())
+    {
+        serializer = fluidity::SceneSerializer(cmdArgs.scenePath);
+        if (cmdArgs.shardCount > 0)
+        {
+            serializer.SetFluidFrameRange(cmdArgs.shardFirst, cmdArgs.shardCount);
+        }
+        serializer.Deserialize();
+        scene = serializer.GetScene();
+    }
+
+    return applyRenderTargetFormats(cmdArgs.renderTargetFormats, scene.renderTargetFormats);
+}
+
+void runDiagnostics(const CommandLineArgs& cmdArgs, fluidity::FluidRenderer* renderer)
+{
+    if (cmdArgs.validateRenderTargetFormats)
+    {
+        std::cout << renderer->ValidateRenderTargetFormats();
+    }
+
+    if (cmdArgs.benchmarkFilters)
+    {
+        std::cout << renderer->BenchmarkFilters();
+    }
+}
+
+// Renders frame_count frames (every frame of the scene by default) from first_frame into the
+// renderer's output framebuffer, without a window or a GUI, and reports the frame rate.
+// With an output directory or a stream, the frames are written there as well.
+int runHeadless(const CommandLineArgs& cmdArgs)
+{
+    // Scene loading and renderer initialization log to stdout, so a stream on stdout must take
+    // it over before anything else runs
+    FILE* stdoutStream = nullptr;
+    if (cmdArgs.streamPath == "-")
+    {
+        stdoutStream = fluidity::DetachStandardOutput();
+        if (stdoutStream == nullptr)
+        {
+            std::cerr << "Error: Unable to stream to stdout.\n";
+            return 8;
+        }
+    }
+
+    fluidity::HeadlessContext context;
+    if (!context.Init())
+    {
+        LOG_ERROR("Unable to create headless context.");
+        return 5;
+    }
+    std::cout << "Headless context: " << context.GetBackendName() << ", " << 
+        glGetString(GL_RENDERER) << "\n";
+
+    fluidity::SceneSerializer ss;
+    fluidity::Scene sc;
+    if (!loadScene(cmdArgs, ss, sc)) return 4;
+    // Offline renders must not depend on how fast the machine is
+    sc.resolutionParameters.dynamicResolution = false;
+
+    fluidity::FluidRenderer* renderer = new fluidity::FluidRenderer(cmdArgs.width, cmdArgs.height,
+        0.06250);
+    renderer->SetOffscreen(true);
+    renderer->SetScene(sc);
+
+    if (!renderer->Init())
+    {
+        LOG_ERROR("Unable to initialize fluid renderer.");
+        return 6;
+    }
+    renderer->Pause();
+
+    runDiagnostics(cmdArgs, renderer);
+
+    int numSceneFrames = std::max(sc.fluid.GetNumberOfFrames(), 1);
+    int firstFrame = std::clamp(cmdArgs.firstFrame, 0, numSceneFrames - 1);
+    int numFrames  = cmdArgs.frameCount > 0 ? 
+        std::min(cmdArgs.frameCount, numSceneFrames - firstFrame) : numSceneFrames - firstFrame;
+
+    if (!cmdArgs.outputDirectory.empty() || !cmdArgs.streamPath.empty())
+    {
+        fluidity::BatchRenderSettings settings;
+        settings.firstFrame      = firstFrame;
+        settings.numFrames       = numFrames;
+        settings.outputDirectory = cmdArgs.outputDirectory;
+        settings.format          = cmdArgs.outputFormat;
+        settings.streamPath      = cmdArgs.streamPath;
+        settings.streamFile      = stdoutStream;
+        settings.streamFormat    = cmdArgs.streamFormat;
+        settings.fps             = cmdArgs.fps;
+        settings.aovs            = sc.aovParameters;
+        settings.manifestPath    = cmdArgs.manifestPath;
+        // A shard's frames start at 0 once loaded
+        settings.frameNumberOffset = cmdArgs.shardCount > 0 ? cmdArgs.shardFirst : 0;
+
+        bool rendered = fluidity::BatchRenderer(renderer, settings).Run();
+        renderer->CleanUp();
+        return rendered ? 0 : 7;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    for (int frame = firstFrame; frame < firstFrame + numFrames; frame++)
+    {
+        PROFILE_SCOPE("Frame");
+        renderer->SetCurrentFrame(frame);
+        renderer->Render();
+        // Nothing waits for the frame otherwise, so the GPU could queue up any number of them
+        glFinish();
+        fluidity::Profiler::EndFrame();
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    renderer->CleanUp();
+
+    std::cout << "Rendered " << numFrames << " frames at " << cmdArgs.width << "x" << 
+        cmdArgs.height << " in " << seconds << " s (" << numFrames / seconds << " fps)\n";
+    return 0;
+}
+
+// Splits a headless render among worker processes, which run this executable with the same
+// options (see fluidity::ShardDriver). Doesn't need an OpenGL context itself.
+int runDriver(const CommandLineArgs& cmdArgs)
+{
+    if (cmdArgs.scenePath.empty() || cmdArgs.outputDirectory.empty() || 
+        !cmdArgs.streamPath.empty())
+    {
+        std::cerr << "Error: Workers require a scene and an output directory, and can't stream.\n";
+        printUsage();
+        return 1;
+    }
+
+    fluidity::SceneSerializer serializer(cmdArgs.scenePath);
+    int numSceneFrames = serializer.CountFluidFrames();
+    if (numSceneFrames < 0) return 4;
+    numSceneFrames = std::max(numSceneFrames, 1);
+
+    fluidity::ShardSettings settings;
+    settings.arguments = { cmdArgs.scenePath };
+    settings.arguments.insert(settings.arguments.end(), cmdArgs.workerArgs.begin(), 
+        cmdArgs.workerArgs.end());
+    settings.arguments.push_back("--headless");
+    settings.firstFrame = std::clamp(cmdArgs.firstFrame, 0, numSceneFrames - 1);
+    settings.numFrames  = cmdArgs.frameCount > 0 ? 
+        std::min(cmdArgs.frameCount, numSceneFrames - settings.firstFrame) : 
+        numSceneFrames - settings.firstFrame;
+    settings.numWorkers   = cmdArgs.numWorkers;
+    settings.pinCores     = cmdArgs.pinCores;
+    settings.memoryBudget = cmdArgs.workerMemoryMegabytes * 1024 * 1024;
+    settings.manifestPath = !cmdArgs.manifestPath.empty() ? cmdArgs.manifestPath :
+        (std::filesystem::path(cmdArgs.outputDirectory) / "manifest.yml").string();
+
+    fluidity::ShardDriver driver(settings);
+    return driver.Run() ? 0 : 7;
+}
+
 int main(int argc, char* args[])
 {
     auto cmdLineArgs = parseCommandArgs(argc, args);
+    fluidity::Profiler::SetThreadName("Main");
+
+    if (cmdLineArgs.invalidArgs)
+    {
+        printUsage();
+        return 4;
+    }
+    if (cmdLineArgs.benchmarkProfiler)
+    {
+        std::cout << fluidity::Profiler::Benchmark();
+        return 0;
+    }
+
+    if (cmdLineArgs.numWorkers > 1) return runDriver(cmdLineArgs);
+    if (cmdLineArgs.headless)
+    {
+        // Workers report it, so that the driver can tell a memory limit from other failures
+        try
+        {
+            return runHeadless(cmdLineArgs);
+        }
+        catch (const std::bad_alloc&)
+        {
+            std::cerr << "Error: Out of memory.\n";
+            return fluidity::ShardDriver::OUT_OF_MEMORY_EXIT_STATUS;
+        }
+    }
 
-    const unsigned int WINDOW_WIDTH = 1366;
-    const unsigned int WINDOW_HEIGHT = 768;
+    const unsigned int WINDOW_WIDTH  = cmdLineArgs.width;
+    const unsigned int WINDOW_HEIGHT = cmdLineArgs.height;
 
     Window window = Window("Fluidity", WINDOW_WIDTH, WINDOW_HEIGHT, 4, 5, true, false);
 
@@ -78,15 +472,11 @@ int main(int argc, char* args[])
     fluidity::GuiLayer gui = fluidity::GuiLayer(window.GetSDLWindow(), window.GetSDLGLContext(), renderer);
     gui.Init();
 
-    if (!cmdLineArgs.scenePath.empty())
-    {
-        fluidity::SceneSerializer ss(cmdLineArgs.scenePath);
-        ss.Deserialize();
-        fluidity::Scene sc = ss.GetScene();
-        renderer->SetScene(sc);
-        gui.SetSceneSerializer(ss);
-    }
-    else renderer->SetScene(fluidity::Scene::CreateEmptyScene());
+    fluidity::SceneSerializer ss;
+    fluidity::Scene sc;
+    if (!loadScene(cmdLineArgs, ss, sc)) return 4;
+    if (!cmdLineArgs.scenePath.empty()) gui.SetSceneSerializer(ss);
+    renderer->SetScene(sc);
 
     if(!renderer->Init())
     {
@@ -94,54 +484,77 @@ int main(int argc, char* args[])
         return 6;
     }
 
+    runDiagnostics(cmdLineArgs, renderer);
+
 
     bool running = true;
     bool showGui = true;
 
     while(running) 
     {
+        PROFILE_SCOPE("Frame");
         SDL_Event e;
 
-        while(SDL_PollEvent(&e)) 
         {
-            if(e.type == SDL_QUIT) running = false;
+            PROFILE_SCOPE("PollEvents");
+            while(SDL_PollEvent(&e)) 
+            {
+                if(e.type == SDL_QUIT) running = false;
+
+                if(e.type == SDL_WINDOWEVENT && e.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                {
+                    int drawableWidth, drawableHeight;
+                    SDL_GL_GetDrawableSize(window.GetSDLWindow(), &drawableWidth, &drawableHeight);
+                    renderer->Resize(drawableWidth, drawableHeight);
+                }
             
-            if (gui.ProcessEvent(e)) continue;
+                if (gui.ProcessEvent(e)) continue;
 
-            if(e.type == SDL_KEYUP)
-            {
-                switch(e.key.keysym.sym)
+                if(e.type == SDL_KEYUP)
                 {
-                    case SDLK_ESCAPE:
+                    switch(e.key.keysym.sym)
                     {
-                        running = false;
-                    } break;
+                        case SDLK_ESCAPE:
+                        {
+                            running = false;
+                        } break;
 
-                    case SDLK_SPACE:
-                    {
-                        renderer->TogglePlayPause();
-                    } break;
+                        case SDLK_SPACE:
+                        {
+                            renderer->TogglePlayPause();
+                        } break;
 
-                    case SDLK_i:
-                    {
-                        showGui = !showGui;
-                        break;
-                    }
+                        case SDLK_i:
+                        {
+                            showGui = !showGui;
+                            break;
+                        }
 
-                    default: break;
+                        case SDLK_F12:
+                        {
+                            fluidity::Profiler::RequestCapture(fluidity::Profiler::GenerateCaptureFileName());
+                        } break;
+
+                        default: break;
+                    }
                 }
+                renderer->ProcessInput(e);
             }
-            renderer->ProcessInput(e);
         }
 
-
         renderer->Update();
         renderer->Render();
 
         if (showGui) gui.Render();
 
-        window.Swap();
+        {
+            PROFILE_SCOPE("Window::Swap");
+            window.Swap();
+        }
+
+        fluidity::Profiler::EndFrame();
     }
 
+    renderer->CleanUp();
     return 0;
 }
@@ -0,0 +1,337 @@
+#include "renderer/batch_renderer.hpp"
+#include "renderer/fluid_renderer.hpp"
+#include "renderer/render_target_formats.hpp"
+#include "utils/image_writer.hpp"
+#include "utils/logger.h"
+#include "utils/mapped_file.hpp"
+#include "utils/profiler.hpp"
+#include "utils/thread_pool.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <yaml-cpp/yaml.h>
+
+namespace fluidity
+{
+
+namespace
+{
+
+double GetTime()
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+// Readbacks are tagged with their frame and output: the image, or an AOV's render target
+constexpr int IMAGE_OUTPUT = (int)RenderTarget::Count;
+constexpr uint64_t NUM_OUTPUTS = (uint64_t)RenderTarget::Count + 1;
+
+uint64_t MakeTag(int frame, int output)
+{
+  return (uint64_t)frame * NUM_OUTPUTS + output;
+}
+
+}
+
+bool ParseImageFormat(const std::string& name, ImageFormat& format)
+{
+  if (name == "png") format = ImageFormat::PNG;
+  else if (name == "exr") format = ImageFormat::EXR;
+  else if (name == "raw") format = ImageFormat::Raw;
+  else return false;
+  return true;
+}
+
+const char* GetImageFormatExtension(ImageFormat format)
+{
+  switch (format)
+  {
+    case ImageFormat::PNG: return "png";
+    case ImageFormat::EXR: return "exr";
+    case ImageFormat::Raw: return "rgb";
+  }
+  return "";
+}
+
+BatchRenderer::BatchRenderer(FluidRenderer* renderer, const BatchRenderSettings& settings)
+  : m_renderer(renderer),
+  m_settings(settings),
+  // Every frame takes a buffer per output, and three frames stay in flight
+  m_readback(3 * (1 + (unsigned)settings.aovs.targets.size()))
+{ /* */ }
+
+bool BatchRenderer::Run()
+{
+  auto& output = m_renderer->GetOutputFramebuffer();
+  bool streaming = !m_settings.streamPath.empty();
+  if (streaming)
+  {
+    bool opened = m_settings.streamFile != nullptr ? 
+      m_stream.Open(m_settings.streamFile, m_settings.streamFormat, output.GetWidth(), 
+        output.GetHeight(), m_settings.fps) :
+      m_stream.Open(m_settings.streamPath, m_settings.streamFormat, output.GetWidth(), 
+        output.GetHeight(), m_settings.fps);
+    if (!opened) return false;
+  }
+  if (!m_readback.Init()) return false;
+  if (!m_settings.aovs.targets.empty() && m_settings.outputDirectory.empty())
+  {
+    std::cerr << "Warning: AOVs require an output directory, none will be written\n";
+  }
+
+  m_numWritten  = 0;
+  m_numFailed   = 0;
+  m_numStreamed = 0;
+  m_writtenFiles.clear();
+  m_encodeWaitSeconds = 0.0;
+  m_startTime = m_lastReportTime = GetTime();
+
+  int numRendered = 0;
+  for (int frame = m_settings.firstFrame; 
+    frame < m_settings.firstFrame + m_settings.numFrames; frame++, numRendered++)
+  {
+    // Nothing would read the remaining frames
+    if (streaming && m_stream.HasFailed())
+    {
+      std::cerr << "Error: The stream failed, stopping after " << numRendered << " frames\n";
+      break;
+    }
+
+    PROFILE_SCOPE("Frame");
+    m_renderer->SetCurrentFrame(frame);
+    m_renderer->Render();
+    ReadFrame(frame);
+    CollectReadbacks(false);
+    ReportProgress(false);
+    Profiler::EndFrame();
+  }
+
+  CollectReadbacks(true);
+  WaitForEncodes(0);
+  if (streaming)
+  {
+    // Frames pushed after a failed write are dropped, and the frames not rendered are lost too.
+    // A failed final flush loses buffered frames that were counted as written.
+    bool closed = m_stream.Close();
+    int numDropped = m_numStreamed - m_stream.GetNumberOfWrittenFrames();
+    m_numFailed += numDropped + m_settings.numFrames - numRendered;
+    if (!closed && numDropped == 0) m_numFailed++;
+  }
+  m_readback.CleanUp();
+  ReportProgress(true);
+
+  double seconds = GetTime() - m_startTime;
+  std::cout << "Rendered " << numRendered << " frames at " << output.GetWidth() << 
+    "x" << output.GetHeight() << " in " << seconds << " s (" << 
+    numRendered / seconds << " fps), waited " << m_encodeWaitSeconds << 
+    " s for encoders\n";
+  if (m_numFailed > 0) std::cerr << "Error: " << m_numFailed << " outputs couldn't be written\n";
+  if (!m_settings.manifestPath.empty() && !WriteManifest(seconds)) return false;
+  return m_numFailed == 0;
+}
+
+std::string BatchRenderer::GetFramePath(int frame) const
+{
+  char fileName[64];
+  snprintf(fileName, sizeof(fileName), "_%05d.%s", frame + m_settings.frameNumberOffset, 
+    GetImageFormatExtension(m_settings.format));
+  return (std::filesystem::path(m_settings.outputDirectory) / 
+    (m_settings.prefix + fileName)).string();
+}
+
+std::string BatchRenderer::GetAovPath(RenderTarget target, int frame) const
+{
+  char fileName[64];
+  snprintf(fileName, sizeof(fileName), "_%05d.%s", frame + m_settings.frameNumberOffset, 
+    GetAovFormatName(m_settings.aovs.format));
+  return (std::filesystem::path(m_settings.outputDirectory) / 
+    (m_settings.prefix + "_" + GetRenderTargetName(target) + fileName)).string();
+}
+
+void BatchRenderer::ReadFrame(int frame)
+{
+  uint64_t imageTag = MakeTag(frame, IMAGE_OUTPUT);
+  // Alpha is dropped while converting, and 4 byte pixels are what drivers copy fastest
+  if (!m_settings.streamPath.empty())
+  {
+    m_readback.Read(m_renderer->GetOutputFramebuffer().GetAttachment(0), GL_RGBA, 
+      GL_UNSIGNED_BYTE, imageTag);
+  }
+  // EXR keeps the linear image, before it is quantized by the gamma correction pass
+  else if (m_settings.format == ImageFormat::EXR)
+  {
+    m_readback.Read(m_renderer->GetLinearOutputTexture(), GL_RGB, GL_FLOAT, imageTag);
+  }
+  else
+  {
+    m_readback.Read(m_renderer->GetOutputFramebuffer().GetAttachment(0), GL_RGB, 
+      GL_UNSIGNED_BYTE, imageTag);
+  }
+
+  if (m_settings.outputDirectory.empty()) return;
+  for (RenderTarget target : m_settings.aovs.targets)
+  {
+    GLuint texture = m_renderer->GetRenderTargetTexture(target);
+    if (texture == 0) continue;
+
+    GLenum format = GetRequiredChannels(target) == 1 ? GL_RED : GL_RGB;
+    m_readback.Read(texture, format, GL_FLOAT, MakeTag(frame, (int)target));
+  }
+}
+
+void BatchRenderer::CollectReadbacks(bool wait)
+{
+  std::vector<PixelReadback::Result> results;
+  if (!m_readback.Poll(results, wait)) return;
+
+  // Twice as many encodes as workers keeps every worker busy between polls
+  size_t maxInFlight = 2 * ThreadPool::GetGlobal().GetNumberOfThreads() + 2;
+  for (auto& result : results)
+  {
+    if (result.failed)
+    {
+      m_numFailed++;
+      continue;
+    }
+
+    // The stream converts on the pool as well, and keeps the frames in order
+    bool isImage = result.tag % NUM_OUTPUTS == IMAGE_OUTPUT;
+    if (isImage && !m_settings.streamPath.empty())
+    {
+      double start = GetTime();
+      m_stream.Wait(maxInFlight - 1);
+      m_encodeWaitSeconds += GetTime() - start;
+      m_stream.Push(std::move(result.pixels));
+      m_numStreamed++;
+      continue;
+    }
+
+    WaitForEncodes(maxInFlight - 1);
+    m_encodes.push_back(ThreadPool::GetGlobal().Submit(
+      [this, result = std::move(result)]() { return Encode(result); }));
+  }
+}
+
+void BatchRenderer::WaitForEncodes(size_t maxInFlight)
+{
+  auto isReady = [](std::future<bool>& encode) {
+    return encode.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+  };
+
+  while (!m_encodes.empty() && (m_encodes.size() > maxInFlight || isReady(m_encodes.front())))
+  {
+    if (!isReady(m_encodes.front()))
+    {
+      PROFILE_SCOPE("WaitForEncodes");
+      double start = GetTime();
+      m_encodes.front().wait();
+      m_encodeWaitSeconds += GetTime() - start;
+    }
+
+    if (!m_encodes.front().get()) m_numFailed++;
+    m_encodes.pop_front();
+  }
+}
+
+bool BatchRenderer::Encode(const PixelReadback::Result& result)
+{
+  PROFILE_SCOPE("EncodeFrame");
+  int frame  = (int)(result.tag / NUM_OUTPUTS);
+  int output = (int)(result.tag % NUM_OUTPUTS);
+  if (output != IMAGE_OUTPUT) return EncodeAov((RenderTarget)output, frame, result);
+
+  std::string path = GetFramePath(frame);
+  bool written = false;
+  switch (m_settings.format)
+  {
+    case ImageFormat::PNG:
+      written = WritePng(path, result.width, result.height, 3, result.pixels.data());
+      break;
+    case ImageFormat::EXR:
+      written = WriteExr(path, result.width, result.height, { "R", "G", "B" }, 
+        reinterpret_cast<const float*>(result.pixels.data()));
+      break;
+    case ImageFormat::Raw:
+      written = WriteRaw(path, result.width, result.height, 3, result.pixels.data());
+      break;
+  }
+
+  if (written)
+  {
+    AddWrittenFile(path);
+    m_numWritten++;
+  }
+  return written;
+}
+
+bool BatchRenderer::EncodeAov(RenderTarget target, int frame, 
+  const PixelReadback::Result& result)
+{
+  std::string path = GetAovPath(target, frame);
+  const float* pixels = reinterpret_cast<const float*>(result.pixels.data());
+  int numChannels = GetRequiredChannels(target);
+
+  bool written = false;
+  if (m_settings.aovs.format == AovFormat::NPY)
+  {
+    written = WriteNpy(path, result.width, result.height, numChannels, pixels);
+  }
+  else
+  {
+    std::vector<std::string> channelNames = { "R", "G", "B" };
+    if (numChannels == 1)
+    {
+      bool isDepth = target == RenderTarget::Depth || target == RenderTarget::MeshDepth;
+      channelNames = { isDepth ? "Z" : "Y" };
+    }
+    written = WriteExr(path, result.width, result.height, channelNames, pixels);
+  }
+
+  if (written) AddWrittenFile(path);
+  return written;
+}
+
+void BatchRenderer::AddWrittenFile(const std::string& path)
+{
+  std::lock_guard<std::mutex> lock(m_writtenFilesMutex);
+  m_writtenFiles.push_back(path);
+}
+
+bool BatchRenderer::WriteManifest(double seconds)
+{
+  // Files are written in whatever order the encodes finish
+  std::sort(m_writtenFiles.begin(), m_writtenFiles.end());
+
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "FirstFrame" << YAML::Value << 
+    m_settings.firstFrame + m_settings.frameNumberOffset;
+  out << YAML::Key << "NumFrames" << YAML::Value << m_settings.numFrames;
+  out << YAML::Key << "Seconds" << YAML::Value << seconds;
+  out << YAML::Key << "Failed" << YAML::Value << m_numFailed;
+  if (!m_settings.streamPath.empty())
+  {
+    out << YAML::Key << "Stream" << YAML::Value << m_settings.streamPath;
+  }
+  out << YAML::Key << "Files" << YAML::Value << m_writtenFiles;
+  out << YAML::EndMap;
+
+  return WriteFileAtomically(m_settings.manifestPath, out.c_str(), out.size());
+}
+
+void BatchRenderer::ReportProgress(bool force)
+{
+  double now = GetTime();
+  if (!force && now - m_lastReportTime < 1.0) return;
+
+  m_lastReportTime = now;
+  int numWritten = m_settings.streamPath.empty() ? (int)m_numWritten : 
+    m_stream.GetNumberOfWrittenFrames();
+  std::cout << "Progress: " << numWritten << "/" << m_settings.numFrames << " frames, " << 
+    numWritten / (now - m_startTime) << " fps" << std::endl;
+}
+
+}
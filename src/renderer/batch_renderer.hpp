@@ -0,0 +1,98 @@
+#pragma once
+#include "renderer/pixel_readback.hpp"
+#include "renderer/rendering_parameters.hpp"
+#include "utils/frame_stream.hpp"
+#include <atomic>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+class FluidRenderer;
+
+enum class ImageFormat
+{
+  PNG, // Gamma corrected, 8 bits per channel
+  EXR, // Linear, 32-bit float per channel
+  Raw  // Gamma corrected rgb24, rows top to bottom, no header
+};
+
+bool ParseImageFormat(const std::string& name, ImageFormat& format);
+const char* GetImageFormatExtension(ImageFormat format);
+
+struct BatchRenderSettings
+{
+  int firstFrame = 0;
+  int numFrames  = 1;
+  std::string outputDirectory;
+  ImageFormat format = ImageFormat::PNG;
+  // Files are named <prefix>_<frame>.<extension>, with the frame padded to 5 digits
+  std::string prefix = "frame";
+  // Added to the frame numbers in file names, when the renderer only has a slice of the
+  // scene's frames (see SceneSerializer::SetFluidFrameRange)
+  int frameNumberOffset = 0;
+  // When set, the files written and the timings are listed here (YAML) at the end
+  std::string manifestPath;
+  // When set, frames are streamed here (see FrameStream) instead of written to files. AOVs
+  // are still written to outputDirectory, if any.
+  std::string streamPath;
+  // Already open stream, used instead of opening streamPath (see DetachStandardOutput)
+  FILE* streamFile = nullptr;
+  StreamFormat streamFormat = StreamFormat::Y4M;
+  int fps = 30;
+  // Render targets written to outputDirectory as well, named 
+  // <prefix>_<target>_<frame>.<extension>
+  AovParameters aovs;
+};
+
+// Renders a range of frames offscreen and writes each one to its own file, or to a stream.
+// The three stages overlap: while the GPU renders a frame, earlier frames are read back
+// asynchronously (see PixelReadback), and earlier still ones are encoded and written by the
+// global thread pool. Encodes in flight are bounded, so memory stays bounded when encoding
+// is slower than rendering; the time the renderer spends waiting on them is reported.
+class BatchRenderer
+{
+public:
+  // renderer must be offscreen and initialized
+  BatchRenderer(FluidRenderer* renderer, const BatchRenderSettings& settings);
+  BatchRenderer(const BatchRenderer&) = delete;
+
+  // Returns false if any frame couldn't be written
+  bool Run();
+
+  std::string GetFramePath(int frame) const;
+  std::string GetAovPath(RenderTarget target, int frame) const;
+
+private:
+  void ReadFrame(int frame);
+  // Hands finished readbacks to the thread pool
+  void CollectReadbacks(bool wait);
+  // Waits until at most maxInFlight encodes are left
+  void WaitForEncodes(size_t maxInFlight);
+  bool Encode(const PixelReadback::Result& result);
+  bool EncodeAov(RenderTarget target, int frame, const PixelReadback::Result& result);
+  void AddWrittenFile(const std::string& path);
+  bool WriteManifest(double seconds);
+  // Prints progress at most once a second, unless forced
+  void ReportProgress(bool force);
+
+  FluidRenderer* m_renderer;
+  BatchRenderSettings m_settings;
+  PixelReadback m_readback;
+  FrameStream m_stream;
+  std::deque<std::future<bool>> m_encodes;
+  std::atomic<int> m_numWritten { 0 };
+  int m_numFailed = 0;
+  int m_numStreamed = 0;
+  std::vector<std::string> m_writtenFiles;
+  std::mutex m_writtenFilesMutex;
+  double m_encodeWaitSeconds = 0.0;
+  double m_startTime = 0.0;
+  double m_lastReportTime = 0.0;
+};
+
+}
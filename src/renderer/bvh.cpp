@@ -0,0 +1,153 @@
+#include "renderer/bvh.hpp"
+#include "utils/profiler.hpp"
+#include <algorithm>
+
+namespace fluidity
+{
+
+Frustum Frustum::FromMatrix(const glm::mat4& m)
+{
+    // Gribb-Hartmann plane extraction. GLM matrices are column major, m[column][row]
+    auto row = [&](int i) { return glm::vec4(m[0][i], m[1][i], m[2][i], m[3][i]); };
+
+    Frustum frustum;
+    frustum.planes[0] = row(3) + row(0);
+    frustum.planes[1] = row(3) - row(0);
+    frustum.planes[2] = row(3) + row(1);
+    frustum.planes[3] = row(3) - row(1);
+    frustum.planes[4] = row(3) + row(2);
+    frustum.planes[5] = row(3) - row(2);
+    return frustum;
+}
+
+Frustum::Containment Frustum::Classify(const AABB& box) const
+{
+    if (box.IsEmpty()) return Containment::Outside;
+
+    Containment containment = Containment::Inside;
+    for (const auto& plane : planes)
+    {
+        // Corners furthest along and against the plane normal
+        glm::vec3 positive = { plane.x >= 0 ? box.max.x : box.min.x,
+            plane.y >= 0 ? box.max.y : box.min.y, plane.z >= 0 ? box.max.z : box.min.z };
+        glm::vec3 negative = { plane.x >= 0 ? box.min.x : box.max.x,
+            plane.y >= 0 ? box.min.y : box.max.y, plane.z >= 0 ? box.min.z : box.max.z };
+
+        if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), positive) + plane.w < 0)
+            return Containment::Outside;
+        if (glm::dot(glm::vec3(plane.x, plane.y, plane.z), negative) + plane.w < 0)
+            containment = Containment::Intersecting;
+    }
+
+    return containment;
+}
+
+void Bvh::Build(const std::vector<AABB>& primitiveBounds)
+{
+    PROFILE_SCOPE("Bvh::Build");
+    m_nodes.clear();
+    m_primitives.resize(primitiveBounds.size());
+    for (unsigned i = 0; i < m_primitives.size(); i++) m_primitives[i] = i;
+
+    if (!m_primitives.empty()) BuildNode(primitiveBounds, 0, m_primitives.size());
+}
+
+unsigned Bvh::BuildNode(const std::vector<AABB>& primitiveBounds, unsigned first, unsigned count)
+{
+    unsigned nodeIndex = m_nodes.size();
+    m_nodes.push_back({ AABB(), first, count, 0 });
+
+    AABB bounds;
+    AABB centroidBounds;
+    for (unsigned i = first; i < first + count; i++)
+    {
+        bounds.Expand(primitiveBounds[m_primitives[i]]);
+        centroidBounds.Expand(primitiveBounds[m_primitives[i]].GetCenter());
+    }
+    m_nodes[nodeIndex].bounds = bounds;
+    if (count <= MAX_LEAF_SIZE) return nodeIndex;
+
+    // Median split along the largest axis of the primitives' centers
+    glm::vec3 extent = { centroidBounds.max.x - centroidBounds.min.x,
+        centroidBounds.max.y - centroidBounds.min.y, centroidBounds.max.z - centroidBounds.min.z };
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+    auto center = [&](unsigned primitive) {
+        vec3 c = primitiveBounds[primitive].GetCenter();
+        return axis == 0 ? c.x : (axis == 1 ? c.y : c.z);
+    };
+
+    unsigned half = count / 2;
+    std::nth_element(m_primitives.begin() + first, m_primitives.begin() + first + half,
+        m_primitives.begin() + first + count, [&](unsigned a, unsigned b) {
+            return center(a) < center(b);
+        });
+
+    BuildNode(primitiveBounds, first, half);
+    unsigned rightChild = BuildNode(primitiveBounds, first + half, count - half);
+    m_nodes[nodeIndex].rightChild = rightChild;
+
+    return nodeIndex;
+}
+
+void Bvh::Refit(const std::vector<AABB>& primitiveBounds)
+{
+    PROFILE_SCOPE("Bvh::Refit");
+    // Children always come after their parent
+    for (int i = (int)m_nodes.size() - 1; i >= 0; i--)
+    {
+        Node& node = m_nodes[i];
+        node.bounds = AABB();
+        if (node.rightChild == 0)
+        {
+            for (unsigned j = node.first; j < node.first + node.count; j++)
+            {
+                node.bounds.Expand(primitiveBounds[m_primitives[j]]);
+            }
+        }
+        else
+        {
+            node.bounds.Expand(m_nodes[i + 1].bounds);
+            node.bounds.Expand(m_nodes[node.rightChild].bounds);
+        }
+    }
+}
+
+void Bvh::Query(const Frustum& frustum, const std::vector<AABB>& primitiveBounds,
+    std::vector<unsigned>& visiblePrimitives) const
+{
+    if (m_nodes.empty()) return;
+
+    unsigned stack[64];
+    int stackSize = 0;
+    stack[stackSize++] = 0;
+
+    while (stackSize > 0)
+    {
+        const Node& node = m_nodes[stack[--stackSize]];
+        Frustum::Containment containment = frustum.Classify(node.bounds);
+        if (containment == Frustum::Containment::Outside) continue;
+
+        // Whole subtree is visible, no need to test its children
+        if (containment == Frustum::Containment::Inside)
+        {
+            visiblePrimitives.insert(visiblePrimitives.end(), m_primitives.begin() + node.first,
+                m_primitives.begin() + node.first + node.count);
+            continue;
+        }
+
+        if (node.rightChild == 0)
+        {
+            for (unsigned i = node.first; i < node.first + node.count; i++)
+            {
+                if (frustum.Classify(primitiveBounds[m_primitives[i]]) != Frustum::Containment::Outside)
+                    visiblePrimitives.push_back(m_primitives[i]);
+            }
+            continue;
+        }
+
+        stack[stackSize++] = node.rightChild;
+        stack[stackSize++] = &node - m_nodes.data() + 1;
+    }
+}
+
+}
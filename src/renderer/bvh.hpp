@@ -0,0 +1,61 @@
+#pragma once
+#include "renderer/mesh.hpp"
+#include <glm/glm.hpp>
+#include <vector>
+
+namespace fluidity
+{
+
+struct Frustum
+{
+    enum class Containment
+    {
+        Outside,
+        Intersecting,
+        Inside
+    };
+
+    // Left, right, bottom, top, near and far planes, with normals pointing inside
+    glm::vec4 planes[6];
+
+    static Frustum FromMatrix(const glm::mat4& viewProjection);
+    Containment Classify(const AABB& box) const;
+};
+
+// Bounding volume hierarchy over a list of boxes (the primitives), queried with a frustum.
+// Build is only needed when the primitives are added or removed; when they just move, Refit
+// updates the node bounds while keeping the tree.
+class Bvh
+{
+public:
+    Bvh() = default;
+
+    void Build(const std::vector<AABB>& primitiveBounds);
+    void Refit(const std::vector<AABB>& primitiveBounds);
+    // Appends the indices of the primitives that are not outside the frustum. The bounds must
+    // be the same the tree was last built or refitted with.
+    void Query(const Frustum& frustum, const std::vector<AABB>& primitiveBounds,
+        std::vector<unsigned>& visiblePrimitives) const;
+
+    unsigned GetNumberOfPrimitives() const { return m_primitives.size(); }
+
+    static constexpr unsigned MAX_LEAF_SIZE = 4;
+
+private:
+    // Nodes are stored in depth first order, so the left child of a node is the next one.
+    // Every node covers the primitives [first, first + count) of m_primitives.
+    struct Node
+    {
+        AABB bounds;
+        unsigned first;
+        unsigned count;
+        unsigned rightChild; // 0 for leaves
+    };
+
+    unsigned BuildNode(const std::vector<AABB>& primitiveBounds, unsigned first, unsigned count);
+
+    std::vector<Node> m_nodes;
+    std::vector<unsigned> m_primitives;
+};
+
+}
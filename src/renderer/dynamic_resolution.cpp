@@ -0,0 +1,73 @@
+#include "renderer/dynamic_resolution.hpp"
+#include "renderer/gpu_timer.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace fluidity
+{
+
+DynamicResolutionController::DynamicResolutionController(float targetFrameTime, float minScale,
+  float maxScale)
+  : m_targetFrameTime(targetFrameTime),
+  m_minScale(minScale),
+  m_maxScale(maxScale),
+  m_scale(maxScale)
+{ /* */ }
+
+bool DynamicResolutionController::Update(float gpuFrameTime)
+{
+  if (m_samplesToSkip > 0)
+  {
+    m_samplesToSkip--;
+    return false;
+  }
+
+  m_accumulatedTime += gpuFrameTime;
+  m_numSamples++;
+  if (m_numSamples < FRAMES_PER_ADJUSTMENT) return false;
+
+  float averageFrameTime = m_accumulatedTime / m_numSamples;
+  m_accumulatedTime = 0.f;
+  m_numSamples = 0;
+
+  float newScale = m_scale;
+  if (averageFrameTime > m_targetFrameTime)
+  {
+    // Cost is roughly proportional to the number of pixels, which is quadratic in the scale
+    float desiredScale = m_scale * std::sqrt(m_targetFrameTime / averageFrameTime);
+    newScale = std::min(Quantize(desiredScale), m_scale - SCALE_STEP);
+  }
+  else if (averageFrameTime < m_targetFrameTime * UPSCALE_THRESHOLD)
+  {
+    newScale = m_scale + SCALE_STEP;
+  }
+
+  newScale = std::clamp(newScale, m_minScale, m_maxScale);
+  if (std::abs(newScale - m_scale) < SCALE_STEP * 0.5f) return false;
+
+  m_scale = newScale;
+  m_samplesToSkip = GpuTimer::NUM_QUERIES;
+  return true;
+}
+
+void DynamicResolutionController::Reset()
+{
+  m_scale = m_maxScale;
+  m_accumulatedTime = 0.f;
+  m_numSamples = 0;
+  m_samplesToSkip = 0;
+}
+
+void DynamicResolutionController::SetScaleRange(float minScale, float maxScale)
+{
+  m_minScale = std::min(minScale, maxScale);
+  m_maxScale = maxScale;
+  m_scale = std::clamp(m_scale, m_minScale, m_maxScale);
+}
+
+float DynamicResolutionController::Quantize(float scale) const
+{
+  return std::floor(scale / SCALE_STEP + 1e-3f) * SCALE_STEP;
+}
+
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+namespace fluidity
+{
+
+// Feedback controller that picks a render scale so the GPU frame time stays under a budget.
+// The scale only goes down when the average frame time is over the budget, and only goes up
+// when it is comfortably under it, so it doesn't oscillate around the target.
+class DynamicResolutionController
+{
+public:
+  DynamicResolutionController(float targetFrameTime = 16.6f, float minScale = 0.5f,
+    float maxScale = 1.f);
+
+  // Feeds a GPU frame time sample, in milliseconds. Returns true if the scale changed.
+  bool Update(float gpuFrameTime);
+  void Reset();
+
+  float GetScale() const { return m_scale; }
+  float GetTargetFrameTime() const { return m_targetFrameTime; }
+  void SetTargetFrameTime(float targetFrameTime) { m_targetFrameTime = targetFrameTime; }
+  void SetScaleRange(float minScale, float maxScale);
+
+  // Number of samples averaged before each adjustment
+  static constexpr int FRAMES_PER_ADJUSTMENT = 8;
+  // Going back up requires the frame time to be under this fraction of the budget
+  static constexpr float UPSCALE_THRESHOLD = 0.8f;
+  // Scales are multiples of this, which bounds the number of distinct buffer sizes
+  static constexpr float SCALE_STEP = 0.05f;
+
+private:
+  float Quantize(float scale) const;
+
+  float m_targetFrameTime;
+  float m_minScale;
+  float m_maxScale;
+  float m_scale;
+
+  float m_accumulatedTime = 0.f;
+  int m_numSamples = 0;
+  // Samples still measuring frames rendered at the previous scale
+  int m_samplesToSkip = 0;
+};
+
+}
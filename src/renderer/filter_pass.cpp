@@ -86,11 +86,14 @@ void FilterPass::Render()
 {
   // Sanity check
   assert(m_shader != nullptr);
+  int viewportState[4];
+  glGetIntegerv(GL_VIEWPORT, viewportState);
 
   RenderState previousRenderState = GetCurrentOpenGLRenderState();
   ChangeOpenGLRenderState(m_renderState);
 
   m_framebuffer.Bind();
+  glViewport(0, 0, m_bufferWidth, m_bufferHeight);
   m_shader->Bind();
 
   BindTextures();
@@ -101,6 +104,7 @@ void FilterPass::Render()
   m_framebuffer.Unbind();
 
   // Restore previous render state
+  glViewport(viewportState[0], viewportState[1], viewportState[2], viewportState[3]);
   ChangeOpenGLRenderState(previousRenderState);
 }
 
@@ -2,10 +2,16 @@
 #include "utils/glcall.h"
 #include "utils/opengl_utils.hpp"
 #include "renderer/skybox.hpp"
+#include "renderer/render_target_formats.hpp"
 #include "utils/logger.h"
+#include "utils/profiler.hpp"
 #include "vec.hpp"
 #include <SDL2/SDL.h>
+#include <algorithm>
 #include <cmath>
+#include <iomanip>
+#include <limits>
+#include <sstream>
 #include <glm/glm.hpp>
 #include <glm/gtc/type_ptr.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -17,8 +23,13 @@ FluidRenderer::FluidRenderer(unsigned windowWidth, unsigned windowHeight, float
   :   Renderer(),
   m_textureRenderer(nullptr),
   m_particleRenderPass(nullptr),
-  m_depthPass(nullptr),
+  m_depthThicknessPass(nullptr),
   m_filterPass(nullptr),
+  m_computeFilterPass(nullptr),
+  m_pyramidFilterPass(nullptr),
+  m_hiZCullingPass(nullptr),
+  m_outputFramebuffer({ { { GL_RGBA8, GL_RGBA, GL_UNSIGNED_BYTE } }, (GLsizei)windowWidth, 
+    (GLsizei)windowHeight, false }),
   m_uniformBufferCameraData(0),
   m_uniformBufferLights(0),
   m_uniformBufferMaterial(0),
@@ -32,6 +43,7 @@ FluidRenderer::FluidRenderer(unsigned windowWidth, unsigned windowHeight, float
 
 auto FluidRenderer::Init() -> bool 
 {
+  PROFILE_SCOPE("FluidRenderer::Init");
   GLCall(glEnable(GL_PROGRAM_POINT_SIZE));
 
   m_textureRenderer = new TextureRenderer();
@@ -39,6 +51,16 @@ auto FluidRenderer::Init() -> bool
   GLuint currentVao = m_scene.fluid.GetNumberOfFrames() > 0 ? 
     m_scene.fluid.GetFrameVao(m_currentFrame) : 0;
 
+  m_dynamicResolution.Reset();
+  m_fluidResolutionScale = std::clamp(m_scene.resolutionParameters.fluidScale, 0.25f, 1.f);
+  m_meshResolutionScale  = std::clamp(m_scene.resolutionParameters.meshScale, 0.25f, 1.f);
+  unsigned fluidBufferWidth  = GetFluidBufferWidth();
+  unsigned fluidBufferHeight = GetFluidBufferHeight();
+
+  SanitizeRenderTargetFormats(m_scene.renderTargetFormats);
+  m_appliedRenderTargetFormats = m_scene.renderTargetFormats;
+  const auto& formats = m_scene.renderTargetFormats;
+
   // Init all passes
   m_particleRenderPass = new ParticleRenderPass(
       m_windowWidth,
@@ -48,58 +70,71 @@ auto FluidRenderer::Init() -> bool
       currentVao
   );
 
-  m_depthPass = new ParticlePass(
-      m_windowWidth,
-      m_windowHeight,
-      0,
-      currentVao,
-      { GL_R32F, GL_RED, GL_FLOAT },
-      "../../shaders/depth-pass.vert",
-      "../../shaders/depth-pass.frag"
-  );
-
-  m_thicknessPass = new ParticlePass(
-    m_windowWidth,
-    m_windowHeight,
+  // Eye space depth of the closest surface (largest z) and additive thickness, in one draw
+  constexpr float minusInfinity = -std::numeric_limits<float>::infinity();
+  m_depthThicknessPass = new FusedParticlePass(
+    fluidBufferWidth,
+    fluidBufferHeight,
     0,
     currentVao,
-    { GL_R32F, GL_RED, GL_FLOAT },
-    "../../shaders/thickness-pass.vert",
-    "../../shaders/thickness-pass.frag"
+    { GetFramebufferAttachment(formats.depth), GetFramebufferAttachment(formats.thickness) },
+    {
+      { GL_MAX,      GL_ONE, GL_ONE, { minusInfinity, minusInfinity, minusInfinity, 1.f } },
+      { GL_FUNC_ADD, GL_ONE, GL_ONE, { 0.f, 0.f, 0.f, 1.f } }
+    },
+    "../../shaders/depth-thickness-pass.vert",
+    "../../shaders/depth-thickness-pass.frag"
   );
 
   m_normalPass = new FilterPass(
-      m_windowWidth,
-      m_windowHeight,
-      { GL_RGB32F, GL_RGB, GL_FLOAT },
+      fluidBufferWidth,
+      fluidBufferHeight,
+      GetFramebufferAttachment(formats.normal),
       "../../shaders/normal-pass.frag"
   );
 
   m_filterPass = new FilterPass(
-      m_windowWidth,
-      m_windowHeight,
-      { GL_R32F, GL_RED, GL_FLOAT },
+      fluidBufferWidth,
+      fluidBufferHeight,
+      GetFramebufferAttachment(formats.depth),
       "../../shaders/filter-narrow-range.frag",
       true
   );
 
+  m_computeFilterPass = new NarrowRangeFilterPass(
+      fluidBufferWidth,
+      fluidBufferHeight,
+      GetFramebufferAttachment(formats.depth),
+      "../../shaders/filter-narrow-range.comp"
+  );
+
+  m_pyramidFilterPass = new PyramidFilterPass(
+      fluidBufferWidth,
+      fluidBufferHeight,
+      GetFramebufferAttachment(formats.depth),
+      "../../shaders/filter-pyramid-downsample.comp",
+      "../../shaders/filter-pyramid-composite.comp"
+  );
+
   m_compositionPass = new FilterPass(
     m_windowWidth,
     m_windowHeight,
-    { GL_RGBA32F, GL_RGBA, GL_FLOAT },
+    GetFramebufferAttachment(formats.composition),
     "../../shaders/composition-pass.frag"
   );
 
   m_meshesPass = new MeshesPass(
-    m_windowWidth,
-    m_windowHeight,
+    GetMeshBufferWidth(),
+    GetMeshBufferHeight(),
     "../../shaders/mesh.vert", 
     "../../shaders/mesh.frag",
     { 
-      { GL_RGB32F, GL_RGB, GL_FLOAT },
-      { GL_R32F,   GL_RED, GL_FLOAT }
+      // Linear filtering, since it may be upsampled by the composition pass
+      GetFramebufferAttachment(formats.meshColor, GL_LINEAR),
+      GetFramebufferAttachment(formats.meshDepth)
     },
-    &m_scene
+    &m_scene,
+    &m_meshGeometry
   );
 
   m_meshesShadowPass = new MeshesPass(
@@ -110,39 +145,50 @@ auto FluidRenderer::Init() -> bool
     {
       { GL_R32F, GL_RED, GL_FLOAT }
     },
-    &m_scene
+    &m_scene,
+    &m_meshGeometry
   );
 
-  m_fluidShadowPass = new ParticlePass(
-    2048,
-    2048,
-    0,
-    currentVao,
-    { GL_R32F, GL_RED, GL_FLOAT },
-    "../../shaders/fluid-shadow.vs",
-    "../../shaders/fluid-shadow.fs"
+  // Same size as the meshes pass, since it reduces its depth
+  m_hiZCullingPass = new HiZCullingPass(
+    GetMeshBufferWidth(),
+    GetMeshBufferHeight(),
+    "../../shaders/hiz-downsample.comp",
+    "../../shaders/hiz-cull.comp"
   );
 
-  m_thicknessShadowPass = new ParticlePass(
-    m_windowWidth,
-    m_windowHeight,
+  // Window space depth in the light view (smallest z) and additive thickness, in one draw
+  m_fluidShadowPass = new FusedParticlePass(
+    2048, // Shadow map resolution
+    2048,
     0,
     currentVao,
-    { GL_R32F, GL_RED, GL_FLOAT },
-    "../../shaders/thickness-shadow.vert",
-    "../../shaders/thickness-shadow.frag"
+    { { GL_R32F, GL_RED, GL_FLOAT }, { GL_R32F, GL_RED, GL_FLOAT } },
+    {
+      { GL_MIN,      GL_ONE, GL_ONE, { 1.f, 1.f, 1.f, 1.f } },
+      { GL_FUNC_ADD, GL_ONE, GL_ONE, { 0.f, 0.f, 0.f, 1.f } }
+    },
+    "../../shaders/depth-thickness-shadow.vert",
+    "../../shaders/depth-thickness-shadow.frag"
   );
 
   m_renderPasses["ParticleRenderPass"] = m_particleRenderPass;
-  m_renderPasses["DepthPass"]          = m_depthPass;
+  m_renderPasses["DepthThicknessPass"] = m_depthThicknessPass;
   m_renderPasses["FilterPass"]         = m_filterPass;
+  m_renderPasses["ComputeFilterPass"]  = m_computeFilterPass;
+  m_renderPasses["PyramidFilterPass"]  = m_pyramidFilterPass;
   m_renderPasses["NormalPass"]         = m_normalPass;
   m_renderPasses["CompositionPass"]    = m_compositionPass;
-  m_renderPasses["ThicknessPass"]      = m_thicknessPass;
   m_renderPasses["MeshesPass"]         = m_meshesPass;
   m_renderPasses["MeshesShadowPass"]   = m_meshesShadowPass;
   m_renderPasses["FluidShadowPass"]    = m_fluidShadowPass;
-  m_renderPasses["ThicknessShadow"]    = m_thicknessShadowPass;
+  m_renderPasses["HiZCullingPass"]     = m_hiZCullingPass;
+
+  if (!m_meshGeometry.Init())
+  {
+    LOG_ERROR("Unable to initialize the mesh geometry.");
+    return false;
+  }
 
   for (auto& renderPassPair : m_renderPasses)
   {
@@ -153,34 +199,30 @@ auto FluidRenderer::Init() -> bool
     }
   }
 
+  // Shaders are reloaded when their files are saved. Not being able to watch them is fine.
+  if (!m_shaderWatcher.Init("../../shaders"))
+  {
+    LOG_WARNING("Unable to watch the shaders directory, shaders won't be reloaded on changes.");
+  }
+
+  if (m_offscreen && !m_outputFramebuffer.Init())
+  {
+    LOG_ERROR("Unable to initialize the output framebuffer.");
+    return false;
+  }
+
   if(!m_textureRenderer->Init()) 
   {
     LOG_ERROR("Unable to initialize texture renderer.");
     return false;  
   }
 
-  // Thickness pass -> Setup
+  if (!m_gpuTimer.Init())
   {
-    auto renderState = m_thicknessPass->GetRenderState();
-    renderState.useBlend                = true;
-    renderState.useDepthTest            = false;
-    renderState.blendSourceFactor       = GL_ONE;
-    renderState.blendDestinationFactor  = GL_ONE;
-    renderState.clearColor              = Vec4{ 0.f, 0.f, 0.f, 1.f };
-    m_thicknessPass->SetRenderState(renderState);
+    LOG_ERROR("Unable to initialize GPU timer.");
+    return false;
   }
 
-  // Thickness shadow pass -> Setup
-  {
-    auto renderState = m_thicknessShadowPass->GetRenderState();
-    renderState.useBlend                = true;
-    renderState.useDepthTest            = false;
-    renderState.blendSourceFactor       = GL_ONE;
-    renderState.blendDestinationFactor  = GL_ONE;
-    renderState.clearColor              = Vec4{ 0.f, 0.f, 0.f, 1.f };
-    m_thicknessShadowPass->SetRenderState(renderState);
-  }
-  
   // Meshes pass -> Setup
   {
     auto& meshesRenderState = m_meshesPass->GetRenderState();
@@ -189,13 +231,6 @@ auto FluidRenderer::Init() -> bool
     meshesShadowRenderState.clearColor = { 1.f, 1.f, 1.f, 1.f };
   }
 
-  // Fluid shadow pass -> Setup
-  {
-    auto& m_fluidShadowRenderState = m_fluidShadowPass->GetRenderState();
-    m_fluidShadowRenderState.useDepthTest = true;
-    m_fluidShadowRenderState.clearColor = { 1.f, 1.f, 1.f, 1.f };
-  }
-
 
   // Load light model - Represents the light in the scene
   m_lightModel.Load();
@@ -208,6 +243,20 @@ auto FluidRenderer::Init() -> bool
   return true;
 }
 
+void FluidRenderer::CleanUp()
+{
+  for (auto& model : m_scene.models)
+  {
+    model.CleanUp();
+  }
+  m_scene.fluid.CleanUp();
+  m_lightModel.CleanUp();
+
+  m_meshGeometry.CleanUp();
+  m_gpuTimer.CleanUp();
+  Framebuffer::CleanUpTexturePool();
+}
+
 void FluidRenderer::SetScene(const Scene& scene)
 {
   for (auto& model : m_scene.models)
@@ -217,18 +266,23 @@ void FluidRenderer::SetScene(const Scene& scene)
   m_scene.fluid.CleanUp();
 
   m_scene = scene;
+  m_lightsUploaded = false;
+  InvalidatePasses();
 }
 
 bool FluidRenderer::LoadScene()
 {
   // Sanity check: Guarantes the fluid renderer has been init
   assert(m_meshesPass != nullptr);
+  PROFILE_SCOPE("FluidRenderer::LoadScene");
 
   m_meshesPass->RemoveSkybox();
   
   if (m_scene.skyboxPath != "")
   {
-    Skybox skybox(m_scene.skyboxPath);
+    // Uses the faces already decoded by the SceneSerializer, if any
+    Skybox skybox = m_scene.skybox.GetFolderPath() == m_scene.skyboxPath ? m_scene.skybox :
+      Skybox(m_scene.skyboxPath);
     if (skybox.Init())
     {
       m_meshesPass->RemoveSkybox();
@@ -254,7 +308,11 @@ bool FluidRenderer::LoadScene()
   }
 
   m_cameraController.SetCamera(m_scene.camera);
+  m_cameraController.GetCamera().SetAspectRatio(m_aspectRatio);
 
+  m_dynamicResolution.Reset();
+  UpdateRenderTargetSizes();
+  ApplyRenderTargetFormats();
   SetUpStaticUniforms();
 
   ResetPlayback();
@@ -279,6 +337,263 @@ void FluidRenderer::SetCurrentFrame(int frame)
 }
 
 
+GLuint FluidRenderer::GetLinearOutputTexture() const
+{
+  return m_textureRenderer->GetTexture();
+}
+
+void FluidRenderer::Resize(unsigned windowWidth, unsigned windowHeight)
+{
+  if (windowWidth == 0 || windowHeight == 0) return;
+  if (windowWidth == m_windowWidth && windowHeight == m_windowHeight) return;
+  PROFILE_SCOPE("FluidRenderer::Resize");
+
+  m_windowWidth  = windowWidth;
+  m_windowHeight = windowHeight;
+  m_aspectRatio  = (float)windowWidth / windowHeight;
+  m_cameraController.GetCamera().SetAspectRatio(m_aspectRatio);
+  GLCall(glViewport(0, 0, windowWidth, windowHeight));
+
+  m_compositionPass->Resize(windowWidth, windowHeight);
+  m_particleRenderPass->Resize(windowWidth, windowHeight);
+  if (m_offscreen) m_outputFramebuffer.Resize(windowWidth, windowHeight);
+
+  // The scaled passes depend on the window size as well
+  UpdateRenderTargetSizes(true);
+}
+
+void FluidRenderer::UpdateDynamicResolution()
+{
+  auto& resolutionParameters = m_scene.resolutionParameters;
+  if (!m_gpuTimer.Poll()) return;
+
+  if (!resolutionParameters.dynamicResolution)
+  {
+    if (m_dynamicResolution.GetScale() != 1.f) m_dynamicResolution.Reset();
+    return;
+  }
+
+  m_dynamicResolution.SetTargetFrameTime(resolutionParameters.targetFrameTime);
+  m_dynamicResolution.SetScaleRange(std::clamp(resolutionParameters.minDynamicScale, 0.25f, 1.f), 1.f);
+  m_dynamicResolution.Update(m_gpuTimer.GetLastResult());
+}
+
+void FluidRenderer::UpdateRenderTargetSizes(bool force)
+{
+  auto& resolutionParameters = m_scene.resolutionParameters;
+  float dynamicScale = resolutionParameters.dynamicResolution ? m_dynamicResolution.GetScale() : 1.f;
+  float fluidScale   = std::clamp(resolutionParameters.fluidScale, 0.25f, 1.f) * dynamicScale;
+  float meshScale    = std::clamp(resolutionParameters.meshScale, 0.25f, 1.f) * dynamicScale;
+
+  if (!force && fluidScale == m_fluidResolutionScale && meshScale == m_meshResolutionScale) return;
+  PROFILE_SCOPE("FluidRenderer::UpdateRenderTargetSizes");
+
+  m_fluidResolutionScale = fluidScale;
+  m_meshResolutionScale  = meshScale;
+
+  unsigned fluidWidth  = GetFluidBufferWidth();
+  unsigned fluidHeight = GetFluidBufferHeight();
+  m_depthThicknessPass->Resize(fluidWidth, fluidHeight);
+  m_filterPass->Resize(fluidWidth, fluidHeight);
+  m_computeFilterPass->Resize(fluidWidth, fluidHeight);
+  m_pyramidFilterPass->Resize(fluidWidth, fluidHeight);
+  m_normalPass->Resize(fluidWidth, fluidHeight);
+
+  m_meshesPass->Resize(GetMeshBufferWidth(), GetMeshBufferHeight());
+  m_hiZCullingPass->Resize(GetMeshBufferWidth(), GetMeshBufferHeight());
+
+  // Screen size uniforms depend on the buffer size
+  SetUpStaticUniforms();
+}
+
+void FluidRenderer::ApplyRenderTargetFormats()
+{
+  PROFILE_SCOPE("FluidRenderer::ApplyRenderTargetFormats");
+  auto& formats = m_scene.renderTargetFormats;
+  SanitizeRenderTargetFormats(formats);
+
+  m_depthThicknessPass->GetFramebuffer().SetAttachmentFormat(0, GetFramebufferAttachment(formats.depth));
+  m_depthThicknessPass->GetFramebuffer().SetAttachmentFormat(1, 
+    GetFramebufferAttachment(formats.thickness));
+  m_filterPass->GetFramebuffer().SetAttachmentFormat(0, GetFramebufferAttachment(formats.depth));
+  m_filterPass->GetFramebuffer().SetAttachmentFormat(1, GetFramebufferAttachment(formats.depth));
+  m_computeFilterPass->SetRenderTargetFormat(GetFramebufferAttachment(formats.depth));
+  m_pyramidFilterPass->SetRenderTargetFormat(GetFramebufferAttachment(formats.depth));
+  m_normalPass->GetFramebuffer().SetAttachmentFormat(0, GetFramebufferAttachment(formats.normal));
+  m_compositionPass->GetFramebuffer().SetAttachmentFormat(0, 
+    GetFramebufferAttachment(formats.composition));
+  m_meshesPass->GetFramebuffer().SetAttachmentFormat(0, 
+    GetFramebufferAttachment(formats.meshColor, GL_LINEAR));
+  m_meshesPass->GetFramebuffer().SetAttachmentFormat(1, GetFramebufferAttachment(formats.meshDepth));
+
+  m_appliedRenderTargetFormats = formats;
+  InvalidatePasses();
+}
+
+GLuint FluidRenderer::GetRenderTargetTexture(RenderTarget target)
+{
+  bool hasFluid = m_scene.fluid.GetNumberOfFrames() > 0;
+  switch (target)
+  {
+    case RenderTarget::Depth:       return hasFluid ? GetFilteredDepthTexture() : 0;
+    case RenderTarget::Thickness:   return hasFluid ? m_depthThicknessPass->GetBuffer(1) : 0;
+    case RenderTarget::Normal:      return hasFluid ? m_normalPass->GetBuffer() : 0;
+    case RenderTarget::Composition: return hasFluid ? m_compositionPass->GetBuffer() : 0;
+    case RenderTarget::MeshColor:   return m_meshesPass->GetBuffer(0);
+    case RenderTarget::MeshDepth:   return m_meshesPass->GetBuffer(1);
+    default:                        return 0;
+  }
+}
+
+std::vector<RenderTargetReadback> FluidRenderer::ReadBackRenderTargets()
+{
+  std::vector<RenderTargetReadback> readbacks;
+  for (int i = 0; i < (int)RenderTarget::Count; i++)
+  {
+    RenderTarget target = (RenderTarget)i;
+    GLuint texture = GetRenderTargetTexture(target);
+    if (texture != 0) readbacks.push_back(ReadRenderTarget(target, texture));
+  }
+
+  return readbacks;
+}
+
+std::string FluidRenderer::ValidateRenderTargetFormats()
+{
+  PROFILE_SCOPE("FluidRenderer::ValidateRenderTargetFormats");
+  // Both frames must be rendered at the same resolution
+  bool dynamicResolution = m_scene.resolutionParameters.dynamicResolution;
+  m_scene.resolutionParameters.dynamicResolution = false;
+
+  RenderTargetFormats formats = m_scene.renderTargetFormats;
+  m_scene.renderTargetFormats = RenderTargetFormats();
+  Render();
+  auto reference = ReadBackRenderTargets();
+
+  m_scene.renderTargetFormats = formats;
+  Render();
+  auto test = ReadBackRenderTargets();
+
+  m_scene.resolutionParameters.dynamicResolution = dynamicResolution;
+
+  std::stringstream report;
+  report << "Maximum error against FP32 targets:\n";
+  for (int i = 0; i < reference.size(); i++)
+  {
+    RenderTarget target = reference[i].target;
+    RenderTargetError error = CompareRenderTargets(reference[i], test[i]);
+    report << "  " << GetRenderTargetName(target) << " (" << 
+      GetRenderTargetFormatName(formats[target]) << "): " << error.maxAbsoluteError << 
+      " absolute, " << error.maxRelativeError << " relative, " << error.coverageMismatches << 
+      " coverage mismatches\n";
+  }
+
+  return report.str();
+}
+
+std::string FluidRenderer::BenchmarkFilters()
+{
+  PROFILE_SCOPE("FluidRenderer::BenchmarkFilters");
+  if (m_scene.fluid.GetNumberOfFrames() == 0) return "Filter benchmark requires a fluid.\n";
+
+  struct FilterConfiguration
+  {
+    const char* name;
+    FilterBackend backend;
+    bool filter1D;
+  };
+
+  const FilterConfiguration configurations[] =
+  {
+    { "fragment 2D", FilterBackend::Fragment, false },
+    { "fragment 1D", FilterBackend::Fragment, true  },
+    { "compute",     FilterBackend::Compute,  false },
+    { "pyramid",     FilterBackend::Pyramid,  false },
+  };
+  const int maxFilterSizes[] = { 8, 16, 32, 64, 128, 200 };
+  constexpr int NUM_RUNS = 16;
+
+  // Renders once, so the depth pass and the buffer sizes are up to date
+  bool dynamicResolution = m_scene.resolutionParameters.dynamicResolution;
+  m_scene.resolutionParameters.dynamicResolution = false;
+  Render();
+
+  FilteringParameters filteringParameters = m_scene.filteringParameters;
+  m_scene.filteringParameters.nIterations = std::max(1, filteringParameters.nIterations);
+  // Largest filter size in the GUI, so that most pixels are limited by the max filter size
+  m_scene.filteringParameters.filterSize  = 30;
+
+  GpuTimer timer;
+  timer.Init();
+
+  std::stringstream report;
+  report << "Filtering GPU time (ms), " << m_scene.filteringParameters.nIterations << 
+    " iterations at " << GetFluidBufferWidth() << "x" << GetFluidBufferHeight() << ":\n";
+  report << std::setw(16) << "max filter size";
+  for (const auto& configuration : configurations) report << std::setw(13) << configuration.name;
+  report << "\n" << std::fixed << std::setprecision(3);
+
+  for (int maxFilterSize : maxFilterSizes)
+  {
+    report << std::setw(16) << maxFilterSize;
+    for (const auto& configuration : configurations)
+    {
+      m_scene.filteringParameters.maxFilterSize = maxFilterSize;
+      m_scene.filteringParameters.backend       = configuration.backend;
+      m_scene.filteringParameters.filter1D      = configuration.filter1D;
+      SetUpPerFrameUniforms();
+
+      // Warm up, then wait on every run so that each query is read right away
+      DoFiltering();
+      float totalTime = 0.f;
+      int numResults  = 0;
+      for (int i = 0; i < NUM_RUNS; i++)
+      {
+        timer.Begin();
+        DoFiltering();
+        timer.End();
+        GLCall(glFinish());
+        if (timer.Poll())
+        {
+          totalTime += timer.GetLastResult();
+          numResults++;
+        }
+      }
+      report << std::setw(13) << (numResults > 0 ? totalTime / numResults : 0.f);
+    }
+    report << "\n";
+  }
+
+  timer.CleanUp();
+  m_scene.filteringParameters = filteringParameters;
+  m_scene.resolutionParameters.dynamicResolution = dynamicResolution;
+  SetUpPerFrameUniforms();
+  // The filter passes' buffers were overwritten behind their input hashes
+  InvalidatePasses();
+
+  return report.str();
+}
+
+unsigned FluidRenderer::GetFluidBufferWidth() const
+{
+  return std::max(1u, (unsigned)std::round(m_windowWidth * m_fluidResolutionScale));
+}
+
+unsigned FluidRenderer::GetFluidBufferHeight() const
+{
+  return std::max(1u, (unsigned)std::round(m_windowHeight * m_fluidResolutionScale));
+}
+
+unsigned FluidRenderer::GetMeshBufferWidth() const
+{
+  return std::max(1u, (unsigned)std::round(m_windowWidth * m_meshResolutionScale));
+}
+
+unsigned FluidRenderer::GetMeshBufferHeight() const
+{
+  return std::max(1u, (unsigned)std::round(m_windowHeight * m_meshResolutionScale));
+}
+
 auto FluidRenderer::SetVAOS() -> void
 {
   assert(m_scene.fluid.GetNumberOfFrames() > 0);
@@ -309,11 +624,6 @@ auto FluidRenderer::InitUniformBuffers() -> bool
   GLCall(glGenBuffers(1, &m_uniformBufferMaterial));
   GLCall(glGenBuffers(1, &m_uniformBufferLightMatrices));
 
-  constexpr int CAMERA_DATA_UB_INDEX    = 0;
-  constexpr int LIGHTS_UB_INDEX         = 1;
-  constexpr int LIGHT_MATRICES_UB_INDEX = 2;
-  constexpr int MATERIAL_UB_INDEX       = 3;
-
   GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_uniformBufferCameraData));
   GLCall(glBufferData(GL_UNIFORM_BUFFER, sizeof(CameraData), nullptr, GL_DYNAMIC_DRAW));
   GLCall(glBindBufferRange(GL_UNIFORM_BUFFER, CAMERA_DATA_UB_INDEX, 
@@ -337,6 +647,13 @@ auto FluidRenderer::InitUniformBuffers() -> bool
 
   GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 
+  SetUpUniformBuffers();
+
+  return true;
+}
+
+void FluidRenderer::SetUpUniformBuffers()
+{
   // Setup uniform buffers on render passes
   for (auto& renderPassPair : m_renderPasses)
   {
@@ -357,9 +674,88 @@ auto FluidRenderer::InitUniformBuffers() -> bool
     {
       LOG_WARNING("Unable to set Material uniform buffer on " + renderPassPair.first);
     }
+  }
 }
 
-  return true;
+bool FluidRenderer::ReloadChangedShaders()
+{
+  PROFILE_SCOPE("FluidRenderer::ReloadChangedShaders");
+  for (const std::string& fileName : m_shaderWatcher.PollChangedFiles())
+  {
+    for (auto& renderPassPair : m_renderPasses)
+    {
+      for (Shader* shader : renderPassPair.second->GetShaders())
+      {
+        if (!shader->UsesFile(fileName)) continue;
+        DBG("Reloading " << fileName << " (" << renderPassPair.first << ")");
+        shader->Reload();
+      }
+    }
+  }
+
+  // Without parallel compilation the programs were already built by Reload, so they're
+  // swapped in right away
+  bool swappedAny = false;
+  for (auto& renderPassPair : m_renderPasses)
+  {
+    for (Shader* shader : renderPassPair.second->GetShaders())
+    {
+      Shader::ReloadStatus status = shader->PollReload();
+      if (status == Shader::ReloadStatus::Failed)
+      {
+        LOG_ERROR("Unable to reload a shader of " + renderPassPair.first + 
+          ", keeping the previous one");
+      }
+      swappedAny |= status == Shader::ReloadStatus::Swapped;
+    }
+  }
+
+  return swappedAny;
+}
+
+uint32_t FluidRenderer::GetShaderFeatures() const
+{
+  uint32_t features = 0;
+  if (m_scene.fluidParameters.transparentFluid)      features |= SHADER_FEATURE_TRANSPARENT_FLUID;
+  if (m_scene.lightingParameters.usePcf)             features |= SHADER_FEATURE_USE_PCF;
+  if (m_scene.lightingParameters.renderShadows)      features |= SHADER_FEATURE_RENDER_SHADOWS;
+  if (m_scene.filteringParameters.filter1D)          features |= SHADER_FEATURE_FILTER_1D;
+  if (m_scene.filteringParameters.useRefractionMask) features |= SHADER_FEATURE_USE_REFRACTION_MASK;
+  // Particles have no anisotropy data yet, so SHADER_FEATURE_USE_ANISOTROPY_KERNEL is never set
+  return features;
+}
+
+bool FluidRenderer::SelectShaderVariants()
+{
+  PROFILE_SCOPE("FluidRenderer::SelectShaderVariants");
+  uint32_t features = GetShaderFeatures();
+  bool changedAny   = false;
+  for (auto& renderPassPair : m_renderPasses)
+  {
+    for (Shader* shader : renderPassPair.second->GetShaders())
+    {
+      changedAny |= shader->SetFeatures(features);
+    }
+  }
+
+  return changedAny;
+}
+
+void FluidRenderer::RestoreProgramState()
+{
+  // Block bindings and uniforms belong to the program, so a program that was just built starts
+  // from defaults, and one built before may have missed changes. Per frame uniforms are set
+  // again anyway.
+  SetUpUniformBuffers();
+  for (auto& renderPassPair : m_renderPasses)
+  {
+    if (!renderPassPair.second->RestoreUniforms())
+    {
+      LOG_WARNING("Unable to restore the uniforms of " + renderPassPair.first);
+    }
+  }
+  SetUpStaticUniforms();
+  InvalidatePasses();
 }
 
 auto FluidRenderer::UploadMaterial() -> void
@@ -375,15 +771,17 @@ auto FluidRenderer::SetUpStaticUniforms() -> void
   auto& filteringParameters = m_scene.filteringParameters;
 
   // TODO: Maybe these passes should be serialized, or initialized in another class?
-  // Depth pass -> Init uniforms
+  // Depth and thickness pass -> Init uniforms
   {
-    auto& depthPassShader = m_depthPass->GetShader();
-    depthPassShader.Bind();
-    depthPassShader.SetUniform1i("u_UseAnisotropyKernel", 0);
-    depthPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius);
-    depthPassShader.SetUniform1i("u_ScreenWidth", m_windowWidth);
-    depthPassShader.SetUniform1i("u_ScreenHeight", m_windowHeight);
-    depthPassShader.Unbind();
+    auto& depthThicknessPassShader = m_depthThicknessPass->GetShader();
+    depthThicknessPassShader.Bind();
+    depthThicknessPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius);
+    depthThicknessPassShader.SetUniform1f("u_ThicknessRadius", fluidParameters.pointRadius * 1.2f);
+    depthThicknessPassShader.SetUniform1f("u_PointScale", 
+      (float)GetFluidBufferHeight() / tanf(55.0 * 0.5 * 3.14159265358979323846f / 180.0));
+    depthThicknessPassShader.SetUniform1i("u_ScreenWidth", GetFluidBufferWidth());
+    depthThicknessPassShader.SetUniform1i("u_ScreenHeight", GetFluidBufferHeight());
+    depthThicknessPassShader.Unbind();
   }
 
   // Meshes pass -> Init uniforms
@@ -397,47 +795,42 @@ auto FluidRenderer::SetUpStaticUniforms() -> void
     meshesPassSahder.Unbind(); 
   }
 
-  // Thickness pass -> Init uniforms, set up render state
-  {
-
-    auto& thicknessPassShader = m_thicknessPass->GetShader();
-    thicknessPassShader.Bind();
-    thicknessPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius * 1.2f);
-    thicknessPassShader.SetUniform1f("u_PointScale", 
-      (float)m_windowHeight / tanf(55.0 * 0.5 * 3.14159265358979323846f / 180.0));
-    thicknessPassShader.SetUniform1i("u_HasSolid", 0);
-    thicknessPassShader.Unbind();
-  }
-
-  // Thickness shadow -> Init uniforms, set up render state
-  {
-
-    auto& thicknessShadowPassShader = m_thicknessShadowPass->GetShader();
-    thicknessShadowPassShader.Bind();
-    thicknessShadowPassShader.SetUniform1f("u_PointScale", 
-      (float)m_windowHeight / tanf(55.0 * 0.5 * 3.14159265358979323846f / 180.0));
-    thicknessShadowPassShader.SetUniform1i("u_LightID", 0);
-    thicknessShadowPassShader.Unbind();
-  }
-  
   // Narrow filter pass -> Init uniforms
   {
     auto& narrowFilterShader = m_filterPass->GetShader();
     narrowFilterShader.Bind();
-    narrowFilterShader.SetUniform1i("u_ScreenWidth", m_windowWidth);
-    narrowFilterShader.SetUniform1i("u_ScreenHeight", m_windowHeight);
+    narrowFilterShader.SetUniform1i("u_ScreenWidth", GetFluidBufferWidth());
+    narrowFilterShader.SetUniform1i("u_ScreenHeight", GetFluidBufferHeight());
     narrowFilterShader.SetUniform1i("u_FilterSize", filteringParameters.filterSize);
     narrowFilterShader.SetUniform1i("u_MaxFilterSize", filteringParameters.maxFilterSize);
     narrowFilterShader.SetUniform1f("u_ParticleRadius", fluidParameters.pointRadius);
     narrowFilterShader.Unbind();
+
+    auto& computeFilterShader = m_computeFilterPass->GetShader();
+    computeFilterShader.Bind();
+    computeFilterShader.SetUniform1i("u_ScreenWidth", GetFluidBufferWidth());
+    computeFilterShader.SetUniform1i("u_ScreenHeight", GetFluidBufferHeight());
+    computeFilterShader.SetUniform1i("u_FilterSize", filteringParameters.filterSize);
+    computeFilterShader.SetUniform1i("u_MaxFilterSize", filteringParameters.maxFilterSize);
+    computeFilterShader.SetUniform1f("u_ParticleRadius", fluidParameters.pointRadius);
+    computeFilterShader.Unbind();
+
+    auto& pyramidFilterShader = m_pyramidFilterPass->GetShader();
+    pyramidFilterShader.Bind();
+    pyramidFilterShader.SetUniform1i("u_ScreenWidth", GetFluidBufferWidth());
+    pyramidFilterShader.SetUniform1i("u_ScreenHeight", GetFluidBufferHeight());
+    pyramidFilterShader.SetUniform1i("u_FilterSize", filteringParameters.filterSize);
+    pyramidFilterShader.SetUniform1i("u_MaxFilterSize", filteringParameters.maxFilterSize);
+    pyramidFilterShader.SetUniform1f("u_ParticleRadius", fluidParameters.pointRadius);
+    pyramidFilterShader.Unbind();
   }
 
   // Normal pass -> Init uniforms 
   {
     auto& normalPassShader = m_normalPass->GetShader();
     normalPassShader.Bind();
-    normalPassShader.SetUniform1i("u_ScreenWidth", m_windowWidth);
-    normalPassShader.SetUniform1i("u_ScreenHeight", m_windowHeight);
+    normalPassShader.SetUniform1i("u_ScreenWidth", GetFluidBufferWidth());
+    normalPassShader.SetUniform1i("u_ScreenHeight", GetFluidBufferHeight());
     normalPassShader.Unbind();
   }
 
@@ -453,7 +846,6 @@ auto FluidRenderer::SetUpStaticUniforms() -> void
     compositionPassShader.SetUniform1i("u_SolidDepthMap",       4);
     compositionPassShader.SetUniform1i("u_SolidShadowMaps[0]",  5);
     compositionPassShader.SetUniform1i("u_SkyBoxTex",           6);
-    compositionPassShader.SetUniform1i("u_TransparentFluid", fluidParameters.transparentFluid ? 1 : 0);
     compositionPassShader.SetUniform1f("u_ReflectionConstant", 0.f);
     compositionPassShader.SetUniform1i("u_FluidShadowMaps[0]", 7);
     compositionPassShader.SetUniform1i("u_FluidShadowThickness[0]", 8);
@@ -464,53 +856,45 @@ auto FluidRenderer::SetUpStaticUniforms() -> void
   {
     auto& fluidShadowShader = m_fluidShadowPass->GetShader();
     fluidShadowShader.Bind();
-    fluidShadowShader.SetUniform1i("u_ScreenWidth", m_windowWidth);
-    fluidShadowShader.SetUniform1i("u_ScreenHeight", m_windowHeight);
+    fluidShadowShader.SetUniform1i("u_LightID", 0);
+    fluidShadowShader.SetUniform1f("u_PointScale", (float)m_fluidShadowPass->GetBufferHeight() / 
+      tanf(55.0 * 0.5 * 3.14159265358979323846f / 180.0));
+    fluidShadowShader.SetUniform1i("u_ScreenWidth", m_fluidShadowPass->GetBufferWidth());
+    fluidShadowShader.SetUniform1i("u_ScreenHeight", m_fluidShadowPass->GetBufferHeight());
+    fluidShadowShader.Unbind();
   }
 }
 
 void FluidRenderer::SetUpPerFrameUniforms()
 {
+  PROFILE_SCOPE("FluidRenderer::SetUpPerFrameUniforms");
   auto& fluidParameters     = m_scene.fluidParameters;
   auto& filteringParameters = m_scene.filteringParameters;
   auto& lightingParameters  = m_scene.lightingParameters;
 
   UploadCameraData();
-  UploadLights();
   UploadMaterial();
 
-  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_uniformBufferLightMatrices));
-  float zNear = 1.0;
-  float zFar  = 100.f;
-  for (int i = 0; i < m_scene.lights.size(); i++)
+  // Lights only change when edited, so there's no need to upload them every frame
+  if (!m_lightsUploaded || m_uploadedLightsVersion != m_scene.lightsVersion)
   {
-    auto& l = m_scene.lights[i];
-    float radius = 10.f;
-    glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, zNear, zFar);
-    // Find light matrix
-    glm::mat4 lightView = glm::lookAt(glm::vec3(l.position.x, l.position.y, l.position.z),
-      glm::vec3(0), // directional light, pointing at scene origin
-      glm::vec3(0, 1.0, 0));
-
-    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Mat4), glm::value_ptr(lightView)));
-    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, sizeof(Mat4), sizeof(Mat4), glm::value_ptr(lightProjection)));
+    UploadLights();
+    UploadLightMatrices();
+    m_uploadedLightsVersion = m_scene.lightsVersion;
+    m_lightsUploaded = true;
   }
-  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 
   auto& meshesShader = m_meshesPass->GetShader();
   meshesShader.Bind();
-  meshesShader.SetUniform1i("uRenderShadows", lightingParameters.renderShadows ? 1 : 0);
   meshesShader.SetUniform1i("uRenderFluidShadows", lightingParameters.renderFluidShadows ? 1 : 0);
   meshesShader.SetUniform1f("uMinShadowBias", lightingParameters.minShadowBias);
   meshesShader.SetUniform1f("uMaxShadowBias", lightingParameters.maxShadowBias);
   meshesShader.SetUniform1f("uShadowIntensity", lightingParameters.shadowIntensity);
   meshesShader.SetUniform1f("uFluidShadowIntensity", lightingParameters.fluidShadowIntensity);
-  meshesShader.SetUniform1i("uUsePcf", lightingParameters.usePcf ? 1 : 0);
   meshesShader.Unbind();
 
   auto& compositionPassShader = m_compositionPass->GetShader();
   compositionPassShader.Bind();
-  compositionPassShader.SetUniform1i("u_TransparentFluid", fluidParameters.transparentFluid ? 1 : 0);
   // Detail: Shadows require at least one mesh for now
   // TODO: This will change when fluid shadows are added
 #ifdef ENABLE_COMPOSITION_SHADOWS
@@ -522,32 +906,41 @@ void FluidRenderer::SetUpPerFrameUniforms()
 
   compositionPassShader.SetUniform1f("u_AttennuationConstant", fluidParameters.attenuation);
   compositionPassShader.SetUniform1f("uRefractionModifier", fluidParameters.refractionModifier);
-  compositionPassShader.SetUniform1i("uUseRefractionMask", filteringParameters.useRefractionMask ? 1 : 0);
+  compositionPassShader.SetUniform1i("u_UpsampleFluid", GetFluidBufferWidth() != m_windowWidth ||
+    GetFluidBufferHeight() != m_windowHeight ? 1 : 0);
+  compositionPassShader.SetUniform1f("u_UpsampleDepthSigma", fluidParameters.pointRadius * 2.f);
   compositionPassShader.Unbind();
 
   auto& narrowFilterShader = m_filterPass->GetShader();
   narrowFilterShader.Bind();
-  narrowFilterShader.SetUniform1i("u_DoFilter1D", m_scene.filteringParameters.filter1D ? 1 : 0);
   narrowFilterShader.SetUniform1i("u_FilterSize", filteringParameters.filterSize);
   narrowFilterShader.SetUniform1i("u_MaxFilterSize", filteringParameters.maxFilterSize);
   narrowFilterShader.SetUniform1f("u_ParticleRadius", fluidParameters.pointRadius);
   narrowFilterShader.Unbind();
 
-  auto& thicknessPassShader = m_thicknessPass->GetShader();
-  thicknessPassShader.Bind();
-  thicknessPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius * 1.2f);
-
-  auto& thicknessShadowPassShader = m_thicknessShadowPass->GetShader();
-  thicknessShadowPassShader.Bind();
-  thicknessShadowPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius * 1.2f);
-
-  auto& depthPassShader = m_depthPass->GetShader();
-  depthPassShader.Bind();
-  depthPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius);
+  auto& computeFilterShader = m_computeFilterPass->GetShader();
+  computeFilterShader.Bind();
+  computeFilterShader.SetUniform1i("u_FilterSize", filteringParameters.filterSize);
+  computeFilterShader.SetUniform1i("u_MaxFilterSize", filteringParameters.maxFilterSize);
+  computeFilterShader.SetUniform1f("u_ParticleRadius", fluidParameters.pointRadius);
+  computeFilterShader.Unbind();
+
+  auto& pyramidFilterShader = m_pyramidFilterPass->GetShader();
+  pyramidFilterShader.Bind();
+  pyramidFilterShader.SetUniform1i("u_FilterSize", filteringParameters.filterSize);
+  pyramidFilterShader.SetUniform1i("u_MaxFilterSize", filteringParameters.maxFilterSize);
+  pyramidFilterShader.SetUniform1f("u_ParticleRadius", fluidParameters.pointRadius);
+  pyramidFilterShader.Unbind();
+
+  auto& depthThicknessPassShader = m_depthThicknessPass->GetShader();
+  depthThicknessPassShader.Bind();
+  depthThicknessPassShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius);
+  depthThicknessPassShader.SetUniform1f("u_ThicknessRadius", fluidParameters.pointRadius * 1.2f);
 
   auto& fluidShadowShader = m_fluidShadowPass->GetShader();
   fluidShadowShader.Bind();
   fluidShadowShader.SetUniform1f("u_PointRadius", fluidParameters.pointRadius);
+  fluidShadowShader.SetUniform1f("u_ThicknessRadius", fluidParameters.pointRadius * 1.2f);
   fluidShadowShader.SetUniform1i("u_LightID", 0);
 
   m_textureRenderer->SetGammaCorrectionEnabled(filteringParameters.gammaCorrection);
@@ -556,41 +949,101 @@ void FluidRenderer::SetUpPerFrameUniforms()
 
 auto FluidRenderer::Update() -> void
 {
+  PROFILE_SCOPE("FluidRenderer::Update");
   m_cameraController.Update();
   if (IsPlaying()) AdvanceFrame();
 }
 
 auto FluidRenderer::Render() -> void
 {
+  PROFILE_SCOPE("FluidRenderer::Render");
+  // Programs only change when a shader file is saved or a feature is toggled
+  bool programsChanged = ReloadChangedShaders();
+  programsChanged     |= SelectShaderVariants();
+  if (programsChanged) RestoreProgramState();
+  UpdateDynamicResolution();
+  UpdateRenderTargetSizes();
+  if (m_scene.renderTargetFormats != m_appliedRenderTargetFormats) ApplyRenderTargetFormats();
+  m_gpuTimer.Begin();
+
   SetUpPerFrameUniforms(); 
+
+  // Passes are skipped when their inputs are the same as in their last render, so a paused
+  // scene with a still camera only costs the final blit, and lighting or material changes
+  // only run the meshes and composition passes
+  uint64_t cameraHash = HashCamera();
   GLuint depthTexture = 0;
   if (m_scene.fluid.GetNumberOfFrames() > 0)
   {
     SetVAOS();
     SetNumberOfParticles();
 
-    m_depthPass->Render();
-    m_thicknessPass->Render();
+    uint64_t particlesHash = PassInputHash()
+      .Add(m_currentFrame)
+      .Add(m_scene.fluid.GetFrameVao(m_currentFrame))
+      .Add(m_scene.fluid.GetNumberOfParticles(m_currentFrame))
+      .Add(m_scene.fluidParameters.pointRadius)
+      .Get();
 
-    m_fluidShadowPass->Render();
-    m_thicknessShadowPass->Render();
+    // The shadow map always draws every particle, as the meshes don't occlude the light view
+    if (m_fluidShadowPass->NeedsRender(PassInputHash().Add(particlesHash)
+      .Add(m_scene.lightsVersion).Get()))
+    {
+      PROFILE_SCOPE("FluidShadowPass");
+      m_fluidShadowPass->Render();
+    }
   
-    RenderMeshes();
-    DoFiltering();
+    // Meshes go first, their depth is used to cull the particles
+    RenderMeshes(cameraHash);
+
+    bool occlusionCulling = IsOcclusionCullingActive();
+    if (occlusionCulling) CullParticleChunks(particlesHash);
+    else m_depthThicknessPass->SetIndirectDraws(0, 0);
+
+    if (m_depthThicknessPass->NeedsRender(PassInputHash()
+      .Add(particlesHash)
+      .Add(cameraHash)
+      .Add(occlusionCulling ? m_hiZCullingPass->GetOutputVersion() : 0)
+      .Get()))
+    {
+      PROFILE_SCOPE("DepthThicknessPass");
+      m_depthThicknessPass->Render();
+    }
+
+    RenderPass* filterPass = GetActiveFilterPass();
+    if (filterPass->NeedsRender(PassInputHash()
+      .Add(m_depthThicknessPass->GetOutputVersion())
+      .Add(m_scene.filteringParameters)
+      .Add(m_scene.fluidParameters.pointRadius)
+      .Get()))
+    {
+      DoFiltering();
+    }
     
-    depthTexture = m_scene.filteringParameters.nIterations > 0 ? m_filterPass->GetBuffer() : 
-      m_depthPass->GetBuffer();
+    depthTexture = GetFilteredDepthTexture();
 
+    // Each backend counts its own versions, so a switch could otherwise go unnoticed
     m_normalPass->SetInputTexture(depthTexture);
-    m_normalPass->Render();
+    if (m_normalPass->NeedsRender(PassInputHash()
+      .Add(m_depthThicknessPass->GetOutputVersion())
+      .Add(filterPass->GetOutputVersion())
+      .Add(m_scene.filteringParameters.backend)
+      .Add(depthTexture)
+      .Add(m_scene.filteringParameters.nIterations)
+      .Add(cameraHash)
+      .Get()))
+    {
+      PROFILE_SCOPE("NormalPass");
+      m_normalPass->Render();
+    }
     m_compositionPass->SetInputTexture({ depthTexture,                        0 });
-    m_compositionPass->SetInputTexture({ m_thicknessPass->GetBuffer(),        1 });
+    m_compositionPass->SetInputTexture({ m_depthThicknessPass->GetBuffer(1),  1 });
     m_compositionPass->SetInputTexture({ m_normalPass->GetBuffer(),           2 });
     m_compositionPass->SetInputTexture({ m_meshesPass->GetBuffer(),           3 });
     m_compositionPass->SetInputTexture({ m_meshesPass->GetBuffer(1),          4 });
     m_compositionPass->SetInputTexture({ m_meshesShadowPass->GetBuffer(0),    5 });
     m_compositionPass->SetInputTexture({ m_filterPass->GetBuffer(0),          7 });
-    m_compositionPass->SetInputTexture({ m_thicknessShadowPass->GetBuffer(0), 8 });
+    m_compositionPass->SetInputTexture({ m_fluidShadowPass->GetBuffer(1),     8 });
     
     // TODO: This needs to be done at the render pass level
     if (m_meshesPass->HasSkybox())
@@ -599,7 +1052,27 @@ auto FluidRenderer::Render() -> void
       glActiveTexture(GL_TEXTURE0 + 6);
       glBindTexture(GL_TEXTURE_CUBE_MAP, skyboxTextureID);
     }
-    m_compositionPass->Render();
+    uint64_t compositionHash = PassInputHash()
+      .Add(m_depthThicknessPass->GetOutputVersion())
+      .Add(filterPass->GetOutputVersion())
+      .Add(m_filterPass->GetOutputVersion())
+      .Add(m_normalPass->GetOutputVersion())
+      .Add(m_meshesPass->GetOutputVersion())
+      .Add(m_meshesShadowPass->GetOutputVersion())
+      .Add(m_fluidShadowPass->GetOutputVersion())
+      .Add(depthTexture)
+      .Add(cameraHash)
+      .Add(m_scene.lightsVersion)
+      .Add(m_scene.fluidMaterial)
+      .Add(m_scene.fluidParameters)
+      .Add(m_scene.lightingParameters)
+      .Add(m_scene.filteringParameters)
+      .Get();
+    if (m_compositionPass->NeedsRender(compositionHash))
+    {
+      PROFILE_SCOPE("CompositionPass");
+      m_compositionPass->Render();
+    }
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
     m_textureRenderer->SetTexture(m_compositionPass->GetBuffer());
@@ -612,12 +1085,23 @@ auto FluidRenderer::Render() -> void
       auto& meshesPassShader = m_meshesPass->GetShader();
       meshesPassShader.Bind();
       meshesPassShader.SetUniform1i("uRenderFluidShadows", 0);
-      RenderMeshes();
+      RenderMeshes(cameraHash);
     }
     m_textureRenderer->SetTexture(m_meshesPass->GetBuffer());
   }
 
-  m_textureRenderer->Render();
+  {
+    PROFILE_SCOPE("TextureRenderer");
+    if (m_offscreen)
+    {
+      m_outputFramebuffer.Bind();
+      GLCall(glViewport(0, 0, m_windowWidth, m_windowHeight));
+    }
+    m_textureRenderer->Render();
+    if (m_offscreen) m_outputFramebuffer.Unbind();
+  }
+
+  m_gpuTimer.End();
 }
 
 auto FluidRenderer::UploadCameraData() -> void
@@ -664,11 +1148,101 @@ auto FluidRenderer::UploadLights() -> void
   GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
 }
 
-void FluidRenderer::RenderMeshes()
+auto FluidRenderer::UploadLightMatrices() -> void
+{
+  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, m_uniformBufferLightMatrices));
+  float zNear = 1.0;
+  float zFar  = 100.f;
+  for (int i = 0; i < m_scene.lights.size(); i++)
+  {
+    auto& l = m_scene.lights[i];
+    float radius = 10.f;
+    glm::mat4 lightProjection = glm::ortho(-radius, radius, -radius, radius, zNear, zFar);
+    // Find light matrix
+    glm::mat4 lightView = glm::lookAt(glm::vec3(l.position.x, l.position.y, l.position.z),
+      glm::vec3(0), // directional light, pointing at scene origin
+      glm::vec3(0, 1.0, 0));
+
+    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(Mat4), glm::value_ptr(lightView)));
+    GLCall(glBufferSubData(GL_UNIFORM_BUFFER, sizeof(Mat4), sizeof(Mat4), glm::value_ptr(lightProjection)));
+
+    // Only the first light casts shadows
+    if (i == 0) m_meshesShadowPass->SetView(lightView, lightProjection);
+  }
+  GLCall(glBindBuffer(GL_UNIFORM_BUFFER, 0));
+}
+
+auto FluidRenderer::HashCamera() -> uint64_t
+{
+  auto& camera = m_cameraController.GetCamera();
+  return PassInputHash().Add(camera.GetViewMatrix()).Add(camera.GetProjectionMatrix()).Get();
+}
+
+RenderPass* FluidRenderer::GetActiveFilterPass()
 {
+  if (m_scene.filteringParameters.backend == FilterBackend::Compute) return m_computeFilterPass;
+  if (m_scene.filteringParameters.backend == FilterBackend::Pyramid) return m_pyramidFilterPass;
+  return m_filterPass;
+}
+
+bool FluidRenderer::IsOcclusionCullingActive()
+{
+  // Without meshes there's nothing to cull against
+  return m_scene.fluidParameters.occlusionCulling && !m_scene.models.empty() &&
+    m_scene.fluid.GetNumberOfChunks(m_currentFrame) > 0;
+}
+
+void FluidRenderer::CullParticleChunks(uint64_t particlesHash)
+{
+  // Thickness sprites are the largest ones the particles are drawn with
+  float cullRadius = m_scene.fluidParameters.pointRadius * 1.2f;
+  int nChunks      = m_scene.fluid.GetNumberOfChunks(m_currentFrame);
+  m_hiZCullingPass->SetChunks(m_scene.fluid.GetFrameChunkBoundsBuffer(m_currentFrame), nChunks,
+    m_scene.fluid.GetNumberOfParticles(m_currentFrame), Fluid::PARTICLES_PER_CHUNK);
+  m_hiZCullingPass->SetParticleRadius(cullRadius);
+  m_hiZCullingPass->SetInputTexture(m_meshesPass->GetBuffer(1));
+
+  // The mesh output version covers the camera
+  if (m_hiZCullingPass->NeedsRender(PassInputHash()
+    .Add(particlesHash)
+    .Add(m_meshesPass->GetOutputVersion())
+    .Get()))
+  {
+    PROFILE_SCOPE("HiZCullingPass");
+    m_hiZCullingPass->Render();
+  }
+
+  m_depthThicknessPass->SetIndirectDraws(m_hiZCullingPass->GetIndirectBuffer(), nChunks);
+}
+
+auto FluidRenderer::InvalidatePasses() -> void
+{
+  for (auto& renderPassPair : m_renderPasses)
+  {
+    renderPassPair.second->InvalidateOutput();
+  }
+}
+
+void FluidRenderer::RenderMeshes(uint64_t cameraHash)
+{
+    PROFILE_SCOPE("FluidRenderer::RenderMeshes");
     if (m_scene.lightingParameters.renderShadows)
     {
-      m_meshesShadowPass->Render();
+      // The mesh shadow map only depends on the lights and on the models' geometry and
+      // transforms, so it's kept until one of them changes
+      const auto& lodParameters = m_scene.meshLodParameters;
+      m_meshesShadowPass->SetLodParameters(true, lodParameters.maxPixelError,
+        std::max(lodParameters.shadowMinLod, 0));
+
+      PassInputHash shadowHash;
+      shadowHash.Add(m_scene.lightsVersion).Add(lodParameters);
+      for (const auto& model : m_scene.models) shadowHash.Add(model.GetVersion());
+
+      if (m_meshesShadowPass->NeedsRender(shadowHash.Get()))
+      {
+        PROFILE_SCOPE("MeshesShadowPass");
+        m_meshesShadowPass->Render();
+      }
       m_meshesPass->SetInputTexture(m_meshesShadowPass->GetBuffer());
     }
     // Places light model in the scene
@@ -685,24 +1259,61 @@ void FluidRenderer::RenderMeshes()
     if (m_meshesPass->HasSkybox()) m_meshesPass->SetInputTexture({ m_meshesPass->GetSkybox()
       .GetTextureID(), 1, TextureType::Cubemap });
     else m_meshesPass->SetInputTexture({ 0, 1, TextureType::Cubemap });
-    m_meshesPass->SetInputTexture({ m_fluidShadowPass->GetBuffer(), 2 });
-    m_meshesPass->SetInputTexture({ m_thicknessShadowPass->GetBuffer(), 3 });
+    m_meshesPass->SetInputTexture({ m_fluidShadowPass->GetBuffer(0), 2 });
+    m_meshesPass->SetInputTexture({ m_fluidShadowPass->GetBuffer(1), 3 });
 
     // Set background clear color (comes from meshes rendering, for now)
     m_meshesPass->GetRenderState().clearColor = m_scene.clearColor;
-    m_meshesPass->Render();
+    auto& camera = m_cameraController.GetCamera();
+    m_meshesPass->SetView(camera.GetViewMatrix(), camera.GetProjectionMatrix());
+    m_meshesPass->SetLodParameters(m_scene.meshLodParameters.enabled,
+      m_scene.meshLodParameters.maxPixelError, 0);
+
+    // Materials aren't versioned, so they're hashed directly
+    PassInputHash meshesHash;
+    meshesHash.Add(cameraHash)
+      .Add(m_scene.lightsVersion)
+      .Add(m_scene.lightingParameters)
+      .Add(m_scene.clearColor)
+      .Add(m_scene.meshLodParameters)
+      .Add(m_meshesPass->HasSkybox() ? m_meshesPass->GetSkybox().GetTextureID() : 0)
+      .Add(m_meshesShadowPass->GetOutputVersion())
+      .Add(m_fluidShadowPass->GetOutputVersion());
+    for (const auto& model : m_scene.models)
+    {
+      meshesHash.Add(model.GetVersion()).Add(model.GetMaterialConst());
+    }
+
+    if (m_meshesPass->NeedsRender(meshesHash.Get()))
+    {
+      PROFILE_SCOPE("MeshesPass");
+      m_meshesPass->Render();
+    }
 
     // Remove light model from scene so it does not affect other passes
     if (m_scene.lightingParameters.showLightsOnScene) m_scene.models.pop_back();
 }
 void FluidRenderer::DoFiltering()
 {
-    if (m_scene.filteringParameters.filter1D)
+    PROFILE_SCOPE("FluidRenderer::DoFiltering");
+    if (m_scene.filteringParameters.backend == FilterBackend::Compute)
+    {
+      m_computeFilterPass->SetInputTexture(m_depthThicknessPass->GetBuffer(0));
+      m_computeFilterPass->SetNumberOfIterations(m_scene.filteringParameters.nIterations);
+      m_computeFilterPass->Render();
+    }
+    else if (m_scene.filteringParameters.backend == FilterBackend::Pyramid)
+    {
+      m_pyramidFilterPass->SetInputTexture(m_depthThicknessPass->GetBuffer(0));
+      m_pyramidFilterPass->SetNumberOfIterations(m_scene.filteringParameters.nIterations);
+      m_pyramidFilterPass->Render();
+    }
+    else if (m_scene.filteringParameters.filter1D)
     {
       auto& narrowRangeFilterShader = m_filterPass->GetShader();
       for (int i = 0; i < m_scene.filteringParameters.nIterations; i++)
       {
-        if (i == 0) m_filterPass->SetInputTexture(m_depthPass->GetBuffer());
+        if (i == 0) m_filterPass->SetInputTexture(m_depthThicknessPass->GetBuffer(0));
         else m_filterPass->SwapBuffers();
 
         narrowRangeFilterShader.Bind();
@@ -719,11 +1330,19 @@ void FluidRenderer::DoFiltering()
     {
       for (int i = 0; i < m_scene.filteringParameters.nIterations; i++)
       {
-        if (i == 0) m_filterPass->SetInputTexture(m_depthPass->GetBuffer());
+        if (i == 0) m_filterPass->SetInputTexture(m_depthThicknessPass->GetBuffer(0));
         else m_filterPass->SwapBuffers();
         m_filterPass->Render();
       }
     }
 }
 
+GLuint FluidRenderer::GetFilteredDepthTexture()
+{
+  if (m_scene.filteringParameters.nIterations <= 0) return m_depthThicknessPass->GetBuffer(0);
+  if (m_scene.filteringParameters.backend == FilterBackend::Compute) return m_computeFilterPass->GetBuffer();
+  if (m_scene.filteringParameters.backend == FilterBackend::Pyramid) return m_pyramidFilterPass->GetBuffer();
+  return m_filterPass->GetBuffer();
+}
+
 }
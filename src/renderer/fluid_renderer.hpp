@@ -3,13 +3,22 @@
 #include "renderer/particle_render_pass.hpp"
 #include "renderer/particle_render_pass.hpp"
 #include "renderer/particle_pass.hpp"
+#include "renderer/fused_particle_pass.hpp"
 #include "renderer/filter_pass.hpp"
+#include "renderer/narrow_range_filter_pass.hpp"
+#include "renderer/pyramid_filter_pass.hpp"
+#include "renderer/hiz_culling_pass.hpp"
 #include "renderer/meshes_pass.hpp"
+#include "renderer/gpu_timer.hpp"
+#include "renderer/pass_input_hash.hpp"
+#include "renderer/dynamic_resolution.hpp"
 #include "renderer/texture_renderer.h"
 #include "renderer/rendering_parameters.hpp"
+#include "renderer/render_target_formats.hpp"
 #include "renderer/scene.hpp"
 #include "utils/export_directives.h"
 #include "utils/camera_controller.hpp"
+#include "utils/file_watcher.hpp"
 #include <unordered_map>
 
 namespace fluidity
@@ -22,7 +31,30 @@ public:
   FluidRenderer(const FluidRenderer&) = delete;
 
   bool Init();
+  // Releases the scene and the GPU resources shared among renderers. Requires the context the
+  // renderer was initialized in.
+  void CleanUp();
   bool LoadScene();
+  // Offscreen, the final image is rendered into an RGBA8 framebuffer (see GetOutputFramebuffer)
+  // instead of the default one, which headless contexts don't have. Must be set before Init.
+  void SetOffscreen(bool offscreen) { m_offscreen = offscreen; }
+  bool IsOffscreen() const { return m_offscreen; }
+  // Window sized, gamma corrected final image. Only valid when offscreen.
+  Framebuffer& GetOutputFramebuffer() { return m_outputFramebuffer; }
+  // Final image of the last rendered frame, linear (before gamma correction) and in the
+  // composition format
+  GLuint GetLinearOutputTexture() const;
+  // Texture the target was last rendered to. 0 if it isn't rendered, such as the fluid
+  // targets in scenes without a fluid.
+  GLuint GetRenderTargetTexture(RenderTarget target);
+  // Resizes every window sized buffer. Doesn't require the renderer to be reinitialized.
+  void Resize(unsigned windowWidth, unsigned windowHeight);
+  // Renders the current frame with FP32 targets and with the scene's formats, and
+  // reports the maximum error of each target
+  std::string ValidateRenderTargetFormats();
+  // Measures the GPU time of the filtering passes of every backend, over a range of maximum
+  // filter sizes
+  std::string BenchmarkFilters();
 
   // Playback methods
   void Play()            { m_playing = true;       }
@@ -46,11 +78,41 @@ private:
   bool InitUniformBuffers();
   void UploadCameraData();
   void UploadLights();
+  void UploadLightMatrices();
   void UploadMaterial(); 
   void SetUpStaticUniforms();
+  // Binds the uniform blocks of every pass to the uniform buffers
+  void SetUpUniformBuffers();
+  // Reloads the pass shaders whose files changed. Returns true if any rebuilt program was
+  // swapped in.
+  bool ReloadChangedShaders();
+  // Shader features (see ShaderFeature) the scene's parameters call for
+  uint32_t GetShaderFeatures() const;
+  // Switches every pass shader to the variant with the scene's features. Returns true if any
+  // program changed.
+  bool SelectShaderVariants();
+  // Sets the uniform block bindings and uniforms again, after programs changed
+  void RestoreProgramState();
   void SetUpPerFrameUniforms();
-  void RenderMeshes();
+  void RenderMeshes(uint64_t cameraHash);
   void DoFiltering();
+  GLuint GetFilteredDepthTexture();
+  RenderPass* GetActiveFilterPass();
+  // Culls the particle chunks against the mesh depth and sets up the depth and thickness
+  // pass to only draw the visible ones
+  void CullParticleChunks(uint64_t particlesHash);
+  bool IsOcclusionCullingActive();
+  uint64_t HashCamera();
+  void InvalidatePasses();
+  void UpdateDynamicResolution();
+  // Resizes the scaled passes when their scale changed, or always if force is set
+  void UpdateRenderTargetSizes(bool force = false);
+  void ApplyRenderTargetFormats();
+  std::vector<RenderTargetReadback> ReadBackRenderTargets();
+  unsigned GetFluidBufferWidth() const;
+  unsigned GetFluidBufferHeight() const;
+  unsigned GetMeshBufferWidth() const;
+  unsigned GetMeshBufferHeight() const;
 
   void SetVAOS();
   void SetNumberOfParticles();
@@ -59,17 +121,25 @@ private:
   // Render passes
   TextureRenderer*    m_textureRenderer;
   ParticleRenderPass* m_particleRenderPass;
-  ParticlePass*       m_depthPass;
-  ParticlePass*       m_thicknessPass;
-  ParticlePass*       m_fluidShadowPass;
-  ParticlePass*       m_thicknessShadowPass;
+  // Depth (0) and thickness (1), in the camera view and in the light view
+  FusedParticlePass*  m_depthThicknessPass;
+  FusedParticlePass*  m_fluidShadowPass;
   FilterPass*         m_filterPass;
+  NarrowRangeFilterPass* m_computeFilterPass;
+  PyramidFilterPass*  m_pyramidFilterPass;
   FilterPass*         m_normalPass;
   FilterPass*         m_compositionPass;
   MeshesPass*         m_meshesPass;
   MeshesPass*         m_meshesShadowPass;
+  // Scene meshes, drawn by both meshes passes
+  MeshGeometry        m_meshGeometry;
+  HiZCullingPass*     m_hiZCullingPass;
+
+  bool m_offscreen = false;
+  Framebuffer m_outputFramebuffer;
 
   CameraController m_cameraController;
+  FileWatcher m_shaderWatcher;
 
   // Useful for performing operations that affect every render pass
   std::unordered_map<std::string, RenderPass*> m_renderPasses;
@@ -81,6 +151,10 @@ private:
   GLuint m_uniformBufferMaterial;
 
   static constexpr int NUM_TOTAL_LIGHTS = 8;
+  static constexpr int CAMERA_DATA_UB_INDEX    = 0;
+  static constexpr int LIGHTS_UB_INDEX         = 1;
+  static constexpr int LIGHT_MATRICES_UB_INDEX = 2;
+  static constexpr int MATERIAL_UB_INDEX       = 3;
   Scene m_scene;
   Model m_lightModel;
 
@@ -90,6 +164,17 @@ private:
   unsigned m_currentFrame = 0;
   bool m_playing = false;
   float m_aspectRatio;
+  // Scales the fluid and meshes passes are currently allocated with, relative to the window
+  float m_fluidResolutionScale = 1.f;
+  float m_meshResolutionScale  = 1.f;
+  RenderTargetFormats m_appliedRenderTargetFormats;
+
+  // Lights version the lights uniform buffers were last uploaded with
+  bool m_lightsUploaded = false;
+  uint64_t m_uploadedLightsVersion = 0;
+
+  GpuTimer m_gpuTimer;
+  DynamicResolutionController m_dynamicResolution;
 };
 
 }
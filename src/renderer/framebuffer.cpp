@@ -6,6 +6,21 @@
 namespace fluidity
 {
 
+namespace
+{
+  struct PooledTexture
+  {
+    GLuint  id;
+    GLint   internalFormat;
+    GLint   filter;
+    GLsizei width;
+    GLsizei height;
+  };
+
+  constexpr size_t MAX_POOLED_TEXTURES = 16;
+  std::vector<PooledTexture> s_texturePool;
+}
+
 Framebuffer::Framebuffer(const FramebufferSpecification& specification)
   : m_specification(specification)
 { /* */ }
@@ -49,6 +64,111 @@ bool Framebuffer::Init()
   return true;
 }
 
+void Framebuffer::Resize(GLsizei width, GLsizei height)
+{
+  if (width == m_specification.width && height == m_specification.height) return;
+
+  GLsizei previousWidth  = m_specification.width;
+  GLsizei previousHeight = m_specification.height;
+  m_specification.width  = width;
+  m_specification.height = height;
+
+  // Not initialized yet, storage will be created with the new size
+  if (m_attachments.empty()) return;
+
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, m_fbo));
+  for (int i = 0; i < m_attachments.size(); i++)
+  {
+    const auto& attachment = m_specification.attachments[i];
+    ReleaseTexture(m_attachments[i], attachment, previousWidth, previousHeight);
+    m_attachments[i] = AcquireTexture(attachment, width, height);
+    GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, 
+          m_attachments[i], 0));
+  }
+
+  if (m_specification.createDepthBuffer)
+  {
+    GLCall(glBindRenderbuffer(GL_RENDERBUFFER, m_depthAttachment));
+    GLCall(glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT, width, height));
+    GLCall(glBindRenderbuffer(GL_RENDERBUFFER, 0));
+  }
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+void Framebuffer::SetAttachmentFormat(int attachment, const FramebufferAttachment& format)
+{
+  assert(attachment < m_specification.attachments.size());
+
+  FramebufferAttachment previousFormat = m_specification.attachments[attachment];
+  if (previousFormat.internalFormat == format.internalFormat && previousFormat.filter == format.filter) 
+  {
+    return;
+  }
+  m_specification.attachments[attachment] = format;
+
+  // Not initialized yet, storage will be created with the new format
+  if (!IsAttachmentValid(attachment)) return;
+
+  ReleaseTexture(m_attachments[attachment], previousFormat, m_specification.width, 
+    m_specification.height);
+  m_attachments[attachment] = AcquireTexture(format, m_specification.width, m_specification.height);
+
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, m_fbo));
+  GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + attachment, GL_TEXTURE_2D,
+        m_attachments[attachment], 0));
+  GLCall(glBindFramebuffer(GL_FRAMEBUFFER, 0));
+}
+
+GLuint Framebuffer::AcquireTexture(const FramebufferAttachment& attachment, GLsizei width,
+  GLsizei height)
+{
+  for (auto it = s_texturePool.begin(); it != s_texturePool.end(); it++)
+  {
+    if (it->internalFormat == attachment.internalFormat && it->filter == attachment.filter &&
+        it->width == width && it->height == height)
+    {
+      GLuint texture = it->id;
+      s_texturePool.erase(it);
+      return texture;
+    }
+  }
+
+  GLuint texture;
+  GLCall(glGenTextures(1, &texture));
+  GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+  GLCall(glTexImage2D(GL_TEXTURE_2D, 0, attachment.internalFormat, width, height, 0, 
+        attachment.pixelFormat, attachment.dataType, nullptr));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, attachment.filter));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, attachment.filter));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+
+  return texture;
+}
+
+void Framebuffer::ReleaseTexture(GLuint texture, const FramebufferAttachment& attachment,
+  GLsizei width, GLsizei height)
+{
+  s_texturePool.push_back({ texture, attachment.internalFormat, attachment.filter, width, height });
+
+  // Evict the least recently released texture
+  if (s_texturePool.size() > MAX_POOLED_TEXTURES)
+  {
+    GLCall(glDeleteTextures(1, &s_texturePool.front().id));
+    s_texturePool.erase(s_texturePool.begin());
+  }
+}
+
+void Framebuffer::CleanUpTexturePool()
+{
+  for (const PooledTexture& texture : s_texturePool)
+  {
+    GLCall(glDeleteTextures(1, &texture.id));
+  }
+  s_texturePool.clear();
+}
+
 void Framebuffer::PushAttachment(const FramebufferAttachment& attachment)
 { 
   m_specification.attachments.push_back(attachment);
@@ -65,15 +185,7 @@ void Framebuffer::DuplicateAttachment(int attachment)
 void Framebuffer::InitAttachment(const FramebufferAttachment& attachment)
 {
     int currentAttachmentIndex = m_attachments.size();
-    GLuint texture;
-    GLCall(glGenTextures(1, &texture));
-    GLCall(glBindTexture(GL_TEXTURE_2D, texture));
-    GLCall(glTexImage2D(GL_TEXTURE_2D, 0, attachment.internalFormat, m_specification.width, 
-          m_specification.height, 0, attachment.pixelFormat, attachment.dataType, nullptr));
-    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
-    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
-    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST));
-    GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+    GLuint texture = AcquireTexture(attachment, m_specification.width, m_specification.height);
     GLCall(glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + currentAttachmentIndex,
           GL_TEXTURE_2D, texture, 0));
 
@@ -9,6 +9,7 @@ namespace fluidity
     GLint   internalFormat;
     GLenum  pixelFormat;
     GLenum  dataType;
+    GLint   filter = GL_NEAREST;
   };
 
   struct FramebufferSpecification
@@ -28,6 +29,19 @@ namespace fluidity
     bool Init();
     void Bind();
     void Unbind();
+    // Replaces the storage of every attachment. Contents are undefined afterwards, and
+    // attachment ids change, so they must be queried again.
+    void Resize(GLsizei width, GLsizei height);
+
+    // Replaces the storage of an attachment with one of a different format
+    void SetAttachmentFormat(int attachment, const FramebufferAttachment& format);
+    const FramebufferAttachment& GetAttachmentFormat(int attachment) const 
+    { 
+      return m_specification.attachments[attachment]; 
+    }
+
+    GLsizei GetWidth() const  { return m_specification.width;  }
+    GLsizei GetHeight() const { return m_specification.height; }
 
     GLuint GetAttachment(int attachmentNumber);
     // By default, swap targets 0 and 1
@@ -39,8 +53,17 @@ namespace fluidity
     bool AttachRenderTarget(int attachment);
     bool DetachRenderTarget(int attachment);
 
+    // Deletes the textures pooled by resizes. Requires the context they were created in.
+    static void CleanUpTexturePool();
+
   private:
     void InitAttachment(const FramebufferAttachment& attachment);
+    // Textures released on resize are kept in a pool, since dynamic resolution keeps
+    // switching between a handful of sizes
+    static GLuint AcquireTexture(const FramebufferAttachment& attachment, GLsizei width, 
+      GLsizei height);
+    static void ReleaseTexture(GLuint texture, const FramebufferAttachment& attachment, 
+      GLsizei width, GLsizei height);
     void AttachDepthBuffer();
     bool IsAttachmentValid(int attachment);
 
@@ -0,0 +1,90 @@
+#include "fused_particle_pass.hpp"
+#include "../utils/glcall.h"
+#include <cassert>
+
+namespace fluidity
+{
+FusedParticlePass::FusedParticlePass(
+  int bufferWidth,
+  int bufferHeight,
+  int numberOfParticles,
+  GLuint particlesVAO,
+  const std::vector<FramebufferAttachment>& renderTargetSpecifications,
+  const std::vector<AttachmentBlendState>& blendStates,
+  const std::string& vsFilepath,
+  const std::string& fsFilepath)
+  : RenderPass(bufferWidth, bufferHeight, numberOfParticles, particlesVAO),
+    m_blendStates(blendStates),
+    m_vsFilePath(vsFilepath),
+    m_fsFilePath(fsFilepath),
+    m_indirectBuffer(0),
+    m_numIndirectDraws(0)
+{
+  assert(renderTargetSpecifications.size() == blendStates.size());
+  m_renderState.useDepthTest = false;
+  for (const auto& renderTargetSpecification : renderTargetSpecifications)
+  {
+    m_framebuffer.PushAttachment(renderTargetSpecification);
+  }
+}
+
+bool FusedParticlePass::Init()
+{
+  m_shader = new Shader(m_vsFilePath, m_fsFilePath);
+  if (!RenderPass::Init()) return false;
+
+  return true;
+}
+
+void FusedParticlePass::Render()
+{
+  assert(m_shader != nullptr);
+  int viewportState[4];
+  glGetIntegerv(GL_VIEWPORT, viewportState);
+
+  // Save OpenGL state before changing it
+  RenderState previousRenderState = GetCurrentOpenGLRenderState();
+  m_framebuffer.Bind();
+  ChangeOpenGLRenderState(m_renderState);
+  glViewport(0, 0, m_bufferWidth, m_bufferHeight);
+
+  for (int i = 0; i < (int)m_blendStates.size(); i++)
+  {
+    const auto& blendState = m_blendStates[i];
+    GLCall(glClearBufferfv(GL_COLOR, i, (const GLfloat*)&blendState.clearColor));
+    GLCall(glEnablei(GL_BLEND, i));
+    GLCall(glBlendEquationi(i, blendState.blendEquation));
+    GLCall(glBlendFunci(i, blendState.blendSourceFactor, blendState.blendDestinationFactor));
+  }
+
+  m_shader->Bind();
+
+  GLCall(glBindVertexArray(m_vao));
+  if (m_numIndirectDraws > 0)
+  {
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer));
+    GLCall(glMultiDrawArraysIndirect(GL_POINTS, nullptr, m_numIndirectDraws, 0));
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+  }
+  else
+  {
+    GLCall(glDrawArrays(GL_POINTS, 0, m_numVertices));
+  }
+
+  GLCall(glBindVertexArray(0));
+  m_shader->Unbind();
+
+  // Every other pass uses the default blend equation
+  for (int i = 0; i < (int)m_blendStates.size(); i++)
+  {
+    GLCall(glBlendEquationi(i, GL_FUNC_ADD));
+    GLCall(glDisablei(GL_BLEND, i));
+  }
+  m_framebuffer.Unbind();
+
+  // Restore previous render state
+  glViewport(viewportState[0], viewportState[1], viewportState[2], viewportState[3]);
+  ChangeOpenGLRenderState(previousRenderState);
+}
+
+}
@@ -0,0 +1,56 @@
+#pragma once
+#include "render_pass.hpp"
+#include "framebuffer.hpp"
+#include "renderer.h"
+#include "shader.h"
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+struct AttachmentBlendState
+{
+  GLenum blendEquation          = GL_FUNC_ADD;
+  GLenum blendSourceFactor      = GL_ONE;
+  GLenum blendDestinationFactor = GL_ONE;
+  Vec4 clearColor               = { 0.f, 0.f, 0.f, 1.f };
+};
+
+// Draws the particles once into several render targets, each one with its own blend state
+// and clear color. Depth test is disabled, so depth must be resolved by blending (GL_MAX for
+// eye space depth, GL_MIN for window space depth).
+class FusedParticlePass : public RenderPass
+{
+public:
+  FusedParticlePass(
+    int bufferWidth,
+    int bufferHeight,
+    int numberOfParticles,
+    GLuint particlesVAO,
+    const std::vector<FramebufferAttachment>& renderTargetSpecifications,
+    const std::vector<AttachmentBlendState>& blendStates,
+    const std::string& vsFilepath,
+    const std::string& fsFilepath
+  );
+
+  virtual bool Init() override;
+  virtual void Render() override;
+
+  // Draws the particles with glMultiDrawArraysIndirect, one DrawArraysIndirectCommand per
+  // chunk (see HiZCullingPass). With no draws, every particle is drawn.
+  void SetIndirectDraws(GLuint indirectBuffer, int numDraws)
+  {
+    m_indirectBuffer = indirectBuffer;
+    m_numIndirectDraws = numDraws;
+  }
+
+private:
+  std::vector<AttachmentBlendState> m_blendStates;
+  std::string m_vsFilePath;
+  std::string m_fsFilePath;
+  GLuint m_indirectBuffer;
+  int m_numIndirectDraws;
+};
+
+}
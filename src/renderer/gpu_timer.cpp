@@ -0,0 +1,65 @@
+#include "renderer/gpu_timer.hpp"
+#include "utils/glcall.h"
+
+namespace fluidity
+{
+
+bool GpuTimer::Init()
+{
+  GLCall(glGenQueries(NUM_QUERIES, m_queries));
+  m_nextQuery  = 0;
+  m_numPending = 0;
+  m_hasResult  = false;
+  return true;
+}
+
+void GpuTimer::CleanUp()
+{
+  if (m_queries[0] != 0) GLCall(glDeleteQueries(NUM_QUERIES, m_queries));
+  for (auto& query : m_queries) query = 0;
+  m_numPending = 0;
+}
+
+void GpuTimer::Begin()
+{
+  Poll();
+  // Every query is still in flight: skip this measurement instead of waiting on the GPU
+  if (m_numPending == NUM_QUERIES) return;
+
+  GLCall(glBeginQuery(GL_TIME_ELAPSED, m_queries[m_nextQuery]));
+  m_running = true;
+}
+
+void GpuTimer::End()
+{
+  if (!m_running) return;
+
+  GLCall(glEndQuery(GL_TIME_ELAPSED));
+  m_running    = false;
+  m_nextQuery  = (m_nextQuery + 1) % NUM_QUERIES;
+  m_numPending++;
+}
+
+bool GpuTimer::Poll()
+{
+  bool newResult = false;
+  while (m_numPending > 0)
+  {
+    int oldestQuery = (m_nextQuery - m_numPending + NUM_QUERIES) % NUM_QUERIES;
+
+    GLint available = 0;
+    GLCall(glGetQueryObjectiv(m_queries[oldestQuery], GL_QUERY_RESULT_AVAILABLE, &available));
+    if (!available) break;
+
+    GLuint64 elapsed = 0;
+    GLCall(glGetQueryObjectui64v(m_queries[oldestQuery], GL_QUERY_RESULT, &elapsed));
+    m_lastResult = (float)((double)elapsed / 1.0e6);
+    m_hasResult  = true;
+    newResult    = true;
+    m_numPending--;
+  }
+
+  return newResult;
+}
+
+}
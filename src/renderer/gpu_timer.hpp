@@ -0,0 +1,39 @@
+#pragma once
+#include <GL/glew.h>
+
+namespace fluidity
+{
+
+// Measures GPU time with a ring of GL_TIME_ELAPSED queries. Results are read a few
+// frames late, so measuring never stalls the pipeline.
+// Time elapsed queries can't be nested: only one timer may be running at a time.
+class GpuTimer
+{
+public:
+  GpuTimer() = default;
+  GpuTimer(const GpuTimer&) = delete;
+
+  bool Init();
+  void CleanUp();
+
+  void Begin();
+  void End();
+
+  // Collects finished queries. Returns true if a new measurement is available.
+  bool Poll();
+  // Most recent measurement, in milliseconds
+  float GetLastResult() const { return m_lastResult; }
+  bool HasResult() const { return m_hasResult; }
+
+  static constexpr int NUM_QUERIES = 4;
+
+private:
+  GLuint m_queries[NUM_QUERIES] = {};
+  int m_nextQuery = 0;
+  int m_numPending = 0;
+  bool m_running = false;
+  bool m_hasResult = false;
+  float m_lastResult = 0.f;
+};
+
+}
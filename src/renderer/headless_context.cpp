@@ -0,0 +1,222 @@
+#include "renderer/headless_context.hpp"
+#include "utils/logger.h"
+#include <cstring>
+#include <string>
+
+#include <GL/glew.h>
+
+#ifdef FLUIDITY_HAS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#endif
+
+#ifdef FLUIDITY_HAS_OSMESA
+#include <GL/osmesa.h>
+#endif
+
+// Returned by GLEW 2.1 and later when it's built for GLX and there's no X display. The OpenGL
+// functions are loaded before GLEW looks for the display, so it's harmless here.
+#ifndef GLEW_ERROR_NO_GLX_DISPLAY
+#define GLEW_ERROR_NO_GLX_DISPLAY 4
+#endif
+
+namespace fluidity
+{
+
+HeadlessContext::HeadlessContext(int openGLMajorVersion, int openGLMinorVersion)
+  : m_openGLMajorVersion(openGLMajorVersion),
+  m_openGLMinorVersion(openGLMinorVersion)
+{ /* */ }
+
+HeadlessContext::~HeadlessContext()
+{
+  Close();
+}
+
+bool HeadlessContext::Init()
+{
+  if (InitEGL())         m_backend = Backend::EGL;
+  else if (InitOSMesa()) m_backend = Backend::OSMesa;
+  else
+  {
+    LOG_ERROR("Unable to create a headless OpenGL context. Fluidity must be built with EGL or "
+      "OSMesa.");
+    return false;
+  }
+
+  if (!InitGlew())
+  {
+    Close();
+    return false;
+  }
+
+  return true;
+}
+
+void HeadlessContext::Close()
+{
+#ifdef FLUIDITY_HAS_EGL
+  if (m_eglDisplay != nullptr)
+  {
+    EGLDisplay display = (EGLDisplay)m_eglDisplay;
+    eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (m_eglContext != nullptr) eglDestroyContext(display, (EGLContext)m_eglContext);
+    eglTerminate(display);
+  }
+#endif
+#ifdef FLUIDITY_HAS_OSMESA
+  if (m_osMesaContext != nullptr) OSMesaDestroyContext((OSMesaContext)m_osMesaContext);
+#endif
+
+  m_eglDisplay    = nullptr;
+  m_eglContext    = nullptr;
+  m_osMesaContext = nullptr;
+  m_backend       = Backend::None;
+}
+
+const char* HeadlessContext::GetBackendName() const
+{
+  switch (m_backend)
+  {
+    case Backend::EGL:    return "EGL";
+    case Backend::OSMesa: return "OSMesa";
+    default:              return "None";
+  }
+}
+
+bool HeadlessContext::InitEGL()
+{
+#ifdef FLUIDITY_HAS_EGL
+  // Mesa's surfaceless platform needs neither a display server nor a GPU. Other drivers
+  // usually support surfaceless contexts on their default display.
+  EGLDisplay display = EGL_NO_DISPLAY;
+  auto getPlatformDisplay = 
+    (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+  if (getPlatformDisplay != nullptr)
+  {
+    display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+  }
+  if (display == EGL_NO_DISPLAY) display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+  EGLint major, minor;
+  if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+  {
+    LOG_WARNING("Unable to initialize an EGL display.");
+    return false;
+  }
+  m_eglDisplay = display;
+
+  const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+  if (extensions == nullptr || std::strstr(extensions, "EGL_KHR_surfaceless_context") == nullptr)
+  {
+    LOG_WARNING("The EGL display doesn't support surfaceless contexts.");
+    Close();
+    return false;
+  }
+
+  if (!eglBindAPI(EGL_OPENGL_API))
+  {
+    LOG_WARNING("The EGL display doesn't support OpenGL.");
+    Close();
+    return false;
+  }
+
+  // Without EGL_KHR_no_config_context, any config that renders OpenGL will do, since nothing
+  // is drawn to a surface
+  EGLConfig config = EGL_NO_CONFIG_KHR;
+  if (std::strstr(extensions, "EGL_KHR_no_config_context") == nullptr)
+  {
+    const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLint numConfigs = 0;
+    if (!eglChooseConfig(display, configAttributes, &config, 1, &numConfigs) || numConfigs == 0)
+    {
+      LOG_WARNING("No EGL config supports OpenGL.");
+      Close();
+      return false;
+    }
+  }
+
+  const EGLint contextAttributes[] = {
+    EGL_CONTEXT_MAJOR_VERSION_KHR, m_openGLMajorVersion,
+    EGL_CONTEXT_MINOR_VERSION_KHR, m_openGLMinorVersion,
+    EGL_CONTEXT_OPENGL_PROFILE_MASK_KHR, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT_KHR,
+    EGL_NONE
+  };
+  EGLContext context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+  if (context == EGL_NO_CONTEXT)
+  {
+    LOG_WARNING("Unable to create an OpenGL " + std::to_string(m_openGLMajorVersion) + "." + 
+      std::to_string(m_openGLMinorVersion) + " core context with EGL.");
+    Close();
+    return false;
+  }
+  m_eglContext = context;
+
+  if (!eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+  {
+    LOG_WARNING("Unable to make the EGL context current.");
+    Close();
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool HeadlessContext::InitOSMesa()
+{
+#ifdef FLUIDITY_HAS_OSMESA
+  // Rendering goes to framebuffer objects, so the color buffer doesn't need depth or stencil
+  const int attributes[] = {
+    OSMESA_FORMAT,                OSMESA_RGBA,
+    OSMESA_DEPTH_BITS,            0,
+    OSMESA_PROFILE,               OSMESA_CORE_PROFILE,
+    OSMESA_CONTEXT_MAJOR_VERSION, m_openGLMajorVersion,
+    OSMESA_CONTEXT_MINOR_VERSION, m_openGLMinorVersion,
+    0
+  };
+  OSMesaContext context = OSMesaCreateContextAttribs(attributes, nullptr);
+  if (context == nullptr)
+  {
+    LOG_WARNING("Unable to create an OpenGL " + std::to_string(m_openGLMajorVersion) + "." + 
+      std::to_string(m_openGLMinorVersion) + " core context with OSMesa.");
+    return false;
+  }
+  m_osMesaContext = context;
+
+  if (!OSMesaMakeCurrent(context, m_osMesaBuffer, GL_UNSIGNED_BYTE, 1, 1))
+  {
+    LOG_WARNING("Unable to make the OSMesa context current.");
+    Close();
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+bool HeadlessContext::InitGlew()
+{
+  glewExperimental = true;
+  GLenum glewInitStatus = glewInit();
+  if (glewInitStatus != GLEW_OK && glewInitStatus != GLEW_ERROR_NO_GLX_DISPLAY)
+  {
+    LOG_ERROR("Unable to initialize Glew. " + 
+      std::string((const char*)glewGetErrorString(glewInitStatus)));
+    return false;
+  }
+
+  // The core profile makes glewInit's glGetString(GL_EXTENSIONS) fail. It's expected.
+  while (glGetError() != GL_NO_ERROR);
+  return true;
+}
+
+}
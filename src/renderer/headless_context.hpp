@@ -0,0 +1,47 @@
+#pragma once
+#include <string>
+
+namespace fluidity
+{
+
+// OpenGL context without a window, for machines with no display (and possibly no GPU, with
+// Mesa's llvmpipe). Everything is rendered into framebuffer objects, since there's no default
+// framebuffer to draw to.
+// Tries a surfaceless EGL context first, then OSMesa. Each backend is only compiled in if its
+// library was found at build time (FLUIDITY_HAS_EGL, FLUIDITY_HAS_OSMESA).
+class HeadlessContext
+{
+public:
+  HeadlessContext(int openGLMajorVersion = 4, int openGLMinorVersion = 5);
+  ~HeadlessContext();
+
+  HeadlessContext(const HeadlessContext&) = delete;
+  HeadlessContext& operator=(const HeadlessContext&) = delete;
+
+  // Creates the context, makes it current on the calling thread and loads the OpenGL functions
+  bool Init();
+  void Close();
+
+  // "EGL", "OSMesa", or "None" before Init succeeds
+  const char* GetBackendName() const;
+
+private:
+  enum class Backend { None, EGL, OSMesa };
+
+  bool InitEGL();
+  bool InitOSMesa();
+  bool InitGlew();
+
+  int m_openGLMajorVersion;
+  int m_openGLMinorVersion;
+  Backend m_backend = Backend::None;
+
+  // EGLDisplay, EGLContext and OSMesaContext, so users don't need their headers
+  void* m_eglDisplay    = nullptr;
+  void* m_eglContext    = nullptr;
+  void* m_osMesaContext = nullptr;
+  // OSMesa only makes a context current with a color buffer, even if it's never drawn to
+  unsigned char m_osMesaBuffer[4] = { 0, 0, 0, 0 };
+};
+
+}
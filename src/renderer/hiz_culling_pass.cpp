@@ -0,0 +1,195 @@
+#include "hiz_culling_pass.hpp"
+#include "../utils/glcall.h"
+#include <algorithm>
+#include <cassert>
+
+namespace fluidity
+{
+HiZCullingPass::HiZCullingPass(
+    int bufferWidth,
+    int bufferHeight,
+    const std::string& downsampleFilePath,
+    const std::string& cullFilePath)
+    : RenderPass(bufferWidth, bufferHeight, 0, 0),
+    m_downsampleFilePath(downsampleFilePath),
+    m_cullFilePath(cullFilePath),
+    m_downsampleShader(nullptr),
+    m_pyramidTexture(0),
+    m_numLevels(0),
+    m_chunkBoundsBuffer(0),
+    m_nChunks(0),
+    m_nParticles(0),
+    m_particlesPerChunk(0),
+    m_particleRadius(0.f),
+    m_indirectBuffer(0),
+    m_indirectBufferCapacity(0),
+    m_statsBuffers{ 0, 0 },
+    m_currentStatsBuffer(0),
+    m_hasStats{ false, false },
+    m_visibleChunks(0),
+    m_visibleParticles(0)
+{ /* */ }
+
+bool HiZCullingPass::Init()
+{
+  m_shader           = new Shader(m_cullFilePath);
+  m_downsampleShader = new Shader(m_downsampleFilePath);
+
+  // There are no attachments, the pyramid has its own mip chain
+  if (!RenderPass::Init()) return false;
+
+  InitPyramid();
+
+  GLCall(glGenBuffers(1, &m_indirectBuffer));
+  GLCall(glGenBuffers(2, m_statsBuffers));
+  for (GLuint statsBuffer : m_statsBuffers)
+  {
+    GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer));
+    GLCall(glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * sizeof(GLuint), nullptr, GL_DYNAMIC_READ));
+  }
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+  return true;
+}
+
+bool HiZCullingPass::SetUniforms()
+{
+  m_downsampleShader->Bind();
+  m_downsampleShader->SetUniform1i("u_InputTex", 0);
+  m_downsampleShader->SetUniform1i("u_OutputImage", 0);
+  m_downsampleShader->Unbind();
+
+  m_shader->Bind();
+  m_shader->SetUniform1i("u_HiZTex", 0);
+  m_shader->Unbind();
+
+  return true;
+}
+
+void HiZCullingPass::InitPyramid()
+{
+  if (m_pyramidTexture != 0) GLCall(glDeleteTextures(1, &m_pyramidTexture));
+
+  m_numLevels = 1;
+  for (unsigned size = std::max(m_bufferWidth, m_bufferHeight); size > 1 &&
+    m_numLevels < MAX_LEVELS; size /= 2)
+  {
+    m_numLevels++;
+  }
+
+  GLCall(glGenTextures(1, &m_pyramidTexture));
+  GLCall(glBindTexture(GL_TEXTURE_2D, m_pyramidTexture));
+  GLCall(glTexStorage2D(GL_TEXTURE_2D, m_numLevels, GL_R32F, m_bufferWidth, m_bufferHeight));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  // Only read with texelFetch
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void HiZCullingPass::Resize(int bufferWidth, int bufferHeight)
+{
+  RenderPass::Resize(bufferWidth, bufferHeight);
+  InitPyramid();
+}
+
+void HiZCullingPass::SetChunks(GLuint chunkBoundsBuffer, int nChunks, int nParticles,
+  int particlesPerChunk)
+{
+  m_chunkBoundsBuffer = chunkBoundsBuffer;
+  m_nChunks           = nChunks;
+  m_nParticles        = nParticles;
+  m_particlesPerChunk = particlesPerChunk;
+}
+
+void HiZCullingPass::Render()
+{
+  // Sanity check
+  assert(m_shader != nullptr && m_downsampleShader != nullptr);
+  if (m_nChunks <= 0 || m_textureBinds.count(0) == 0) return;
+
+  BuildPyramid();
+
+  if (m_indirectBufferCapacity < m_nChunks)
+  {
+    // Four GLuints per DrawArraysIndirectCommand
+    GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_indirectBuffer));
+    GLCall(glBufferData(GL_SHADER_STORAGE_BUFFER, 4 * sizeof(GLuint) * m_nChunks, nullptr,
+      GL_DYNAMIC_DRAW));
+    m_indirectBufferCapacity = m_nChunks;
+  }
+
+  const GLuint zeroStats[2] = { 0, 0 };
+  GLuint statsBuffer = m_statsBuffers[m_currentStatsBuffer];
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, statsBuffer));
+  GLCall(glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(zeroStats), zeroStats));
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+  m_shader->Bind();
+  m_shader->SetUniform1i("u_NumChunks", m_nChunks);
+  m_shader->SetUniform1i("u_NumParticles", m_nParticles);
+  m_shader->SetUniform1i("u_ParticlesPerChunk", m_particlesPerChunk);
+  m_shader->SetUniform1i("u_NumLevels", m_numLevels);
+  m_shader->SetUniform1f("u_ParticleRadius", m_particleRadius);
+
+  GLCall(glActiveTexture(GL_TEXTURE0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, m_pyramidTexture));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CHUNK_BOUNDS_BINDING, m_chunkBoundsBuffer));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, m_indirectBuffer));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATS_BINDING, statsBuffer));
+
+  GLCall(glDispatchCompute((m_nChunks + CHUNKS_PER_GROUP - 1) / CHUNKS_PER_GROUP, 1, 1));
+  // The commands are read by the particle draws, the stats by ReadStats
+  GLCall(glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT));
+
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CHUNK_BOUNDS_BINDING, 0));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, COMMANDS_BINDING, 0));
+  GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, STATS_BINDING, 0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+  m_shader->Unbind();
+
+  m_hasStats[m_currentStatsBuffer] = true;
+  m_currentStatsBuffer = 1 - m_currentStatsBuffer;
+  ReadStats();
+}
+
+void HiZCullingPass::BuildPyramid()
+{
+  m_downsampleShader->Bind();
+  GLCall(glActiveTexture(GL_TEXTURE0));
+
+  for (int level = 0; level < m_numLevels; level++)
+  {
+    // Level 0 copies the mesh depth, every other level reduces the previous one
+    GLCall(glBindTexture(GL_TEXTURE_2D, level == 0 ? m_textureBinds[0].id : m_pyramidTexture));
+    GLCall(glBindImageTexture(0, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F));
+    m_downsampleShader->SetUniform1i("u_Level", level);
+
+    unsigned levelWidth  = std::max(1u, m_bufferWidth >> level);
+    unsigned levelHeight = std::max(1u, m_bufferHeight >> level);
+    GLCall(glDispatchCompute((levelWidth + TILE_SIZE - 1) / TILE_SIZE,
+      (levelHeight + TILE_SIZE - 1) / TILE_SIZE, 1));
+    GLCall(glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT));
+  }
+
+  GLCall(glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+  m_downsampleShader->Unbind();
+}
+
+// Reads the buffer written by the previous cull, which has most likely finished by now
+void HiZCullingPass::ReadStats()
+{
+  if (!m_hasStats[m_currentStatsBuffer]) return;
+
+  GLuint stats[2];
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_statsBuffers[m_currentStatsBuffer]));
+  GLCall(glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(stats), stats));
+  GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+  m_visibleChunks    = stats[0];
+  m_visibleParticles = stats[1];
+}
+
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include "render_pass.hpp"
+#include "renderer.h"
+#include "shader.h"
+#include <string>
+
+namespace fluidity
+{
+
+// Occlusion culling of particle chunks against the meshes.
+// The mesh eye depth (set with SetInputTexture) is reduced into a min pyramid, where each texel
+// holds the farthest mesh surface of its footprint. Each chunk's screen rectangle is then tested
+// against the level where it covers at most 2x2 texels: chunks entirely behind the meshes get an
+// indirect draw command with no instances. Draw the particles with GetIndirectBuffer and
+// GetNumberOfChunks, one glMultiDrawArraysIndirect command per chunk.
+class HiZCullingPass : public RenderPass
+{
+public:
+    HiZCullingPass(
+      int bufferWidth,
+      int bufferHeight,
+      const std::string& downsampleFilePath,
+      const std::string& cullFilePath
+    );
+
+    virtual bool Init() override;
+    virtual void Render() override;
+    virtual void Resize(int bufferWidth, int bufferHeight) override;
+    virtual std::vector<Shader*> GetShaders() override { return { m_shader, m_downsampleShader }; }
+
+    void SetChunks(GLuint chunkBoundsBuffer, int nChunks, int nParticles, int particlesPerChunk);
+    void SetParticleRadius(float particleRadius) { m_particleRadius = particleRadius; }
+
+    GLuint GetIndirectBuffer() const { return m_indirectBuffer; }
+    int GetNumberOfChunks() const { return m_nChunks; }
+
+    // Results of the previous cull, so reading them doesn't wait on the GPU
+    unsigned GetVisibleChunks() const    { return m_visibleChunks; }
+    unsigned GetVisibleParticles() const { return m_visibleParticles; }
+
+    // Must match the shaders' local sizes
+    static constexpr int TILE_SIZE        = 8;
+    static constexpr int CHUNKS_PER_GROUP = 64;
+    static constexpr int MAX_LEVELS       = 16;
+
+    // Shader storage buffer bindings
+    static constexpr GLuint CHUNK_BOUNDS_BINDING = 1;
+    static constexpr GLuint COMMANDS_BINDING     = 2;
+    static constexpr GLuint STATS_BINDING        = 3;
+
+private:
+    virtual bool SetUniforms() override;
+    void InitPyramid();
+    void BuildPyramid();
+    void ReadStats();
+
+    std::string m_downsampleFilePath;
+    std::string m_cullFilePath;
+
+    Shader* m_downsampleShader;
+    GLuint m_pyramidTexture;
+    int m_numLevels;
+
+    GLuint m_chunkBoundsBuffer;
+    int m_nChunks;
+    int m_nParticles;
+    int m_particlesPerChunk;
+    float m_particleRadius;
+
+    GLuint m_indirectBuffer;
+    int m_indirectBufferCapacity;
+    // Written on alternate frames
+    GLuint m_statsBuffers[2];
+    int m_currentStatsBuffer;
+    bool m_hasStats[2];
+    unsigned m_visibleChunks;
+    unsigned m_visibleParticles;
+};
+
+}
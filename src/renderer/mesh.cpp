@@ -1,42 +1,193 @@
 #include "renderer/mesh.hpp"
-#include "utils/glcall.h"
+#include "renderer/mesh_simplifier.hpp"
+#include "renderer/mesh_optimizer.hpp"
+#include <algorithm>
+#include <atomic>
 #include <iostream>
 
-Mesh::Mesh(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices)
-    : m_vertices(vertices),
-    m_indices(indices)
+void AABB::Expand(const vec3& point)
+{
+    min = { std::min(min.x, point.x), std::min(min.y, point.y), std::min(min.z, point.z) };
+    max = { std::max(max.x, point.x), std::max(max.y, point.y), std::max(max.z, point.z) };
+}
+
+void AABB::Expand(const AABB& box)
+{
+    if (box.IsEmpty()) return;
+    Expand(box.min);
+    Expand(box.max);
+}
+
+vec3 AABB::GetCenter() const
+{
+    return { (min.x + max.x) * 0.5f, (min.y + max.y) * 0.5f, (min.z + max.z) * 0.5f };
+}
+
+AABB AABB::Transformed(const vec3& scale, const vec3& translation) const
+{
+    if (IsEmpty()) return *this;
+
+    AABB box;
+    box.Expand(vec3{ min.x * scale.x + translation.x, min.y * scale.y + translation.y, 
+        min.z * scale.z + translation.z });
+    box.Expand(vec3{ max.x * scale.x + translation.x, max.y * scale.y + translation.y, 
+        max.z * scale.z + translation.z });
+    return box;
+}
+
+// Meshes are built on the thread pool
+static uint64_t GenerateMeshId()
+{
+    static std::atomic<uint64_t> nextId { 1 };
+    return nextId++;
+}
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices)
+    : m_vertices(std::move(vertices)),
+    m_indices(std::move(indices)),
+    m_id(GenerateMeshId())
 { /* */ }
-    
-bool Mesh::Init()
+
+Mesh::Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, const AABB& bounds,
+    std::vector<MeshCluster> clusters, const MeshOptimizationStats& optimizationStats)
+    : m_vertices(std::move(vertices)),
+    m_indices(std::move(indices)),
+    m_bounds(bounds),
+    m_clusters(std::move(clusters)),
+    m_optimizationStats(optimizationStats),
+    m_id(GenerateMeshId())
+{ /* */ }
+
+void Mesh::Build()
+{
+    m_optimizationStats.importedVertices = m_vertices.size();
+    m_optimizationStats.numTriangles     = m_indices.size() / 3;
+    m_optimizationStats.importedAcmr     = ComputeAcmr(m_indices.data(), m_indices.size(),
+        m_vertices.size());
+
+    WeldVertices(m_vertices, m_indices);
+    BuildClusters();
+    BuildLods();
+    OptimizeLods();
+
+    // Clusters are stored first, so their levels 0 are the full resolution triangles
+    unsigned numIndices = m_clusters.empty() ? 0 : m_clusters.back().firstIndex +
+        m_clusters.back().numIndices;
+    m_optimizationStats.numVertices = m_vertices.size();
+    m_optimizationStats.acmr        = ComputeAcmr(m_indices.data(), numIndices, m_vertices.size());
+}
+
+void Mesh::BuildClusters()
 {
-    GLCall(glGenVertexArrays(1, &m_vao));
-    GLCall(glGenBuffers(1, &m_vbo));
-    GLCall(glGenBuffers(1, &m_ibo));
+    for (const auto& vertex : m_vertices) m_bounds.Expand(vertex.position);
 
-    GLCall(glBindVertexArray(m_vao));
-    GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
-    GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * m_vertices.size(), 
-        &m_vertices[0], GL_STATIC_DRAW));
-    
-    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
-    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indices.size() * sizeof(unsigned int), 
-        &m_indices[0], GL_STATIC_DRAW));
+    unsigned numTriangles = m_indices.size() / 3;
+    if (numTriangles <= MAX_CLUSTER_TRIANGLES)
+    {
+        m_clusters.push_back({ 0, (unsigned)m_indices.size(), m_bounds });
+        m_clusters.back().lods.push_back({ 0, (unsigned)m_indices.size(), 0.f });
+        return;
+    }
 
-    GLCall(glEnableVertexAttribArray(0)); // Position
-    GLCall(glEnableVertexAttribArray(1)); // Normal
-    GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0));
-    GLCall(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)sizeof(vec3)));
+    std::vector<vec3> centroids(numTriangles);
+    std::vector<unsigned> triangles(numTriangles);
+    for (unsigned i = 0; i < numTriangles; i++)
+    {
+        const vec3& a = m_vertices[m_indices[i * 3 + 0]].position;
+        const vec3& b = m_vertices[m_indices[i * 3 + 1]].position;
+        const vec3& c = m_vertices[m_indices[i * 3 + 2]].position;
+        centroids[i] = { (a.x + b.x + c.x) / 3.f, (a.y + b.y + c.y) / 3.f, (a.z + b.z + c.z) / 3.f };
+        triangles[i] = i;
+    }
 
-    GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
-    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
-    GLCall(glBindVertexArray(0));
+    SplitCluster(triangles, centroids, 0, numTriangles);
 
-    return true;
+    // Triangles are reordered so that each cluster is a contiguous range of indices
+    std::vector<unsigned int> indices(m_indices.size());
+    for (unsigned i = 0; i < numTriangles; i++)
+    {
+        for (int k = 0; k < 3; k++) indices[i * 3 + k] = m_indices[triangles[i] * 3 + k];
+    }
+    m_indices = std::move(indices);
+
+    for (auto& cluster : m_clusters)
+    {
+        for (unsigned i = cluster.firstIndex; i < cluster.firstIndex + cluster.numIndices; i++)
+        {
+            cluster.bounds.Expand(m_vertices[m_indices[i]].position);
+        }
+        cluster.lods.push_back({ cluster.firstIndex, cluster.numIndices, 0.f });
+    }
 }
 
-void Mesh::CleanUp()
+// Every level is a separate draw, so each one is ordered for the cache on its own. Vertices are
+// then renumbered in draw order, full resolution levels first.
+void Mesh::OptimizeLods()
 {
-    GLCall(glDeleteBuffers(1, &m_ibo));
-    GLCall(glDeleteBuffers(1, &m_vbo));
-    GLCall(glDeleteVertexArrays(1, &m_vao));
-}
\ No newline at end of file
+    for (const auto& cluster : m_clusters)
+    {
+        for (const auto& lod : cluster.lods)
+        {
+            OptimizeVertexCache(&m_indices[lod.firstIndex], lod.numIndices, m_vertices.size());
+        }
+    }
+
+    OptimizeVertexFetch(m_vertices, m_indices);
+}
+
+void Mesh::BuildLods()
+{
+    for (auto& cluster : m_clusters)
+    {
+        // Each level is simplified from the previous one, so errors add up
+        std::vector<unsigned int> lodIndices(m_indices.begin() + cluster.firstIndex,
+            m_indices.begin() + cluster.firstIndex + cluster.numIndices);
+        float error = 0.f;
+
+        while (cluster.lods.size() < MAX_LODS && lodIndices.size() / 3 >= MIN_LOD_TRIANGLES * 2)
+        {
+            float lodError;
+            size_t previousSize = lodIndices.size();
+            lodIndices = SimplifyTriangles(m_vertices, lodIndices.data(), lodIndices.size(),
+                previousSize / 6 * 3, lodError);
+
+            // Mostly border left, further levels wouldn't save much
+            if (lodIndices.empty() || lodIndices.size() > previousSize * 3 / 4) break;
+
+            error += lodError;
+            cluster.lods.push_back({ (unsigned)m_indices.size(), (unsigned)lodIndices.size(), error });
+            m_indices.insert(m_indices.end(), lodIndices.begin(), lodIndices.end());
+        }
+    }
+}
+
+static float GetAxis(const vec3& v, int axis)
+{
+    return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+}
+
+// Median split along the largest axis of the triangles' centroids
+void Mesh::SplitCluster(std::vector<unsigned>& triangles, const std::vector<vec3>& centroids,
+    unsigned first, unsigned count)
+{
+    if (count <= MAX_CLUSTER_TRIANGLES)
+    {
+        m_clusters.push_back({ first * 3, count * 3, AABB() });
+        return;
+    }
+
+    AABB centroidBounds;
+    for (unsigned i = first; i < first + count; i++) centroidBounds.Expand(centroids[triangles[i]]);
+    vec3 extent = { centroidBounds.max.x - centroidBounds.min.x, 
+        centroidBounds.max.y - centroidBounds.min.y, centroidBounds.max.z - centroidBounds.min.z };
+    int axis = extent.x > extent.y ? (extent.x > extent.z ? 0 : 2) : (extent.y > extent.z ? 1 : 2);
+
+    unsigned half = count / 2;
+    std::nth_element(triangles.begin() + first, triangles.begin() + first + half, 
+        triangles.begin() + first + count, [&](unsigned a, unsigned b) {
+            return GetAxis(centroids[a], axis) < GetAxis(centroids[b], axis);
+        });
+
+    SplitCluster(triangles, centroids, first, half);
+    SplitCluster(triangles, centroids, first + half, count - half);
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include "vec.hpp"
 #include <vector>
+#include <cfloat>
+#include <cstdint>
 #include <GL/glew.h>
 
 #pragma pack(push, 1)
@@ -11,27 +13,100 @@ struct Vertex
 };
 #pragma pack(pop)
 
+struct AABB
+{
+    vec3 min = {  FLT_MAX,  FLT_MAX,  FLT_MAX };
+    vec3 max = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+
+    void Expand(const vec3& point);
+    void Expand(const AABB& box);
+    vec3 GetCenter() const;
+    bool IsEmpty() const { return min.x > max.x; }
+    // Bounds after scaling (possibly by negative factors) and translating
+    AABB Transformed(const vec3& scale, const vec3& translation) const;
+};
+
+// Simplified version of a cluster, stored after the full resolution indices
+struct MeshLod
+{
+    unsigned firstIndex;
+    unsigned numIndices;
+    // Largest distance from the full resolution surface, in mesh space
+    float error;
+};
+
+// Contiguous range of the mesh's indices whose triangles are close to each other, so that
+// large meshes can be culled in parts
+struct MeshCluster
+{
+    unsigned firstIndex;
+    unsigned numIndices;
+    AABB bounds;
+    // Levels of detail, lods[0] being the cluster itself. Each level has at most half the
+    // triangles of the previous one, and the cluster's border is kept across all levels, so
+    // neighbouring clusters can use different levels without cracks.
+    std::vector<MeshLod> lods;
+};
+
+// Import optimization results, see Mesh::Build
+struct MeshOptimizationStats
+{
+    unsigned importedVertices;
+    unsigned numVertices;
+    unsigned numTriangles;
+    // Of the full resolution triangles, see ComputeAcmr
+    float importedAcmr;
+    float acmr;
+};
+
 class Mesh
 {
 public: 
-    Mesh(const std::vector<Vertex>& vertices, 
-        const std::vector<unsigned int>& indices);
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices);
+    // Already built mesh, e.g. loaded from the MeshCache. Build must not be called.
+    Mesh(std::vector<Vertex> vertices, std::vector<unsigned int> indices, const AABB& bounds,
+        std::vector<MeshCluster> clusters, const MeshOptimizationStats& optimizationStats);
 
-    // Requires an active OpenGL context
-    bool Init();
-    void CleanUp();
-    
-    GLuint GetVao() { return m_vao; }
-    GLuint GetIbo() { return m_ibo; }
+    // Welds duplicate vertices, splits the triangles into clusters of at most
+    // MAX_CLUSTER_TRIANGLES triangles, simplifies each cluster into its levels of detail (see
+    // SimplifyTriangles), and reorders every level for the vertex cache and the vertices for
+    // fetch locality. Must be called once, before the mesh is drawn. Doesn't use OpenGL, so
+    // meshes can be built in parallel.
+    void Build();
+
+    // Meshes only live on the CPU: they're drawn from the shared buffers of a MeshBatch, which
+    // tells them apart by id. Copies share the id, since they share the geometry.
+    uint64_t GetId() const { return m_id; }
 
     std::vector<Vertex>& GetVertices()       { return m_vertices; }
     std::vector<unsigned int>& GetIndices()  { return m_indices;  }
+    const std::vector<Vertex>& GetVertices() const      { return m_vertices; }
+    const std::vector<unsigned int>& GetIndices() const { return m_indices;  }
+    // Indices are relative to the mesh, so they fit in 16 bits with at most 65536 vertices
+    bool Uses16BitIndices() const { return m_vertices.size() <= 0x10000; }
+    const MeshOptimizationStats& GetOptimizationStats() const { return m_optimizationStats; }
+
+    // Local space bounds
+    const AABB& GetBounds() const { return m_bounds; }
+    const std::vector<MeshCluster>& GetClusters() const { return m_clusters; }
+
+    static constexpr unsigned MAX_CLUSTER_TRIANGLES = 4096;
+    static constexpr unsigned MAX_LODS              = 5;
+    // Clusters aren't simplified further than this
+    static constexpr unsigned MIN_LOD_TRIANGLES     = 64;
 
 private:
+    void BuildClusters();
+    void BuildLods();
+    void OptimizeLods();
+    void SplitCluster(std::vector<unsigned>& triangles, const std::vector<vec3>& centroids,
+        unsigned first, unsigned count);
+
     std::vector<Vertex> m_vertices;
     std::vector<unsigned int> m_indices;
+    AABB m_bounds;
+    std::vector<MeshCluster> m_clusters;
+    MeshOptimizationStats m_optimizationStats = {};
 
-    GLuint m_vao;
-    GLuint m_vbo;
-    GLuint m_ibo;
+    uint64_t m_id;
 };
\ No newline at end of file
@@ -0,0 +1,329 @@
+#include "renderer/mesh_batch.hpp"
+#include "renderer/pass_input_hash.hpp"
+#include "utils/glcall.h"
+#include "utils/profiler.hpp"
+#include <glm/gtc/matrix_transform.hpp>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace fluidity
+{
+
+static glm::mat4 GetModelMatrix(const Model& model)
+{
+    vec3 translation = model.GetTranslation();
+    vec3 scale       = model.GetScale();
+
+    glm::mat4 modelMatrix = glm::translate(glm::mat4(1.f), glm::vec3(translation.x, translation.y,
+        translation.z));
+    return glm::scale(modelMatrix, glm::vec3(scale.x, scale.y, scale.z));
+}
+
+bool MeshGeometry::Init()
+{
+    GLCall(glGenVertexArrays(1, &m_vao));
+    GLCall(glGenBuffers(1, &m_vbo));
+    GLCall(glGenBuffers(1, &m_ibo));
+
+    // Vertex layout, see Vertex
+    GLCall(glBindVertexArray(m_vao));
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
+    GLCall(glEnableVertexAttribArray(0)); // Position
+    GLCall(glEnableVertexAttribArray(1)); // Normal
+    GLCall(glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0));
+    GLCall(glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)sizeof(vec3)));
+    GLCall(glBindVertexArray(0));
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+
+    return true;
+}
+
+void MeshGeometry::CleanUp()
+{
+    GLCall(glDeleteBuffers(1, &m_ibo));
+    GLCall(glDeleteBuffers(1, &m_vbo));
+    GLCall(glDeleteVertexArrays(1, &m_vao));
+    m_geometryHash = 0;
+}
+
+void MeshGeometry::Update(std::vector<Model>& models)
+{
+    PROFILE_SCOPE("MeshGeometry::Update");
+    // Meshes of a reloaded model may have the same sizes, hence the geometry versions
+    PassInputHash geometryHash;
+    PassInputHash transformsHash;
+    for (auto& model : models)
+    {
+        geometryHash.Add(model.GetGeometryVersion());
+        for (auto& mesh : model.GetMeshes())
+        {
+            geometryHash.Add(mesh.GetId()).Add(mesh.GetIndices().size());
+        }
+        transformsHash.Add(model.GetTranslation()).Add(model.GetScale());
+    }
+
+    if (geometryHash.Get() != m_geometryHash)
+    {
+        UploadGeometry(models);
+        UpdateClusterBounds(models);
+        m_bvh.Build(m_clusterBounds);
+        m_geometryHash   = geometryHash.Get();
+        m_transformsHash = transformsHash.Get();
+    }
+    else if (transformsHash.Get() != m_transformsHash)
+    {
+        UpdateClusterBounds(models);
+        m_bvh.Refit(m_clusterBounds);
+        m_transformsHash = transformsHash.Get();
+    }
+}
+
+void MeshGeometry::Query(const Frustum& frustum, std::vector<unsigned>& clusters) const
+{
+    m_bvh.Query(frustum, m_clusterBounds, clusters);
+}
+
+bool MeshBatch::Init()
+{
+    m_useMultiDrawIndirect = GLEW_ARB_shader_draw_parameters;
+
+    GLCall(glGenBuffers(1, &m_drawDataBuffer));
+    GLCall(glGenBuffers(1, &m_indirectBuffer));
+
+    return true;
+}
+
+void MeshBatch::CleanUp()
+{
+    GLCall(glDeleteBuffers(1, &m_indirectBuffer));
+    GLCall(glDeleteBuffers(1, &m_drawDataBuffer));
+}
+
+void MeshBatch::Update(std::vector<Model>& models, const Frustum* frustum,
+    const LodSelection* lodSelection)
+{
+    PROFILE_SCOPE("MeshBatch::Update");
+    m_geometry->Update(models);
+    const auto& clusters = m_geometry->GetClusters();
+
+    m_visibleClusters.clear();
+    if (frustum != nullptr) m_geometry->Query(*frustum, m_visibleClusters);
+    else for (unsigned i = 0; i < clusters.size(); i++) m_visibleClusters.push_back(i);
+    // Keeps the draws of each model together, regardless of the tree order
+    std::sort(m_visibleClusters.begin(), m_visibleClusters.end());
+
+    m_drawData.clear();
+    m_commands.clear();
+    m_groups.clear();
+    m_numTriangles = 0;
+
+    // One group per cull state, so that the state only changes between multi-draw calls
+    for (bool cullFrontFaces : { false, true })
+    {
+        DrawGroup group = { cullFrontFaces, (unsigned)m_commands.size(), 0 };
+        for (unsigned clusterIndex : m_visibleClusters)
+        {
+            const MeshGeometry::ClusterRange& cluster = clusters[clusterIndex];
+            const Model& model = models[cluster.model];
+            if (!model.IsVisible() || model.GetHideFrontFaces() != cullFrontFaces) continue;
+
+            const Material& material = model.GetMaterialConst();
+            DrawData drawData;
+            drawData.model          = GetModelMatrix(model);
+            drawData.diffuse        = { material.diffuse.x, material.diffuse.y, material.diffuse.z, 1.f };
+            drawData.specular       = { material.specular.x, material.specular.y, material.specular.z,
+                material.shininess };
+            drawData.reflectiveness = material.reflectiveness;
+            drawData.emissive       = material.emissive ? 1 : 0;
+            drawData.invertNormals  = model.GetHideFrontFaces() ? 1 : 0;
+            drawData.padding        = 0;
+
+            const MeshGeometry::LodRange& lod = lodSelection != nullptr ?
+                m_geometry->SelectLod(clusterIndex, model, *lodSelection) :
+                m_geometry->GetLods()[cluster.firstLod];
+
+            m_drawData.push_back(drawData);
+            m_commands.push_back({ lod.numIndices, 1, lod.firstIndex, cluster.baseVertex, 0 });
+            m_numTriangles += lod.numIndices / 3;
+        }
+
+        group.numDraws = m_commands.size() - group.firstDraw;
+        if (group.numDraws > 0) m_groups.push_back(group);
+    }
+
+    if (m_commands.empty()) return;
+
+    GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_drawDataBuffer));
+    GLCall(glBufferData(GL_SHADER_STORAGE_BUFFER, sizeof(DrawData) * m_drawData.size(),
+        m_drawData.data(), GL_DYNAMIC_DRAW));
+    GLCall(glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0));
+
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer));
+    GLCall(glBufferData(GL_DRAW_INDIRECT_BUFFER, sizeof(DrawElementsIndirectCommand) *
+        m_commands.size(), m_commands.data(), GL_DYNAMIC_DRAW));
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+}
+
+void MeshGeometry::UploadGeometry(std::vector<Model>& models)
+{
+    PROFILE_SCOPE("MeshGeometry::UploadGeometry");
+    size_t numVertices  = 0;
+    size_t numIndices   = 0;
+    bool use16BitIndices = true;
+    for (auto& model : models)
+    {
+        for (auto& mesh : model.GetMeshes())
+        {
+            numVertices += mesh.GetVertices().size();
+            numIndices  += mesh.GetIndices().size();
+            use16BitIndices = use16BitIndices && mesh.Uses16BitIndices();
+        }
+    }
+    // Indices are relative to their mesh, so only the largest mesh matters
+    m_indexType = use16BitIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT;
+    size_t indexSize = use16BitIndices ? sizeof(GLushort) : sizeof(GLuint);
+
+    m_clusters.clear();
+    m_lods.clear();
+
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, m_vbo));
+    GLCall(glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * numVertices, nullptr, GL_STATIC_DRAW));
+    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo));
+    GLCall(glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexSize * numIndices, nullptr, GL_STATIC_DRAW));
+    std::vector<GLushort> shortIndices;
+
+    // Indices are kept relative to their mesh, baseVertex offsets them at draw time
+    GLuint firstIndex = 0;
+    GLint  baseVertex = 0;
+    for (unsigned i = 0; i < models.size(); i++)
+    {
+        for (auto& mesh : models[i].GetMeshes())
+        {
+            const auto& vertices = mesh.GetVertices();
+            const auto& indices  = mesh.GetIndices();
+            if (vertices.empty() || indices.empty()) continue;
+
+            GLCall(glBufferSubData(GL_ARRAY_BUFFER, sizeof(Vertex) * baseVertex,
+                sizeof(Vertex) * vertices.size(), vertices.data()));
+            if (use16BitIndices)
+            {
+                shortIndices.assign(indices.begin(), indices.end());
+                GLCall(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexSize * firstIndex,
+                    indexSize * shortIndices.size(), shortIndices.data()));
+            }
+            else
+            {
+                GLCall(glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, indexSize * firstIndex,
+                    indexSize * indices.size(), indices.data()));
+            }
+
+            for (const auto& cluster : mesh.GetClusters())
+            {
+                m_clusters.push_back({ i, (unsigned)m_lods.size(), (unsigned)cluster.lods.size(),
+                    baseVertex, cluster.bounds });
+                for (const auto& lod : cluster.lods)
+                {
+                    m_lods.push_back({ firstIndex + lod.firstIndex, lod.numIndices, lod.error });
+                }
+            }
+            firstIndex += indices.size();
+            baseVertex += vertices.size();
+        }
+    }
+
+    GLCall(glBindBuffer(GL_ARRAY_BUFFER, 0));
+    GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0));
+}
+
+void MeshGeometry::UpdateClusterBounds(const std::vector<Model>& models)
+{
+    m_clusterBounds.resize(m_clusters.size());
+    for (unsigned i = 0; i < m_clusters.size(); i++)
+    {
+        const Model& model = models[m_clusters[i].model];
+        m_clusterBounds[i] = m_clusters[i].localBounds.Transformed(model.GetScale(),
+            model.GetTranslation());
+    }
+}
+
+const MeshGeometry::LodRange& MeshGeometry::SelectLod(unsigned clusterIndex, const Model& model,
+    const LodSelection& lodSelection) const
+{
+    const ClusterRange& cluster = m_clusters[clusterIndex];
+    const AABB& bounds = m_clusterBounds[clusterIndex];
+    vec3 scale = model.GetScale();
+    float maxScale = std::max({ std::abs(scale.x), std::abs(scale.y), std::abs(scale.z) });
+
+    float pixelsPerUnit = lodSelection.pixelsPerUnit;
+    if (lodSelection.perspective)
+    {
+        // Distance to the closest point of the cluster, zero from inside it
+        const glm::vec3& eye = lodSelection.viewPosition;
+        glm::vec3 closest = glm::clamp(eye, glm::vec3(bounds.min.x, bounds.min.y, bounds.min.z),
+            glm::vec3(bounds.max.x, bounds.max.y, bounds.max.z));
+        float distance = glm::length(closest - eye);
+        pixelsPerUnit = distance > 0.f ? pixelsPerUnit / distance :
+            std::numeric_limits<float>::infinity();
+    }
+
+    unsigned lod = 0;
+    while (lod + 1 < cluster.numLods &&
+        m_lods[cluster.firstLod + lod + 1].error * maxScale * pixelsPerUnit <= lodSelection.maxPixelError)
+    {
+        lod++;
+    }
+
+    lod = std::max(lod, std::min(lodSelection.minLod, cluster.numLods - 1));
+    return m_lods[cluster.firstLod + lod];
+}
+
+void MeshBatch::Draw(Shader& shader)
+{
+    if (m_commands.empty()) return;
+    GLenum indexType = m_geometry->GetIndexType();
+
+    GLCall(glBindVertexArray(m_geometry->GetVao()));
+    GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, m_drawDataBuffer));
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_indirectBuffer));
+
+    for (const auto& group : m_groups)
+    {
+        if (group.cullFrontFaces)
+        {
+            glEnable(GL_CULL_FACE);
+            glCullFace(GL_FRONT);
+        }
+        else
+        {
+            glDisable(GL_CULL_FACE);
+            glCullFace(GL_BACK);
+        }
+
+        if (m_useMultiDrawIndirect)
+        {
+            shader.SetUniform1i("u_DrawOffset", group.firstDraw, true);
+            GLCall(glMultiDrawElementsIndirect(GL_TRIANGLES, indexType,
+                (const void*)(sizeof(DrawElementsIndirectCommand) * group.firstDraw), group.numDraws, 0));
+        }
+        else
+        {
+            for (unsigned i = group.firstDraw; i < group.firstDraw + group.numDraws; i++)
+            {
+                const auto& command = m_commands[i];
+                shader.SetUniform1i("u_DrawOffset", i, true);
+                size_t indexSize = indexType == GL_UNSIGNED_SHORT ? sizeof(GLushort) : sizeof(GLuint);
+                GLCall(glDrawElementsBaseVertex(GL_TRIANGLES, command.count, indexType,
+                    (const void*)(indexSize * command.firstIndex), command.baseVertex));
+            }
+        }
+    }
+
+    GLCall(glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0));
+    GLCall(glBindBufferBase(GL_SHADER_STORAGE_BUFFER, DRAW_DATA_BINDING, 0));
+    GLCall(glBindVertexArray(0));
+}
+
+}
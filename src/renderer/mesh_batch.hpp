@@ -0,0 +1,167 @@
+#pragma once
+#include "renderer/model.hpp"
+#include "renderer/bvh.hpp"
+#include "renderer/shader.h"
+#include <glm/glm.hpp>
+#include <GL/glew.h>
+#include <cstdint>
+#include <vector>
+
+namespace fluidity
+{
+
+// Picks a level of detail for each cluster, the coarsest one whose error covers at most
+// maxPixelError pixels in the view
+struct LodSelection
+{
+    glm::vec3 viewPosition;
+    // Pixels covered by a unit length at unit distance (perspective projections), or at any
+    // distance (orthographic projections)
+    float pixelsPerUnit;
+    bool perspective;
+    float maxPixelError;
+    // Clusters never use a finer level than this one (if they have it)
+    unsigned minLod;
+};
+
+// Every mesh of a list of models, sub-allocated in a single vertex and index buffer, with the
+// levels of detail of each mesh cluster and a BVH over the world space cluster bounds.
+// Indices are kept relative to their mesh (offset by baseVertex), so they're 16 bit unless a
+// mesh has more than 65536 vertices.
+// Shared among the MeshBatches that draw the same models, so the geometry is only stored and
+// updated once.
+class MeshGeometry
+{
+public:
+    // Range of a cluster level of detail in the shared index buffer
+    struct LodRange
+    {
+        GLuint firstIndex;
+        GLuint numIndices;
+        float  error;
+    };
+
+    // A mesh cluster's levels of detail are GetLods()[firstLod, firstLod + numLods)
+    struct ClusterRange
+    {
+        unsigned model;
+        unsigned firstLod;
+        unsigned numLods;
+        GLint    baseVertex;
+        AABB     localBounds;
+    };
+
+    MeshGeometry() = default;
+    MeshGeometry(const MeshGeometry&) = delete;
+
+    bool Init();
+    void CleanUp();
+
+    // Rebuilds the buffers and the BVH if the models' geometry changed, or refits the BVH if
+    // they only moved. Cheap when nothing changed, so every batch can call it.
+    void Update(std::vector<Model>& models);
+    // Appends the clusters whose bounds intersect the frustum, in no particular order
+    void Query(const Frustum& frustum, std::vector<unsigned>& clusters) const;
+    const LodRange& SelectLod(unsigned clusterIndex, const Model& model,
+        const LodSelection& lodSelection) const;
+
+    GLuint GetVao() const { return m_vao; }
+    // GL_UNSIGNED_SHORT when every mesh has at most 65536 vertices
+    GLenum GetIndexType() const { return m_indexType; }
+    const std::vector<ClusterRange>& GetClusters() const { return m_clusters; }
+    const std::vector<LodRange>& GetLods() const { return m_lods; }
+
+private:
+    void UploadGeometry(std::vector<Model>& models);
+    void UpdateClusterBounds(const std::vector<Model>& models);
+
+    GLenum m_indexType          = GL_UNSIGNED_INT;
+    uint64_t m_geometryHash     = 0;
+    uint64_t m_transformsHash   = 0;
+
+    GLuint m_vao = 0;
+    GLuint m_vbo = 0;
+    GLuint m_ibo = 0;
+
+    std::vector<ClusterRange> m_clusters;
+    std::vector<LodRange> m_lods;
+    std::vector<AABB> m_clusterBounds; // World space
+    Bvh m_bvh;
+};
+
+// Draws the meshes of a MeshGeometry with (at most) one glMultiDrawElementsIndirect per cull
+// mode. The per draw model matrix and material are read from a shader storage buffer, indexed
+// by u_DrawOffset + gl_DrawID.
+// Without ARB_shader_draw_parameters, draws are issued one at a time with the same buffers.
+// Each mesh cluster is a separate draw, and only the clusters in the view frustum are drawn
+// (see Bvh), at the level of detail picked by a LodSelection.
+class MeshBatch
+{
+public:
+    explicit MeshBatch(MeshGeometry* geometry)
+        : m_geometry(geometry)
+    { /* */ }
+
+    bool Init();
+    void CleanUp();
+
+    // Updates the geometry (see MeshGeometry::Update), and uploads the draws of the clusters
+    // inside the frustum (or of every cluster, without a frustum). Without a LodSelection,
+    // clusters are drawn at full resolution.
+    void Update(std::vector<Model>& models, const Frustum* frustum = nullptr,
+        const LodSelection* lodSelection = nullptr);
+    // The shader is expected to be bound, with the DrawData buffer at DRAW_DATA_BINDING
+    void Draw(Shader& shader);
+
+    bool IsUsingMultiDrawIndirect() const { return m_useMultiDrawIndirect; }
+    unsigned GetNumberOfDraws() const { return m_commands.size(); }
+    unsigned GetNumberOfClusters() const { return m_geometry->GetClusters().size(); }
+    unsigned GetNumberOfTriangles() const { return m_numTriangles; }
+
+    static constexpr GLuint DRAW_DATA_BINDING = 0;
+
+private:
+    // std430 layout, must match DrawData in the mesh shaders
+    struct DrawData
+    {
+        glm::mat4 model;
+        glm::vec4 diffuse;
+        glm::vec4 specular; // w: shininess
+        float reflectiveness;
+        int emissive;
+        int invertNormals;
+        int padding;
+    };
+
+    struct DrawElementsIndirectCommand
+    {
+        GLuint count;
+        GLuint instanceCount;
+        GLuint firstIndex;
+        GLint  baseVertex;
+        GLuint baseInstance;
+    };
+
+    // Draws sharing the same cull state, contiguous in the command and draw data buffers
+    struct DrawGroup
+    {
+        bool cullFrontFaces;
+        unsigned firstDraw;
+        unsigned numDraws;
+    };
+
+    MeshGeometry* m_geometry;
+    bool m_useMultiDrawIndirect = false;
+
+    GLuint m_drawDataBuffer = 0;
+    GLuint m_indirectBuffer = 0;
+
+    std::vector<unsigned> m_visibleClusters;
+
+    std::vector<DrawData> m_drawData;
+    std::vector<DrawElementsIndirectCommand> m_commands;
+    std::vector<DrawGroup> m_groups;
+    unsigned m_numTriangles = 0;
+};
+
+}
@@ -0,0 +1,310 @@
+#include "renderer/mesh_cache.hpp"
+#include "utils/logger.h"
+#include "utils/mapped_file.hpp"
+#include "utils/profiler.hpp"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <type_traits>
+
+std::string MeshCache::s_directory = "../../cache/meshes";
+
+namespace
+{
+
+constexpr char MAGIC[8] = { 'F', 'L', 'M', 'E', 'S', 'H', '\0', '\0' };
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t numMeshes;
+    uint64_t key;
+};
+
+struct FileBounds
+{
+    float min[3];
+    float max[3];
+};
+
+struct FileMesh
+{
+    uint64_t verticesOffset;
+    uint64_t indicesOffset;
+    uint64_t clustersOffset;
+    uint64_t lodsOffset;
+    uint32_t numVertices;
+    uint32_t numIndices;
+    uint32_t numClusters;
+    uint32_t numLods;
+    FileBounds bounds;
+    uint32_t importedVertices;
+    uint32_t numTriangles;
+    float importedAcmr;
+    float acmr;
+};
+
+// The cluster's levels are lods[firstLod, firstLod + numLods) of its mesh
+struct FileCluster
+{
+    uint32_t firstIndex;
+    uint32_t numIndices;
+    uint32_t firstLod;
+    uint32_t numLods;
+    FileBounds bounds;
+};
+
+static_assert(sizeof(Vertex) == 24, "Vertex layout changed, increment MeshCache::VERSION");
+static_assert(std::is_trivially_copyable<MeshLod>::value, "MeshLod is stored as is");
+
+FileBounds ToFileBounds(const AABB& box)
+{
+    return { { box.min.x, box.min.y, box.min.z }, { box.max.x, box.max.y, box.max.z } };
+}
+
+AABB FromFileBounds(const FileBounds& bounds)
+{
+    AABB box;
+    box.min = { bounds.min[0], bounds.min[1], bounds.min[2] };
+    box.max = { bounds.max[0], bounds.max[1], bounds.max[2] };
+    return box;
+}
+
+size_t Align(size_t offset)
+{
+    return (offset + 7) & ~size_t(7);
+}
+
+// FNV-1a over 64 bit words, so hashing large model files stays far cheaper than importing them
+class WordHash
+{
+public:
+    void Add(const void* data, size_t size)
+    {
+        const char* bytes = static_cast<const char*>(data);
+        size_t i = 0;
+        for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t))
+        {
+            uint64_t word;
+            std::memcpy(&word, bytes + i, sizeof(uint64_t));
+            Mix(word);
+        }
+        for (; i < size; i++) Mix((unsigned char)bytes[i]);
+    }
+
+    uint64_t Get() const { return m_hash; }
+
+private:
+    void Mix(uint64_t value)
+    {
+        m_hash ^= value;
+        m_hash *= 1099511628211ull;
+    }
+
+    uint64_t m_hash = 14695981039346656037ull;
+};
+
+}
+
+uint64_t MeshCache::ComputeKey(const std::string& modelFilePath, bool smoothNormals)
+{
+    PROFILE_SCOPE("MeshCache::ComputeKey");
+    std::ifstream file(modelFilePath, std::ios::binary);
+    if (!file) return 0;
+
+    WordHash hash;
+    std::vector<char> buffer(1 << 20);
+    while (file)
+    {
+        file.read(buffer.data(), buffer.size());
+        hash.Add(buffer.data(), file.gcount());
+    }
+
+    uint32_t options[2] = { VERSION, smoothNormals ? 1u : 0u };
+    hash.Add(options, sizeof(options));
+
+    // 0 means no key
+    return hash.Get() != 0 ? hash.Get() : 1;
+}
+
+std::string MeshCache::GetEntryPath(uint64_t key)
+{
+    std::stringstream fileName;
+    fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".mesh";
+    return (std::filesystem::path(s_directory) / fileName.str()).string();
+}
+
+bool MeshCache::Load(uint64_t key, std::vector<Mesh>& meshes)
+{
+    PROFILE_SCOPE("MeshCache::Load");
+    fluidity::MappedFile file;
+    if (!file.Open(GetEntryPath(key))) return false;
+
+    const char* data = file.GetData();
+    size_t size      = file.GetSize();
+    auto isInFile = [size](uint64_t offset, uint64_t count, size_t elementSize) {
+        return offset <= size && count <= (size - offset) / elementSize;
+    };
+
+    if (size < sizeof(FileHeader)) return false;
+    FileHeader header;
+    std::memcpy(&header, data, sizeof(FileHeader));
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.key != key || !isInFile(sizeof(FileHeader), header.numMeshes, sizeof(FileMesh)))
+    {
+        LOG_WARNING("Invalid mesh cache entry: " + GetEntryPath(key));
+        return false;
+    }
+
+    const FileMesh* fileMeshes = reinterpret_cast<const FileMesh*>(data + sizeof(FileHeader));
+    for (uint32_t i = 0; i < header.numMeshes; i++)
+    {
+        if (!isInFile(fileMeshes[i].verticesOffset, fileMeshes[i].numVertices, sizeof(Vertex)) ||
+            !isInFile(fileMeshes[i].indicesOffset, fileMeshes[i].numIndices, sizeof(uint32_t)) ||
+            !isInFile(fileMeshes[i].clustersOffset, fileMeshes[i].numClusters, sizeof(FileCluster)) ||
+            !isInFile(fileMeshes[i].lodsOffset, fileMeshes[i].numLods, sizeof(MeshLod)))
+        {
+            LOG_WARNING("Truncated mesh cache entry: " + GetEntryPath(key));
+            return false;
+        }
+
+        // Ranges that don't fit the mesh would make the draws read out of bounds
+        const FileMesh& fileMesh = fileMeshes[i];
+        const uint32_t* indices  = reinterpret_cast<const uint32_t*>(data + fileMesh.indicesOffset);
+        const FileCluster* fileClusters = reinterpret_cast<const FileCluster*>(data +
+            fileMesh.clustersOffset);
+        const MeshLod* lods = reinterpret_cast<const MeshLod*>(data + fileMesh.lodsOffset);
+        auto isInIndices = [&fileMesh](uint64_t firstIndex, uint64_t numIndices) {
+            return firstIndex + numIndices <= fileMesh.numIndices;
+        };
+
+        bool valid = std::all_of(indices, indices + fileMesh.numIndices,
+            [&fileMesh](uint32_t index) { return index < fileMesh.numVertices; });
+        for (uint32_t j = 0; j < fileMesh.numClusters && valid; j++)
+        {
+            valid = isInIndices(fileClusters[j].firstIndex, fileClusters[j].numIndices) &&
+                fileClusters[j].firstLod + (uint64_t)fileClusters[j].numLods <= fileMesh.numLods;
+        }
+        for (uint32_t j = 0; j < fileMesh.numLods && valid; j++)
+        {
+            valid = isInIndices(lods[j].firstIndex, lods[j].numIndices);
+        }
+
+        if (!valid)
+        {
+            LOG_WARNING("Invalid mesh cache entry: " + GetEntryPath(key));
+            return false;
+        }
+    }
+
+    for (uint32_t i = 0; i < header.numMeshes; i++)
+    {
+        const FileMesh& fileMesh = fileMeshes[i];
+        const Vertex* vertices   = reinterpret_cast<const Vertex*>(data + fileMesh.verticesOffset);
+        const uint32_t* indices  = reinterpret_cast<const uint32_t*>(data + fileMesh.indicesOffset);
+        const FileCluster* fileClusters = reinterpret_cast<const FileCluster*>(data +
+            fileMesh.clustersOffset);
+        const MeshLod* lods = reinterpret_cast<const MeshLod*>(data + fileMesh.lodsOffset);
+
+        std::vector<MeshCluster> clusters(fileMesh.numClusters);
+        for (uint32_t j = 0; j < fileMesh.numClusters; j++)
+        {
+            const FileCluster& fileCluster = fileClusters[j];
+            clusters[j].firstIndex = fileCluster.firstIndex;
+            clusters[j].numIndices = fileCluster.numIndices;
+            clusters[j].bounds     = FromFileBounds(fileCluster.bounds);
+            clusters[j].lods.assign(lods + fileCluster.firstLod,
+                lods + fileCluster.firstLod + fileCluster.numLods);
+        }
+
+        MeshOptimizationStats stats;
+        stats.importedVertices = fileMesh.importedVertices;
+        stats.numVertices      = fileMesh.numVertices;
+        stats.numTriangles     = fileMesh.numTriangles;
+        stats.importedAcmr     = fileMesh.importedAcmr;
+        stats.acmr             = fileMesh.acmr;
+
+        meshes.emplace_back(std::vector<Vertex>(vertices, vertices + fileMesh.numVertices),
+            std::vector<unsigned int>(indices, indices + fileMesh.numIndices),
+            FromFileBounds(fileMesh.bounds), std::move(clusters), stats);
+    }
+
+    return true;
+}
+
+bool MeshCache::Store(uint64_t key, const std::vector<Mesh>& meshes, size_t firstMesh)
+{
+    PROFILE_SCOPE("MeshCache::Store");
+    size_t numMeshes = meshes.size() - firstMesh;
+
+    // Lays out the arrays after the header and the mesh table
+    std::vector<FileMesh> fileMeshes(numMeshes);
+    size_t offset = sizeof(FileHeader) + sizeof(FileMesh) * numMeshes;
+    for (size_t i = 0; i < numMeshes; i++)
+    {
+        const Mesh& mesh = meshes[firstMesh + i];
+        const auto& stats = mesh.GetOptimizationStats();
+        FileMesh& fileMesh = fileMeshes[i];
+
+        fileMesh.numVertices = mesh.GetVertices().size();
+        fileMesh.numIndices  = mesh.GetIndices().size();
+        fileMesh.numClusters = mesh.GetClusters().size();
+        fileMesh.numLods     = 0;
+        for (const auto& cluster : mesh.GetClusters()) fileMesh.numLods += cluster.lods.size();
+
+        fileMesh.verticesOffset = offset = Align(offset);
+        offset += sizeof(Vertex) * fileMesh.numVertices;
+        fileMesh.indicesOffset  = offset = Align(offset);
+        offset += sizeof(uint32_t) * fileMesh.numIndices;
+        fileMesh.clustersOffset = offset = Align(offset);
+        offset += sizeof(FileCluster) * fileMesh.numClusters;
+        fileMesh.lodsOffset     = offset = Align(offset);
+        offset += sizeof(MeshLod) * fileMesh.numLods;
+
+        fileMesh.bounds           = ToFileBounds(mesh.GetBounds());
+        fileMesh.importedVertices = stats.importedVertices;
+        fileMesh.numTriangles     = stats.numTriangles;
+        fileMesh.importedAcmr     = stats.importedAcmr;
+        fileMesh.acmr             = stats.acmr;
+    }
+
+    std::vector<char> buffer(offset, 0);
+    FileHeader header;
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version   = VERSION;
+    header.numMeshes = numMeshes;
+    header.key       = key;
+    std::memcpy(buffer.data(), &header, sizeof(FileHeader));
+    std::memcpy(buffer.data() + sizeof(FileHeader), fileMeshes.data(), sizeof(FileMesh) * numMeshes);
+
+    for (size_t i = 0; i < numMeshes; i++)
+    {
+        const Mesh& mesh = meshes[firstMesh + i];
+        const FileMesh& fileMesh = fileMeshes[i];
+        std::memcpy(buffer.data() + fileMesh.verticesOffset, mesh.GetVertices().data(),
+            sizeof(Vertex) * fileMesh.numVertices);
+        std::memcpy(buffer.data() + fileMesh.indicesOffset, mesh.GetIndices().data(),
+            sizeof(uint32_t) * fileMesh.numIndices);
+
+        uint32_t firstLod = 0;
+        char* clusters = buffer.data() + fileMesh.clustersOffset;
+        char* lods     = buffer.data() + fileMesh.lodsOffset;
+        for (const auto& cluster : mesh.GetClusters())
+        {
+            FileCluster fileCluster = { cluster.firstIndex, cluster.numIndices, firstLod,
+                (uint32_t)cluster.lods.size(), ToFileBounds(cluster.bounds) };
+            std::memcpy(clusters, &fileCluster, sizeof(FileCluster));
+            clusters += sizeof(FileCluster);
+
+            std::memcpy(lods + sizeof(MeshLod) * firstLod, cluster.lods.data(),
+                sizeof(MeshLod) * cluster.lods.size());
+            firstLod += cluster.lods.size();
+        }
+    }
+
+    return fluidity::WriteFileAtomically(GetEntryPath(key), buffer.data(), buffer.size());
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include "renderer/mesh.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Binary cache of built meshes (see Mesh::Build), so loading a model again skips both assimp and
+// the import pipeline. Entries are keyed by a hash of the model file's contents, the import
+// options (smooth or flat normals) and the cache format version, so edited files and changes
+// to the pipeline miss the cache instead of loading stale data.
+// An entry is one file: a header, a table of meshes, then the vertex, index, cluster and LOD
+// arrays, each 8 byte aligned and in the in-memory layout, so the file is read by mapping it.
+class MeshCache
+{
+public:
+    // Returns 0 if the model file can't be read
+    static uint64_t ComputeKey(const std::string& modelFilePath, bool smoothNormals);
+
+    // Appends the cached meshes to meshes. Returns false on a miss, or if the entry is invalid.
+    static bool Load(uint64_t key, std::vector<Mesh>& meshes);
+    // Stores meshes [firstMesh, meshes.size()), replacing the entry atomically, so concurrent
+    // loads never read a partial file
+    static bool Store(uint64_t key, const std::vector<Mesh>& meshes, size_t firstMesh = 0);
+
+    static void SetDirectory(const std::string& directory) { s_directory = directory; }
+    static const std::string& GetDirectory() { return s_directory; }
+
+    // Must be incremented whenever Mesh::Build or the file layout changes
+    static constexpr uint32_t VERSION = 1;
+
+private:
+    static std::string GetEntryPath(uint64_t key);
+
+    static std::string s_directory;
+};
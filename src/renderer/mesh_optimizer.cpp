@@ -0,0 +1,222 @@
+#include "renderer/mesh_optimizer.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+
+// Vertex is packed, so equal vertices have equal bytes
+struct VertexBytesHash
+{
+    size_t operator()(const Vertex& vertex) const
+    {
+        // FNV-1a
+        const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&vertex);
+        uint64_t hash = 14695981039346656037ull;
+        for (size_t i = 0; i < sizeof(Vertex); i++) hash = (hash ^ bytes[i]) * 1099511628211ull;
+        return (size_t)hash;
+    }
+};
+
+struct VertexBytesEqual
+{
+    bool operator()(const Vertex& a, const Vertex& b) const
+    {
+        return std::memcmp(&a, &b, sizeof(Vertex)) == 0;
+    }
+};
+
+}
+
+void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    std::unordered_map<Vertex, unsigned, VertexBytesHash, VertexBytesEqual> uniqueVertices;
+    uniqueVertices.reserve(vertices.size());
+
+    std::vector<Vertex> welded;
+    std::vector<unsigned> remap(vertices.size());
+    for (unsigned i = 0; i < vertices.size(); i++)
+    {
+        auto inserted = uniqueVertices.emplace(vertices[i], (unsigned)welded.size());
+        if (inserted.second) welded.push_back(vertices[i]);
+        remap[i] = inserted.first->second;
+    }
+
+    for (auto& index : indices) index = remap[index];
+    vertices = std::move(welded);
+}
+
+namespace
+{
+
+constexpr int   CACHE_SIZE           = 32;
+constexpr float CACHE_DECAY_POWER    = 1.5f;
+constexpr float LAST_TRIANGLE_SCORE  = 0.75f;
+constexpr float VALENCE_BOOST_SCALE  = 2.0f;
+constexpr float VALENCE_BOOST_POWER  = 0.5f;
+
+// Vertices used by the last triangle score the same, so the next one isn't biased by the
+// order of its vertices. Vertices with few triangles left score higher, so they're finished
+// (and leave no lone triangles behind) early.
+float VertexScore(int cachePosition, unsigned remainingTriangles)
+{
+    if (remainingTriangles == 0) return -1.f;
+
+    float score = 0.f;
+    if (cachePosition >= 0)
+    {
+        if (cachePosition < 3) score = LAST_TRIANGLE_SCORE;
+        else
+        {
+            float scaler = 1.f / (CACHE_SIZE - 3);
+            score = std::pow(1.f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+
+    return score + VALENCE_BOOST_SCALE * std::pow((float)remainingTriangles, -VALENCE_BOOST_POWER);
+}
+
+}
+
+void OptimizeVertexCache(unsigned int* indices, size_t numIndices, size_t numVertices)
+{
+    size_t numTriangles = numIndices / 3;
+    if (numTriangles == 0) return;
+
+    // Triangles of each vertex, the first remainingTriangles[v] of them not emitted yet
+    std::vector<unsigned> offsets(numVertices + 1, 0);
+    for (size_t i = 0; i < numIndices; i++) offsets[indices[i] + 1]++;
+    for (size_t v = 0; v < numVertices; v++) offsets[v + 1] += offsets[v];
+    std::vector<unsigned> vertexTriangles(numIndices);
+    std::vector<unsigned> remainingTriangles(numVertices, 0);
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        unsigned v = indices[i];
+        vertexTriangles[offsets[v] + remainingTriangles[v]++] = i / 3;
+    }
+
+    std::vector<int> cachePositions(numVertices, -1);
+    std::vector<float> vertexScores(numVertices);
+    for (size_t v = 0; v < numVertices; v++) vertexScores[v] = VertexScore(-1, remainingTriangles[v]);
+
+    std::vector<float> triangleScores(numTriangles);
+    std::vector<bool> emitted(numTriangles, false);
+    for (size_t t = 0; t < numTriangles; t++)
+    {
+        triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] +
+            vertexScores[indices[t * 3 + 2]];
+    }
+
+    std::vector<unsigned> output;
+    output.reserve(numIndices);
+    std::vector<unsigned> cache;
+    std::vector<unsigned> newCache;
+    size_t nextUnemitted = 0;
+    int bestTriangle     = -1;
+
+    while (output.size() < numIndices)
+    {
+        // Nothing in the cache has triangles left, start again from the next unemitted one
+        if (bestTriangle < 0)
+        {
+            while (emitted[nextUnemitted]) nextUnemitted++;
+            bestTriangle = nextUnemitted;
+        }
+
+        const unsigned* triangle = &indices[bestTriangle * 3];
+        emitted[bestTriangle] = true;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // Removes the triangle from its vertices' lists
+        for (int k = 0; k < 3; k++)
+        {
+            unsigned v = triangle[k];
+            unsigned* first = &vertexTriangles[offsets[v]];
+            unsigned* last  = first + remainingTriangles[v];
+            std::iter_swap(std::find(first, last, (unsigned)bestTriangle), last - 1);
+            remainingTriangles[v]--;
+        }
+
+        // The triangle's vertices move to the front of the cache
+        newCache.assign(triangle, triangle + 3);
+        for (unsigned v : cache)
+        {
+            if (v != triangle[0] && v != triangle[1] && v != triangle[2]) newCache.push_back(v);
+        }
+
+        for (size_t i = 0; i < newCache.size(); i++)
+        {
+            unsigned v = newCache[i];
+            cachePositions[v] = i < CACHE_SIZE ? (int)i : -1;
+            vertexScores[v]   = VertexScore(cachePositions[v], remainingTriangles[v]);
+        }
+
+        // Vertices just pushed out of the cache are rescored too, before being dropped
+        bestTriangle = -1;
+        float bestScore = -1.f;
+        for (unsigned v : newCache)
+        {
+            for (unsigned j = offsets[v]; j < offsets[v] + remainingTriangles[v]; j++)
+            {
+                unsigned t = vertexTriangles[j];
+                const unsigned* tv = &indices[t * 3];
+                triangleScores[t] = vertexScores[tv[0]] + vertexScores[tv[1]] + vertexScores[tv[2]];
+                if (triangleScores[t] > bestScore)
+                {
+                    bestScore    = triangleScores[t];
+                    bestTriangle = t;
+                }
+            }
+        }
+
+        if (newCache.size() > CACHE_SIZE) newCache.resize(CACHE_SIZE);
+        std::swap(cache, newCache);
+    }
+
+    std::copy(output.begin(), output.end(), indices);
+}
+
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices)
+{
+    constexpr unsigned UNUSED = 0xFFFFFFFF;
+    std::vector<unsigned> remap(vertices.size(), UNUSED);
+    std::vector<Vertex> reordered;
+    reordered.reserve(vertices.size());
+
+    for (auto& index : indices)
+    {
+        if (remap[index] == UNUSED)
+        {
+            remap[index] = reordered.size();
+            reordered.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+
+    vertices = std::move(reordered);
+}
+
+float ComputeAcmr(const unsigned int* indices, size_t numIndices, size_t numVertices,
+    unsigned cacheSize)
+{
+    if (numIndices < 3) return 0.f;
+
+    // Time each vertex entered the cache, a vertex is cached if it entered in the last
+    // cacheSize misses
+    std::vector<size_t> entry(numVertices, 0);
+    size_t misses = 0;
+    for (size_t i = 0; i < numIndices; i++)
+    {
+        unsigned v = indices[i];
+        if (entry[v] == 0 || misses - entry[v] >= cacheSize)
+        {
+            misses++;
+            entry[v] = misses;
+        }
+    }
+
+    return (float)misses / (numIndices / 3);
+}
@@ -0,0 +1,20 @@
+#pragma once
+#include "renderer/mesh.hpp"
+#include <cstddef>
+#include <vector>
+
+// Merges vertices with the same position and normal, and rewrites the indices to use them
+void WeldVertices(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Reorders the triangles of an index range so that consecutive triangles reuse the vertices
+// still in the post-transform cache (Forsyth, "Linear-Speed Vertex Cache Optimisation")
+void OptimizeVertexCache(unsigned int* indices, size_t numIndices, size_t numVertices);
+
+// Renumbers the vertices in the order the indices first use them, so vertex fetches walk the
+// vertex buffer forward. Unused vertices are removed.
+void OptimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+
+// Average number of vertices transformed per triangle, with a FIFO post-transform cache.
+// 3 means no reuse at all, and well ordered meshes get close to 0.5.
+float ComputeAcmr(const unsigned int* indices, size_t numIndices, size_t numVertices,
+    unsigned cacheSize = 16);
@@ -0,0 +1,272 @@
+#include "renderer/mesh_simplifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+
+namespace
+{
+
+struct Vector
+{
+    double x, y, z;
+
+    Vector operator - (const Vector& v) const { return { x - v.x, y - v.y, z - v.z }; }
+    double Dot(const Vector& v) const { return x * v.x + y * v.y + z * v.z; }
+    Vector Cross(const Vector& v) const
+    {
+        return { y * v.z - z * v.y, z * v.x - x * v.z, x * v.y - y * v.x };
+    }
+    double Length() const { return std::sqrt(Dot(*this)); }
+};
+
+// Sum of squared distances to a set of planes, weighted by the area of their triangles:
+// Q(p) = p^T A p + 2 b.p + c
+struct Quadric
+{
+    double a00 = 0, a01 = 0, a02 = 0, a11 = 0, a12 = 0, a22 = 0;
+    double b0 = 0, b1 = 0, b2 = 0;
+    double c = 0;
+    double weight = 0;
+
+    static Quadric FromPlane(const Vector& n, double d, double weight)
+    {
+        Quadric q;
+        q.a00 = weight * n.x * n.x; q.a01 = weight * n.x * n.y; q.a02 = weight * n.x * n.z;
+        q.a11 = weight * n.y * n.y; q.a12 = weight * n.y * n.z; q.a22 = weight * n.z * n.z;
+        q.b0  = weight * n.x * d;   q.b1  = weight * n.y * d;   q.b2  = weight * n.z * d;
+        q.c   = weight * d * d;
+        q.weight = weight;
+        return q;
+    }
+
+    void Add(const Quadric& q)
+    {
+        a00 += q.a00; a01 += q.a01; a02 += q.a02; a11 += q.a11; a12 += q.a12; a22 += q.a22;
+        b0  += q.b0;  b1  += q.b1;  b2  += q.b2;
+        c   += q.c;
+        weight += q.weight;
+    }
+
+    // Mean squared distance of p to the planes
+    double Evaluate(const Vector& p) const
+    {
+        double error = a00 * p.x * p.x + a11 * p.y * p.y + a22 * p.z * p.z +
+            2.0 * (a01 * p.x * p.y + a02 * p.x * p.z + a12 * p.y * p.z) +
+            2.0 * (b0 * p.x + b1 * p.y + b2 * p.z) + c;
+        return weight > 0 ? std::max(0.0, error / weight) : 0.0;
+    }
+};
+
+struct Collapse
+{
+    unsigned from;
+    unsigned to;
+    double error;
+};
+
+Vector ToVector(const vec3& v)
+{
+    return { v.x, v.y, v.z };
+}
+
+uint64_t EdgeKey(unsigned a, unsigned b)
+{
+    return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+}
+
+}
+
+std::vector<unsigned int> SimplifyTriangles(
+    const std::vector<Vertex>& vertices,
+    const unsigned int* indices,
+    size_t numIndices,
+    size_t targetNumIndices,
+    float& resultError)
+{
+    resultError = 0.f;
+    std::vector<unsigned int> result(indices, indices + numIndices);
+    if (numIndices <= targetNumIndices) return result;
+
+    // Welds the referenced vertices by position into local ids. Each local vertex keeps one of
+    // the original vertices, whose attributes are used when other vertices collapse onto it.
+    std::vector<unsigned> referenced(indices, indices + numIndices);
+    std::sort(referenced.begin(), referenced.end());
+    referenced.erase(std::unique(referenced.begin(), referenced.end()), referenced.end());
+    std::stable_sort(referenced.begin(), referenced.end(), [&](unsigned a, unsigned b) {
+        return std::memcmp(&vertices[a].position, &vertices[b].position, sizeof(vec3)) < 0;
+    });
+
+    std::unordered_map<unsigned, unsigned> localIds;
+    std::vector<unsigned> representatives;
+    std::vector<Vector> positions;
+    for (unsigned i = 0; i < referenced.size(); i++)
+    {
+        bool samePosition = i > 0 && std::memcmp(&vertices[referenced[i]].position,
+            &vertices[referenced[i - 1]].position, sizeof(vec3)) == 0;
+        if (!samePosition)
+        {
+            representatives.push_back(referenced[i]);
+            positions.push_back(ToVector(vertices[referenced[i]].position));
+        }
+        localIds[referenced[i]] = representatives.size() - 1;
+    }
+
+    unsigned numVertices = representatives.size();
+    std::vector<unsigned> triangles(numIndices);
+    for (size_t i = 0; i < numIndices; i++) triangles[i] = localIds[indices[i]];
+
+    std::vector<Quadric> quadrics(numVertices);
+    std::unordered_map<uint64_t, unsigned> edgeUses;
+    for (size_t i = 0; i < numIndices; i += 3)
+    {
+        const Vector& p0 = positions[triangles[i + 0]];
+        Vector normal = (positions[triangles[i + 1]] - p0).Cross(positions[triangles[i + 2]] - p0);
+        double length = normal.Length();
+        if (length > 0)
+        {
+            normal = { normal.x / length, normal.y / length, normal.z / length };
+            Quadric q = Quadric::FromPlane(normal, -normal.Dot(p0), length * 0.5);
+            for (int k = 0; k < 3; k++) quadrics[triangles[i + k]].Add(q);
+        }
+
+        for (int k = 0; k < 3; k++) edgeUses[EdgeKey(triangles[i + k], triangles[i + (k + 1) % 3])]++;
+    }
+
+    // Open (and non-manifold) edges keep their vertices in place
+    std::vector<bool> locked(numVertices, false);
+    for (const auto& edge : edgeUses)
+    {
+        if (edge.second == 2) continue;
+        locked[edge.first >> 32]        = true;
+        locked[edge.first & 0xFFFFFFFF] = true;
+    }
+
+    size_t targetNumTriangles = targetNumIndices / 3;
+    double maxError = 0;
+    std::vector<unsigned> remap(numVertices);
+    std::vector<bool> touched(numVertices);
+    std::vector<unsigned> adjacencyOffsets(numVertices + 1);
+    std::vector<unsigned> adjacency;
+    std::vector<uint64_t> edges;
+    std::vector<Collapse> collapses;
+
+    // Each pass collapses the cheapest edges whose neighbourhoods don't overlap, then
+    // rebuilds the triangles
+    while (triangles.size() / 3 > targetNumTriangles)
+    {
+        size_t numTriangles = triangles.size() / 3;
+
+        std::fill(adjacencyOffsets.begin(), adjacencyOffsets.end(), 0);
+        for (unsigned v : triangles) adjacencyOffsets[v + 1]++;
+        for (unsigned v = 0; v < numVertices; v++) adjacencyOffsets[v + 1] += adjacencyOffsets[v];
+        adjacency.resize(triangles.size());
+        {
+            std::vector<unsigned> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+            for (size_t i = 0; i < triangles.size(); i++) adjacency[fill[triangles[i]]++] = i / 3;
+        }
+
+        edges.clear();
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            for (int k = 0; k < 3; k++) edges.push_back(EdgeKey(triangles[i + k], triangles[i + (k + 1) % 3]));
+        }
+        std::sort(edges.begin(), edges.end());
+        edges.erase(std::unique(edges.begin(), edges.end()), edges.end());
+
+        collapses.clear();
+        for (uint64_t edge : edges)
+        {
+            unsigned a = edge >> 32;
+            unsigned b = edge & 0xFFFFFFFF;
+            Quadric q = quadrics[a];
+            q.Add(quadrics[b]);
+
+            Collapse collapse = { 0, 0, -1.0 };
+            if (!locked[a]) collapse = { a, b, q.Evaluate(positions[b]) };
+            if (!locked[b])
+            {
+                double error = q.Evaluate(positions[a]);
+                if (collapse.error < 0 || error < collapse.error) collapse = { b, a, error };
+            }
+            if (collapse.error >= 0) collapses.push_back(collapse);
+        }
+        if (collapses.empty()) break;
+        std::sort(collapses.begin(), collapses.end(), [](const Collapse& a, const Collapse& b) {
+            return a.error < b.error;
+        });
+
+        for (unsigned v = 0; v < numVertices; v++) remap[v] = v;
+        std::fill(touched.begin(), touched.end(), false);
+
+        size_t trianglesToRemove = numTriangles - targetNumTriangles;
+        size_t removedTriangles  = 0;
+        for (const auto& collapse : collapses)
+        {
+            if (removedTriangles >= trianglesToRemove) break;
+            if (touched[collapse.from] || touched[collapse.to]) continue;
+
+            // Rejects collapses that flip (or nearly degenerate) the triangles that are kept
+            bool flips = false;
+            size_t removes = 0;
+            for (unsigned j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+            {
+                const unsigned* t = &triangles[adjacency[j] * 3];
+                if (t[0] == collapse.to || t[1] == collapse.to || t[2] == collapse.to)
+                {
+                    removes++;
+                    continue;
+                }
+
+                Vector before[3];
+                Vector after[3];
+                for (int k = 0; k < 3; k++)
+                {
+                    before[k] = positions[t[k]];
+                    after[k]  = positions[t[k] == collapse.from ? collapse.to : t[k]];
+                }
+                Vector n0 = (before[1] - before[0]).Cross(before[2] - before[0]);
+                Vector n1 = (after[1] - after[0]).Cross(after[2] - after[0]);
+                if (n0.Dot(n1) <= 0.25 * n0.Length() * n1.Length())
+                {
+                    flips = true;
+                    break;
+                }
+            }
+            if (flips) continue;
+
+            // The whole neighbourhood is touched, so the flip test above stays valid
+            for (unsigned j = adjacencyOffsets[collapse.from]; j < adjacencyOffsets[collapse.from + 1]; j++)
+            {
+                for (int k = 0; k < 3; k++) touched[triangles[adjacency[j] * 3 + k]] = true;
+            }
+
+            remap[collapse.from] = collapse.to;
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            removedTriangles += removes;
+            maxError = std::max(maxError, collapse.error);
+        }
+        if (removedTriangles == 0) break;
+
+        size_t kept = 0;
+        for (size_t i = 0; i < triangles.size(); i += 3)
+        {
+            unsigned t[3] = { remap[triangles[i]], remap[triangles[i + 1]], remap[triangles[i + 2]] };
+            if (t[0] == t[1] || t[1] == t[2] || t[0] == t[2]) continue;
+
+            for (int k = 0; k < 3; k++)
+            {
+                // Collapsed corners take the vertex kept at their new position
+                result[kept + k] = t[k] == triangles[i + k] ? result[i + k] : representatives[t[k]];
+                triangles[kept + k] = t[k];
+            }
+            kept += 3;
+        }
+        triangles.resize(kept);
+        result.resize(kept);
+    }
+
+    resultError = (float)std::sqrt(maxError);
+    return result;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include "renderer/mesh.hpp"
+#include <cstddef>
+#include <vector>
+
+// Simplifies a triangle list with quadric error metrics (Garland and Heckbert), by collapsing
+// vertices onto their neighbours until at most targetNumIndices indices are left, or no collapse
+// is possible. Only the indices change, so every level of detail can share the same vertices.
+// Vertices at the same position are treated as one, and vertices on open edges are never moved,
+// so parts of a mesh simplified independently still line up.
+// resultError is set to the largest distance (RMS, in the vertices' space) introduced by a collapse.
+std::vector<unsigned int> SimplifyTriangles(
+    const std::vector<Vertex>& vertices,
+    const unsigned int* indices,
+    size_t numIndices,
+    size_t targetNumIndices,
+    float& resultError);
@@ -1,7 +1,6 @@
 #pragma once
 #include "renderer/meshes_pass.hpp"
 #include "utils/glcall.h"
-#include <glm/gtc/type_ptr.hpp>
 #include <cassert>
 
 namespace fluidity
@@ -12,12 +11,17 @@ MeshesPass::MeshesPass(int bufferWidth,
     const std::string& vsFilePath,
     const std::string& fsFilePath,
     const std::vector<FramebufferAttachment> attachments,
-    Scene* scene)
+    Scene* scene,
+    MeshGeometry* meshGeometry)
     : RenderPass(bufferWidth, bufferHeight, 0, 0),
     m_vsFilePath(vsFilePath),
     m_fsFilePath(fsFilePath),
     m_hasSkybox(false),
-    m_scene(scene)
+    m_scene(scene),
+    m_meshBatch(meshGeometry),
+    m_useFrustumCulling(false),
+    m_useLods(false),
+    m_lodSelection{ glm::vec3(0.f), 0.f, true, 1.f, 0 }
 {
     for (const auto& attachment : attachments) m_framebuffer.PushAttachment(attachment);
 }
@@ -28,6 +32,7 @@ bool MeshesPass::Init()
     m_skybBoxShader = new Shader("../../shaders/skybox.vert",
     "../../shaders/skybox.frag");
 
+    if (!m_meshBatch.Init()) return false;
     return RenderPass::Init();
 }
 
@@ -52,52 +57,9 @@ void MeshesPass::Render()
     m_shader->Bind();
     BindTextures();
 
-    // TODO: The per-model uniforms and context changes are acceptable here only because
-    // the number of models is admitted to be short
-    for (auto& model : m_scene->models)
-    {
-        if (!model.IsVisible()) continue;
-
-        if (model.GetHideFrontFaces()) 
-        {
-            glEnable(GL_CULL_FACE);
-            glCullFace(GL_FRONT);
-        }
-        else
-        {
-            glDisable(GL_CULL_FACE);
-            glCullFace(GL_BACK);
-        }
-        
-        const auto& material = model.GetMaterial();
-        auto diffuse         = material.diffuse;
-        auto specular        = material.specular;
-        m_shader->SetUniform1i("uInvertNormals", model.GetHideFrontFaces() ? 1 : 0, true);
-        m_shader->SetUniform3f("uDiffuse", diffuse.x, diffuse.y, diffuse.z, true);
-        m_shader->SetUniform3f("uSpecular", specular.x, specular.y, specular.z, true);
-        m_shader->SetUniform1f("uShininess", material.shininess, true);
-        m_shader->SetUniform1i("uEmissive", material.emissive ? 1 : 0, true);
-        m_shader->SetUniform1f("uReflectiveness", material.reflectiveness, true);
-
-        vec3 modelTranslation = model.GetTranslation();
-        vec3 modelScale       = model.GetScale();
-
-        glm::mat4 modelMatrix = modelMatrix = glm::translate(glm::mat4(1.f), glm::vec3(modelTranslation.x,
-            modelTranslation.y, modelTranslation.z));
-        modelMatrix = glm::scale(modelMatrix, glm::vec3(modelScale.x, 
-            modelScale.y, modelScale.z));
-        
-
-        m_shader->SetUniformMat4("model", glm::value_ptr(modelMatrix), true);
-
-        for (auto& mesh : model.GetMeshes())
-        {
-            GLCall(glBindVertexArray(mesh.GetVao()));
-            GLCall(glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.GetIbo()));
-            GLCall(glDrawElements(GL_TRIANGLES, mesh.GetIndices().size(), GL_UNSIGNED_INT, 
-                (const void*)0));
-        }
-    }
+    m_meshBatch.Update(m_scene->models, m_useFrustumCulling ? &m_frustum : nullptr,
+        m_useLods && m_useFrustumCulling ? &m_lodSelection : nullptr);
+    m_meshBatch.Draw(*m_shader);
 
     glDisable(GL_CULL_FACE);
     if (m_hasSkybox)
@@ -131,6 +93,25 @@ void MeshesPass::Render()
 
 }
 
+void MeshesPass::SetView(const glm::mat4& view, const glm::mat4& projection)
+{
+    m_frustum           = Frustum::FromMatrix(projection * view);
+    m_useFrustumCulling = true;
+
+    // projection[1][1] maps a unit length (at unit distance, for perspective projections) to
+    // NDC units, half the buffer height in pixels
+    m_lodSelection.viewPosition  = glm::vec3(glm::inverse(view)[3]);
+    m_lodSelection.perspective   = projection[3][3] == 0.f;
+    m_lodSelection.pixelsPerUnit = projection[1][1] * m_bufferHeight * 0.5f;
+}
+
+void MeshesPass::SetLodParameters(bool useLods, float maxPixelError, unsigned minLod)
+{
+    m_useLods                    = useLods;
+    m_lodSelection.maxPixelError = maxPixelError;
+    m_lodSelection.minLod        = minLod;
+}
+
 void MeshesPass::RenderSkybox(const RenderState& previousRenderState)
 {
     // Save current depth func before changing it
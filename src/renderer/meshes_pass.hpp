@@ -2,11 +2,13 @@
 #include "renderer/render_pass.hpp"
 #include "renderer/scene.hpp"
 #include "renderer/model.hpp"
+#include "renderer/mesh_batch.hpp"
 #include "renderer/skybox.hpp"
 
 namespace fluidity
 {
 
+// Draws the scene's models from a MeshGeometry, which passes drawing the same models share
 class MeshesPass : public RenderPass
 {
 public:
@@ -15,13 +17,15 @@ public:
     const std::string& vsFilePath,
     const std::string& fsFilePath,
     const std::vector<FramebufferAttachment> attachments,
-    Scene* scene
+    Scene* scene,
+    MeshGeometry* meshGeometry
     );
 
   virtual bool Init() override;
   virtual void Render() override;
   virtual void RenderSkybox(const RenderState& previousRenderState);
   virtual bool SetUniformBuffer(const std::string& name, GLuint uniformBlockBinding) override;
+  virtual std::vector<Shader*> GetShaders() override { return { m_shader, m_skybBoxShader }; }
 
   // void AddModel(const Model& model) { m_scene->models.push_back(model); };
   void AddSkybox(const Skybox& skybox);
@@ -32,6 +36,13 @@ public:
 
   Skybox& GetSkybox();
 
+  // Mesh clusters outside of the view's frustum are not drawn, and the others are drawn at
+  // the level of detail their size in the view calls for (see LodSelection)
+  void SetView(const glm::mat4& view, const glm::mat4& projection);
+  // When disabled, meshes are always drawn at full resolution
+  void SetLodParameters(bool useLods, float maxPixelError, unsigned minLod);
+  const MeshBatch& GetMeshBatch() const { return m_meshBatch; }
+
 private:
   Shader* m_skybBoxShader;
   // TODO: This needs to be made const. Changes in the scene from here are not obvious
@@ -41,5 +52,10 @@ private:
 
   bool m_hasSkybox;
   Skybox m_skybox;
+  MeshBatch m_meshBatch;
+  bool m_useFrustumCulling;
+  Frustum m_frustum;
+  bool m_useLods;
+  LodSelection m_lodSelection;
 };
 }
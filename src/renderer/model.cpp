@@ -1,5 +1,8 @@
 #include "renderer/model.hpp"
+#include "renderer/mesh_cache.hpp"
 #include "utils/logger.h"
+#include "utils/profiler.hpp"
+#include "utils/parallel_for.hpp"
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
@@ -20,13 +23,75 @@ Model::Model(const std::string& filePath, bool genSmoothNormals)
 
 bool Model::Load()
 {
+    if (!LoadMeshes()) return false;
+    Init();
+    return true;
+}
+
+bool Model::LoadMeshes()
+{
+    PROFILE_SCOPE("Model::LoadMeshes");
+    size_t firstMesh  = m_meshes.size();
+    uint64_t cacheKey = MeshCache::ComputeKey(m_filePath, m_genSmoothNormals);
+    if (cacheKey != 0 && MeshCache::Load(cacheKey, m_meshes))
+    {
+        DBG("Model " << m_filePath << " loaded from the mesh cache");
+    }
+    else
+    {
+        if (!Import()) return false;
+        if (cacheKey != 0) MeshCache::Store(cacheKey, m_meshes, firstMesh);
+    }
+
+    // Triangle weighted averages of the meshes' ACMR
+    unsigned importedVertices = 0;
+    unsigned numVertices      = 0;
+    double importedAcmr       = 0;
+    double acmr               = 0;
+    size_t numTriangles       = 0;
+    for (size_t i = firstMesh; i < m_meshes.size(); i++)
+    {
+        const auto& stats = m_meshes[i].GetOptimizationStats();
+        importedVertices += stats.importedVertices;
+        numVertices      += stats.numVertices;
+        importedAcmr     += stats.importedAcmr * stats.numTriangles;
+        acmr             += stats.acmr * stats.numTriangles;
+        numTriangles     += stats.numTriangles;
+    }
+    if (numTriangles > 0)
+    {
+        DBG("Model " << m_filePath << ": " << importedVertices << " -> " << numVertices <<
+            " vertices, ACMR " << importedAcmr / numTriangles << " -> " << acmr / numTriangles);
+    }
+
+    return true;
+}
+
+void Model::Init()
+{
+    if (m_numInitializedMeshes == m_meshes.size()) return;
+
+    // Nothing to upload per mesh: MeshBatch uploads the geometry when the version changes
+    m_numInitializedMeshes = m_meshes.size();
+
+    m_version++;
+    m_geometryVersion++;
+}
+
+bool Model::Import()
+{
+    PROFILE_SCOPE("Model::Import");
     Assimp::Importer importer;
     if (m_genSmoothNormals) importer.SetPropertyInteger(AI_CONFIG_PP_RVC_FLAGS, 
         aiComponent_NORMALS);
 
-    const aiScene* scene = importer.ReadFile(m_filePath, aiProcess_Triangulate | aiProcess_FlipUVs | 
-        (m_genSmoothNormals ? (aiProcess_RemoveComponent | aiProcess_GenSmoothNormals) : 0) |
-        aiProcess_CalcTangentSpace);
+    const aiScene* scene = nullptr;
+    {
+        PROFILE_SCOPE("Assimp::Importer::ReadFile");
+        scene = importer.ReadFile(m_filePath, aiProcess_Triangulate | aiProcess_FlipUVs | 
+            (m_genSmoothNormals ? (aiProcess_RemoveComponent | aiProcess_GenSmoothNormals) : 0) |
+            aiProcess_CalcTangentSpace);
+    }
     
     if (!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode)
     {
@@ -34,7 +99,7 @@ bool Model::Load()
         return false;
     }
 
-
+    size_t firstMesh = m_meshes.size();
     for (int i = 0; i < scene->mNumMeshes; i++)
     {
         auto* assimpMesh = scene->mMeshes[i];
@@ -60,20 +125,26 @@ bool Model::Load()
             }
         }
 
+        indices.resize(assimpMesh->mNumFaces * 3);
         for (int j = 0; j < assimpMesh->mNumFaces; j++)
         {
-            auto face = assimpMesh->mFaces[j];
+            const auto& face = assimpMesh->mFaces[j];
             // Sanity check: Faces should be triangles
             assert(face.mNumIndices == 3);
 
-            for (int k = 0; k < face.mNumIndices; k++)
-            {
-                indices.push_back(face.mIndices[k]);
-            }
+            indices[j * 3 + 0] = face.mIndices[0];
+            indices[j * 3 + 1] = face.mIndices[1];
+            indices[j * 3 + 2] = face.mIndices[2];
         }
 
-        m_meshes.push_back(Mesh(vertices, indices));
-        m_meshes.back().Init();
+        m_meshes.emplace_back(std::move(vertices), std::move(indices));
+    }
+
+    {
+        PROFILE_SCOPE("Mesh::Build");
+        fluidity::ParallelFor(m_meshes.size() - firstMesh, [&](unsigned i) {
+            m_meshes[firstMesh + i].Build();
+        });
     }
 
     return true;
@@ -81,10 +152,8 @@ bool Model::Load()
 
 void Model::CleanUp()
 {
-    for (auto& mesh : m_meshes)
-    {
-        mesh.CleanUp();
-    }
-
     m_meshes.clear();
+    m_numInitializedMeshes = 0;
+    m_version++;
+    m_geometryVersion++;
 }
\ No newline at end of file
@@ -1,13 +1,20 @@
 #pragma once
 #include "renderer/mesh.hpp"
 #include <string>
+#include <cstdint>
 
 class Model
 {
 public:
     Model(const std::string& filePath, bool genSmoothNormals = false);
     Model() = default;
+    // Loads the built meshes from the MeshCache if possible, otherwise imports and builds them,
+    // and stores them in the cache for the next time. Same as LoadMeshes followed by Init.
     bool Load();
+    // CPU side of Load, doesn't use OpenGL, so models can be loaded in parallel
+    bool LoadMeshes();
+    // Hands the meshes loaded since the last call over to the MeshBatch, which uploads them
+    void Init();
     void CleanUp();
 
     bool HasSmoothNormals() const { return m_genSmoothNormals; }
@@ -17,14 +24,21 @@ public:
     std::vector<Mesh>& GetMeshes() { return m_meshes; }
     const std::string& GetFilePath() const { return m_filePath; }
 
-    void SetTranslation(const vec3& translation) { m_translation = translation; }
+    // Incremented whenever the model's geometry, transform or visibility changes, so passes
+    // that cache their results (e.g. the mesh shadow map) know when to render again.
+    // Material changes are not tracked, since they're edited through GetMaterial.
+    uint64_t GetVersion() const { return m_version; }
+    // Only incremented when the meshes are loaded or cleaned up
+    uint64_t GetGeometryVersion() const { return m_geometryVersion; }
+
+    void SetTranslation(const vec3& translation) { SetIfChanged(m_translation, translation); }
     const vec3& GetTranslation() const { return m_translation; }
 
     bool IsVisible() const { return m_isVisible; }
-    void SetIsVisible(bool visible) { m_isVisible = visible; }
+    void SetIsVisible(bool visible) { SetIfChanged(m_isVisible, visible); }
 
     bool GetHideFrontFaces() const { return m_hideFrontFaces; }
-    void SetHideFrontFaces(bool hide) { m_hideFrontFaces = hide; }
+    void SetHideFrontFaces(bool hide) { SetIfChanged(m_hideFrontFaces, hide); }
 
     // TODO: GetMaterialConst is needed when calling GetMaterial from a
     // const Material&. However, this is not very consistent with the rest
@@ -33,9 +47,20 @@ public:
     const Material& GetMaterialConst() const { return m_material; }
     
     const vec3& GetScale() const { return m_scale; }
-    void SetScale(const vec3& scale) { m_scale = scale; }
+    void SetScale(const vec3& scale) { SetIfChanged(m_scale, scale); }
 
 private:
+    // Appends the file's meshes, built
+    bool Import();
+
+    template<typename T>
+    void SetIfChanged(T& field, const T& value)
+    {
+        if (field == value) return;
+        field = value;
+        m_version++;
+    }
+
     Material m_material;
     bool m_isVisible      = true;
     bool m_hideFrontFaces = false;
@@ -45,5 +70,8 @@ private:
 
     std::string m_filePath;
     std::vector<Mesh> m_meshes;
+    size_t m_numInitializedMeshes = 0;
     bool m_genSmoothNormals;
+    uint64_t m_version = 0;
+    uint64_t m_geometryVersion = 0;
 };
\ No newline at end of file
@@ -1,26 +1,89 @@
 #include "narrow_range_filter_pass.hpp"
+#include "render_target_formats.hpp"
+#include "../utils/glcall.h"
+#include <cassert>
 
-/* 
 namespace fluidity
 {
 NarrowRangeFilterPass::NarrowRangeFilterPass(
-    const unsigned bufferWidth,
-    const unsigned bufferHeight,
-    const unsigned numberOfParticles,
-    const float pointRadius,
-    GLuint particlesVAO)
-    : RenderPass(bufferWidth, bufferHeight, numberOfParticles, pointRadius, particlesVAO)
-    { /*  } */
-
-/*
+    int bufferWidth,
+    int bufferHeight,
+    const FramebufferAttachment& renderTargetSpecification,
+    const std::string& csFilePath)
+    : RenderPass(bufferWidth, bufferHeight, 0, 0),
+    m_csFilePath(csFilePath),
+    m_renderTargetSpecification(GetImageCompatibleAttachment(renderTargetSpecification)),
+    m_nIterations(0)
+{ /* */ }
+
 bool NarrowRangeFilterPass::Init()
 {
-  m_shader = new Shader("../../shaders/depth-pass.vert", "../../shaders/depth-pass.frag");
-  m_framebuffer.PushAttachment({ GL_RED, (int)m_bufferWidth, (int)m_bufferHeight, GL_RED, 
-      GL_FLOAT
+  m_shader = new Shader(m_csFilePath);
+
+  // The framebuffer is never bound, it only owns (and resizes) the two ping-pong images
+  m_framebuffer.PushAttachment({ m_renderTargetSpecification.internalFormat,
+      m_renderTargetSpecification.pixelFormat, m_renderTargetSpecification.dataType
   });
+  m_framebuffer.DuplicateAttachment(0);
+  return RenderPass::Init();
+}
+
+bool NarrowRangeFilterPass::SetUniforms()
+{
+  m_shader->Bind();
+  m_shader->SetUniform1i("u_DepthTex", 0);
+  m_shader->SetUniform1i("u_OutputImage", 0);
+  m_shader->Unbind();
+
+  return true;
+}
+
+void NarrowRangeFilterPass::SetRenderTargetFormat(const FramebufferAttachment& renderTargetSpecification)
+{
+  m_renderTargetSpecification = GetImageCompatibleAttachment(renderTargetSpecification);
+  m_framebuffer.SetAttachmentFormat(0, m_renderTargetSpecification);
+  m_framebuffer.SetAttachmentFormat(1, m_renderTargetSpecification);
+}
+
+void NarrowRangeFilterPass::Render()
+{
+  // Sanity check
+  assert(m_shader != nullptr);
+  if (m_nIterations <= 0 || m_textureBinds.count(0) == 0) return;
+
+  m_shader->Bind();
+
+  // Horizontal passes write to image 1, vertical passes to image 0
+  GLuint inputTexture = m_textureBinds[0].id;
+  for (int i = 0; i < m_nIterations; i++)
+  {
+    Dispatch(inputTexture, 1, 0);
+    Dispatch(m_framebuffer.GetAttachment(1), 0, 1);
+    inputTexture = m_framebuffer.GetAttachment(0);
+  }
+
+  GLCall(glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY, 
+    m_renderTargetSpecification.internalFormat));
+  GLCall(glActiveTexture(GL_TEXTURE0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+  m_shader->Unbind();
+}
+
+void NarrowRangeFilterPass::Dispatch(GLuint inputTexture, int outputAttachment, int filterDirection)
+{
+  GLCall(glActiveTexture(GL_TEXTURE0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, inputTexture));
+  GLCall(glBindImageTexture(0, m_framebuffer.GetAttachment(outputAttachment), 0, GL_FALSE, 0,
+    GL_WRITE_ONLY, m_renderTargetSpecification.internalFormat));
+  m_shader->SetUniform1i("u_FilterDirection", filterDirection);
+
+  // One work group per tile of a row (or column)
+  unsigned lineLength = filterDirection == 0 ? m_bufferWidth : m_bufferHeight;
+  unsigned nLines     = filterDirection == 0 ? m_bufferHeight : m_bufferWidth;
+  GLCall(glDispatchCompute((lineLength + TILE_SIZE - 1) / TILE_SIZE, nLines, 1));
 
+  // The next dispatch, or the passes after filtering, sample the result as a texture
+  GLCall(glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT));
 }
 
 }
-*/
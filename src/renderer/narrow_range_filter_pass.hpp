@@ -3,27 +3,43 @@
 #include "framebuffer.hpp"
 #include "renderer.h"
 #include "shader.h"
+#include <string>
 
-/*
 namespace fluidity
 {
 
+// Compute implementation of the separable (1D) narrow-range filter.
+// Each work group loads a row (or column) tile plus its halo into shared memory, and
+// iterations ping-pong between the two storage images of the framebuffer, so no
+// framebuffer binds or render target swaps happen between iterations.
+// The input depth texture is set with SetInputTexture, the result is always in GetBuffer(0).
 class NarrowRangeFilterPass : public RenderPass
 {
 public:
     NarrowRangeFilterPass(
-      const unsigned bufferWidth,
-      const unsigned bufferHeight,
-      const unsigned numberOfParticles,
-      const float pointRadius,
-      GLuint particlesVAO
+      int bufferWidth,
+      int bufferHeight,
+      const FramebufferAttachment& renderTargetSpecification,
+      const std::string& csFilePath
     );
 
     virtual bool Init() override;
     virtual void Render() override;
 
+    void SetNumberOfIterations(int nIterations) { m_nIterations = nIterations; }
+    void SetRenderTargetFormat(const FramebufferAttachment& renderTargetSpecification);
+
+    // Must match the shader's local size and halo size
+    static constexpr int TILE_SIZE = 128;
+    static constexpr int MAX_HALO  = 256;
+
 private:
-    bool SetUniforms() override;
+    virtual bool SetUniforms() override;
+    void Dispatch(GLuint inputTexture, int outputAttachment, int filterDirection);
+
+    std::string m_csFilePath;
+    FramebufferAttachment m_renderTargetSpecification;
+    int m_nIterations;
 };
+
 }
-*/
@@ -56,7 +56,6 @@ ParticleRenderPass::ParticleRenderPass(
       m_shader->Bind();
       m_shader->SetUniform1ui("u_nParticles", m_numVertices);
       m_shader->SetUniform1i("u_ColorMode", COLOR_MODE_RANDOM);
-      m_shader->SetUniform1i("u_UseAnisotropyKernel", 0);
       m_shader->SetUniform1f("u_PointRadius", (float)m_pointRadius);
       m_shader->SetUniform1i("u_ScreenWidth", m_bufferWidth);
       m_shader->SetUniform1i("u_ScreenHeight", m_bufferHeight);
@@ -0,0 +1,43 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace fluidity
+{
+
+// FNV-1a hash of everything a render pass reads (frame, camera, parameters and the output
+// versions of the passes it samples from). See RenderPass::NeedsRender.
+class PassInputHash
+{
+public:
+  PassInputHash& Add(const void* data, size_t size)
+  {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++)
+    {
+      m_hash ^= bytes[i];
+      m_hash *= FNV_PRIME;
+    }
+    return *this;
+  }
+
+  // Structs are hashed byte by byte, so they should be kept in place (padding included) between
+  // frames. A changed padding byte only costs an extra render.
+  template<typename T>
+  PassInputHash& Add(const T& value)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "Only plain data can be hashed");
+    return Add(&value, sizeof(T));
+  }
+
+  uint64_t Get() const { return m_hash; }
+
+private:
+  static constexpr uint64_t FNV_OFFSET_BASIS = 14695981039346656037ull;
+  static constexpr uint64_t FNV_PRIME        = 1099511628211ull;
+
+  uint64_t m_hash = FNV_OFFSET_BASIS;
+};
+
+}
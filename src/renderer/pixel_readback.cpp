@@ -0,0 +1,160 @@
+#include "renderer/pixel_readback.hpp"
+#include "utils/glcall.h"
+#include "utils/logger.h"
+#include "utils/profiler.hpp"
+#include <cstring>
+
+namespace fluidity
+{
+
+PixelReadback::PixelReadback(unsigned ringSize)
+  : m_slots(ringSize > 0 ? ringSize : 1)
+{ /* */ }
+
+bool PixelReadback::Init()
+{
+  for (auto& slot : m_slots)
+  {
+    GLCall(glGenBuffers(1, &slot.buffer));
+  }
+
+  m_nextSlot   = 0;
+  m_numPending = 0;
+  return true;
+}
+
+void PixelReadback::CleanUp()
+{
+  for (auto& slot : m_slots)
+  {
+    if (slot.fence != nullptr)
+    {
+      GLCall(glDeleteSync(slot.fence));
+    }
+    if (slot.buffer != 0)
+    {
+      GLCall(glDeleteBuffers(1, &slot.buffer));
+    }
+    slot = {};
+  }
+
+  m_numPending = 0;
+  m_finished.clear();
+}
+
+void PixelReadback::Read(GLuint texture, GLenum format, GLenum type, uint64_t tag)
+{
+  PROFILE_SCOPE("PixelReadback::Read");
+  // Every buffer is in flight, so one has to be freed
+  if (m_numPending == m_slots.size()) Retire(true);
+
+  Slot& slot = m_slots[m_nextSlot];
+  GLint width = 0, height = 0;
+  GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+  GLCall(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width));
+  GLCall(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height));
+
+  slot.size   = (size_t)width * height * GetPixelSize(format, type);
+  slot.result = { tag, width, height, {}, false };
+
+  GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer));
+  if ((GLsizeiptr)slot.size > slot.capacity)
+  {
+    GLCall(glBufferData(GL_PIXEL_PACK_BUFFER, slot.size, nullptr, GL_STREAM_READ));
+    slot.capacity = slot.size;
+  }
+
+  // With a pack buffer bound, the pointer is an offset into it, and the call returns
+  // as soon as the copy is queued
+  GLCall(glPixelStorei(GL_PACK_ALIGNMENT, 1));
+  GLCall(glGetTexImage(GL_TEXTURE_2D, 0, format, type, nullptr));
+  GLCall(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+  GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+
+  slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+  // Makes sure the fence reaches the GPU, otherwise polling it could never signal
+  GLCall(glFlush());
+
+  m_nextSlot = (m_nextSlot + 1) % m_slots.size();
+  m_numPending++;
+}
+
+bool PixelReadback::Poll(std::vector<Result>& results, bool wait)
+{
+  while (m_numPending > 0 && Retire(wait));
+
+  bool newResults = !m_finished.empty();
+  for (auto& result : m_finished) results.push_back(std::move(result));
+  m_finished.clear();
+  return newResults;
+}
+
+bool PixelReadback::Retire(bool wait)
+{
+  unsigned oldestSlot = (m_nextSlot + m_slots.size() - m_numPending) % m_slots.size();
+  Slot& slot = m_slots[oldestSlot];
+
+  GLuint64 timeout = wait ? GL_TIMEOUT_IGNORED : 0;
+  GLenum status = glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, timeout);
+  if (status == GL_TIMEOUT_EXPIRED) return false;
+
+  GLCall(glDeleteSync(slot.fence));
+  slot.fence = nullptr;
+  m_numPending--;
+
+  // Failed reads are still retired, so whoever is waiting for them knows
+  slot.result.failed = true;
+  if (status == GL_WAIT_FAILED)
+  {
+    LOG_ERROR("Waiting for a pixel readback failed.");
+    m_finished.push_back(std::move(slot.result));
+    return true;
+  }
+
+  PROFILE_SCOPE("PixelReadback::Map");
+  GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, slot.buffer));
+  const void* data = glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, slot.size, GL_MAP_READ_BIT);
+  if (data != nullptr)
+  {
+    slot.result.pixels.resize(slot.size);
+    std::memcpy(slot.result.pixels.data(), data, slot.size);
+    // The contents may have been lost while mapped
+    slot.result.failed = glUnmapBuffer(GL_PIXEL_PACK_BUFFER) == GL_FALSE;
+    if (slot.result.failed) LOG_ERROR("Pixel pack buffer contents were lost.");
+  }
+  else
+  {
+    LOG_ERROR("Unable to map pixel pack buffer.");
+  }
+  GLCall(glBindBuffer(GL_PIXEL_PACK_BUFFER, 0));
+
+  m_finished.push_back(std::move(slot.result));
+  return true;
+}
+
+size_t PixelReadback::GetPixelSize(GLenum format, GLenum type)
+{
+  size_t numChannels = 1;
+  switch (format)
+  {
+    case GL_RG:   numChannels = 2; break;
+    case GL_RGB:  numChannels = 3; break;
+    case GL_RGBA: numChannels = 4; break;
+    default: break;
+  }
+
+  size_t channelSize = 1;
+  switch (type)
+  {
+    case GL_HALF_FLOAT:
+    case GL_UNSIGNED_SHORT: channelSize = 2; break;
+    case GL_FLOAT:
+    case GL_UNSIGNED_INT:   channelSize = 4; break;
+    default: break;
+  }
+
+  return numChannels * channelSize;
+}
+
+}
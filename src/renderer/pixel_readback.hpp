@@ -0,0 +1,66 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <vector>
+
+namespace fluidity
+{
+
+// Reads textures back asynchronously through a ring of pixel pack buffers. Each read is
+// copied into a buffer on the GPU and fenced; the pixels are only mapped once the fence has
+// signalled, a few frames later, so reading never stalls the pipeline the way glReadPixels
+// into client memory does. Only when every buffer is still in flight does a read wait for
+// the oldest one.
+class PixelReadback
+{
+public:
+  struct Result
+  {
+    uint64_t tag;
+    int width;
+    int height;
+    // Rows bottom to top, tightly packed
+    std::vector<uint8_t> pixels;
+    // The pixels couldn't be read back, and are empty
+    bool failed = false;
+  };
+
+  explicit PixelReadback(unsigned ringSize = 3);
+  PixelReadback(const PixelReadback&) = delete;
+
+  bool Init();
+  void CleanUp();
+
+  // Queues a read of level 0 of texture. format and type are the client format, as in
+  // glGetTexImage. tag identifies the result.
+  void Read(GLuint texture, GLenum format, GLenum type, uint64_t tag);
+  // Appends finished reads to results, oldest first, failed ones included. If wait is set,
+  // waits for every read in flight. Returns true if any result was appended.
+  bool Poll(std::vector<Result>& results, bool wait = false);
+
+  unsigned GetNumberOfPendingReads() const { return m_numPending; }
+
+  static size_t GetPixelSize(GLenum format, GLenum type);
+
+private:
+  struct Slot
+  {
+    GLuint buffer  = 0;
+    GLsizeiptr capacity = 0;
+    GLsync fence   = nullptr;
+    Result result  = {};
+    size_t size    = 0;
+  };
+
+  // Maps the oldest read in flight into m_finished. Returns false if it hasn't finished yet.
+  bool Retire(bool wait);
+
+  std::vector<Slot> m_slots;
+  unsigned m_nextSlot   = 0;
+  unsigned m_numPending = 0;
+  std::deque<Result> m_finished;
+};
+
+}
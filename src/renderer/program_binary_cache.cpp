@@ -0,0 +1,137 @@
+#include "program_binary_cache.hpp"
+#include "pass_input_hash.hpp"
+#include "../utils/glcall.h"
+#include "../utils/logger.h"
+#include "../utils/mapped_file.hpp"
+#include "../utils/profiler.hpp"
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+#include <vector>
+
+std::string ProgramBinaryCache::s_directory = "../../cache/programs";
+
+namespace
+{
+
+constexpr char MAGIC[8] = { 'F', 'L', 'P', 'R', 'O', 'G', 'R', 'M' };
+
+struct FileHeader
+{
+  char magic[8];
+  uint32_t version;
+  uint32_t binaryFormat;
+  uint64_t key;
+  uint64_t binaryLength;
+};
+
+std::string GetDriverString()
+{
+  auto getString = [](GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value != nullptr ? std::string((const char*)value) : std::string();
+  };
+
+  return getString(GL_VENDOR) + "\n" + getString(GL_RENDERER) + "\n" + getString(GL_VERSION);
+}
+
+void AddSource(fluidity::PassInputHash& hash, GLenum stage, const std::string& source)
+{
+  // Stages are hashed with their length, so moving code between stages changes the key
+  uint64_t length = source.size();
+  hash.Add(stage).Add(length).Add(source.data(), source.size());
+}
+
+}
+
+uint64_t ProgramBinaryCache::ComputeKey(const ShaderSource& shaderSource)
+{
+  static const std::string driverString = GetDriverString();
+
+  fluidity::PassInputHash hash;
+  hash.Add(VERSION).Add(driverString.data(), driverString.size());
+  AddSource(hash, GL_VERTEX_SHADER, shaderSource.vertexShaderSource);
+  AddSource(hash, GL_FRAGMENT_SHADER, shaderSource.fragmentShaderSource);
+  AddSource(hash, GL_COMPUTE_SHADER, shaderSource.computeShaderSource);
+  return hash.Get();
+}
+
+bool ProgramBinaryCache::IsSupported()
+{
+  static const bool isSupported = []() {
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &numFormats);
+    return numFormats > 0;
+  }();
+
+  return isSupported;
+}
+
+std::string ProgramBinaryCache::GetEntryPath(uint64_t key)
+{
+  std::stringstream fileName;
+  fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".program";
+  return (std::filesystem::path(s_directory) / fileName.str()).string();
+}
+
+GLuint ProgramBinaryCache::Load(uint64_t key)
+{
+  PROFILE_SCOPE("ProgramBinaryCache::Load");
+  if (!IsSupported()) return 0;
+
+  fluidity::MappedFile file;
+  if (!file.Open(GetEntryPath(key))) return 0;
+
+  FileHeader header;
+  if (file.GetSize() < sizeof(FileHeader)) return 0;
+  std::memcpy(&header, file.GetData(), sizeof(FileHeader));
+  if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+    header.key != key || header.binaryLength != file.GetSize() - sizeof(FileHeader))
+  {
+    LOG_WARNING("Invalid program cache entry: " + GetEntryPath(key));
+    return 0;
+  }
+
+  GLuint programID = glCreateProgram();
+  if (programID == 0) return 0;
+
+  // A rejected binary only fails the link, it isn't an OpenGL error
+  glProgramBinary(programID, header.binaryFormat, file.GetData() + sizeof(FileHeader),
+    (GLsizei)header.binaryLength);
+  GLint linkStatus = GL_FALSE;
+  glGetProgramiv(programID, GL_LINK_STATUS, &linkStatus);
+  if (linkStatus != GL_TRUE)
+  {
+    GLCall(glDeleteProgram(programID));
+    return 0;
+  }
+
+  return programID;
+}
+
+bool ProgramBinaryCache::Store(uint64_t key, GLuint programID)
+{
+  PROFILE_SCOPE("ProgramBinaryCache::Store");
+  if (!IsSupported()) return false;
+
+  GLint binaryLength = 0;
+  GLCall(glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &binaryLength));
+  if (binaryLength <= 0) return false;
+
+  std::vector<char> binary(binaryLength);
+  GLenum binaryFormat;
+  GLsizei length = 0;
+  GLCall(glGetProgramBinary(programID, binaryLength, &length, &binaryFormat, binary.data()));
+  if (length <= 0) return false;
+
+  FileHeader header = {};
+  std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+  header.version      = VERSION;
+  header.binaryFormat = binaryFormat;
+  header.key          = key;
+  header.binaryLength = length;
+
+  return fluidity::WriteFileAtomically(GetEntryPath(key), 
+    { { &header, sizeof(FileHeader) }, { binary.data(), (size_t)length } });
+}
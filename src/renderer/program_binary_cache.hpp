@@ -0,0 +1,35 @@
+#pragma once
+#include "shader.h"
+#include <cstdint>
+#include <string>
+
+#include <GL/glew.h>
+
+// Cache of linked program binaries (glGetProgramBinary), so programs built before skip
+// compiling and linking. Entries are keyed by the exact sources given to the compiler and by
+// the driver's vendor, renderer and version strings, since binaries are only valid for the
+// driver that produced them. Every function requires an active OpenGL context.
+class ProgramBinaryCache
+{
+public:
+  static uint64_t ComputeKey(const ShaderSource& shaderSource);
+
+  // Returns 0 on a miss, or if the driver rejects the binary (e.g. after a driver update that
+  // kept the version string)
+  static GLuint Load(uint64_t key);
+  // The program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT set
+  static bool Store(uint64_t key, GLuint programID);
+
+  // False if the driver supports no binary formats at all
+  static bool IsSupported();
+
+  static void SetDirectory(const std::string& directory) { s_directory = directory; }
+  static const std::string& GetDirectory() { return s_directory; }
+
+  static constexpr uint32_t VERSION = 1;
+
+private:
+  static std::string GetEntryPath(uint64_t key);
+
+  static std::string s_directory;
+};
@@ -0,0 +1,159 @@
+#include "pyramid_filter_pass.hpp"
+#include "render_target_formats.hpp"
+#include "../utils/glcall.h"
+#include <algorithm>
+#include <cassert>
+
+namespace fluidity
+{
+PyramidFilterPass::PyramidFilterPass(
+    int bufferWidth,
+    int bufferHeight,
+    const FramebufferAttachment& renderTargetSpecification,
+    const std::string& downsampleFilePath,
+    const std::string& compositeFilePath)
+    : RenderPass(bufferWidth, bufferHeight, 0, 0),
+    m_downsampleFilePath(downsampleFilePath),
+    m_compositeFilePath(compositeFilePath),
+    m_renderTargetSpecification(GetImageCompatibleAttachment(renderTargetSpecification)),
+    m_nIterations(0),
+    m_downsampleShader(nullptr),
+    m_pyramidTexture(0),
+    m_numLevels(0)
+{ /* */ }
+
+bool PyramidFilterPass::Init()
+{
+  m_shader           = new Shader(m_compositeFilePath);
+  m_downsampleShader = new Shader(m_downsampleFilePath);
+
+  // The framebuffer is never bound, it only owns (and resizes) the two ping-pong images
+  m_framebuffer.PushAttachment({ m_renderTargetSpecification.internalFormat,
+      m_renderTargetSpecification.pixelFormat, m_renderTargetSpecification.dataType
+  });
+  m_framebuffer.DuplicateAttachment(0);
+  if (!RenderPass::Init()) return false;
+
+  InitPyramid();
+
+  return true;
+}
+
+bool PyramidFilterPass::SetUniforms()
+{
+  m_downsampleShader->Bind();
+  m_downsampleShader->SetUniform1i("u_InputTex", 0);
+  m_downsampleShader->SetUniform1i("u_OutputImage", 0);
+  m_downsampleShader->Unbind();
+
+  m_shader->Bind();
+  m_shader->SetUniform1i("u_DepthTex", 0);
+  m_shader->SetUniform1i("u_PyramidTex", 1);
+  m_shader->SetUniform1i("u_OutputImage", 0);
+  m_shader->Unbind();
+
+  return true;
+}
+
+void PyramidFilterPass::InitPyramid()
+{
+  if (m_pyramidTexture != 0) GLCall(glDeleteTextures(1, &m_pyramidTexture));
+
+  m_numLevels = 1;
+  for (unsigned size = std::max(m_bufferWidth, m_bufferHeight); size > 1 &&
+    m_numLevels < MAX_LEVELS; size /= 2)
+  {
+    m_numLevels++;
+  }
+
+  GLCall(glGenTextures(1, &m_pyramidTexture));
+  GLCall(glBindTexture(GL_TEXTURE_2D, m_pyramidTexture));
+  GLCall(glTexStorage2D(GL_TEXTURE_2D, m_numLevels, GL_RG32F, m_bufferWidth, m_bufferHeight));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE));
+  // Levels are always selected explicitly, and blended in the shader
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_NEAREST));
+  GLCall(glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void PyramidFilterPass::Resize(int bufferWidth, int bufferHeight)
+{
+  RenderPass::Resize(bufferWidth, bufferHeight);
+  InitPyramid();
+}
+
+void PyramidFilterPass::SetRenderTargetFormat(const FramebufferAttachment& renderTargetSpecification)
+{
+  m_renderTargetSpecification = GetImageCompatibleAttachment(renderTargetSpecification);
+  m_framebuffer.SetAttachmentFormat(0, m_renderTargetSpecification);
+  m_framebuffer.SetAttachmentFormat(1, m_renderTargetSpecification);
+}
+
+void PyramidFilterPass::Render()
+{
+  // Sanity check
+  assert(m_shader != nullptr && m_downsampleShader != nullptr);
+  if (m_nIterations <= 0 || m_textureBinds.count(0) == 0) return;
+
+  // Iterations alternate between both images, so that the last one writes to image 0
+  GLuint inputTexture = m_textureBinds[0].id;
+  for (int i = 0; i < m_nIterations; i++)
+  {
+    int outputAttachment = (m_nIterations - 1 - i) % 2;
+    BuildPyramid(inputTexture);
+    Composite(inputTexture, outputAttachment);
+    inputTexture = m_framebuffer.GetAttachment(outputAttachment);
+  }
+
+  GLCall(glBindImageTexture(0, 0, 0, GL_FALSE, 0, GL_WRITE_ONLY,
+    m_renderTargetSpecification.internalFormat));
+  GLCall(glActiveTexture(GL_TEXTURE1));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+  GLCall(glActiveTexture(GL_TEXTURE0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+}
+
+void PyramidFilterPass::BuildPyramid(GLuint inputTexture)
+{
+  m_downsampleShader->Bind();
+  GLCall(glActiveTexture(GL_TEXTURE0));
+
+  for (int level = 0; level < m_numLevels; level++)
+  {
+    // Level 0 reads the depth texture, every other level reads the previous one
+    GLCall(glBindTexture(GL_TEXTURE_2D, level == 0 ? inputTexture : m_pyramidTexture));
+    GLCall(glBindImageTexture(0, m_pyramidTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_RG32F));
+    m_downsampleShader->SetUniform1i("u_Level", level);
+
+    unsigned levelWidth  = std::max(1u, m_bufferWidth >> level);
+    unsigned levelHeight = std::max(1u, m_bufferHeight >> level);
+    GLCall(glDispatchCompute((levelWidth + TILE_SIZE - 1) / TILE_SIZE,
+      (levelHeight + TILE_SIZE - 1) / TILE_SIZE, 1));
+    GLCall(glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT));
+  }
+
+  m_downsampleShader->Unbind();
+}
+
+void PyramidFilterPass::Composite(GLuint inputTexture, int outputAttachment)
+{
+  m_shader->Bind();
+  m_shader->SetUniform1i("u_NumLevels", m_numLevels);
+
+  GLCall(glActiveTexture(GL_TEXTURE0));
+  GLCall(glBindTexture(GL_TEXTURE_2D, inputTexture));
+  GLCall(glActiveTexture(GL_TEXTURE1));
+  GLCall(glBindTexture(GL_TEXTURE_2D, m_pyramidTexture));
+  GLCall(glBindImageTexture(0, m_framebuffer.GetAttachment(outputAttachment), 0, GL_FALSE, 0,
+    GL_WRITE_ONLY, m_renderTargetSpecification.internalFormat));
+
+  GLCall(glDispatchCompute((m_bufferWidth + TILE_SIZE - 1) / TILE_SIZE,
+    (m_bufferHeight + TILE_SIZE - 1) / TILE_SIZE, 1));
+  // The next iteration, or the passes after filtering, sample the result as a texture
+  GLCall(glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT));
+
+  m_shader->Unbind();
+}
+
+}
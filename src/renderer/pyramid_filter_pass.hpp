@@ -0,0 +1,56 @@
+#pragma once
+#include "render_pass.hpp"
+#include "framebuffer.hpp"
+#include "renderer.h"
+#include "shader.h"
+#include <string>
+
+namespace fluidity
+{
+
+// Depth smoothing with a cost per pixel that doesn't depend on the filter size.
+// Fluid depth is pulled into a mip pyramid of (depth * weight, weight), where background has no
+// weight. Each pixel then reads the level whose footprint matches the narrow-range filter size,
+// with a cubic B-spline lookup, stepping down to finer levels while the smoothed depth is out of
+// the narrow-range threshold (so separate surfaces aren't blended together).
+// The input depth texture is set with SetInputTexture, the result is always in GetBuffer(0).
+class PyramidFilterPass : public RenderPass
+{
+public:
+    PyramidFilterPass(
+      int bufferWidth,
+      int bufferHeight,
+      const FramebufferAttachment& renderTargetSpecification,
+      const std::string& downsampleFilePath,
+      const std::string& compositeFilePath
+    );
+
+    virtual bool Init() override;
+    virtual void Render() override;
+    virtual void Resize(int bufferWidth, int bufferHeight) override;
+    virtual std::vector<Shader*> GetShaders() override { return { m_shader, m_downsampleShader }; }
+
+    void SetNumberOfIterations(int nIterations) { m_nIterations = nIterations; }
+    void SetRenderTargetFormat(const FramebufferAttachment& renderTargetSpecification);
+
+    // Must match the shaders' local size
+    static constexpr int TILE_SIZE  = 8;
+    static constexpr int MAX_LEVELS = 10;
+
+private:
+    virtual bool SetUniforms() override;
+    void InitPyramid();
+    void BuildPyramid(GLuint inputTexture);
+    void Composite(GLuint inputTexture, int outputAttachment);
+
+    std::string m_downsampleFilePath;
+    std::string m_compositeFilePath;
+    FramebufferAttachment m_renderTargetSpecification;
+    int m_nIterations;
+
+    Shader* m_downsampleShader;
+    GLuint m_pyramidTexture;
+    int m_numLevels;
+};
+
+}
@@ -24,6 +24,24 @@ bool RenderPass:: Init()
     return true;
 }
 
+void RenderPass::Resize(int bufferWidth, int bufferHeight)
+{
+  m_bufferWidth  = bufferWidth;
+  m_bufferHeight = bufferHeight;
+  m_framebuffer.Resize(bufferWidth, bufferHeight);
+  InvalidateOutput();
+}
+
+bool RenderPass::NeedsRender(uint64_t inputHash)
+{
+  if (m_hasValidOutput && inputHash == m_inputHash) return false;
+
+  m_hasValidOutput = true;
+  m_inputHash      = inputHash;
+  m_outputVersion++;
+  return true;
+}
+
 bool RenderPass::SetUniformBuffer(const std::string& name, GLuint uniformBlockBinding)
 {
   return m_shader->SetUniformBuffer(name.c_str(), uniformBlockBinding);
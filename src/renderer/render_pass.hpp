@@ -2,7 +2,9 @@
 #include "framebuffer.hpp"
 #include "shader.h"
 #include "vec.hpp"
+#include <cstdint>
 #include <unordered_map>
+#include <vector>
 
 namespace fluidity
 {
@@ -63,12 +65,19 @@ public:
   virtual bool Init()   = 0;
   virtual void Render() = 0;
   virtual GLuint GetBuffer(int index = 0) { return m_framebuffer.GetAttachment(index); }
+  virtual void Resize(int bufferWidth, int bufferHeight);
+  unsigned GetBufferWidth() const  { return m_bufferWidth;  }
+  unsigned GetBufferHeight() const { return m_bufferHeight; }
 
   virtual void SetVAO(GLuint vao)                 { m_vao         = vao;       }
   virtual void SetNumVertices(unsigned nVertices) { m_numVertices = nVertices; }
   virtual bool SetUniformBuffer(const std::string& name, GLuint uniformBlockBinding);
 
   Shader& GetShader();
+  // Every shader the pass renders with, so they can be reloaded when their files change
+  virtual std::vector<Shader*> GetShaders() { return { m_shader }; }
+  // Sets the uniforms the pass owns (e.g. texture units) again, after a shader is reloaded
+  bool RestoreUniforms() { return SetUniforms(); }
   Framebuffer& GetFramebuffer() { return m_framebuffer; }
 
   virtual void SetRenderState(const RenderState& state) { m_renderState = state; };
@@ -78,6 +87,14 @@ public:
   void BindTextures();
   void UnbindTextures();
 
+  // Returns false if the pass was last rendered with the same inputs (see PassInputHash), in
+  // which case its buffers still hold the result. Otherwise records the hash, and the pass must
+  // be rendered. Passes sampling from this one include its output version in their own hash.
+  bool NeedsRender(uint64_t inputHash);
+  // Forces the next NeedsRender to return true, e.g. after the buffers are reallocated
+  void InvalidateOutput() { m_hasValidOutput = false; }
+  uint64_t GetOutputVersion() const { return m_outputVersion; }
+
 protected:
   virtual bool SetUniformBufferForShader(const std::string& name, GLuint uniformBlockBinding, 
       Shader* shader);
@@ -96,6 +113,10 @@ protected:
 
   std::unordered_map<int, TextureBind> m_textureBinds;
 
+  bool m_hasValidOutput    = false;
+  uint64_t m_inputHash     = 0;
+  uint64_t m_outputVersion = 0;
+
 };
 
 }
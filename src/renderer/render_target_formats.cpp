@@ -0,0 +1,198 @@
+#include "renderer/render_target_formats.hpp"
+#include "utils/glcall.h"
+#include "utils/logger.h"
+#include <algorithm>
+#include <cmath>
+#include <string>
+
+namespace fluidity
+{
+
+namespace
+{
+  struct FormatDescription
+  {
+    const char* name;
+    FramebufferAttachment attachment;
+    int  numChannels;
+    bool isSigned;
+  };
+
+  // Indexed by RenderTargetFormat
+  const FormatDescription FORMAT_DESCRIPTIONS[(int)RenderTargetFormat::Count] =
+  {
+    { "R32F",       { GL_R32F,           GL_RED,  GL_FLOAT }, 1, true  },
+    { "RGB32F",     { GL_RGB32F,         GL_RGB,  GL_FLOAT }, 3, true  },
+    { "RGBA32F",    { GL_RGBA32F,        GL_RGBA, GL_FLOAT }, 4, true  },
+    { "R16F",       { GL_R16F,           GL_RED,  GL_FLOAT }, 1, true  },
+    { "RG16F",      { GL_RG16F,          GL_RG,   GL_FLOAT }, 2, true  },
+    { "RGBA16F",    { GL_RGBA16F,        GL_RGBA, GL_FLOAT }, 4, true  },
+    { "R11G11B10F", { GL_R11F_G11F_B10F, GL_RGB,  GL_FLOAT }, 3, false },
+  };
+
+  // Indexed by RenderTarget
+  const char* RENDER_TARGET_NAMES[(int)RenderTarget::Count] =
+  {
+    "depth", "thickness", "normal", "composition", "meshColor", "meshDepth"
+  };
+
+  // Values under this are background (cleared to -inf or -1e6)
+  constexpr float BACKGROUND_DEPTH = -1000.f;
+
+  bool IsBackground(RenderTarget target, float value)
+  {
+    bool isDepth = target == RenderTarget::Depth || target == RenderTarget::MeshDepth;
+    return !std::isfinite(value) || (isDepth && (value < BACKGROUND_DEPTH || value > 0.f));
+  }
+}
+
+FramebufferAttachment GetFramebufferAttachment(RenderTargetFormat format, GLint filter)
+{
+  FramebufferAttachment attachment = FORMAT_DESCRIPTIONS[(int)format].attachment;
+  attachment.filter = filter;
+  return attachment;
+}
+
+FramebufferAttachment GetImageCompatibleAttachment(FramebufferAttachment attachment)
+{
+  if (attachment.internalFormat == GL_RGB32F)
+  {
+    attachment.internalFormat = GL_RGBA32F;
+    attachment.pixelFormat    = GL_RGBA;
+  }
+  return attachment;
+}
+
+const char* GetRenderTargetFormatName(RenderTargetFormat format)
+{
+  return FORMAT_DESCRIPTIONS[(int)format].name;
+}
+
+bool ParseRenderTargetFormat(const std::string& name, RenderTargetFormat& format)
+{
+  for (int i = 0; i < (int)RenderTargetFormat::Count; i++)
+  {
+    if (name == FORMAT_DESCRIPTIONS[i].name)
+    {
+      format = (RenderTargetFormat)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* GetRenderTargetName(RenderTarget target)
+{
+  return RENDER_TARGET_NAMES[(int)target];
+}
+
+bool ParseRenderTarget(const std::string& name, RenderTarget& target)
+{
+  for (int i = 0; i < (int)RenderTarget::Count; i++)
+  {
+    if (name == RENDER_TARGET_NAMES[i])
+    {
+      target = (RenderTarget)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+int GetRequiredChannels(RenderTarget target)
+{
+  switch (target)
+  {
+    case RenderTarget::Normal:
+    case RenderTarget::Composition:
+    case RenderTarget::MeshColor:
+      return 3;
+    default:
+      return 1;
+  }
+}
+
+bool IsFormatCompatible(RenderTarget target, RenderTargetFormat format)
+{
+  const auto& description = FORMAT_DESCRIPTIONS[(int)format];
+  bool requiresSign = target == RenderTarget::Depth || target == RenderTarget::Normal ||
+    target == RenderTarget::MeshDepth;
+
+  if (description.numChannels < GetRequiredChannels(target)) return false;
+  if (requiresSign && !description.isSigned) return false;
+  return true;
+}
+
+void SanitizeRenderTargetFormats(RenderTargetFormats& formats)
+{
+  const RenderTargetFormats defaultFormats;
+  for (int i = 0; i < (int)RenderTarget::Count; i++)
+  {
+    RenderTarget target = (RenderTarget)i;
+    if (IsFormatCompatible(target, formats[target])) continue;
+
+    LOG_WARNING(std::string(GetRenderTargetFormatName(formats[target])) + 
+      " can't be used for the " + GetRenderTargetName(target) + " target. Using " + 
+      GetRenderTargetFormatName(defaultFormats[target]) + " instead.");
+    formats[target] = defaultFormats[target];
+  }
+}
+
+RenderTargetReadback ReadRenderTarget(RenderTarget target, GLuint texture)
+{
+  RenderTargetReadback readback = { target, 0, 0, {} };
+
+  GLCall(glBindTexture(GL_TEXTURE_2D, texture));
+  GLCall(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &readback.width));
+  GLCall(glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &readback.height));
+
+  readback.pixels.resize((size_t)readback.width * readback.height * 4);
+  GLCall(glPixelStorei(GL_PACK_ALIGNMENT, 4));
+  GLCall(glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_FLOAT, readback.pixels.data()));
+  GLCall(glBindTexture(GL_TEXTURE_2D, 0));
+
+  return readback;
+}
+
+RenderTargetError CompareRenderTargets(const RenderTargetReadback& reference,
+  const RenderTargetReadback& test)
+{
+  RenderTargetError error;
+  if (reference.width != test.width || reference.height != test.height)
+  {
+    LOG_ERROR("Can't compare render targets with different sizes.");
+    return error;
+  }
+
+  int numChannels = GetRequiredChannels(reference.target);
+  size_t numPixels = (size_t)reference.width * reference.height;
+  for (size_t i = 0; i < numPixels; i++)
+  {
+    for (int c = 0; c < numChannels; c++)
+    {
+      float referenceValue = reference.pixels[i * 4 + c];
+      float testValue      = test.pixels[i * 4 + c];
+
+      bool referenceIsBackground = IsBackground(reference.target, referenceValue);
+      bool testIsBackground      = IsBackground(reference.target, testValue);
+      if (referenceIsBackground != testIsBackground)
+      {
+        error.coverageMismatches++;
+        break;
+      }
+      if (referenceIsBackground) continue;
+
+      float absoluteError = std::abs(referenceValue - testValue);
+      error.maxAbsoluteError = std::max(error.maxAbsoluteError, absoluteError);
+      if (std::abs(referenceValue) > 1e-4f)
+      {
+        error.maxRelativeError = std::max(error.maxRelativeError, 
+          absoluteError / std::abs(referenceValue));
+      }
+    }
+  }
+
+  return error;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include "renderer/framebuffer.hpp"
+#include "renderer/rendering_parameters.hpp"
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+FramebufferAttachment GetFramebufferAttachment(RenderTargetFormat format, GLint filter = GL_NEAREST);
+// Three channel formats can't be bound as images, so compute passes store them with four
+FramebufferAttachment GetImageCompatibleAttachment(FramebufferAttachment attachment);
+
+const char* GetRenderTargetFormatName(RenderTargetFormat format);
+bool ParseRenderTargetFormat(const std::string& name, RenderTargetFormat& format);
+const char* GetRenderTargetName(RenderTarget target);
+bool ParseRenderTarget(const std::string& name, RenderTarget& target);
+
+// Number of channels the passes writing to the target actually use
+int GetRequiredChannels(RenderTarget target);
+// Checks channel count and sign (R11G11B10F can't store negative values, such as eye
+// space depth or normals)
+bool IsFormatCompatible(RenderTarget target, RenderTargetFormat format);
+// Replaces incompatible formats with the FP32 default
+void SanitizeRenderTargetFormats(RenderTargetFormats& formats);
+
+struct RenderTargetReadback
+{
+  RenderTarget target;
+  int width;
+  int height;
+  // Always RGBA
+  std::vector<float> pixels;
+};
+
+struct RenderTargetError
+{
+  float maxAbsoluteError = 0.f;
+  float maxRelativeError = 0.f;
+  // Pixels that are background in one of the targets, but not in the other
+  int coverageMismatches = 0;
+};
+
+RenderTargetReadback ReadRenderTarget(RenderTarget target, GLuint texture);
+RenderTargetError CompareRenderTargets(const RenderTargetReadback& reference, 
+  const RenderTargetReadback& test);
+
+}
@@ -1,8 +1,28 @@
 #pragma once
+#include <vector>
 
 namespace fluidity
 {
 
+enum class FilterBackend
+{
+  Fragment, // filter-narrow-range.frag, 1D or 2D
+  Compute,  // filter-narrow-range.comp, always separable (1D)
+  Pyramid,  // Push-pull mip pyramid, cost independent of the filter size
+  Count
+};
+
+inline const char* GetFilterBackendName(FilterBackend backend)
+{
+  switch (backend)
+  {
+    case FilterBackend::Fragment: return "fragment";
+    case FilterBackend::Compute:  return "compute";
+    case FilterBackend::Pyramid:  return "pyramid";
+    default:                      return "unknown";
+  }
+}
+
 struct FilteringParameters
 {
   int nIterations;
@@ -11,6 +31,7 @@ struct FilteringParameters
   bool gammaCorrection; // TODO: This should not be here. More like "post processing parameters"
   bool useRefractionMask = true;
   bool filter1D          = false;
+  FilterBackend backend  = FilterBackend::Fragment;
 };
 
 struct FluidParameters
@@ -19,6 +40,81 @@ struct FluidParameters
   bool  transparentFluid;
   float pointRadius;
   float refractionModifier = 1.0;
+  // Skips the depth and thickness draws of particle chunks hidden behind the meshes
+  bool  occlusionCulling   = true;
+};
+
+struct ResolutionParameters
+{
+  // Scale of the fluid buffers (depth, thickness, filtering and normals) relative to the
+  // window. The composition pass upsamples them back to full resolution.
+  float fluidScale = 1.f;
+  // Scale of the meshes pass (background and solid depth) relative to the window
+  float meshScale  = 1.f;
+
+  // Lowers both scales further when the GPU frame time goes over the target (in ms)
+  bool  dynamicResolution = false;
+  float targetFrameTime   = 16.6f;
+  float minDynamicScale   = 0.5f;
+};
+
+enum class RenderTargetFormat
+{
+  R32F,
+  RGB32F,
+  RGBA32F,
+  R16F,
+  RG16F,
+  RGBA16F,
+  R11G11B10F,
+  Count
+};
+
+enum class RenderTarget
+{
+  Depth, // Also used by the filter pass
+  Thickness,
+  Normal,
+  Composition,
+  MeshColor,
+  MeshDepth,
+  Count
+};
+
+struct RenderTargetFormats
+{
+  RenderTargetFormat depth       = RenderTargetFormat::R32F;
+  RenderTargetFormat thickness   = RenderTargetFormat::R32F;
+  RenderTargetFormat normal      = RenderTargetFormat::RGB32F;
+  RenderTargetFormat composition = RenderTargetFormat::RGBA32F;
+  RenderTargetFormat meshColor   = RenderTargetFormat::RGB32F;
+  RenderTargetFormat meshDepth   = RenderTargetFormat::R32F;
+
+  RenderTargetFormat& operator[](RenderTarget target)
+  {
+    switch (target)
+    {
+      case RenderTarget::Depth:       return depth;
+      case RenderTarget::Thickness:   return thickness;
+      case RenderTarget::Normal:      return normal;
+      case RenderTarget::Composition: return composition;
+      case RenderTarget::MeshColor:   return meshColor;
+      default:                        return meshDepth;
+    }
+  }
+
+  RenderTargetFormat operator[](RenderTarget target) const
+  {
+    return const_cast<RenderTargetFormats&>(*this)[target];
+  }
+
+  bool operator==(const RenderTargetFormats& other) const
+  {
+    return depth == other.depth && thickness == other.thickness && normal == other.normal &&
+      composition == other.composition && meshColor == other.meshColor && 
+      meshDepth == other.meshDepth;
+  }
+  bool operator!=(const RenderTargetFormats& other) const { return !(*this == other); }
 };
 
 struct LightingParameters
@@ -33,4 +129,39 @@ struct LightingParameters
   bool  showLightsOnScene;
 };
 
-}
\ No newline at end of file
+struct MeshLodParameters
+{
+  // Simplified meshes in the camera view. The shadow map always uses them.
+  bool  enabled       = true;
+  // Largest simplification error shown, in pixels of the buffer drawn to
+  float maxPixelError = 1.f;
+  // Shadows don't need full detail, so the shadow map never uses a finer level than this one
+  int   shadowMinLod  = 2;
+};
+
+enum class AovFormat
+{
+  NPY, // float32, shaped (height, width, channels), rows top to bottom
+  EXR, // float32 channels: Z for depths, Y for other single channel targets, RGB otherwise
+  Count
+};
+
+inline const char* GetAovFormatName(AovFormat format)
+{
+  switch (format)
+  {
+    case AovFormat::NPY: return "npy";
+    case AovFormat::EXR: return "exr";
+    default:             return "unknown";
+  }
+}
+
+// Arbitrary output variables: render targets written next to every frame of a batch render,
+// unprocessed (e.g. eye space depth, or normals before shading)
+struct AovParameters
+{
+  std::vector<RenderTarget> targets;
+  AovFormat format = AovFormat::NPY;
+};
+
+}
@@ -1,9 +1,14 @@
 #include "renderer/scene.hpp"
 #include "utils/logger.h"
+#include "utils/profiler.hpp"
+#include "renderer/render_target_formats.hpp"
+#include "utils/thread_pool.hpp"
+#include <algorithm>
 #include <iostream>
 #include <fstream>
 #include <sstream>
 #include <filesystem>
+#include <future>
 
 template<>
 struct YAML::convert<fluidity::FilteringParameters>
@@ -18,6 +23,15 @@ struct YAML::convert<fluidity::FilteringParameters>
         fp.gammaCorrection   = node[3].as<bool>();
         fp.useRefractionMask = node[4].as<bool>();
         if (node.size() > 5) fp.filter1D = node[5].as<bool>();
+        if (node.size() > 6)
+        {
+            std::string backendName = node[6].as<std::string>();
+            for (int i = 0; i < (int)fluidity::FilterBackend::Count; i++)
+            {
+                auto backend = (fluidity::FilterBackend)i;
+                if (backendName == fluidity::GetFilterBackendName(backend)) fp.backend = backend;
+            }
+        }
 
         return true;
     }
@@ -28,11 +42,107 @@ struct YAML::convert<fluidity::FluidParameters>
 {
     static bool decode(const YAML::Node& node, fluidity::FluidParameters& fp)
     {
-        if (!node.IsSequence() || node.size() != 3) return false;
+        if (!node.IsSequence() || node.size() < 3) return false;
 
         fp.attenuation       = node[0].as<float>();
         fp.transparentFluid  = node[1].as<bool>();
         fp.pointRadius       = node[2].as<float>();
+        if (node.size() > 3) fp.occlusionCulling = node[3].as<bool>();
+        return true;
+    }
+};
+
+template<>
+struct YAML::convert<fluidity::ResolutionParameters>
+{
+    static bool decode(const YAML::Node& node, fluidity::ResolutionParameters& rp)
+    {
+        if (!node.IsSequence() || node.size() < 1) return false;
+
+        rp.fluidScale = node[0].as<float>();
+        if (node.size() > 1) rp.meshScale         = node[1].as<float>();
+        if (node.size() > 2) rp.dynamicResolution = node[2].as<bool>();
+        if (node.size() > 3) rp.targetFrameTime   = node[3].as<float>();
+        if (node.size() > 4) rp.minDynamicScale   = node[4].as<float>();
+        return true;
+    }
+};
+
+template<>
+struct YAML::convert<fluidity::MeshLodParameters>
+{
+    static bool decode(const YAML::Node& node, fluidity::MeshLodParameters& mlp)
+    {
+        if (!node.IsSequence() || node.size() < 1) return false;
+
+        mlp.enabled = node[0].as<bool>();
+        if (node.size() > 1) mlp.maxPixelError = node[1].as<float>();
+        if (node.size() > 2) mlp.shadowMinLod  = node[2].as<int>();
+        return true;
+    }
+};
+
+template<>
+struct YAML::convert<fluidity::RenderTargetFormats>
+{
+    static bool decode(const YAML::Node& node, fluidity::RenderTargetFormats& rtf)
+    {
+        if (!node.IsMap()) return false;
+
+        for (const auto& entry : node)
+        {
+            fluidity::RenderTarget target;
+            fluidity::RenderTargetFormat format;
+            if (!fluidity::ParseRenderTarget(entry.first.as<std::string>(), target) ||
+                !fluidity::ParseRenderTargetFormat(entry.second.as<std::string>(), format))
+            {
+                LOG_WARNING("Invalid render target format: " + entry.first.as<std::string>() + 
+                    ": " + entry.second.as<std::string>());
+                continue;
+            }
+            rtf[target] = format;
+        }
+        return true;
+    }
+};
+
+template<>
+struct YAML::convert<fluidity::AovParameters>
+{
+    static bool decode(const YAML::Node& node, fluidity::AovParameters& ap)
+    {
+        if (!node.IsMap()) return false;
+
+        if (node["Format"])
+        {
+            std::string formatName = node["Format"].as<std::string>();
+            bool found = false;
+            for (int i = 0; i < (int)fluidity::AovFormat::Count && !found; i++)
+            {
+                auto format = (fluidity::AovFormat)i;
+                found = formatName == fluidity::GetAovFormatName(format);
+                if (found) ap.format = format;
+            }
+            if (!found)
+            {
+                LOG_WARNING("Invalid AOV format: " + formatName + ", using " + 
+                    fluidity::GetAovFormatName(ap.format));
+            }
+        }
+
+        if (node["Targets"] && node["Targets"].IsSequence())
+        {
+            for (const auto& targetNode : node["Targets"])
+            {
+                fluidity::RenderTarget target;
+                if (!fluidity::ParseRenderTarget(targetNode.as<std::string>(), target))
+                {
+                    LOG_WARNING("Invalid AOV: " + targetNode.as<std::string>());
+                    continue;
+                }
+                ap.targets.push_back(target);
+            }
+        }
         return true;
     }
 };
@@ -188,7 +298,7 @@ YAML::Emitter& operator << (YAML::Emitter& out, const FilteringParameters& filte
     const FilteringParameters& fp = filteringParameters;
     out << YAML::Flow;
     out << YAML::BeginSeq << fp.nIterations << fp.filterSize << fp.maxFilterSize << 
-        fp.gammaCorrection << fp.useRefractionMask << fp.filter1D;
+        fp.gammaCorrection << fp.useRefractionMask << fp.filter1D << GetFilterBackendName(fp.backend);
     out << YAML::EndSeq;
 
     return out;
@@ -198,12 +308,62 @@ YAML::Emitter& operator << (YAML::Emitter& out, const FluidParameters& fluidPara
 {
     const FluidParameters& fp = fluidParameters;
     out << YAML::Flow;
-    out << YAML::BeginSeq << fp.attenuation << fp.transparentFluid << fp.pointRadius;
+    out << YAML::BeginSeq << fp.attenuation << fp.transparentFluid << fp.pointRadius <<
+        fp.occlusionCulling;
     out << YAML::EndSeq;
 
     return out;
 }
 
+YAML::Emitter& operator << (YAML::Emitter& out, const ResolutionParameters& resolutionParameters)
+{
+    const ResolutionParameters& rp = resolutionParameters;
+    out << YAML::Flow;
+    out << YAML::BeginSeq << rp.fluidScale << rp.meshScale << rp.dynamicResolution << 
+        rp.targetFrameTime << rp.minDynamicScale;
+    out << YAML::EndSeq;
+
+    return out;
+}
+
+YAML::Emitter& operator << (YAML::Emitter& out, const MeshLodParameters& meshLodParameters)
+{
+    const MeshLodParameters& mlp = meshLodParameters;
+    out << YAML::Flow;
+    out << YAML::BeginSeq << mlp.enabled << mlp.maxPixelError << mlp.shadowMinLod;
+    out << YAML::EndSeq;
+
+    return out;
+}
+
+YAML::Emitter& operator << (YAML::Emitter& out, const RenderTargetFormats& renderTargetFormats)
+{
+    using namespace YAML;
+    out << BeginMap;
+    for (int i = 0; i < (int)RenderTarget::Count; i++)
+    {
+        RenderTarget target = (RenderTarget)i;
+        out << Key << GetRenderTargetName(target) << Value << 
+            GetRenderTargetFormatName(renderTargetFormats[target]);
+    }
+    out << EndMap;
+
+    return out;
+}
+
+YAML::Emitter& operator << (YAML::Emitter& out, const AovParameters& aovParameters)
+{
+    using namespace YAML;
+    out << BeginMap;
+    out << Key << "Format" << Value << GetAovFormatName(aovParameters.format);
+    out << Key << "Targets" << Value << Flow << BeginSeq;
+    for (RenderTarget target : aovParameters.targets) out << GetRenderTargetName(target);
+    out << EndSeq;
+    out << EndMap;
+
+    return out;
+}
+
 YAML::Emitter& operator << (YAML::Emitter& out, const Vec4& vec)
 {
     out << YAML::Flow;
@@ -323,6 +483,10 @@ void SceneSerializer::Serialize()
         out << Key << "FilteringParameters" << m_scene.filteringParameters;
         out << Key << "FluidParameters"     << m_scene.fluidParameters;
         out << Key << "LightingParameters"  << m_scene.lightingParameters;
+        out << Key << "ResolutionParameters" << m_scene.resolutionParameters;
+        out << Key << "MeshLodParameters"   << m_scene.meshLodParameters;
+        out << Key << "RenderTargetFormats" << m_scene.renderTargetFormats;
+        out << Key << "AOVs"                << m_scene.aovParameters;
         out << Key << "FluidMaterial"       << m_scene.fluidMaterial;
 
         out << Key << "Lights";
@@ -344,6 +508,7 @@ void SceneSerializer::Serialize()
 
 bool SceneSerializer::Deserialize()
 {
+    PROFILE_SCOPE("SceneSerializer::Deserialize");
     std::ifstream sceneFile(m_filePath);
 
     if (!sceneFile)
@@ -355,6 +520,7 @@ bool SceneSerializer::Deserialize()
     contentStream << sceneFile.rdbuf();
 
     YAML::Node root = YAML::Load(contentStream.str());
+    std::filesystem::path sceneDirectory = GetSceneDirectory();
 
     Scene sc = Scene::CreateEmptyScene();
     if (root["FilteringParameters"])
@@ -372,6 +538,26 @@ bool SceneSerializer::Deserialize()
         sc.lightingParameters = root["LightingParameters"].as<LightingParameters>();
     }
 
+    if (root["ResolutionParameters"])
+    {
+        sc.resolutionParameters = root["ResolutionParameters"].as<ResolutionParameters>();
+    }
+
+    if (root["MeshLodParameters"])
+    {
+        sc.meshLodParameters = root["MeshLodParameters"].as<MeshLodParameters>();
+    }
+
+    if (root["RenderTargetFormats"])
+    {
+        sc.renderTargetFormats = root["RenderTargetFormats"].as<RenderTargetFormats>();
+    }
+
+    if (root["AOVs"])
+    {
+        sc.aovParameters = root["AOVs"].as<AovParameters>();
+    }
+
     if (root["Lights"] && root["Lights"].IsSequence())
     {
         for (const auto& l : root["Lights"])
@@ -390,23 +576,20 @@ bool SceneSerializer::Deserialize()
         sc.camera = root["Camera"].as<Camera>();
     }
 
+    std::vector<Model> models;
     if (root["Models"] && root["Models"].IsSequence())
     {
         for (const auto& m : root["Models"])
         {
             Model preloadedModel;
             // If model didn't deserialize properly, don't add it to scene
-            if (!DeserializeModel(m, preloadedModel))
+            if (!DeserializeModel(m, sceneDirectory, preloadedModel))
             {
                 LOG_ERROR(m_filePath + ": Unable to load model " + preloadedModel.GetFilePath());
                 continue;
             }
 
-            if (preloadedModel.Load())
-            {
-                sc.models.push_back(preloadedModel);
-            }
-            else LOG_ERROR("Unable to load model: " + preloadedModel.GetFilePath());
+            models.push_back(std::move(preloadedModel));
         }
     }
 
@@ -417,17 +600,74 @@ bool SceneSerializer::Deserialize()
 
     if (root["Skybox"])
     {
-        sc.skyboxPath = GetAbsolutePathRelativeToScene(root["Skybox"].as<std::string>());
+        sc.skyboxPath = GetAbsolutePathRelativeToScene(root["Skybox"].as<std::string>(),
+            sceneDirectory);
     }
 
+    std::vector<std::string> fluidFileList;
     if (root["Fluid"])
     {
-        if (!DeserializeFluid(root["Fluid"], sc.fluid))
+        if (!DeserializeFluid(root["Fluid"], sceneDirectory, fluidFileList))
         {
             LOG_ERROR(m_filePath + ": Unable to load fluid.");
         }
 
+        int first = std::clamp(m_firstFluidFrame, 0, (int)fluidFileList.size());
+        int last  = m_numFluidFrames < 0 ? (int)fluidFileList.size() : 
+            std::min(first + m_numFluidFrames, (int)fluidFileList.size());
+        fluidFileList = std::vector<std::string>(fluidFileList.begin() + first, 
+            fluidFileList.begin() + last);
+    }
+
+    // Files are read and decoded on the thread pool, all at once. Only the uploads, which need
+    // the OpenGL context, are left to this thread.
+    ThreadPool& pool = ThreadPool::GetGlobal();
+    std::vector<std::future<bool>> modelsLoaded;
+    for (auto& model : models)
+    {
+        modelsLoaded.push_back(pool.Submit([&model]() { return model.LoadMeshes(); }));
+    }
+
+    std::future<bool> skyboxLoaded;
+    if (!sc.skyboxPath.empty())
+    {
+        sc.skybox = Skybox(sc.skyboxPath);
+        skyboxLoaded = pool.Submit([&sc]() { return sc.skybox.LoadFaces(); });
     }
+
+    std::future<bool> fluidLoaded;
+    if (!fluidFileList.empty())
+    {
+        fluidLoaded = pool.Submit([&sc, &fluidFileList]() { 
+            return sc.fluid.LoadFiles(fluidFileList); 
+        });
+    }
+
+    {
+        PROFILE_SCOPE("SceneSerializer::Upload");
+        for (size_t i = 0; i < models.size(); i++)
+        {
+            if (modelsLoaded[i].get())
+            {
+                models[i].Init();
+                sc.models.push_back(std::move(models[i]));
+            }
+            else LOG_ERROR("Unable to load model: " + models[i].GetFilePath());
+        }
+
+        // The skybox is uploaded by FluidRenderer::LoadScene, which retries if this failed
+        if (skyboxLoaded.valid() && !skyboxLoaded.get())
+        {
+            LOG_ERROR(m_filePath + ": Unable to load skybox " + sc.skyboxPath);
+        }
+
+        if (fluidLoaded.valid())
+        {
+            if (fluidLoaded.get()) sc.fluid.Init();
+            else LOG_ERROR(m_filePath + ": Unable to load fluid.");
+        }
+    }
+
     // TODO: Unecessary copy
     m_scene = sc;
     return true;
@@ -463,37 +703,45 @@ void SceneSerializer::SerializeFluid(YAML::Emitter& out, const Fluid& f)
     out << EndSeq << EndMap;
 }
 
-bool SceneSerializer::DeserializeFluid(const YAML::Node& node, Fluid& f)
+int SceneSerializer::CountFluidFrames() const
+{
+    std::ifstream sceneFile(m_filePath);
+    if (!sceneFile)
+    {
+        LOG_ERROR("Unable to open scene file: " + m_filePath);
+        return -1;
+    }
+    std::stringstream contentStream;
+    contentStream << sceneFile.rdbuf();
+
+    YAML::Node root = YAML::Load(contentStream.str());
+    YAML::Node fluid = root["Fluid"];
+    YAML::Node fileList = fluid && fluid.IsMap() ? fluid["fileList"] : YAML::Node();
+    return fileList && fileList.IsSequence() ? (int)fileList.size() : 0;
+}
+
+bool SceneSerializer::DeserializeFluid(const YAML::Node& node, 
+    const std::filesystem::path& sceneDirectory, std::vector<std::string>& fileList)
 {
     if (!node.IsMap()) return false;
     if (!node["fileList"] || !node["fileList"].IsSequence()) return false;
 
-    // Absolute path is calculated her instead of using GetAbsolutePathRelativeToScene()
-    // for optimization purposes. Since each call to GetAbsolutePathRelativeToScene changes 
-    // the current path, and there can be many .npz files, we just do it adhoc, to avoid 
-    // the multiple changes.
-    std::filesystem::path oldPath = std::filesystem::current_path();
-    std::filesystem::current_path(std::filesystem::path(m_filePath).parent_path());
-
-    std::vector<std::string> fileList;
     for (const auto& f : node["fileList"])
     {
-        std::filesystem::path absolutePath = std::filesystem::canonical(f.as<std::string>());
-        fileList.push_back(absolutePath.generic_string());
+        fileList.push_back(GetAbsolutePathRelativeToScene(f.as<std::string>(), sceneDirectory));
     }
-    std::filesystem::current_path(oldPath);
-
-    if (fileList.size() > 0) f.Load(fileList);
 
     return true;
 }
 
 
-bool SceneSerializer::DeserializeModel(const YAML::Node& node, Model& m)
+bool SceneSerializer::DeserializeModel(const YAML::Node& node, 
+    const std::filesystem::path& sceneDirectory, Model& m)
 {
     if (!node.IsMap()) return false;
 
-    auto filePath = GetAbsolutePathRelativeToScene(node["filePath"].as<std::string>());
+    auto filePath = GetAbsolutePathRelativeToScene(node["filePath"].as<std::string>(),
+        sceneDirectory);
     auto genSmoothNormals = node["genSmoothNormals"].as<bool>();
     m = Model(filePath, genSmoothNormals);
 
@@ -539,14 +787,24 @@ std::string SceneSerializer::GetRelativePathFromSceneFile(const std::string& pat
     return std::filesystem::relative(absolutePath, scenePath.parent_path()).generic_string(); 
 }
 
-std::string SceneSerializer::GetAbsolutePathRelativeToScene(const std::string path)
+std::filesystem::path SceneSerializer::GetSceneDirectory() const
 {
-    std::filesystem::path oldPath = std::filesystem::current_path();
-    std::filesystem::current_path(std::filesystem::path(m_filePath).parent_path());
-    std::filesystem::path absolutePath = std::filesystem::canonical(path);
-    std::filesystem::current_path(oldPath);
+    std::filesystem::path directory = std::filesystem::path(m_filePath).parent_path();
+    if (directory.empty()) return std::filesystem::current_path();
+    return std::filesystem::absolute(directory);
+}
+
+std::string SceneSerializer::GetAbsolutePathRelativeToScene(const std::string& path,
+    const std::filesystem::path& sceneDirectory)
+{
+    std::filesystem::path absolutePath(path);
+    if (absolutePath.is_relative()) absolutePath = sceneDirectory / absolutePath;
 
-    return absolutePath.generic_string(); 
+    // Missing files are left to whoever opens them to report
+    std::error_code error;
+    std::filesystem::path canonicalPath = std::filesystem::weakly_canonical(absolutePath, error);
+    if (error) return absolutePath.lexically_normal().generic_string();
 
+    return canonicalPath.generic_string(); 
 }
 }
\ No newline at end of file
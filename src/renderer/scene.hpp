@@ -5,6 +5,7 @@
 #include "utils/camera.hpp"
 #include "Fluid.hpp"
 #include "vec.hpp"
+#include <filesystem>
 #include <vector>
 #include <string>
 #include <yaml-cpp/yaml.h>
@@ -23,6 +24,19 @@ struct Scene
     std::vector<Model> models;
     std::string skyboxPath;
     Vec4 clearColor; 
+    ResolutionParameters resolutionParameters;
+    RenderTargetFormats renderTargetFormats;
+    MeshLodParameters meshLodParameters;
+    AovParameters aovParameters;
+    // Faces of skyboxPath, decoded by the SceneSerializer and uploaded by
+    // FluidRenderer::LoadScene
+    Skybox skybox;
+    // PointLight mirrors the lights uniform block layout, so lights are versioned as a whole.
+    // Whoever edits them calls MarkLightsChanged, so the lights are only uploaded (and the
+    // mesh shadow map only rendered) again when they actually change.
+    uint64_t lightsVersion = 0;
+
+    void MarkLightsChanged() { lightsVersion++; }
 
     static Scene CreateEmptyScene() 
     {
@@ -59,6 +73,17 @@ public:
     void SetScene(const Scene& scene) { m_scene = scene; }
     const Scene& GetScene() { return m_scene; }
 
+    // Only frames [first, first + count) of the fluid are loaded by Deserialize, and become
+    // frames [0, count). A negative count loads every frame from first.
+    void SetFluidFrameRange(int first, int count)
+    {
+        m_firstFluidFrame = first;
+        m_numFluidFrames  = count;
+    }
+    // Number of frames the scene's fluid lists, without loading anything. -1 if the scene
+    // file can't be read.
+    int CountFluidFrames() const;
+
     const std::string& GetFilePath() const { return m_filePath; }
     void SetFilePath(const std::string filePath) { m_filePath = filePath; }
 
@@ -68,14 +93,22 @@ public:
 private:
     Scene m_scene;
     std::string m_filePath;
+    int m_firstFluidFrame = 0;
+    int m_numFluidFrames  = -1;
 
     void SerializeModel(YAML::Emitter& out, const Model& m);
     void SerializeFluid(YAML::Emitter& out, const Fluid& f);
 
-    bool DeserializeFluid(const YAML::Node& node, Fluid& f);
-    bool DeserializeModel(const YAML::Node& node, Model& m);
+    bool DeserializeFluid(const YAML::Node& node, const std::filesystem::path& sceneDirectory,
+        std::vector<std::string>& fileList);
+    bool DeserializeModel(const YAML::Node& node, const std::filesystem::path& sceneDirectory,
+        Model& m);
 
     std::string GetRelativePathFromSceneFile(const std::string& path);
-    std::string GetAbsolutePathRelativeToScene(const std::string path);
+    // Absolute directory of the scene file
+    std::filesystem::path GetSceneDirectory() const;
+    // Doesn't depend on (or change) the current path, so it's safe to call from any thread
+    static std::string GetAbsolutePathRelativeToScene(const std::string& path, 
+        const std::filesystem::path& sceneDirectory);
 };
 }
@@ -1,5 +1,9 @@
 #include "shader.h"
+#include "program_binary_cache.hpp"
 
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
 #include <fstream>
 #include <sstream>
 #include <GL/glu.h>
@@ -7,11 +11,110 @@
 #include "../utils/logger.h"
 #include "../utils/glcall.h"
 
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+// Indexed by the bit of each ShaderFeature
+static const char* FEATURE_DEFINES[SHADER_FEATURE_COUNT] = {
+  "USE_ANISOTROPY_KERNEL",
+  "TRANSPARENT_FLUID",
+  "USE_PCF",
+  "RENDER_SHADOWS",
+  "FILTER_1D",
+  "USE_REFRACTION_MASK"
+};
+
+// Replaces the #include "file" lines of source with the file's contents, with files relative
+// to directory. Each stage is compiled on its own, so stageIncludes is per stage, and files
+// already in it are not included again. #line directives keep the compiler's line numbers
+// matching each file's.
+static bool ExpandIncludes(std::string& source, const std::filesystem::path& directory,
+  std::vector<std::string>& stageIncludes) {
+  std::stringstream input(source);
+  std::stringstream output;
+  std::string line;
+  int lineNumber = 0;
+  while(getline(input, line)) {
+    lineNumber++;
+    size_t start = line.find_first_not_of(" \t");
+    if(start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+      output << line << '\n';
+      continue;
+    }
+
+    size_t open  = line.find('"', start);
+    size_t close = open == std::string::npos ? std::string::npos : line.find('"', open + 1);
+    if(close == std::string::npos) {
+      LOG_ERROR("Malformed include: " + line);
+      return false;
+    }
+
+    std::filesystem::path includePath = 
+      (directory / line.substr(open + 1, close - open - 1)).lexically_normal();
+    if(std::find(stageIncludes.begin(), stageIncludes.end(), includePath.string()) != 
+      stageIncludes.end()) {
+      output << '\n';
+      continue;
+    }
+    stageIncludes.push_back(includePath.string());
+
+    std::ifstream file(includePath);
+    if(file.fail()) {
+      LOG_ERROR("Unable to open included file " + includePath.string());
+      return false;
+    }
+    std::stringstream includeSource;
+    includeSource << file.rdbuf();
+    std::string includeContent = includeSource.str();
+    if(!includeContent.empty() && includeContent.back() != '\n') includeContent += '\n';
+    if(!ExpandIncludes(includeContent, includePath.parent_path(), stageIncludes)) return false;
+
+    output << "#line 1\n" << includeContent << "#line " << lineNumber + 1 << '\n';
+  }
+
+  source = output.str();
+  return true;
+}
+
+// Appends the files of stageIncludes to includedFiles, if they're not there yet
+static void MergeIncludes(std::vector<std::string>& includedFiles, 
+  const std::vector<std::string>& stageIncludes) {
+  for(const std::string& file : stageIncludes) {
+    if(std::find(includedFiles.begin(), includedFiles.end(), file) == includedFiles.end()) {
+      includedFiles.push_back(file);
+    }
+  }
+}
+
 Shader::Shader(const std::string& vsFilepath, const std::string& fsFilepath)
   : _vertexShaderFilepath(vsFilepath), _fragmentShaderFilepath(fsFilepath)
 {
   _shaderSource = ParseShader(vsFilepath, fsFilepath);
+  std::vector<std::string> vsIncludes;
+  std::vector<std::string> fsIncludes;
+  ExpandIncludes(_shaderSource.vertexShaderSource, 
+    std::filesystem::path(vsFilepath).parent_path(), vsIncludes);
+  ExpandIncludes(_shaderSource.fragmentShaderSource, 
+    std::filesystem::path(fsFilepath).parent_path(), fsIncludes);
+  MergeIncludes(_includedFiles, vsIncludes);
+  MergeIncludes(_includedFiles, fsIncludes);
+
+  _usedFeatures = FindUsedFeatures(_shaderSource);
   _programID = CreateShader(_shaderSource);
+  _programs[_features] = _programID;
+}
+
+Shader::Shader(const std::string& csFilepath)
+  : _computeShaderFilepath(csFilepath)
+{
+  _shaderSource.computeShaderSource = ReadFile(csFilepath);
+  ExpandIncludes(_shaderSource.computeShaderSource, 
+    std::filesystem::path(csFilepath).parent_path(), _includedFiles);
+
+  _usedFeatures = FindUsedFeatures(_shaderSource);
+  _programID = CreateComputeShader(_shaderSource);
+  _programs[_features] = _programID;
 }
 
 Shader::~Shader() {
@@ -149,8 +252,36 @@ ShaderSource Shader::ParseShader(const std::string& vsFilepath, const std::strin
   return shaderSource;
 }
 
+std::string Shader::ReadFile(const std::string& filepath) {
+  std::string content;
+  if(!TryReadFile(filepath, content)) {
+    LOG_ERROR("Unable to open file " + filepath);
+    DEBUG_BREAK();
+  }
+
+  return content;
+}
+
+bool Shader::TryReadFile(const std::string& filepath, std::string& content) {
+  std::ifstream file(filepath.c_str());
+  if(file.fail()) return false;
+
+  std::stringstream source;
+  std::string line;
+  while(getline(file, line)) {
+    source << line << '\n';
+  }
+
+  content = source.str();
+  return true;
+}
+
 GLuint Shader::CreateShader(const ShaderSource& shaderSource) {
-  GLuint programID = glCreateProgram();
+  uint64_t cacheKey = ProgramBinaryCache::ComputeKey(shaderSource);
+  GLuint programID  = ProgramBinaryCache::Load(cacheKey);
+  if (programID != 0) return programID;
+
+  programID = glCreateProgram();
 
   if(programID == 0) LOG_ERROR("OpenGL Error: Unable to create program.\n");
 
@@ -159,16 +290,53 @@ GLuint Shader::CreateShader(const ShaderSource& shaderSource) {
 
   GLCall(glAttachShader(programID, vs));
   GLCall(glAttachShader(programID, fs));
+  GLCall(glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
   GLCall(glLinkProgram(programID));
 
   // Shaders are now linked to a program, so we no longer need them
   GLCall(glDeleteShader(vs));
   GLCall(glDeleteShader(fs));
 
+  if (CheckLinkStatus(programID)) ProgramBinaryCache::Store(cacheKey, programID);
   return programID;
 }
 
-GLuint Shader::CompileShader(GLenum shaderType, const std::string& source) {
+GLuint Shader::CreateComputeShader(const ShaderSource& shaderSource) {
+  uint64_t cacheKey = ProgramBinaryCache::ComputeKey(shaderSource);
+  GLuint programID  = ProgramBinaryCache::Load(cacheKey);
+  if (programID != 0) return programID;
+
+  programID = glCreateProgram();
+
+  if(programID == 0) LOG_ERROR("OpenGL Error: Unable to create program.\n");
+
+  GLuint cs = CompileShader(GL_COMPUTE_SHADER, shaderSource.computeShaderSource);
+
+  GLCall(glAttachShader(programID, cs));
+  GLCall(glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+  GLCall(glLinkProgram(programID));
+  GLCall(glDeleteShader(cs));
+
+  if (CheckLinkStatus(programID)) ProgramBinaryCache::Store(cacheKey, programID);
+  return programID;
+}
+
+bool Shader::CheckLinkStatus(GLuint programID) {
+  GLint linkStatus;
+  GLCall(glGetProgramiv(programID, GL_LINK_STATUS, &linkStatus));
+  if(linkStatus != GL_TRUE) {
+    GLchar log[512];
+    GLCall(glGetProgramInfoLog(programID, 512, nullptr, log));
+    const std::string& filepath = _computeShaderFilepath.empty() ? _vertexShaderFilepath : 
+      _computeShaderFilepath;
+    LOG_ERROR("Unable to link program: file: " + filepath + std::string(" \n") + std::string(log));
+    return false;
+  }
+
+  return true;
+}
+
+GLuint Shader::CompileShader(GLenum shaderType, const std::string& source, bool checkStatus) {
   GLuint shader = glCreateShader(shaderType);
 
   if(shader == 0) LOG_ERROR("OpenGL Error: Unable to create Shader.");
@@ -177,24 +345,262 @@ GLuint Shader::CompileShader(GLenum shaderType, const std::string& source) {
   GLCall(glShaderSource(shader, 1, &src, nullptr));
   GLCall(glCompileShader(shader));
 
+  if (checkStatus) CheckCompileStatus(shaderType, shader);
+  return shader;
+}
+
+bool Shader::CheckCompileStatus(GLenum shaderType, GLuint shader) {
   GLint compileStatus;
   GLCall(glGetShaderiv(shader, GL_COMPILE_STATUS, &compileStatus));
   if(compileStatus != GL_TRUE) {
     GLchar log[512];
     GLCall(glGetShaderInfoLog(shader, 512, nullptr, log));
-    LOG_ERROR("Unable to compile shader: file: " +
-      (shaderType == GL_VERTEX_SHADER ? _vertexShaderFilepath : _fragmentShaderFilepath) +
+    const std::string& filepath = shaderType == GL_VERTEX_SHADER ? _vertexShaderFilepath :
+      shaderType == GL_COMPUTE_SHADER ? _computeShaderFilepath : _fragmentShaderFilepath;
+    LOG_ERROR("Unable to compile shader: file: " + filepath +
       std::string(" \n") + std::string(log));
+    return false;
   }
 
-  return shader;
+  return true;
+}
+
+bool Shader::IsParallelCompileSupported() {
+  static const bool isSupported = []() {
+    bool hasKhr = false;
+    bool hasArb = false;
+    GLint numExtensions = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &numExtensions);
+    for (GLint i = 0; i < numExtensions; i++) {
+      const char* extension = (const char*)glGetStringi(GL_EXTENSIONS, i);
+      if (extension == nullptr) continue;
+      if (std::strcmp(extension, "GL_KHR_parallel_shader_compile") == 0) hasKhr = true;
+      if (std::strcmp(extension, "GL_ARB_parallel_shader_compile") == 0) hasArb = true;
+    }
+
+    // The default number of compiler threads is up to the driver, so ask for all of them
+#ifdef GL_KHR_parallel_shader_compile
+    if (hasKhr && glMaxShaderCompilerThreadsKHR != nullptr) glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+#endif
+    return hasKhr || hasArb;
+  }();
+
+  return isSupported;
+}
+
+bool Shader::UsesFile(const std::string& fileName) const {
+  for (const std::string* filepath : 
+    { &_vertexShaderFilepath, &_fragmentShaderFilepath, &_computeShaderFilepath }) {
+    if (!filepath->empty() && std::filesystem::path(*filepath).filename() == fileName) return true;
+  }
+  for (const std::string& filepath : _includedFiles) {
+    if (std::filesystem::path(filepath).filename() == fileName) return true;
+  }
+
+  return false;
+}
+
+bool Shader::SetFeatures(uint32_t features) {
+  features &= _usedFeatures;
+  if (features == _features) return false;
+
+  auto program = _programs.find(features);
+  if (program == _programs.end()) {
+    GLuint programID = CreateProgram(AddFeatureDefines(_shaderSource, features));
+    program = _programs.emplace(features, programID).first;
+  }
+
+  _programID = program->second;
+  _features  = features;
+  return true;
+}
+
+bool Shader::ReadSources(ShaderSource& shaderSource, std::vector<std::string>& includedFiles) {
+  if (!_computeShaderFilepath.empty()) {
+    return TryReadFile(_computeShaderFilepath, shaderSource.computeShaderSource) &&
+      ExpandIncludes(shaderSource.computeShaderSource, 
+        std::filesystem::path(_computeShaderFilepath).parent_path(), includedFiles);
+  }
+
+  std::vector<std::string> vsIncludes;
+  std::vector<std::string> fsIncludes;
+  bool readFiles = 
+    TryReadFile(_vertexShaderFilepath, shaderSource.vertexShaderSource) &&
+    TryReadFile(_fragmentShaderFilepath, shaderSource.fragmentShaderSource) &&
+    ExpandIncludes(shaderSource.vertexShaderSource, 
+      std::filesystem::path(_vertexShaderFilepath).parent_path(), vsIncludes) &&
+    ExpandIncludes(shaderSource.fragmentShaderSource, 
+      std::filesystem::path(_fragmentShaderFilepath).parent_path(), fsIncludes);
+  MergeIncludes(includedFiles, vsIncludes);
+  MergeIncludes(includedFiles, fsIncludes);
+  return readFiles;
+}
+
+ShaderSource Shader::AddFeatureDefines(const ShaderSource& shaderSource, uint32_t features) {
+  if (features == 0) return shaderSource;
+
+  std::string defines;
+  for (int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+    if (features & (1u << i)) defines += "#define " + std::string(FEATURE_DEFINES[i]) + "\n";
+  }
+
+  // The defines go right after #version, which must come first
+  ShaderSource definedSource = shaderSource;
+  for (std::string* source : { &definedSource.vertexShaderSource, 
+    &definedSource.fragmentShaderSource, &definedSource.computeShaderSource }) {
+    if (source->empty()) continue;
+
+    size_t version = source->find("#version");
+    size_t lineEnd = version == std::string::npos ? std::string::npos : source->find('\n', version);
+    if (lineEnd == std::string::npos) {
+      source->insert(0, defines + "#line 1\n");
+      continue;
+    }
+
+    int nextLine = (int)std::count(source->begin(), source->begin() + lineEnd, '\n') + 2;
+    source->insert(lineEnd + 1, defines + "#line " + std::to_string(nextLine) + "\n");
+  }
+
+  return definedSource;
+}
+
+uint32_t Shader::FindUsedFeatures(const ShaderSource& shaderSource) {
+  uint32_t usedFeatures = 0;
+  for (int i = 0; i < SHADER_FEATURE_COUNT; i++) {
+    for (const std::string* source : { &shaderSource.vertexShaderSource, 
+      &shaderSource.fragmentShaderSource, &shaderSource.computeShaderSource }) {
+      if (source->find(FEATURE_DEFINES[i]) != std::string::npos) usedFeatures |= 1u << i;
+    }
+  }
+
+  return usedFeatures;
+}
+
+GLuint Shader::CreateProgram(const ShaderSource& shaderSource) {
+  return _computeShaderFilepath.empty() ? CreateShader(shaderSource) : 
+    CreateComputeShader(shaderSource);
+}
+
+void Shader::Reload() {
+  DiscardPendingProgram();
+
+  bool isCompute = !_computeShaderFilepath.empty();
+  _pendingShaderSource = {};
+  _pendingIncludedFiles.clear();
+  if (!ReadSources(_pendingShaderSource, _pendingIncludedFiles)) {
+    LOG_ERROR("Unable to reload shader: " + (isCompute ? _computeShaderFilepath : 
+      _vertexShaderFilepath));
+    return;
+  }
+
+  // Rebuilds the current variant. The others are rebuilt when they're used again.
+  _pendingFeatures = _features & FindUsedFeatures(_pendingShaderSource);
+  ShaderSource shaderSource = AddFeatureDefines(_pendingShaderSource, _pendingFeatures);
+  _pendingCacheKey  = ProgramBinaryCache::ComputeKey(shaderSource);
+  _pendingProgramID = ProgramBinaryCache::Load(_pendingCacheKey);
+  if (_pendingProgramID != 0) return;
+
+  // Nothing here queries a status, so with parallel compilation none of it waits for the
+  // compiler
+  _pendingProgramID = glCreateProgram();
+  if (isCompute) {
+    _pendingShaders[0] = CompileShader(GL_COMPUTE_SHADER, shaderSource.computeShaderSource, false);
+  }
+  else {
+    _pendingShaders[0] = CompileShader(GL_VERTEX_SHADER, shaderSource.vertexShaderSource, false);
+    _pendingShaders[1] = CompileShader(GL_FRAGMENT_SHADER, shaderSource.fragmentShaderSource, 
+      false);
+  }
+
+  for (GLuint shader : _pendingShaders) {
+    if (shader != 0) {
+      GLCall(glAttachShader(_pendingProgramID, shader));
+    }
+  }
+  GLCall(glProgramParameteri(_pendingProgramID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE));
+  GLCall(glLinkProgram(_pendingProgramID));
+}
+
+Shader::ReloadStatus Shader::PollReload() {
+  if (_pendingProgramID == 0) return ReloadStatus::Idle;
+
+  if (IsParallelCompileSupported()) {
+    GLint isComplete = GL_FALSE;
+    GLCall(glGetProgramiv(_pendingProgramID, GL_COMPLETION_STATUS_KHR, &isComplete));
+    if (isComplete != GL_TRUE) return ReloadStatus::Pending;
+  }
+
+  GLint linkStatus;
+  GLCall(glGetProgramiv(_pendingProgramID, GL_LINK_STATUS, &linkStatus));
+  if (linkStatus != GL_TRUE) {
+    bool isCompute = !_computeShaderFilepath.empty();
+    if (_pendingShaders[0] != 0) {
+      CheckCompileStatus(isCompute ? GL_COMPUTE_SHADER : GL_VERTEX_SHADER, _pendingShaders[0]);
+    }
+    if (_pendingShaders[1] != 0) CheckCompileStatus(GL_FRAGMENT_SHADER, _pendingShaders[1]);
+    CheckLinkStatus(_pendingProgramID);
+
+    DiscardPendingProgram();
+    return ReloadStatus::Failed;
+  }
+
+  // Programs loaded from the cache have no shaders, and are already stored
+  if (_pendingShaders[0] != 0) ProgramBinaryCache::Store(_pendingCacheKey, _pendingProgramID);
+  for (GLuint& shader : _pendingShaders) {
+    if (shader != 0) {
+      GLCall(glDeleteShader(shader));
+    }
+    shader = 0;
+  }
+
+  // Every other variant was built from the previous sources
+  for (auto& program : _programs) {
+    GLCall(glDeleteProgram(program.second));
+  }
+  _programs.clear();
+
+  _programID     = _pendingProgramID;
+  _features      = _pendingFeatures;
+  _shaderSource  = std::move(_pendingShaderSource);
+  _includedFiles = std::move(_pendingIncludedFiles);
+  _usedFeatures  = FindUsedFeatures(_shaderSource);
+  _programs[_features] = _programID;
+  _pendingProgramID = 0;
+  return ReloadStatus::Swapped;
+}
+
+void Shader::DiscardPendingProgram() {
+  for (GLuint& shader : _pendingShaders) {
+    if (shader != 0) {
+      GLCall(glDeleteShader(shader));
+    }
+    shader = 0;
+  }
+
+  if (_pendingProgramID != 0) {
+    GLCall(glDeleteProgram(_pendingProgramID));
+  }
+  _pendingProgramID = 0;
 }
 
 GLint Shader::GetUniformLocation(const std::string& name, bool silentFail) {
   GLint location = glGetUniformLocation(this->_programID, name.c_str());
 
+  // Uniforms only used by code of other variants are compiled out of this one, which is fine
+  if(location == -1 && !silentFail && _usedFeatures != 0) {
+    std::string baseName = name.substr(0, name.find('['));
+    for(const std::string* source : { &_shaderSource.vertexShaderSource, 
+      &_shaderSource.fragmentShaderSource, &_shaderSource.computeShaderSource }) {
+      if(source->find(baseName) != std::string::npos) silentFail = true;
+    }
+  }
+
   // If uniform isn't found in program
-  if(location == -1 && !silentFail) LOG_ERROR("in shader " + _vertexShaderFilepath + " Unable to find uniform: " + name);
+  if(location == -1 && !silentFail) {
+    const std::string& filepath = _computeShaderFilepath.empty() ? _vertexShaderFilepath : 
+      _computeShaderFilepath;
+    LOG_ERROR("in shader " + filepath + " Unable to find uniform: " + name);
+  }
 
   return location;
 }
@@ -1,7 +1,10 @@
 #pragma once
 
+#include <cstdint>
 #include <string>
 #include <iostream>
+#include <unordered_map>
+#include <vector>
 
 #include <GL/glew.h>
 #include <GL/gl.h>
@@ -9,15 +12,53 @@
 struct ShaderSource {
 	std::string vertexShaderSource;
 	std::string fragmentShaderSource;
+	std::string computeShaderSource;
 };
 
+// Compile time switches of the shaders. Variants with a feature have its name #defined (e.g.
+// USE_PCF), so shaders select code with #ifdef instead of branching on a uniform.
+enum ShaderFeature : uint32_t {
+	SHADER_FEATURE_USE_ANISOTROPY_KERNEL = 1 << 0,
+	SHADER_FEATURE_TRANSPARENT_FLUID     = 1 << 1,
+	SHADER_FEATURE_USE_PCF               = 1 << 2,
+	SHADER_FEATURE_RENDER_SHADOWS        = 1 << 3,
+	SHADER_FEATURE_FILTER_1D             = 1 << 4,
+	SHADER_FEATURE_USE_REFRACTION_MASK   = 1 << 5
+};
+
+constexpr int SHADER_FEATURE_COUNT = 6;
+
 class Shader {
 public:
 	Shader(const std::string& vsFilepath, const std::string& fsFilepath);
+	// Compute program
+	explicit Shader(const std::string& csFilepath);
 	~Shader();
 
 	unsigned int programID() const { return (unsigned int)_programID; }
 
+	// Switches to the variant with the given features, building it the first time. Features the
+	// sources never mention are ignored, so they don't build duplicate variants. Returns true if
+	// the program changed, in which case uniforms and uniform block bindings must be set again.
+	bool SetFeatures(uint32_t features);
+	uint32_t GetFeatures() const { return _features; }
+
+	enum class ReloadStatus { Idle, Pending, Swapped, Failed };
+
+	// Rebuilds the program from its files, read again. With GL_KHR_parallel_shader_compile the
+	// driver builds it in the background, so this doesn't wait for the compiler. The current
+	// program stays in use until PollReload swaps the new one in.
+	void Reload();
+	// Swaps the rebuilt program in once it's ready. Uniforms and uniform block bindings are
+	// per program, so whoever set them must set them again. If the build failed, the errors are
+	// logged and the current program is kept.
+	ReloadStatus PollReload();
+	// Whether fileName (without directories) is one of the program's source files, or is
+	// included by them
+	bool UsesFile(const std::string& fileName) const;
+
+	static bool IsParallelCompileSupported();
+
 	void Bind();
 	void Unbind();
 
@@ -41,14 +82,40 @@ public:
 
 private:
 	GLuint _programID;
+	// With #includes expanded, but without the feature #defines
 	ShaderSource _shaderSource;
+	std::vector<std::string> _includedFiles;
+	uint32_t _usedFeatures = 0;
+	uint32_t _features = 0;
+	// Variants built so far, including the current one, by features
+	std::unordered_map<uint32_t, GLuint> _programs;
+
+	// Program being rebuilt by Reload, and its shaders, kept until it's done for their logs
+	GLuint _pendingProgramID = 0;
+	GLuint _pendingShaders[2] = { 0, 0 };
+	uint64_t _pendingCacheKey = 0;
+	uint32_t _pendingFeatures = 0;
+	ShaderSource _pendingShaderSource;
+	std::vector<std::string> _pendingIncludedFiles;
 
 	std::string _vertexShaderFilepath;
 	std::string _fragmentShaderFilepath;
+	std::string _computeShaderFilepath;
 
 	ShaderSource ParseShader(const std::string& vsFilepath, const std::string& fsFilepath);
+	std::string ReadFile(const std::string& filepath);
+	bool TryReadFile(const std::string& filepath, std::string& content);
+	// Reads the program's files and expands their #includes. Doesn't fail hard, for reloads.
+	bool ReadSources(ShaderSource& shaderSource, std::vector<std::string>& includedFiles);
+	static ShaderSource AddFeatureDefines(const ShaderSource& shaderSource, uint32_t features);
+	static uint32_t FindUsedFeatures(const ShaderSource& shaderSource);
+	GLuint CreateProgram(const ShaderSource& shaderSource);
 	GLuint CreateShader(const ShaderSource& shaderSource);
-	GLuint CompileShader(GLenum shaderType, const std::string& source);
+	GLuint CreateComputeShader(const ShaderSource& shaderSource);
+	GLuint CompileShader(GLenum shaderType, const std::string& source, bool checkStatus = true);
+	bool CheckCompileStatus(GLenum shaderType, GLuint shader);
+	bool CheckLinkStatus(GLuint programID);
+	void DiscardPendingProgram();
 	GLint GetUniformLocation(const std::string& name, bool silentFail);
 
 };
@@ -0,0 +1,448 @@
+#include "renderer/shard_driver.hpp"
+#include "utils/logger.h"
+#include "utils/mapped_file.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <yaml-cpp/yaml.h>
+
+#ifdef __linux__
+#include <cerrno>
+#include <fcntl.h>
+#include <poll.h>
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char** environ;
+#endif
+
+namespace fluidity
+{
+
+namespace
+{
+
+double GetTime()
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+std::string ReadSmallFile(const std::string& path)
+{
+  std::ifstream file(path);
+  std::stringstream contents;
+  contents << file.rdbuf();
+  return contents.str();
+}
+
+bool WriteSmallFile(const std::string& path, const std::string& contents)
+{
+  std::ofstream file(path);
+  file << contents;
+  file.close();
+  return !file.fail();
+}
+
+// Cgroup v2 directory of this process, if it can create child cgroups with the memory
+// controller. Empty otherwise.
+std::string FindMemoryCgroup()
+{
+  // The unified hierarchy is the "0::" line
+  std::stringstream cgroups(ReadSmallFile("/proc/self/cgroup"));
+  std::string line;
+  while (std::getline(cgroups, line))
+  {
+    if (line.rfind("0::", 0) != 0) continue;
+
+    std::string directory = "/sys/fs/cgroup" + line.substr(3);
+    std::stringstream controllers(ReadSmallFile(directory + "/cgroup.subtree_control"));
+    std::string controller;
+    while (controllers >> controller)
+    {
+      if (controller == "memory" && access(directory.c_str(), W_OK) == 0) return directory;
+    }
+  }
+  return "";
+}
+
+}
+
+ShardDriver::ShardDriver(const ShardSettings& settings)
+  : m_settings(settings)
+{ /* */ }
+
+void ShardDriver::SplitFrames()
+{
+  int numWorkers = std::clamp(m_settings.numWorkers, 1, std::max(m_settings.numFrames, 1));
+  m_workers = std::vector<Worker>(numWorkers);
+
+  // Contiguous shards, so each worker reads a contiguous run of frame files
+  int firstFrame = m_settings.firstFrame;
+  for (int i = 0; i < numWorkers; i++)
+  {
+    Worker& worker = m_workers[i];
+    worker.firstFrame = firstFrame;
+    worker.numFrames  = m_settings.numFrames / numWorkers + 
+      (i < m_settings.numFrames % numWorkers ? 1 : 0);
+    firstFrame += worker.numFrames;
+
+    std::filesystem::path manifestPath(m_settings.manifestPath);
+    manifestPath.replace_extension();
+    worker.manifestPath = manifestPath.string() + "_worker" + std::to_string(i) + ".yml";
+  }
+
+#ifdef __linux__
+  std::vector<int> cores;
+  cpu_set_t allowedCores;
+  if (sched_getaffinity(0, sizeof(allowedCores), &allowedCores) == 0)
+  {
+    for (int core = 0; core < CPU_SETSIZE; core++)
+    {
+      if (CPU_ISSET(core, &allowedCores)) cores.push_back(core);
+    }
+  }
+  if (cores.empty()) cores.push_back(0);
+
+  // With more workers than cores, cores are shared round robin
+  int coresPerWorker = std::max(1, (int)cores.size() / numWorkers);
+  for (int i = 0; i < numWorkers; i++)
+  {
+    for (int j = 0; j < coresPerWorker; j++)
+    {
+      m_workers[i].cores.push_back(cores[(i * coresPerWorker + j) % cores.size()]);
+    }
+  }
+#endif
+}
+
+void ShardDriver::SelectMemoryLimit()
+{
+#ifdef __linux__
+  m_memoryLimit = MemoryLimit::None;
+  if (m_settings.memoryBudget == 0) return;
+
+  m_cgroupRoot = FindMemoryCgroup();
+  if (!m_cgroupRoot.empty())
+  {
+    m_memoryLimit = MemoryLimit::Cgroup;
+    return;
+  }
+
+  m_memoryLimit = MemoryLimit::AddressSpace;
+  std::cerr << "Warning: No delegated cgroup memory controller, the worker memory budget " << 
+    "limits their address space instead, which needs generous headroom\n";
+#endif
+}
+
+bool ShardDriver::Run()
+{
+#ifdef __linux__
+  SplitFrames();
+  SelectMemoryLimit();
+  m_startTime = m_lastReportTime = GetTime();
+  std::cout << "Rendering frames " << m_settings.firstFrame << " to " << 
+    m_settings.firstFrame + m_settings.numFrames - 1 << " with " << m_workers.size() << 
+    " workers, " << m_workers[0].cores.size() << " cores each" << std::endl;
+
+  bool spawned = true;
+  for (int i = 0; i < (int)m_workers.size() && spawned; i++) spawned = Spawn(i);
+
+  for (;;)
+  {
+    std::vector<pollfd> outputs;
+    std::vector<int> workerIndices;
+    for (int i = 0; i < (int)m_workers.size(); i++)
+    {
+      if (m_workers[i].output < 0) continue;
+      outputs.push_back({ m_workers[i].output, POLLIN, 0 });
+      workerIndices.push_back(i);
+    }
+    if (outputs.empty()) break;
+
+    if (poll(outputs.data(), outputs.size(), 1000) < 0 && errno != EINTR)
+    {
+      LOG_ERROR(std::string("Unable to poll workers: ") + strerror(errno));
+      break;
+    }
+
+    for (size_t i = 0; i < outputs.size(); i++)
+    {
+      if (outputs[i].revents == 0) continue;
+
+      char buffer[4096];
+      ssize_t size = read(outputs[i].fd, buffer, sizeof(buffer));
+      if (size > 0) ProcessOutput(workerIndices[i], buffer, size);
+      else if (size == 0 || errno != EINTR)
+      {
+        // The worker closed its output, which it only does by exiting
+        close(outputs[i].fd);
+        m_workers[workerIndices[i]].output = -1;
+        Reap(workerIndices[i]);
+      }
+    }
+    ReportProgress(false);
+  }
+
+  for (int i = 0; i < (int)m_workers.size(); i++)
+  {
+    if (m_workers[i].pid > 0) Reap(i);
+  }
+  ReportProgress(true);
+
+  double seconds = GetTime() - m_startTime;
+  bool succeeded = spawned;
+  for (size_t i = 0; i < m_workers.size(); i++)
+  {
+    const Worker& worker = m_workers[i];
+    succeeded = succeeded && worker.exitStatus == 0;
+    std::cout << "Worker " << i << ": frames " << worker.firstFrame << " to " << 
+      worker.firstFrame + worker.numFrames - 1 << ", exit status " << worker.exitStatus << 
+      ", " << worker.seconds << " s, " << worker.cpuSeconds << " s CPU, " << 
+      worker.maxResidentMegabytes << " MB peak\n";
+    if (!worker.summary.empty()) std::cout << "  " << worker.summary << "\n";
+  }
+  std::cout << "Rendered " << m_settings.numFrames << " frames with " << m_workers.size() << 
+    " workers in " << seconds << " s (" << m_settings.numFrames / seconds << " fps)" << 
+    std::endl;
+
+  if (!m_settings.manifestPath.empty() && !WriteManifest(seconds)) return false;
+  return succeeded;
+#else
+  LOG_ERROR("Sharded renders are only supported on Linux.");
+  return false;
+#endif
+}
+
+bool ShardDriver::Spawn(int index)
+{
+#ifdef __linux__
+  Worker& worker = m_workers[index];
+
+  // Everything the child needs is prepared before forking, since only async signal safe
+  // calls may be made between fork and exec
+  std::vector<std::string> arguments = { m_settings.executable };
+  arguments.insert(arguments.end(), m_settings.arguments.begin(), m_settings.arguments.end());
+  arguments.insert(arguments.end(), { "--shard", std::to_string(worker.firstFrame), 
+    std::to_string(worker.numFrames), "--manifest", worker.manifestPath });
+  std::vector<char*> argv;
+  for (auto& argument : arguments) argv.push_back(argument.data());
+  argv.push_back(nullptr);
+
+  std::vector<std::string> environment;
+  for (char** variable = environ; *variable != nullptr; variable++)
+  {
+    environment.push_back(*variable);
+  }
+  if (getenv("LP_NUM_THREADS") == nullptr)
+  {
+    environment.push_back("LP_NUM_THREADS=" + std::to_string(worker.cores.size()));
+  }
+  std::vector<char*> envp;
+  for (auto& variable : environment) envp.push_back(variable.data());
+  envp.push_back(nullptr);
+
+  cpu_set_t cores;
+  CPU_ZERO(&cores);
+  for (int core : worker.cores) CPU_SET(core, &cores);
+  rlimit memoryLimit = { (rlim_t)m_settings.memoryBudget, (rlim_t)m_settings.memoryBudget };
+
+  // The child moves itself into its cgroup by writing 0 to cgroup.procs, before it execs
+  int cgroupProcs = -1;
+  if (m_memoryLimit == MemoryLimit::Cgroup)
+  {
+    worker.cgroupPath = m_cgroupRoot + "/fluidity-worker-" + std::to_string(getpid()) + "-" + 
+      std::to_string(index);
+    if (mkdir(worker.cgroupPath.c_str(), 0755) != 0 && errno != EEXIST)
+    {
+      LOG_ERROR("Unable to create worker cgroup " + worker.cgroupPath + ": " + strerror(errno));
+      worker.cgroupPath.clear();
+      return false;
+    }
+    // Swapping would only hide the limit
+    WriteSmallFile(worker.cgroupPath + "/memory.swap.max", "0");
+    cgroupProcs = open((worker.cgroupPath + "/cgroup.procs").c_str(), O_WRONLY | O_CLOEXEC);
+    if (!WriteSmallFile(worker.cgroupPath + "/memory.max", 
+      std::to_string(m_settings.memoryBudget)) || cgroupProcs < 0)
+    {
+      LOG_ERROR("Unable to set up worker cgroup " + worker.cgroupPath);
+      if (cgroupProcs >= 0) close(cgroupProcs);
+      rmdir(worker.cgroupPath.c_str());
+      return false;
+    }
+  }
+
+  // Close on exec, so later workers don't inherit the outputs of earlier ones
+  int output[2];
+  if (pipe2(output, O_CLOEXEC) != 0)
+  {
+    LOG_ERROR(std::string("Unable to create worker pipe: ") + strerror(errno));
+    if (cgroupProcs >= 0) close(cgroupProcs);
+    if (!worker.cgroupPath.empty()) rmdir(worker.cgroupPath.c_str());
+    return false;
+  }
+
+  fflush(stdout);
+  pid_t pid = fork();
+  if (pid == 0)
+  {
+    dup2(output[1], STDOUT_FILENO);
+    if (m_settings.pinCores) sched_setaffinity(0, sizeof(cores), &cores);
+    if (cgroupProcs >= 0 && write(cgroupProcs, "0", 1) != 1) _exit(126);
+    if (m_memoryLimit == MemoryLimit::AddressSpace) setrlimit(RLIMIT_AS, &memoryLimit);
+    execve(argv[0], argv.data(), envp.data());
+    _exit(127);
+  }
+
+  close(output[1]);
+  if (cgroupProcs >= 0) close(cgroupProcs);
+  if (pid < 0)
+  {
+    LOG_ERROR(std::string("Unable to start worker: ") + strerror(errno));
+    close(output[0]);
+    if (!worker.cgroupPath.empty()) rmdir(worker.cgroupPath.c_str());
+    return false;
+  }
+
+  worker.pid    = pid;
+  worker.output = output[0];
+  return true;
+#else
+  return false;
+#endif
+}
+
+void ShardDriver::ProcessOutput(int index, const char* data, size_t size)
+{
+  Worker& worker = m_workers[index];
+  worker.pendingOutput.append(data, size);
+
+  size_t lineEnd;
+  while ((lineEnd = worker.pendingOutput.find('\n')) != std::string::npos)
+  {
+    std::string line = worker.pendingOutput.substr(0, lineEnd);
+    worker.pendingOutput.erase(0, lineEnd + 1);
+
+    // Progress lines are folded into the overall progress (see BatchRenderer)
+    int numFramesDone;
+    if (sscanf(line.c_str(), "Progress: %d/", &numFramesDone) == 1)
+    {
+      worker.numFramesDone = numFramesDone;
+      continue;
+    }
+    if (line.rfind("Rendered ", 0) == 0) worker.summary = line;
+    std::cout << "[worker " << index << "] " << line << "\n";
+  }
+}
+
+void ShardDriver::Reap(int index)
+{
+#ifdef __linux__
+  Worker& worker = m_workers[index];
+  int status = 0;
+  rusage usage = {};
+  if (wait4(worker.pid, &status, 0, &usage) < 0) return;
+
+  worker.pid = -1;
+  worker.seconds = GetTime() - m_startTime;
+  worker.exitStatus = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+  worker.cpuSeconds = usage.ru_utime.tv_sec + usage.ru_utime.tv_usec / 1e6 + 
+    usage.ru_stime.tv_sec + usage.ru_stime.tv_usec / 1e6;
+  // In kilobytes on Linux
+  worker.maxResidentMegabytes = usage.ru_maxrss / 1024.0;
+
+  // Workers report failed allocations themselves, the cgroup counts the ones it OOM killed
+  worker.outOfMemory = worker.exitStatus == OUT_OF_MEMORY_EXIT_STATUS;
+  if (!worker.cgroupPath.empty())
+  {
+    std::stringstream events(ReadSmallFile(worker.cgroupPath + "/memory.events"));
+    std::string event;
+    long long count;
+    while (events >> event >> count)
+    {
+      if (event == "oom_kill" && count > 0) worker.outOfMemory = true;
+    }
+    rmdir(worker.cgroupPath.c_str());
+  }
+
+  if (worker.exitStatus != 0)
+  {
+    std::cerr << "Error: Worker " << index << " (frames " << worker.firstFrame << " to " << 
+      worker.firstFrame + worker.numFrames - 1 << ") failed with status " << 
+      worker.exitStatus << (worker.outOfMemory ? ", out of memory" : "") << "\n";
+  }
+#endif
+}
+
+void ShardDriver::ReportProgress(bool force)
+{
+  double now = GetTime();
+  if (!force && now - m_lastReportTime < 1.0) return;
+
+  m_lastReportTime = now;
+  int numFramesDone = 0;
+  for (const auto& worker : m_workers) numFramesDone += worker.numFramesDone;
+  std::cout << "Progress: " << numFramesDone << "/" << m_settings.numFrames << " frames, " << 
+    numFramesDone / (now - m_startTime) << " fps" << std::endl;
+}
+
+bool ShardDriver::WriteManifest(double seconds)
+{
+  YAML::Emitter out;
+  out << YAML::BeginMap;
+  out << YAML::Key << "FirstFrame" << YAML::Value << m_settings.firstFrame;
+  out << YAML::Key << "NumFrames" << YAML::Value << m_settings.numFrames;
+  out << YAML::Key << "Seconds" << YAML::Value << seconds;
+  const char* memoryLimitNames[] = { "none", "cgroup", "address space" };
+  out << YAML::Key << "MemoryLimit" << YAML::Value << memoryLimitNames[(int)m_memoryLimit];
+  if (m_memoryLimit != MemoryLimit::None)
+  {
+    out << YAML::Key << "MemoryBudgetMB" << YAML::Value << (m_settings.memoryBudget >> 20);
+  }
+  out << YAML::Key << "Workers" << YAML::Value << YAML::BeginSeq;
+  for (const auto& worker : m_workers)
+  {
+    out << YAML::BeginMap;
+    out << YAML::Key << "FirstFrame" << YAML::Value << worker.firstFrame;
+    out << YAML::Key << "NumFrames" << YAML::Value << worker.numFrames;
+    out << YAML::Key << "Cores" << YAML::Value << YAML::Flow << worker.cores;
+    out << YAML::Key << "ExitStatus" << YAML::Value << worker.exitStatus;
+    out << YAML::Key << "OutOfMemory" << YAML::Value << worker.outOfMemory;
+    out << YAML::Key << "Seconds" << YAML::Value << worker.seconds;
+    out << YAML::Key << "CpuSeconds" << YAML::Value << worker.cpuSeconds;
+    out << YAML::Key << "MaxResidentMB" << YAML::Value << worker.maxResidentMegabytes;
+
+    // Workers that died early may not have written theirs
+    std::vector<std::string> files;
+    try
+    {
+      YAML::Node manifest = YAML::LoadFile(worker.manifestPath);
+      if (manifest["Failed"])
+      {
+        out << YAML::Key << "Failed" << YAML::Value << manifest["Failed"].as<int>();
+      }
+      if (manifest["Files"]) files = manifest["Files"].as<std::vector<std::string>>();
+      std::filesystem::remove(worker.manifestPath);
+    }
+    catch (const std::exception& e)
+    {
+      LOG_WARNING("Unable to read worker manifest " + worker.manifestPath + ": " + e.what());
+    }
+    out << YAML::Key << "Files" << YAML::Value << files;
+    out << YAML::EndMap;
+  }
+  out << YAML::EndSeq;
+  out << YAML::EndMap;
+
+  return WriteFileAtomically(m_settings.manifestPath, out.c_str(), out.size());
+}
+
+}
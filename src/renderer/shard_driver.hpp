@@ -0,0 +1,98 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+struct ShardSettings
+{
+  // Every worker runs the executable with these arguments, followed by 
+  // --shard FIRST COUNT and --manifest PATH
+  std::string executable = "/proc/self/exe";
+  std::vector<std::string> arguments;
+  int firstFrame = 0;
+  int numFrames  = 0;
+  int numWorkers = 1;
+  // Pins each worker to its own share of the cores the driver may run on
+  bool pinCores = false;
+  // Memory limit of each worker, in bytes. 0 is unlimited. Enforced on the memory workers
+  // actually use through a cgroup (memory.max), when the driver's cgroup delegates the memory
+  // controller. Otherwise it falls back to an address space limit (RLIMIT_AS), which also counts
+  // what llvmpipe, thread stacks and malloc arenas reserve without touching, so the budget
+  // needs generous headroom over the resident size.
+  size_t memoryBudget = 0;
+  // Worker manifests (see BatchRenderSettings::manifestPath) are merged into this one
+  std::string manifestPath;
+};
+
+// Splits a frame range of an offline render into contiguous shards, rendered by worker
+// processes in parallel, each with its own OpenGL context and only its frames loaded.
+// Software rasterizers such as llvmpipe barely scale past a single context, so processes
+// are what keeps every core of a large machine busy. Each worker's llvmpipe thread count is
+// set to its share of the cores, unless LP_NUM_THREADS is set already.
+// The driver parses the workers' progress into an overall report, forwards the rest of
+// their standard output, and collects their timings and manifests. Linux only.
+class ShardDriver
+{
+public:
+  explicit ShardDriver(const ShardSettings& settings);
+  ShardDriver(const ShardDriver&) = delete;
+
+  // Returns false if any worker failed
+  bool Run();
+
+  // Workers exit with this status when an allocation fails
+  static constexpr int OUT_OF_MEMORY_EXIT_STATUS = 9;
+
+private:
+  enum class MemoryLimit
+  {
+    None,
+    Cgroup,
+    AddressSpace
+  };
+
+  struct Worker
+  {
+    int firstFrame = 0;
+    int numFrames  = 0;
+    std::vector<int> cores;
+    std::string manifestPath;
+
+    int pid    = -1;
+    int output = -1;
+    std::string pendingOutput;
+    int numFramesDone = 0;
+    std::string summary;
+
+    // Only set with MemoryLimit::Cgroup
+    std::string cgroupPath;
+
+    int exitStatus     = -1;
+    bool outOfMemory   = false;
+    double seconds     = 0.0;
+    double cpuSeconds  = 0.0;
+    double maxResidentMegabytes = 0.0;
+  };
+
+  void SplitFrames();
+  void SelectMemoryLimit();
+  bool Spawn(int index);
+  void ProcessOutput(int index, const char* data, size_t size);
+  void Reap(int index);
+  // Prints progress at most once a second, unless forced
+  void ReportProgress(bool force);
+  bool WriteManifest(double seconds);
+
+  ShardSettings m_settings;
+  std::vector<Worker> m_workers;
+  MemoryLimit m_memoryLimit = MemoryLimit::None;
+  // Cgroup the workers' cgroups are created in, with the memory controller enabled
+  std::string m_cgroupRoot;
+  double m_startTime = 0.0;
+  double m_lastReportTime = 0.0;
+};
+
+}
@@ -1,10 +1,17 @@
 #include "renderer/skybox.hpp"
+#include "renderer/skybox_cache.hpp"
 #include "utils/logger.h"
 #include "utils/glcall.h"
 #include "utils/opengl_utils.hpp"
+#include "utils/parallel_for.hpp"
+#include "utils/profiler.hpp"
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
 #include <vector>
 
 namespace fluidity
@@ -13,10 +20,148 @@ Skybox::Skybox(const std::string& folderPath)
     : m_folderPath(folderPath)
 { /* */ }
 
+namespace
+{
+
+uint16_t FloatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(float));
+    uint32_t sign     = (bits >> 16) & 0x8000;
+    uint32_t mantissa = bits & 0x7FFFFF;
+    int exponent      = (int)((bits >> 23) & 0xFF) - 127 + 15;
+
+    // Infinity and NaN
+    if (((bits >> 23) & 0xFF) == 0xFF) return sign | 0x7C00 | (mantissa != 0 ? 0x200 : 0);
+    // Too large values are clamped to the largest half
+    if (exponent >= 31) return sign | 0x7BFF;
+    if (exponent <= 0)
+    {
+        if (exponent < -10) return sign;
+
+        // Denormal
+        mantissa |= 0x800000;
+        uint32_t shift = 14 - exponent;
+        uint32_t half  = mantissa >> shift;
+        if ((mantissa >> (shift - 1)) & 1) half++;
+        return sign | half;
+    }
+
+    // Rounding may carry into the exponent, which is still the right result
+    uint32_t half = sign | (exponent << 10) | (mantissa >> 13);
+    if (mantissa & 0x1000) half++;
+    return half;
+}
+
+// HDR images are converted to half floats, the others to RGB bytes
+bool DecodeFace(const std::string& filePath, int& width, int& height, bool& hdr,
+    std::vector<unsigned char>& pixels)
+{
+    int nChannels;
+    hdr = stbi_is_hdr(filePath.c_str());
+    if (hdr)
+    {
+        float* data = stbi_loadf(filePath.c_str(), &width, &height, &nChannels, 3);
+        if (data == nullptr) return false;
+
+        size_t numValues = (size_t)width * height * 3;
+        pixels.resize(numValues * sizeof(uint16_t));
+        uint16_t* halfs = reinterpret_cast<uint16_t*>(pixels.data());
+        for (size_t i = 0; i < numValues; i++) halfs[i] = FloatToHalf(data[i]);
+        stbi_image_free(data);
+        return true;
+    }
+
+    unsigned char* data = stbi_load(filePath.c_str(), &width, &height, &nChannels, 3);
+    if (data == nullptr) return false;
+
+    pixels.assign(data, data + (size_t)width * height * 3);
+    stbi_image_free(data);
+    return true;
+}
+
+}
+
+bool Skybox::LoadFaces()
+{
+    PROFILE_SCOPE("Skybox::LoadFaces");
+    const char* faceNames[6] = { "right", "left", "top", "bottom", "front", "back" };
+    const char* extensions[] = { ".jpg", ".png", ".hdr" };
+
+    std::vector<std::string> facePaths;
+    for (const char* faceName : faceNames)
+    {
+        std::string facePath;
+        for (const char* extension : extensions)
+        {
+            std::string candidatePath = m_folderPath + "/" + faceName + extension;
+            if (std::filesystem::exists(candidatePath))
+            {
+                facePath = candidatePath;
+                break;
+            }
+        }
+
+        if (facePath.empty())
+        {
+            LOG_ERROR("Unable to find skybox face: " + m_folderPath + "/" + faceName);
+            return false;
+        }
+        facePaths.push_back(facePath);
+    }
+
+    auto faces = std::make_shared<SkyboxFaces>();
+    uint64_t cacheKey = SkyboxCache::ComputeKey(facePaths);
+    if (cacheKey != 0 && SkyboxCache::Load(cacheKey, *faces))
+    {
+        m_faces = faces;
+        return true;
+    }
+
+    int widths[6], heights[6];
+    bool hdr[6];
+    std::atomic<bool> failed(false);
+    {
+        PROFILE_SCOPE("Skybox::DecodeFaces");
+        ParallelFor(6, [&](unsigned i) {
+            if (!DecodeFace(facePaths[i], widths[i], heights[i], hdr[i], faces->pixels[i]))
+            {
+                LOG_ERROR("Unable to load image: " + facePaths[i]);
+                failed = true;
+            }
+        });
+    }
+    if (failed) return false;
+
+    faces->size = widths[0];
+    faces->hdr  = hdr[0];
+    for (int i = 0; i < 6; i++)
+    {
+        if (widths[i] != faces->size || heights[i] != faces->size || hdr[i] != faces->hdr)
+        {
+            LOG_ERROR("Skybox faces must be square, and all the same size and type: " +
+                m_folderPath);
+            return false;
+        }
+    }
+
+    if (cacheKey != 0) SkyboxCache::Store(cacheKey, *faces);
+    m_faces = faces;
+    return true;
+}
+
 bool Skybox::Init()
 {
+    PROFILE_SCOPE("Skybox::Init");
+    if ((m_faces == nullptr || m_faces->size == 0) && !LoadFaces()) return false;
+
+    GLenum internalFormat = m_faces->hdr ? GL_RGB16F : GL_RGB8;
+    GLenum type           = m_faces->hdr ? GL_HALF_FLOAT : GL_UNSIGNED_BYTE;
+    size_t faceSize       = m_faces->GetFaceSize();
+
     GLCall(glGenTextures(1, &m_id));
     GLCall(glBindTexture(GL_TEXTURE_CUBE_MAP, m_id));
+    GLCall(glTexStorage2D(GL_TEXTURE_CUBE_MAP, 1, internalFormat, m_faces->size, m_faces->size));
 
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -24,36 +169,46 @@ bool Skybox::Init()
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);  
 
-    std::vector<std::string> faces =
-    {
-        "right.jpg",
-        "left.jpg",
-        "top.jpg",
-        "bottom.jpg",
-        "front.jpg",
-        "back.jpg"
-    };
+    // The faces are copied (in parallel) into a pixel buffer, and the texture is filled from
+    // it, so the driver transfers them asynchronously instead of stalling in glTexSubImage2D
+    GLuint pixelBuffer;
+    GLCall(glGenBuffers(1, &pixelBuffer));
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, pixelBuffer));
+    GLCall(glBufferData(GL_PIXEL_UNPACK_BUFFER, faceSize * 6, nullptr, GL_STREAM_DRAW));
 
-    // Load textures
-    int width, height, nChannels;
-
-    for (int i = 0; i < faces.size(); i++)
+    char* mappedBuffer;
+    GLCall(mappedBuffer = (char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, faceSize * 6,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (mappedBuffer != nullptr)
     {
-        unsigned char* data = stbi_load((m_folderPath + "/" + faces[i]).c_str(),
-            &width, &height, &nChannels, 0);
-        
-        if (data == nullptr) 
-        {
-            LOG_ERROR("Unable to load image: " + m_folderPath + "/" + faces[i]);
-            // TODO: Clean up before leaving
-            return false;
-        }
+        ParallelFor(6, [&](unsigned i) {
+            std::memcpy(mappedBuffer + faceSize * i, m_faces->pixels[i].data(), faceSize);
+        });
+    }
+    GLboolean unmapped;
+    GLCall(unmapped = glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER));
+    if (mappedBuffer == nullptr || !unmapped)
+    {
+        LOG_ERROR("Unable to upload skybox: " + m_folderPath);
+        GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+        GLCall(glDeleteBuffers(1, &pixelBuffer));
+        GLCall(glDeleteTextures(1, &m_id));
+        return false;
+    }
 
-        GLCall(glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGB, 
-            width, height, 0, GL_RGB, GL_UNSIGNED_BYTE, data));
-        
-        free(data);
+    // Rows of RGB bytes aren't 4 byte aligned in general
+    GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 1));
+    for (int i = 0; i < 6; i++)
+    {
+        GLCall(glTexSubImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, 0, 0, m_faces->size, 
+            m_faces->size, GL_RGB, type, (const void*)(faceSize * i)));
     }
+    GLCall(glPixelStorei(GL_UNPACK_ALIGNMENT, 4));
+
+    // Deleting the buffer doesn't wait for the transfer, the driver keeps it until then
+    GLCall(glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0));
+    GLCall(glDeleteBuffers(1, &pixelBuffer));
+    *m_faces = SkyboxFaces();
 
     glBindTexture(GL_TEXTURE_CUBE_MAP, 0);
 
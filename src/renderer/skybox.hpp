@@ -1,16 +1,36 @@
 #pragma once
+#include <memory>
 #include <string>
+#include <vector>
 #include <GL/glew.h>
 
 namespace fluidity
 {
 
+// Decoded faces, in the cubemap's face order (+X, -X, +Y, -Y, +Z, -Z)
+struct SkyboxFaces
+{
+    // Faces are square
+    int size = 0;
+    // HDR faces are stored as RGB half floats, the others as RGB bytes
+    bool hdr = false;
+    std::vector<unsigned char> pixels[6];
+
+    size_t GetFaceSize() const { return (size_t)size * size * 3 * (hdr ? 2 : 1); }
+};
+
 class Skybox
 {
 public:
     Skybox() = default;
     Skybox(const std::string& folderPath);
     void SetFolderPath(const std::string& folderPath) { m_folderPath = folderPath; };
+    // Decodes the faces' images (right, left, top, bottom, front and back, each a .jpg, .png
+    // or .hdr file) in parallel, or reads them from the SkyboxCache. Doesn't use OpenGL, so it
+    // can run on another thread.
+    bool LoadFaces();
+    // Uploads the faces, loading them first if LoadFaces hasn't been called.
+    // Requires an active OpenGL context.
     bool Init();
     bool CleanUp();
 
@@ -21,6 +41,8 @@ public:
 
 private:
     std::string m_folderPath;
+    // Shared by copies of the skybox, and emptied once uploaded
+    std::shared_ptr<SkyboxFaces> m_faces;
     GLuint m_id;
     GLuint m_vao;
     GLuint m_vbo;
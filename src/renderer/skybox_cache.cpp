@@ -0,0 +1,116 @@
+#include "renderer/skybox_cache.hpp"
+#include "renderer/pass_input_hash.hpp"
+#include "utils/logger.h"
+#include "utils/mapped_file.hpp"
+#include "utils/parallel_for.hpp"
+#include "utils/profiler.hpp"
+#include <cstring>
+#include <filesystem>
+#include <iomanip>
+#include <sstream>
+
+namespace fluidity
+{
+
+std::string SkyboxCache::s_directory = "../../cache/skyboxes";
+
+namespace
+{
+
+constexpr char MAGIC[8] = { 'F', 'L', 'S', 'K', 'Y', 'B', 'O', 'X' };
+
+struct FileHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t size;
+    uint64_t key;
+    uint32_t hdr;
+    uint32_t padding;
+};
+
+}
+
+uint64_t SkyboxCache::ComputeKey(const std::vector<std::string>& facePaths)
+{
+    PassInputHash hash;
+    hash.Add(VERSION);
+    for (const auto& facePath : facePaths)
+    {
+        std::error_code error;
+        std::filesystem::path path = std::filesystem::absolute(facePath, error);
+        uint64_t fileSize = std::filesystem::file_size(path, error);
+        if (error) return 0;
+        int64_t lastWriteTime = std::filesystem::last_write_time(path, error)
+            .time_since_epoch().count();
+        if (error) return 0;
+
+        std::string pathString = path.generic_string();
+        hash.Add(pathString.data(), pathString.size()).Add(fileSize).Add(lastWriteTime);
+    }
+
+    // 0 means no key
+    return hash.Get() != 0 ? hash.Get() : 1;
+}
+
+std::string SkyboxCache::GetEntryPath(uint64_t key)
+{
+    std::stringstream fileName;
+    fileName << std::hex << std::setw(16) << std::setfill('0') << key << ".skybox";
+    return (std::filesystem::path(s_directory) / fileName.str()).string();
+}
+
+bool SkyboxCache::Load(uint64_t key, SkyboxFaces& faces)
+{
+    PROFILE_SCOPE("SkyboxCache::Load");
+    MappedFile file;
+    if (!file.Open(GetEntryPath(key))) return false;
+
+    FileHeader header;
+    if (file.GetSize() < sizeof(FileHeader)) return false;
+    std::memcpy(&header, file.GetData(), sizeof(FileHeader));
+
+    SkyboxFaces loaded;
+    loaded.size = header.size;
+    loaded.hdr  = header.hdr != 0;
+    size_t faceSize = loaded.GetFaceSize();
+    if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+        header.key != key || file.GetSize() != sizeof(FileHeader) + faceSize * 6)
+    {
+        LOG_WARNING("Invalid skybox cache entry: " + GetEntryPath(key));
+        return false;
+    }
+
+    // Reading the pages in parallel keeps more of them in flight
+    const char* data = file.GetData() + sizeof(FileHeader);
+    ParallelFor(6, [&](unsigned i) {
+        loaded.pixels[i].assign(data + faceSize * i, data + faceSize * (i + 1));
+    });
+
+    faces = std::move(loaded);
+    return true;
+}
+
+bool SkyboxCache::Store(uint64_t key, const SkyboxFaces& faces)
+{
+    PROFILE_SCOPE("SkyboxCache::Store");
+    size_t faceSize = faces.GetFaceSize();
+    for (const auto& pixels : faces.pixels)
+    {
+        if (pixels.size() != faceSize) return false;
+    }
+
+    FileHeader header = {};
+    std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    header.version = VERSION;
+    header.size    = faces.size;
+    header.key     = key;
+    header.hdr     = faces.hdr ? 1 : 0;
+
+    std::vector<FileChunk> chunks = { { &header, sizeof(FileHeader) } };
+    for (const auto& pixels : faces.pixels) chunks.push_back({ pixels.data(), faceSize });
+
+    return WriteFileAtomically(GetEntryPath(key), chunks);
+}
+
+}
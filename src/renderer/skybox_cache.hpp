@@ -0,0 +1,37 @@
+#pragma once
+#include "renderer/skybox.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+// Binary cache of decoded skybox faces, so opening a skybox again skips decoding its images.
+// An entry is one file: a header followed by the six faces, in the layout they're uploaded in
+// (RGB bytes, or RGB half floats for HDR skyboxes, half the size of the floats decoded).
+class SkyboxCache
+{
+public:
+    // Hashes the faces' paths, sizes and modification times rather than their contents, since
+    // reading every face just to look the skybox up would cost a good part of decoding it.
+    // Returns 0 if a face can't be found.
+    static uint64_t ComputeKey(const std::vector<std::string>& facePaths);
+
+    // Returns false on a miss, or if the entry is invalid
+    static bool Load(uint64_t key, SkyboxFaces& faces);
+    static bool Store(uint64_t key, const SkyboxFaces& faces);
+
+    static void SetDirectory(const std::string& directory) { s_directory = directory; }
+    static const std::string& GetDirectory() { return s_directory; }
+
+    // Must be incremented whenever the decoding or the file layout changes
+    static constexpr uint32_t VERSION = 1;
+
+private:
+    static std::string GetEntryPath(uint64_t key);
+
+    static std::string s_directory;
+};
+
+}
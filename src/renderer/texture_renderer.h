@@ -18,6 +18,7 @@ public:
     auto Render() -> void override;
 
     auto SetTexture(GLuint texture) { m_currentTexture = texture; }
+    auto GetTexture() const -> GLuint { return m_currentTexture; }
     auto SetGammaCorrectionEnabled(bool status) -> void;
 
 private:
@@ -42,7 +42,7 @@ bool Window::Init() {
   }
 
   _windowHndl = SDL_CreateWindow(_title, SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 
-		                _windowedWidth, _windowedHeight, SDL_WINDOW_OPENGL);
+		                _windowedWidth, _windowedHeight, SDL_WINDOW_OPENGL | SDL_WINDOW_RESIZABLE);
 
   if(_windowHndl == nullptr) {
     LOG_ERROR("Unable to create window. " + std::string(SDL_GetError()));
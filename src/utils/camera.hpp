@@ -23,6 +23,9 @@ namespace fluidity
 
     const float GetFOV() const { return m_fov; };
     void SetFOV(float fov) { m_fov = fov; }
+
+    float GetAspectRatio() const { return m_aspectRatio; }
+    void SetAspectRatio(float aspectRatio) { m_aspectRatio = aspectRatio; }
     
     const float GetYaw() const { return m_yaw; }
     void  SetYaw(float yaw) { m_yaw = yaw; }
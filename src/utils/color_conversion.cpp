@@ -0,0 +1,163 @@
+#include "utils/color_conversion.hpp"
+#include "utils/profiler.hpp"
+#include <algorithm>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define FLUIDITY_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace fluidity
+{
+
+namespace
+{
+
+// Fixed point (8 fractional bits) BT.601 studio swing coefficients
+constexpr int Y_R =  66, Y_G = 129, Y_B =  25;
+constexpr int U_R = -38, U_G = -74, U_B = 112;
+constexpr int V_R = 112, V_G = -94, V_B = -18;
+
+inline uint8_t Luma(const uint8_t* p)
+{
+  return (uint8_t)(((Y_R * p[0] + Y_G * p[1] + Y_B * p[2] + 128) >> 8) + 16);
+}
+
+inline uint8_t Average(uint8_t a, uint8_t b)
+{
+  return (uint8_t)((a + b + 1) >> 1);
+}
+
+// Rounds the same way as the vector path: rows first, then columns
+void Chroma(const uint8_t* row0, const uint8_t* row1, int x0, int x1, uint8_t& u, uint8_t& v)
+{
+  int c[3];
+  for (int i = 0; i < 3; i++)
+  {
+    c[i] = Average(Average(row0[4 * x0 + i], row1[4 * x0 + i]), 
+      Average(row0[4 * x1 + i], row1[4 * x1 + i]));
+  }
+
+  u = (uint8_t)(((U_R * c[0] + U_G * c[1] + U_B * c[2] + 128) >> 8) + 128);
+  v = (uint8_t)(((V_R * c[0] + V_G * c[1] + V_B * c[2] + 128) >> 8) + 128);
+}
+
+#ifdef FLUIDITY_USE_SSE2
+// Sums the two 32-bit halves of each pixel's dot product: [a0+a1, a2+a3, b0+b1, b2+b3]
+inline __m128i SumPairs(__m128i a, __m128i b)
+{
+  __m128 af = _mm_castsi128_ps(a), bf = _mm_castsi128_ps(b);
+  return _mm_add_epi32(_mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(2, 0, 2, 0))),
+    _mm_castps_si128(_mm_shuffle_ps(af, bf, _MM_SHUFFLE(3, 1, 3, 1))));
+}
+
+// Four 32-bit values, packed into four bytes
+inline uint32_t PackBytes(__m128i values)
+{
+  __m128i shorts = _mm_packs_epi32(values, values);
+  return (uint32_t)_mm_cvtsi128_si32(_mm_packus_epi16(shorts, shorts));
+}
+
+// Luma of four pixels
+inline uint32_t Luma4(const uint8_t* p)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i coefficients = _mm_setr_epi16(Y_R, Y_G, Y_B, 0, Y_R, Y_G, Y_B, 0);
+
+  __m128i pixels = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i low  = _mm_madd_epi16(_mm_unpacklo_epi8(pixels, zero), coefficients);
+  __m128i high = _mm_madd_epi16(_mm_unpackhi_epi8(pixels, zero), coefficients);
+  __m128i luma = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(SumPairs(low, high), 
+    _mm_set1_epi32(128)), 8), _mm_set1_epi32(16));
+  return PackBytes(luma);
+}
+
+// Two chroma samples of a 4x2 block: [u0, u1, v0, v1]
+inline uint32_t Chroma4x2(const uint8_t* row0, const uint8_t* row1)
+{
+  const __m128i zero = _mm_setzero_si128();
+  const __m128i uCoefficients = _mm_setr_epi16(U_R, U_G, U_B, 0, U_R, U_G, U_B, 0);
+  const __m128i vCoefficients = _mm_setr_epi16(V_R, V_G, V_B, 0, V_R, V_G, V_B, 0);
+
+  __m128i rows = _mm_avg_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(row0)),
+    _mm_loadu_si128(reinterpret_cast<const __m128i*>(row1)));
+  // [p01, p01, p23, p23], then [p01, p23] widened to 16 bits
+  __m128i pairs = _mm_avg_epu8(rows, _mm_shuffle_epi32(rows, _MM_SHUFFLE(2, 3, 0, 1)));
+  pairs = _mm_unpacklo_epi8(_mm_shuffle_epi32(pairs, _MM_SHUFFLE(2, 0, 2, 0)), zero);
+
+  __m128i chroma = SumPairs(_mm_madd_epi16(pairs, uCoefficients), 
+    _mm_madd_epi16(pairs, vCoefficients));
+  chroma = _mm_add_epi32(_mm_srai_epi32(_mm_add_epi32(chroma, _mm_set1_epi32(128)), 8), 
+    _mm_set1_epi32(128));
+  return PackBytes(chroma);
+}
+#endif
+
+}
+
+void ConvertRgbaToYuv420(const uint8_t* rgba, ptrdiff_t stride, int width, int height, 
+  uint8_t* y, uint8_t* u, uint8_t* v)
+{
+  PROFILE_FUNCTION();
+  const int chromaWidth  = (width + 1) / 2;
+  const int chromaHeight = (height + 1) / 2;
+
+  for (int row = 0; row < height; row++)
+  {
+    const uint8_t* source = rgba + row * stride;
+    uint8_t* destination  = y + (size_t)row * width;
+    int x = 0;
+#ifdef FLUIDITY_USE_SSE2
+    for (; x + 4 <= width; x += 4)
+    {
+      uint32_t luma = Luma4(source + 4 * x);
+      std::memcpy(destination + x, &luma, 4);
+    }
+#endif
+    for (; x < width; x++) destination[x] = Luma(source + 4 * x);
+  }
+
+  for (int chromaRow = 0; chromaRow < chromaHeight; chromaRow++)
+  {
+    const uint8_t* row0 = rgba + (2 * chromaRow) * stride;
+    const uint8_t* row1 = rgba + std::min(2 * chromaRow + 1, height - 1) * stride;
+    uint8_t* uRow = u + (size_t)chromaRow * chromaWidth;
+    uint8_t* vRow = v + (size_t)chromaRow * chromaWidth;
+    int chromaX = 0;
+#ifdef FLUIDITY_USE_SSE2
+    for (; 2 * chromaX + 4 <= width; chromaX += 2)
+    {
+      uint32_t chroma = Chroma4x2(row0 + 8 * chromaX, row1 + 8 * chromaX);
+      uRow[chromaX]     = (uint8_t)(chroma);
+      uRow[chromaX + 1] = (uint8_t)(chroma >> 8);
+      vRow[chromaX]     = (uint8_t)(chroma >> 16);
+      vRow[chromaX + 1] = (uint8_t)(chroma >> 24);
+    }
+#endif
+    for (; chromaX < chromaWidth; chromaX++)
+    {
+      Chroma(row0, row1, 2 * chromaX, std::min(2 * chromaX + 1, width - 1), 
+        uRow[chromaX], vRow[chromaX]);
+    }
+  }
+}
+
+void ConvertRgbaToRgb(const uint8_t* rgba, ptrdiff_t stride, int width, int height, 
+  uint8_t* rgb)
+{
+  PROFILE_FUNCTION();
+  for (int row = 0; row < height; row++)
+  {
+    const uint8_t* source = rgba + row * stride;
+    uint8_t* destination  = rgb + (size_t)row * width * 3;
+    for (int x = 0; x < width; x++)
+    {
+      destination[3 * x]     = source[4 * x];
+      destination[3 * x + 1] = source[4 * x + 1];
+      destination[3 * x + 2] = source[4 * x + 2];
+    }
+  }
+}
+
+}
@@ -0,0 +1,22 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace fluidity
+{
+
+// Conversions of RGBA8 images, as read back from OpenGL, into the layouts video encoders
+// take. Row y of the source starts at rgba + y * stride, so a negative stride starting at
+// the last row flips an image stored bottom to top. Destinations are tightly packed.
+// Safe to call from any thread.
+
+// BT.601 limited range Y'CbCr, with chroma subsampled 2x2 (4:2:0, centered). u and v hold
+// ((width + 1) / 2) * ((height + 1) / 2) samples each. Vectorized with SSE2 where available.
+void ConvertRgbaToYuv420(const uint8_t* rgba, ptrdiff_t stride, int width, int height, 
+  uint8_t* y, uint8_t* u, uint8_t* v);
+
+// Drops alpha
+void ConvertRgbaToRgb(const uint8_t* rgba, ptrdiff_t stride, int width, int height, 
+  uint8_t* rgb);
+
+}
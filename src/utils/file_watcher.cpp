@@ -0,0 +1,80 @@
+#include "utils/file_watcher.hpp"
+#include "utils/logger.h"
+#include <algorithm>
+
+#ifdef __linux__
+#include <cerrno>
+#include <cstring>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace fluidity
+{
+
+FileWatcher::~FileWatcher()
+{
+#ifdef __linux__
+  if (m_fd >= 0) close(m_fd);
+#endif
+}
+
+bool FileWatcher::Init(const std::string& directory)
+{
+#ifdef __linux__
+  if (m_fd >= 0) close(m_fd);
+
+  m_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (m_fd < 0)
+  {
+    LOG_WARNING("Unable to initialize inotify: " + std::string(strerror(errno)));
+    return false;
+  }
+
+  // Editors either write the file in place, or write another one and rename it over the file
+  if (inotify_add_watch(m_fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    LOG_WARNING("Unable to watch " + directory + ": " + std::string(strerror(errno)));
+    close(m_fd);
+    m_fd = -1;
+    return false;
+  }
+
+  return true;
+#else
+  return false;
+#endif
+}
+
+std::vector<std::string> FileWatcher::PollChangedFiles()
+{
+  std::vector<std::string> changedFiles;
+#ifdef __linux__
+  if (m_fd < 0) return changedFiles;
+
+  alignas(inotify_event) char buffer[4096];
+  for (;;)
+  {
+    ssize_t length = read(m_fd, buffer, sizeof(buffer));
+    if (length <= 0) break;
+
+    for (char* event = buffer; event < buffer + length; )
+    {
+      const inotify_event* e = reinterpret_cast<const inotify_event*>(event);
+      if (e->len > 0)
+      {
+        std::string fileName(e->name);
+        if (std::find(changedFiles.begin(), changedFiles.end(), fileName) == changedFiles.end())
+        {
+          changedFiles.push_back(fileName);
+        }
+      }
+      event += sizeof(inotify_event) + e->len;
+    }
+  }
+#endif
+
+  return changedFiles;
+}
+
+}
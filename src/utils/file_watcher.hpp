@@ -0,0 +1,28 @@
+#pragma once
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+// Reports the files written or moved into a directory (not its subdirectories). Uses inotify,
+// so on other platforms Init fails and nothing is ever reported.
+class FileWatcher
+{
+public:
+  FileWatcher() = default;
+  ~FileWatcher();
+
+  FileWatcher(const FileWatcher&) = delete;
+  FileWatcher& operator=(const FileWatcher&) = delete;
+
+  bool Init(const std::string& directory);
+  // Names (without directories) of the files changed since the last call, each reported once.
+  // Never blocks.
+  std::vector<std::string> PollChangedFiles();
+
+private:
+  int m_fd = -1;
+};
+
+}
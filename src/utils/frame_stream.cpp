@@ -0,0 +1,180 @@
+#include "utils/frame_stream.hpp"
+#include "utils/color_conversion.hpp"
+#include "utils/logger.h"
+#include "utils/profiler.hpp"
+#include "utils/thread_pool.hpp"
+#include <cerrno>
+#include <cstring>
+
+#ifdef _WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <csignal>
+#include <unistd.h>
+#endif
+
+namespace fluidity
+{
+
+bool ParseStreamFormat(const std::string& name, StreamFormat& format)
+{
+  if (name == "y4m") format = StreamFormat::Y4M;
+  else if (name == "rgb24") format = StreamFormat::RGB24;
+  else return false;
+  return true;
+}
+
+FrameStream::~FrameStream()
+{
+  Close();
+}
+
+FILE* DetachStandardOutput()
+{
+  fflush(stdout);
+#ifdef _WIN32
+  int streamDescriptor = _dup(_fileno(stdout));
+  if (streamDescriptor < 0 || _dup2(_fileno(stderr), _fileno(stdout)) < 0) return nullptr;
+  _setmode(streamDescriptor, _O_BINARY);
+  return _fdopen(streamDescriptor, "wb");
+#else
+  int streamDescriptor = dup(STDOUT_FILENO);
+  if (streamDescriptor < 0 || dup2(STDERR_FILENO, STDOUT_FILENO) < 0) return nullptr;
+  return fdopen(streamDescriptor, "wb");
+#endif
+}
+
+bool FrameStream::Open(const std::string& path, StreamFormat format, int width, int height, 
+  int fps)
+{
+  FILE* file = fopen(path.c_str(), "wb");
+  if (file == nullptr)
+  {
+    LOG_ERROR("Unable to open stream " + path + ": " + strerror(errno));
+    return false;
+  }
+
+  return Open(file, format, width, height, fps);
+}
+
+bool FrameStream::Open(FILE* file, StreamFormat format, int width, int height, int fps)
+{
+  if (m_file != nullptr) Close();
+  if (file == nullptr) return false;
+  m_file = file;
+
+#ifndef _WIN32
+  // A reader that goes away should fail the writes, not kill the process
+  signal(SIGPIPE, SIG_IGN);
+#endif
+
+  m_format  = format;
+  m_width   = width;
+  m_height  = height;
+  m_closing = false;
+  m_failed  = false;
+  m_numWritten = 0;
+
+  if (format == StreamFormat::Y4M)
+  {
+    fprintf(m_file, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=LIMITED\n", 
+      width, height, fps);
+  }
+
+  m_writer = std::thread(&FrameStream::RunWriter, this);
+  return true;
+}
+
+bool FrameStream::Close()
+{
+  if (m_file == nullptr) return true;
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_closing = true;
+  }
+  m_changed.notify_all();
+  m_writer.join();
+
+  if (fflush(m_file) != 0) m_failed = true;
+  fclose(m_file);
+  m_file = nullptr;
+  return !m_failed;
+}
+
+void FrameStream::Push(std::vector<uint8_t> rgba)
+{
+  auto frame = ThreadPool::GetGlobal().Submit(
+    [this, rgba = std::move(rgba)]() { return Convert(rgba); });
+
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_frames.push_back(std::move(frame));
+  }
+  m_changed.notify_all();
+}
+
+void FrameStream::Wait(size_t maxQueued)
+{
+  std::unique_lock<std::mutex> lock(m_mutex);
+  m_changed.wait(lock, [&]() { return m_frames.size() <= maxQueued; });
+}
+
+void FrameStream::RunWriter()
+{
+  Profiler::SetThreadName("Frame stream");
+  for (;;)
+  {
+    std::future<std::vector<uint8_t>> frame;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_changed.wait(lock, [this]() { return m_closing || !m_frames.empty(); });
+      if (m_frames.empty()) return;
+      frame = std::move(m_frames.front());
+    }
+
+    // Frames are taken in push order, and each one waits for its own conversion
+    std::vector<uint8_t> data = frame.get();
+    if (!m_failed)
+    {
+      PROFILE_SCOPE("WriteStreamFrame");
+      bool written = m_format != StreamFormat::Y4M || fputs("FRAME\n", m_file) >= 0;
+      written = written && fwrite(data.data(), 1, data.size(), m_file) == data.size();
+      if (written) m_numWritten++;
+      else
+      {
+        m_failed = true;
+        LOG_ERROR(std::string("Unable to write to stream: ") + strerror(errno));
+      }
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_frames.pop_front();
+    }
+    m_changed.notify_all();
+  }
+}
+
+std::vector<uint8_t> FrameStream::Convert(const std::vector<uint8_t>& rgba) const
+{
+  const ptrdiff_t rowSize = (ptrdiff_t)m_width * 4;
+  const uint8_t* topRow   = rgba.data() + rowSize * (m_height - 1);
+
+  if (m_format == StreamFormat::RGB24)
+  {
+    std::vector<uint8_t> rgb((size_t)m_width * m_height * 3);
+    ConvertRgbaToRgb(topRow, -rowSize, m_width, m_height, rgb.data());
+    return rgb;
+  }
+
+  const size_t lumaSize   = (size_t)m_width * m_height;
+  const size_t chromaSize = (size_t)((m_width + 1) / 2) * ((m_height + 1) / 2);
+  std::vector<uint8_t> yuv(lumaSize + 2 * chromaSize);
+  ConvertRgbaToYuv420(topRow, -rowSize, m_width, m_height, yuv.data(), yuv.data() + lumaSize,
+    yuv.data() + lumaSize + chromaSize);
+  return yuv;
+}
+
+}
@@ -0,0 +1,76 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <future>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace fluidity
+{
+
+enum class StreamFormat
+{
+  Y4M,  // YUV4MPEG2, 4:2:0 BT.601 limited range
+  RGB24 // Headerless rgb24 frames
+};
+
+bool ParseStreamFormat(const std::string& name, StreamFormat& format);
+
+// Moves stdout to a new descriptor, returned as a binary stream, and points stdout at stderr.
+// Must be called before anything is printed, so nothing printed later (logs included) can
+// end up in the stream. Returns nullptr on failure.
+FILE* DetachStandardOutput();
+
+// Continuous stream of video frames written to stdout or a file, usually a named pipe an
+// encoder reads from, so no intermediate files are written.
+// Frames are converted on the global thread pool, and written by a dedicated thread in the
+// order they were pushed. Only writing blocks when the reader falls behind.
+class FrameStream
+{
+public:
+  FrameStream() = default;
+  ~FrameStream();
+
+  FrameStream(const FrameStream&) = delete;
+  FrameStream& operator=(const FrameStream&) = delete;
+
+  // Opening a named pipe blocks until a reader opens it
+  bool Open(const std::string& path, StreamFormat format, int width, int height, int fps);
+  // Takes ownership of file, such as the one returned by DetachStandardOutput
+  bool Open(FILE* file, StreamFormat format, int width, int height, int fps);
+  // Waits for every frame to be written. Returns false if any write failed.
+  bool Close();
+
+  // Queues an RGBA8 frame, with rows bottom to top, as read back from OpenGL
+  void Push(std::vector<uint8_t> rgba);
+  // Waits until at most maxQueued frames are converting or waiting to be written
+  void Wait(size_t maxQueued);
+
+  int GetNumberOfWrittenFrames() const { return m_numWritten; }
+  // Set once a write fails, usually because the reader went away. Later frames are dropped.
+  bool HasFailed() const { return m_failed; }
+
+private:
+  void RunWriter();
+  std::vector<uint8_t> Convert(const std::vector<uint8_t>& rgba) const;
+
+  FILE* m_file = nullptr;
+  StreamFormat m_format = StreamFormat::Y4M;
+  int m_width  = 0;
+  int m_height = 0;
+
+  std::thread m_writer;
+  std::deque<std::future<std::vector<uint8_t>>> m_frames;
+  std::mutex m_mutex;
+  std::condition_variable m_changed;
+  bool m_closing = false;
+  std::atomic<bool> m_failed { false };
+  std::atomic<int> m_numWritten { 0 };
+};
+
+}
@@ -1,5 +1,6 @@
 #include "utils/gui_layer.hpp"
 #include "utils/logger.h"
+#include "utils/profiler.hpp"
 #include "renderer/fluid_renderer.hpp"
 #include "tinyfiledialogs.h"
 #include <imgui_impl_sdl.h>
@@ -44,6 +45,7 @@ bool GuiLayer::ProcessEvent(const SDL_Event& e)
 
 void GuiLayer::Render()
 {
+    PROFILE_SCOPE("GuiLayer::Render");
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplSDL2_NewFrame();
     ImGui::NewFrame();
@@ -73,10 +75,12 @@ void GuiLayer::RenderParametersWindow()
             // TODO: The ## light identifier is used to avoid id conflicts on imgui, since it will create a hash
             // using the name of the window and the ## identifier.
             // However, it won't work when multiple lights are at play
-            ImGui::DragFloat3("Position##light", (float*)&light.position, 0.5, -100.f, 100.f);
-            ImGui::ColorEdit3("Diffuse##light", (float*)&light.diffuse);
-            ImGui::ColorEdit3("Ambient##light", (float*)&light.ambient);
-            ImGui::ColorEdit3("Specular##light", (float*)&light.specular);
+            bool lightChanged = false;
+            lightChanged |= ImGui::DragFloat3("Position##light", (float*)&light.position, 0.5, -100.f, 100.f);
+            lightChanged |= ImGui::ColorEdit3("Diffuse##light", (float*)&light.diffuse);
+            lightChanged |= ImGui::ColorEdit3("Ambient##light", (float*)&light.ambient);
+            lightChanged |= ImGui::ColorEdit3("Specular##light", (float*)&light.specular);
+            if (lightChanged) m_fluidRenderer->m_scene.MarkLightsChanged();
             ImGui::Separator();
             ImGui::Spacing();
             ImGui::Spacing();
@@ -116,16 +120,80 @@ void GuiLayer::RenderParametersWindow()
             
             ImGui::Separator();
             ImGui::Checkbox("Transparent", &fluidParameters.transparentFluid);
+            ImGui::Checkbox("Occlusion Culling", &fluidParameters.occlusionCulling);
             ImGui::SliderInt("Iterations", &filteringParameters.nIterations, 0, 20);
             ImGui::SliderInt("Filter Size", &filteringParameters.filterSize, 1, 30);
             ImGui::SliderInt("Max Filter Size", &filteringParameters.maxFilterSize, 1, 200);
             ImGui::Checkbox("1D Filter", &filteringParameters.filter1D);
+            if (ImGui::BeginCombo("Filter Backend", GetFilterBackendName(filteringParameters.backend)))
+            {
+                for (int i = 0; i < (int)FilterBackend::Count; i++)
+                {
+                    FilterBackend backend = (FilterBackend)i;
+                    if (ImGui::Selectable(GetFilterBackendName(backend), filteringParameters.backend == backend))
+                    {
+                        filteringParameters.backend = backend;
+                    }
+                }
+                ImGui::EndCombo();
+            }
+            if (ImGui::Button("Benchmark Filters"))
+            {
+                m_filterBenchmarkReport = m_fluidRenderer->BenchmarkFilters();
+            }
+            if (!m_filterBenchmarkReport.empty()) ImGui::TextUnformatted(m_filterBenchmarkReport.c_str());
 
             ImGui::Separator();
             ImGui::Checkbox("Gamma Correction", &filteringParameters.gammaCorrection);
             ImGui::Checkbox("Use Refactinon Mask", &filteringParameters.useRefractionMask);
         }
 
+        if (ImGui::CollapsingHeader("Resolution"))
+        {
+            auto& resolutionParameters = m_fluidRenderer->m_scene.resolutionParameters;
+            ImGui::SliderFloat("Fluid Scale", &resolutionParameters.fluidScale, 0.25f, 1.f, "%.2f");
+            ImGui::SliderFloat("Mesh Scale", &resolutionParameters.meshScale, 0.25f, 1.f, "%.2f");
+
+            ImGui::Separator();
+            ImGui::Checkbox("Dynamic Resolution", &resolutionParameters.dynamicResolution);
+            ImGui::DragFloat("Target Frame Time (ms)", &resolutionParameters.targetFrameTime, 0.1f, 1.f, 100.f);
+            ImGui::SliderFloat("Min Dynamic Scale", &resolutionParameters.minDynamicScale, 0.25f, 1.f, "%.2f");
+
+            ImGui::Separator();
+            auto& meshLodParameters = m_fluidRenderer->m_scene.meshLodParameters;
+            ImGui::Checkbox("Mesh LODs", &meshLodParameters.enabled);
+            ImGui::DragFloat("Max LOD Error (px)", &meshLodParameters.maxPixelError, 0.05f, 0.f, 50.f);
+            ImGui::SliderInt("Shadow Min LOD", &meshLodParameters.shadowMinLod, 0, Mesh::MAX_LODS - 1);
+        }
+
+        if (ImGui::CollapsingHeader("Render Targets"))
+        {
+            auto& formats = m_fluidRenderer->m_scene.renderTargetFormats;
+            for (int i = 0; i < (int)RenderTarget::Count; i++)
+            {
+                RenderTarget target = (RenderTarget)i;
+                if (ImGui::BeginCombo(GetRenderTargetName(target), GetRenderTargetFormatName(formats[target])))
+                {
+                    for (int j = 0; j < (int)RenderTargetFormat::Count; j++)
+                    {
+                        RenderTargetFormat format = (RenderTargetFormat)j;
+                        if (!IsFormatCompatible(target, format)) continue;
+                        if (ImGui::Selectable(GetRenderTargetFormatName(format), formats[target] == format))
+                        {
+                            formats[target] = format;
+                        }
+                    }
+                    ImGui::EndCombo();
+                }
+            }
+
+            if (ImGui::Button("Validate Against FP32"))
+            {
+                m_formatValidationReport = m_fluidRenderer->ValidateRenderTargetFormats();
+            }
+            if (!m_formatValidationReport.empty()) ImGui::TextUnformatted(m_formatValidationReport.c_str());
+        }
+
         if (ImGui::CollapsingHeader("Environment"))
         {
             auto& scene = m_fluidRenderer->m_scene;
@@ -253,8 +321,26 @@ void GuiLayer::RenderPerformanceOverlay()
         ImGui::Separator();
         ImGui::Text("%.1f FPS", io.Framerate);
         ImGui::Text("%.3f ms/frame", 1000.f / io.Framerate);
+        if (m_fluidRenderer->m_gpuTimer.HasResult())
+        {
+            ImGui::Text("%.3f ms GPU", m_fluidRenderer->m_gpuTimer.GetLastResult());
+        }
+        if (m_fluidRenderer->m_scene.resolutionParameters.dynamicResolution)
+        {
+            ImGui::Text("%.2fx render scale", m_fluidRenderer->m_dynamicResolution.GetScale());
+        }
         ImGui::Text("%d particles", m_fluidRenderer->m_scene.fluid.
             GetNumberOfParticles(m_fluidRenderer->GetCurrentFrame()));
+        const auto& meshBatch = m_fluidRenderer->m_meshesPass->GetMeshBatch();
+        ImGui::Text("%u/%u mesh clusters drawn (%u triangles)", meshBatch.GetNumberOfDraws(), 
+            meshBatch.GetNumberOfClusters(), meshBatch.GetNumberOfTriangles());
+        if (m_fluidRenderer->IsOcclusionCullingActive())
+        {
+            const auto& hiZCullingPass = *m_fluidRenderer->m_hiZCullingPass;
+            ImGui::Text("%u/%d particle chunks drawn (%u particles)",
+                hiZCullingPass.GetVisibleChunks(), hiZCullingPass.GetNumberOfChunks(),
+                hiZCullingPass.GetVisibleParticles());
+        }
 
         if (ImGui::BeginPopupContextWindow())
         {
@@ -390,6 +476,11 @@ void GuiLayer::RenderMainMenuBar()
         {
             ImGui::MenuItem("Performance Overlay", nullptr, &m_showPerformanceOverlay);
             ImGui::MenuItem("Parameters Window", nullptr, &m_showParametersWindow);
+            ImGui::Separator();
+            if (ImGui::MenuItem("Capture Profiler Trace", "F12", false, !Profiler::IsCapturing()))
+            {
+                Profiler::RequestCapture(Profiler::GenerateCaptureFileName());
+            }
             ImGui::EndMenu();
         }
         ImGui::EndMainMenuBar();
@@ -40,6 +40,8 @@ private:
     void* m_glContext;
     FluidRenderer* m_fluidRenderer;
     SceneSerializer m_sceneSerializer;
+    std::string m_formatValidationReport;
+    std::string m_filterBenchmarkReport;
 };
 
 }
\ No newline at end of file
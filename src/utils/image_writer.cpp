@@ -0,0 +1,164 @@
+#include "utils/image_writer.hpp"
+#include "utils/logger.h"
+#include "utils/mapped_file.hpp"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+#include <cnpy.h>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <numeric>
+
+namespace fluidity
+{
+
+namespace
+{
+
+// EXR headers and scanline blocks are little endian, as is every platform we build for
+template<typename T>
+void Append(std::vector<uint8_t>& buffer, const T& value)
+{
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+void AppendString(std::vector<uint8_t>& buffer, const std::string& value)
+{
+  buffer.insert(buffer.end(), value.begin(), value.end());
+  buffer.push_back(0);
+}
+
+void AppendAttribute(std::vector<uint8_t>& buffer, const std::string& name, 
+  const std::string& type, const std::vector<uint8_t>& value)
+{
+  AppendString(buffer, name);
+  AppendString(buffer, type);
+  Append(buffer, (int32_t)value.size());
+  buffer.insert(buffer.end(), value.begin(), value.end());
+}
+
+}
+
+bool WritePng(const std::string& path, int width, int height, int channels, 
+  const uint8_t* pixels)
+{
+  // Starting from the last row with a negative stride writes the rows top to bottom
+  int rowSize = width * channels;
+  int size    = 0;
+  unsigned char* png = stbi_write_png_to_mem(pixels + (size_t)rowSize * (height - 1), -rowSize,
+    width, height, channels, &size);
+  if (png == nullptr)
+  {
+    LOG_ERROR("Unable to encode " + path);
+    return false;
+  }
+
+  bool written = WriteFileAtomically(path, png, size);
+  free(png);
+  return written;
+}
+
+bool WriteExr(const std::string& path, int width, int height, 
+  const std::vector<std::string>& channelNames, const float* pixels)
+{
+  constexpr int32_t FLOAT_PIXEL_TYPE = 2;
+  const int numChannels = (int)channelNames.size();
+
+  // Channels must be stored sorted by name
+  std::vector<int> channelOrder(numChannels);
+  std::iota(channelOrder.begin(), channelOrder.end(), 0);
+  std::sort(channelOrder.begin(), channelOrder.end(), [&](int a, int b) { 
+    return channelNames[a] < channelNames[b]; 
+  });
+
+  std::vector<uint8_t> header;
+  Append(header, (int32_t)20000630); // Magic number
+  Append(header, (int32_t)2);        // Version 2, single part scanline file
+
+  std::vector<uint8_t> channelList;
+  for (int channel : channelOrder)
+  {
+    AppendString(channelList, channelNames[channel]);
+    Append(channelList, FLOAT_PIXEL_TYPE);
+    Append(channelList, (int32_t)0); // pLinear and reserved
+    Append(channelList, (int32_t)1); // x sampling
+    Append(channelList, (int32_t)1); // y sampling
+  }
+  channelList.push_back(0);
+
+  std::vector<uint8_t> window;
+  for (int32_t value : { 0, 0, width - 1, height - 1 }) Append(window, value);
+  std::vector<uint8_t> one;
+  Append(one, 1.f);
+  std::vector<uint8_t> center;
+  Append(center, 0.f);
+  Append(center, 0.f);
+
+  AppendAttribute(header, "channels", "chlist", channelList);
+  AppendAttribute(header, "compression", "compression", { 0 }); // None
+  AppendAttribute(header, "dataWindow", "box2i", window);
+  AppendAttribute(header, "displayWindow", "box2i", window);
+  AppendAttribute(header, "lineOrder", "lineOrder", { 0 }); // Increasing y
+  AppendAttribute(header, "pixelAspectRatio", "float", one);
+  AppendAttribute(header, "screenWindowCenter", "v2f", center);
+  AppendAttribute(header, "screenWindowWidth", "float", one);
+  header.push_back(0);
+
+  // Uncompressed, every block is a single scanline, with the channels one after another
+  const size_t lineDataSize  = (size_t)width * numChannels * sizeof(float);
+  const size_t lineBlockSize = 2 * sizeof(int32_t) + lineDataSize;
+  const size_t dataOffset    = header.size() + height * sizeof(uint64_t);
+
+  std::vector<uint8_t> file;
+  file.reserve(dataOffset + height * lineBlockSize);
+  file.insert(file.end(), header.begin(), header.end());
+  for (int y = 0; y < height; y++) Append(file, (uint64_t)(dataOffset + y * lineBlockSize));
+
+  for (int y = 0; y < height; y++)
+  {
+    Append(file, (int32_t)y);
+    Append(file, (int32_t)lineDataSize);
+
+    const float* row = pixels + (size_t)(height - 1 - y) * width * numChannels;
+    for (int channel : channelOrder)
+    {
+      for (int x = 0; x < width; x++) Append(file, row[x * numChannels + channel]);
+    }
+  }
+
+  return WriteFileAtomically(path, file.data(), file.size());
+}
+
+bool WriteNpy(const std::string& path, int width, int height, int channels, 
+  const float* pixels)
+{
+  std::vector<char> header = cnpy::create_npy_header<float>(
+    { (size_t)height, (size_t)width, (size_t)channels });
+
+  const size_t rowSize = (size_t)width * channels * sizeof(float);
+  std::vector<uint8_t> flipped(rowSize * height);
+  FlipRows(pixels, flipped.data(), height, rowSize);
+  return WriteFileAtomically(path, { { header.data(), header.size() }, 
+    { flipped.data(), flipped.size() } });
+}
+
+bool WriteRaw(const std::string& path, int width, int height, size_t pixelSize, 
+  const void* pixels)
+{
+  std::vector<uint8_t> flipped((size_t)width * height * pixelSize);
+  FlipRows(pixels, flipped.data(), height, width * pixelSize);
+  return WriteFileAtomically(path, flipped.data(), flipped.size());
+}
+
+void FlipRows(const void* source, void* destination, int height, size_t rowSize)
+{
+  const uint8_t* sourceRows = static_cast<const uint8_t*>(source);
+  uint8_t* destinationRows  = static_cast<uint8_t*>(destination);
+  for (int y = 0; y < height; y++)
+  {
+    std::memcpy(destinationRows + y * rowSize, sourceRows + (height - 1 - y) * rowSize, rowSize);
+  }
+}
+
+}
@@ -0,0 +1,30 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+// Image files written from pixels read back from OpenGL, so rows are given bottom to top, and
+// written top to bottom. Channels are interleaved. Files are written atomically (see
+// WriteFileAtomically), so an interrupted render never leaves a partial image behind.
+// Safe to call from any thread.
+
+bool WritePng(const std::string& path, int width, int height, int channels, 
+  const uint8_t* pixels);
+// Uncompressed scanline OpenEXR with 32-bit float channels, one name per channel (e.g. "R",
+// "G", "B", or "Z" for depth)
+bool WriteExr(const std::string& path, int width, int height, 
+  const std::vector<std::string>& channelNames, const float* pixels);
+// NumPy array of 32-bit floats, shaped (height, width, channels)
+bool WriteNpy(const std::string& path, int width, int height, int channels, 
+  const float* pixels);
+// The pixels as they are in memory, rows top to bottom, with no header
+bool WriteRaw(const std::string& path, int width, int height, size_t pixelSize, 
+  const void* pixels);
+
+// Copies the rows of a bottom to top image top to bottom, or the other way around
+void FlipRows(const void* source, void* destination, int height, size_t rowSize);
+
+}
@@ -0,0 +1,115 @@
+#include "utils/mapped_file.hpp"
+#include "utils/logger.h"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <thread>
+
+#ifdef _WIN32
+#include <iterator>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fluidity
+{
+
+MappedFile::~MappedFile()
+{
+#ifndef _WIN32
+  if (m_data != nullptr) munmap(m_data, m_size);
+#endif
+}
+
+bool MappedFile::Open(const std::string& filePath)
+{
+#ifdef _WIN32
+  std::ifstream file(filePath, std::ios::binary);
+  if (!file) return false;
+  m_buffer.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+  return !m_buffer.empty();
+#else
+  if (m_data != nullptr) munmap(m_data, m_size);
+  m_data = nullptr;
+  m_size = 0;
+
+  int fd = open(filePath.c_str(), O_RDONLY);
+  if (fd < 0) return false;
+
+  struct stat fileStatus;
+  if (fstat(fd, &fileStatus) != 0 || fileStatus.st_size == 0)
+  {
+    close(fd);
+    return false;
+  }
+
+  void* data = mmap(nullptr, fileStatus.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (data == MAP_FAILED) return false;
+
+  m_data = data;
+  m_size = fileStatus.st_size;
+  return true;
+#endif
+}
+
+const char* MappedFile::GetData() const
+{
+#ifdef _WIN32
+  return m_buffer.data();
+#else
+  return static_cast<const char*>(m_data);
+#endif
+}
+
+size_t MappedFile::GetSize() const
+{
+#ifdef _WIN32
+  return m_buffer.size();
+#else
+  return m_size;
+#endif
+}
+
+bool WriteFileAtomically(const std::string& filePath, const void* data, size_t size)
+{
+  return WriteFileAtomically(filePath, std::vector<FileChunk> { { data, size } });
+}
+
+bool WriteFileAtomically(const std::string& filePath, const std::vector<FileChunk>& chunks)
+{
+  std::error_code error;
+  std::filesystem::path parentPath = std::filesystem::path(filePath).parent_path();
+  if (!parentPath.empty()) std::filesystem::create_directories(parentPath, error);
+
+  std::stringstream temporaryPath;
+  temporaryPath << filePath << "." << std::hash<std::thread::id>()(std::this_thread::get_id()) <<
+    "." << std::chrono::steady_clock::now().time_since_epoch().count() << ".tmp";
+  std::ofstream file(temporaryPath.str(), std::ios::binary);
+  for (const auto& chunk : chunks) file.write(static_cast<const char*>(chunk.data), chunk.size);
+  // Most write errors (ENOSPC, for one) only show up when the buffer is flushed on close
+  file.close();
+  if (!file)
+  {
+    LOG_WARNING("Unable to write file: " + temporaryPath.str());
+    std::filesystem::remove(temporaryPath.str(), error);
+    return false;
+  }
+
+  std::filesystem::rename(temporaryPath.str(), filePath, error);
+  if (error)
+  {
+    LOG_WARNING("Unable to write file: " + filePath + " " + error.message());
+    std::filesystem::remove(temporaryPath.str(), error);
+    return false;
+  }
+
+  return true;
+}
+
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace fluidity
+{
+
+// Read only view of a whole file. Mapped where available, so only the pages actually read
+// are loaded from disk.
+class MappedFile
+{
+public:
+  MappedFile() = default;
+  ~MappedFile();
+
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Fails for empty files
+  bool Open(const std::string& filePath);
+
+  const char* GetData() const;
+  size_t GetSize() const;
+
+private:
+#ifdef _WIN32
+  std::vector<char> m_buffer;
+#else
+  void* m_data  = nullptr;
+  size_t m_size = 0;
+#endif
+};
+
+// Writes the file through a temporary one renamed over it, so readers (even in other
+// processes) never see a partial file. Creates the missing directories.
+bool WriteFileAtomically(const std::string& filePath, const void* data, size_t size);
+
+struct FileChunk
+{
+  const void* data;
+  size_t size;
+};
+
+// Same as above, writing the chunks one after another
+bool WriteFileAtomically(const std::string& filePath, const std::vector<FileChunk>& chunks);
+
+}
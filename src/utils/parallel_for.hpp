@@ -0,0 +1,58 @@
+#pragma once
+#include "utils/thread_pool.hpp"
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+
+namespace fluidity
+{
+
+// Calls function(i) for every i in [0, count), spread over the global thread pool and the
+// calling thread. Items are handed out one at a time, so uneven items balance out.
+// The calling thread works through the items too, so it's safe to call from a pool task,
+// even when every worker is busy.
+// The function must not make OpenGL calls, since only the main thread has a context.
+template<typename Function>
+void ParallelFor(unsigned count, const Function& function)
+{
+  ThreadPool& pool = ThreadPool::GetGlobal();
+  unsigned numHelpers = std::min(count, pool.GetNumberOfThreads() + 1) - 1;
+  if (count <= 1 || numHelpers == 0)
+  {
+    for (unsigned i = 0; i < count; i++) function(i);
+    return;
+  }
+
+  // Helpers may only start after all the items are done, so they share the state, and only
+  // touch the function while there are items left
+  struct State
+  {
+    std::atomic<unsigned> next   { 0 };
+    std::atomic<unsigned> active { 0 };
+    std::mutex mutex;
+    std::condition_variable done;
+  };
+  auto state = std::make_shared<State>();
+
+  auto work = [state, count, &function]() {
+    for (unsigned i = state->next++; i < count; i = state->next++) function(i);
+  };
+
+  for (unsigned i = 0; i < numHelpers; i++)
+  {
+    pool.Submit([state, work]() {
+      state->active++;
+      work();
+      std::lock_guard<std::mutex> lock(state->mutex);
+      if (--state->active == 0) state->done.notify_all();
+    });
+  }
+  work();
+
+  std::unique_lock<std::mutex> lock(state->mutex);
+  state->done.wait(lock, [&]() { return state->active == 0; });
+}
+
+}
@@ -0,0 +1,269 @@
+#include "utils/profiler.hpp"
+#include "utils/logger.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <memory>
+#include <sstream>
+#include <mutex>
+#include <vector>
+
+namespace fluidity
+{
+
+namespace
+{
+  // 64K events per thread (1.5MB), roughly half a minute of history on the main thread
+  constexpr uint64_t RING_BUFFER_SIZE = 1 << 16;
+  constexpr uint64_t RING_BUFFER_MASK = RING_BUFFER_SIZE - 1;
+
+  // Relaxed atomics compile to plain stores, but let a capture read slots the owner thread may
+  // be writing at the same time
+  struct EventSlot
+  {
+    std::atomic<const char*> name { nullptr };
+    std::atomic<uint64_t> start { 0 };
+    std::atomic<uint64_t> end { 0 };
+  };
+
+  struct ThreadBuffer
+  {
+    EventSlot events[RING_BUFFER_SIZE];
+    // Only written by the owner thread, with a release store once the event is complete
+    std::atomic<uint64_t> head { 0 };
+    int threadId = 0;
+    std::string threadName;
+  };
+
+  // Thread buffers are never freed, so a capture can still read the events of
+  // threads that have already exited
+  struct ProfilerState
+  {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+
+    std::string captureFilePath;
+    int framesUntilCapture = -1;
+
+    // Used to convert timestamps to microseconds when writing the trace
+    uint64_t referenceTicks = Profiler::Now();
+    std::chrono::steady_clock::time_point referenceTime = std::chrono::steady_clock::now();
+  };
+
+  ProfilerState& GetState()
+  {
+    static ProfilerState state;
+    return state;
+  }
+
+  ThreadBuffer* RegisterThread()
+  {
+    auto& state = GetState();
+    std::lock_guard<std::mutex> lock(state.mutex);
+
+    state.buffers.push_back(std::make_unique<ThreadBuffer>());
+    ThreadBuffer* buffer = state.buffers.back().get();
+    buffer->threadId = (int)state.buffers.size();
+    buffer->threadName = "Thread " + std::to_string(buffer->threadId);
+    return buffer;
+  }
+
+  ThreadBuffer* GetThreadBuffer()
+  {
+    static thread_local ThreadBuffer* buffer = RegisterThread();
+    return buffer;
+  }
+
+  void WriteEscaped(std::ostream& out, const char* str)
+  {
+    for (; *str != '\0'; str++)
+    {
+      if (*str == '"' || *str == '\\') out << '\\';
+      out << *str;
+    }
+  }
+}
+
+void Profiler::Record(const char* name, uint64_t start, uint64_t end)
+{
+  ThreadBuffer* buffer = GetThreadBuffer();
+  uint64_t head = buffer->head.load(std::memory_order_relaxed);
+  EventSlot& slot = buffer->events[head & RING_BUFFER_MASK];
+  slot.name.store(name, std::memory_order_relaxed);
+  slot.start.store(start, std::memory_order_relaxed);
+  slot.end.store(end, std::memory_order_relaxed);
+  buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void Profiler::SetThreadName(const std::string& name)
+{
+  ThreadBuffer* buffer = GetThreadBuffer();
+  std::lock_guard<std::mutex> lock(GetState().mutex);
+  buffer->threadName = name;
+}
+
+void Profiler::RequestCapture(const std::string& filePath, int numFrames)
+{
+  auto& state = GetState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+
+  if (state.framesUntilCapture >= 0)
+  {
+    LOG_WARNING("A profiler capture is already in progress.");
+    return;
+  }
+
+  state.captureFilePath = filePath;
+  state.framesUntilCapture = numFrames > 0 ? numFrames : 0;
+}
+
+bool Profiler::IsCapturing()
+{
+  auto& state = GetState();
+  std::lock_guard<std::mutex> lock(state.mutex);
+  return state.framesUntilCapture >= 0;
+}
+
+void Profiler::EndFrame()
+{
+  auto& state = GetState();
+  std::string filePath;
+  {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if (state.framesUntilCapture < 0) return;
+    if (state.framesUntilCapture-- > 0) return;
+    filePath = state.captureFilePath;
+  }
+
+  if (WriteTrace(filePath)) DBG("Profiler trace written to " + filePath);
+}
+
+bool Profiler::WriteTrace(const std::string& filePath)
+{
+  PROFILE_SCOPE("Profiler::WriteTrace");
+  auto& state = GetState();
+
+  std::ofstream out(filePath);
+  if (!out)
+  {
+    LOG_ERROR("Unable to open trace file: " + filePath);
+    return false;
+  }
+
+  // Tick rate is measured over the whole lifetime of the profiler, which is
+  // accurate enough for an invariant TSC
+  uint64_t nowTicks = Profiler::Now();
+  auto nowTime = std::chrono::steady_clock::now();
+  double elapsedUs = std::chrono::duration<double, std::micro>(nowTime - state.referenceTime).count();
+  double usPerTick = nowTicks > state.referenceTicks ?
+    elapsedUs / (double)(nowTicks - state.referenceTicks) : 0.0;
+
+  // The other threads keep recording while their buffers are copied, like a seqlock: events
+  // up to the head acquired before the copy are complete, and the ones the owner may have
+  // overwritten during the copy are dropped, going by the head after it
+  struct ThreadSnapshot
+  {
+    int threadId;
+    std::string threadName;
+    std::vector<ProfileEvent> events;
+  };
+  std::vector<ThreadSnapshot> snapshots;
+  {
+    std::lock_guard<std::mutex> stateLock(state.mutex);
+    snapshots.reserve(state.buffers.size());
+    for (auto& buffer : state.buffers)
+    {
+      snapshots.push_back({ buffer->threadId, buffer->threadName, {} });
+      std::vector<ProfileEvent>& events = snapshots.back().events;
+
+      uint64_t head  = buffer->head.load(std::memory_order_acquire);
+      uint64_t count = head < RING_BUFFER_SIZE ? head : RING_BUFFER_SIZE;
+      events.reserve(count);
+      for (uint64_t i = head - count; i < head; i++)
+      {
+        const EventSlot& slot = buffer->events[i & RING_BUFFER_MASK];
+        events.push_back({ slot.name.load(std::memory_order_relaxed),
+          slot.start.load(std::memory_order_relaxed), slot.end.load(std::memory_order_relaxed) });
+      }
+
+      // Writing event i overwrites event i - RING_BUFFER_SIZE, and the owner may be writing
+      // event headAfter already
+      std::atomic_thread_fence(std::memory_order_acquire);
+      uint64_t headAfter = buffer->head.load(std::memory_order_relaxed);
+      uint64_t firstIntact = headAfter >= RING_BUFFER_SIZE ? headAfter - RING_BUFFER_SIZE + 1 : 0;
+      if (firstIntact > head - count)
+      {
+        size_t numOverwritten = std::min<uint64_t>(firstIntact - (head - count), count);
+        events.erase(events.begin(), events.begin() + numOverwritten);
+      }
+    }
+  }
+
+  out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+  bool first = true;
+
+  for (const ThreadSnapshot& snapshot : snapshots)
+  {
+    if (!first) out << ",";
+    first = false;
+    out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << snapshot.threadId
+      << ",\"args\":{\"name\":\"";
+    WriteEscaped(out, snapshot.threadName.c_str());
+    out << "\"}}";
+
+    for (const ProfileEvent& e : snapshot.events)
+    {
+      if (e.name == nullptr || e.end < e.start) continue;
+
+      out << ",{\"name\":\"";
+      WriteEscaped(out, e.name);
+      out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << snapshot.threadId
+        << ",\"ts\":" << (double)(int64_t)(e.start - state.referenceTicks) * usPerTick
+        << ",\"dur\":" << (double)(e.end - e.start) * usPerTick << "}";
+    }
+  }
+  out << "]}\n";
+
+  return true;
+}
+
+std::string Profiler::Benchmark(int numZones)
+{
+  // Same path as instrumented code: ProfileScope, the thread local lookup and the ring buffer
+  auto& state = GetState();
+  uint64_t start = Profiler::Now();
+  for (int i = 0; i < numZones; i++)
+  {
+    ProfileScope scope("Profiler::Benchmark");
+  }
+  uint64_t end = Profiler::Now();
+
+  // Same tick rate estimate as WriteTrace
+  double elapsedNs = std::chrono::duration<double, std::nano>(
+    std::chrono::steady_clock::now() - state.referenceTime).count();
+  double nsPerTick = end > state.referenceTicks ?
+    elapsedNs / (double)(end - state.referenceTicks) : 0.0;
+
+  std::stringstream report;
+  report << "Profiler: " << numZones << " zones, " <<
+    (double)(end - start) * nsPerTick / (numZones > 0 ? numZones : 1) << " ns per zone\n";
+  return report.str();
+}
+
+std::string Profiler::GenerateCaptureFileName()
+{
+  std::time_t now = std::time(nullptr);
+  std::tm localTime {};
+#ifdef _WIN32
+  localtime_s(&localTime, &now);
+#else
+  localtime_r(&now, &localTime);
+#endif
+  char timestamp[32];
+  std::strftime(timestamp, sizeof(timestamp), "%Y%m%d-%H%M%S", &localTime);
+  return std::string("fluidity-trace-") + timestamp + ".json";
+}
+
+}
@@ -0,0 +1,88 @@
+#pragma once
+#include <cstdint>
+#include <string>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define FLUIDITY_PROFILER_USE_RDTSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define FLUIDITY_PROFILER_USE_RDTSC
+#else
+#include <chrono>
+#endif
+
+namespace fluidity
+{
+
+struct ProfileEvent
+{
+  // Must point to a string with static storage duration (usually a literal)
+  const char* name;
+  uint64_t start;
+  uint64_t end;
+};
+
+// Always-on CPU instrumentation. Each thread records zones into its own ring buffer,
+// so recording a zone is two timestamp reads and a few plain stores, without locks.
+// A capture writes everything still retained in the ring buffers as a Chrome trace
+// (chrome://tracing or https://ui.perfetto.dev).
+class Profiler
+{
+public:
+  static inline uint64_t Now()
+  {
+#ifdef FLUIDITY_PROFILER_USE_RDTSC
+    return __rdtsc();
+#else
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+  }
+
+  static void Record(const char* name, uint64_t start, uint64_t end);
+  // Name shown for the calling thread in the trace viewer
+  static void SetThreadName(const std::string& name);
+
+  // Keeps recording for numFrames more frames, then writes the trace to filePath
+  static void RequestCapture(const std::string& filePath, int numFrames = 120);
+  static bool IsCapturing();
+  // Must be called once per frame by the main loop
+  static void EndFrame();
+
+  static bool WriteTrace(const std::string& filePath);
+  static std::string GenerateCaptureFileName();
+  // Records numZones empty zones on the calling thread and reports the average cost of one
+  static std::string Benchmark(int numZones = 20000000);
+};
+
+class ProfileScope
+{
+public:
+  explicit ProfileScope(const char* name)
+    : m_name(name),
+    m_start(Profiler::Now())
+  { /* */ }
+
+  ~ProfileScope() { Profiler::Record(m_name, m_start, Profiler::Now()); }
+
+  ProfileScope(const ProfileScope&) = delete;
+  ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+  const char* m_name;
+  uint64_t m_start;
+};
+
+}
+
+#define PROFILE_CONCAT_IMPL(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_IMPL(a, b)
+
+#ifndef FLUIDITY_DISABLE_PROFILER
+#define PROFILE_SCOPE(name) fluidity::ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_FUNCTION() PROFILE_SCOPE(__func__)
+#else
+#define PROFILE_SCOPE(name)
+#define PROFILE_FUNCTION()
+#endif
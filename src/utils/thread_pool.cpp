@@ -0,0 +1,76 @@
+#include "utils/thread_pool.hpp"
+#include "utils/profiler.hpp"
+#include <algorithm>
+#include <string>
+
+#ifdef __linux__
+#include <sched.h>
+#endif
+
+namespace fluidity
+{
+
+ThreadPool::ThreadPool(unsigned numThreads)
+{
+  for (unsigned i = 0; i < numThreads; i++)
+  {
+    m_threads.emplace_back([this, i]() {
+      Profiler::SetThreadName("Worker " + std::to_string(i));
+      Run();
+    });
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_stopping = true;
+  }
+  m_taskAvailable.notify_all();
+
+  for (auto& thread : m_threads) thread.join();
+}
+
+namespace
+{
+
+// Processes pinned to a subset of the cores (such as sharded render workers) shouldn't start
+// a thread for every core of the machine
+unsigned GetNumberOfUsableCores()
+{
+#ifdef __linux__
+  cpu_set_t cores;
+  if (sched_getaffinity(0, sizeof(cores), &cores) == 0) return std::max(1, CPU_COUNT(&cores));
+#endif
+  return std::max(1u, std::thread::hardware_concurrency());
+}
+
+}
+
+ThreadPool& ThreadPool::GetGlobal()
+{
+  static ThreadPool pool(GetNumberOfUsableCores() - 1);
+  return pool;
+}
+
+void ThreadPool::Run()
+{
+  for (;;)
+  {
+    std::function<void()> task;
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_taskAvailable.wait(lock, [this]() { return m_stopping || !m_tasks.empty(); });
+      // Tasks still queued are finished before stopping, so no future is left waiting
+      if (m_tasks.empty()) return;
+
+      task = std::move(m_tasks.front());
+      m_tasks.pop_front();
+    }
+
+    task();
+  }
+}
+
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace fluidity
+{
+
+// Fixed set of worker threads running tasks in submission order.
+// Tasks must not make OpenGL calls, since only the main thread has a context.
+class ThreadPool
+{
+public:
+  explicit ThreadPool(unsigned numThreads);
+  ~ThreadPool();
+
+  ThreadPool(const ThreadPool&) = delete;
+  ThreadPool& operator=(const ThreadPool&) = delete;
+
+  // The future rethrows whatever the task throws
+  template<typename Function>
+  auto Submit(Function&& function) -> std::future<std::invoke_result_t<Function>>
+  {
+    using Result = std::invoke_result_t<Function>;
+    auto task = std::make_shared<std::packaged_task<Result()>>(std::forward<Function>(function));
+    std::future<Result> result = task->get_future();
+    if (m_threads.empty())
+    {
+      (*task)();
+      return result;
+    }
+
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_tasks.emplace_back([task]() { (*task)(); });
+    }
+    m_taskAvailable.notify_one();
+    return result;
+  }
+
+  unsigned GetNumberOfThreads() const { return (unsigned)m_threads.size(); }
+
+  // Shared pool, with a worker per core the process may run on, besides the main thread
+  static ThreadPool& GetGlobal();
+
+private:
+  void Run();
+
+  std::vector<std::thread> m_threads;
+  std::deque<std::function<void()>> m_tasks;
+  std::mutex m_mutex;
+  std::condition_variable m_taskAvailable;
+  bool m_stopping = false;
+};
+
+}
@@ -11,6 +11,9 @@ struct vec3 {
     float z;
 };
 
+inline bool operator==(const vec3& a, const vec3& b) { return a.x == b.x && a.y == b.y && a.z == b.z; }
+inline bool operator!=(const vec3& a, const vec3& b) { return !(a == b); }
+
 struct dVec3 {
     double x;
     double y;